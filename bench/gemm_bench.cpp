@@ -0,0 +1,355 @@
+// benchmark and tuning harness of the CPU GEMM paths behind dot() and BatchGEMM
+//
+// usage: gemm_bench [sweep] [small] [batch] [conv] [tune=FILE] [dtype=float32]
+//                   [m=LIST] [n=LIST] [k=LIST] [batch=LIST]
+//   sweep      DotEngine over m x n x k, all transposes and (alpha, beta) in
+//              {(1, 0), (2, 1)}: GFLOP/s and the path dot() chose (default)
+//   small      SmallDotEngine against BLAS, the crossover for
+//              MSHADOW_SMALL_GEMM_MAX_MNK
+//   batch      BatchGEMM over the batch counts, with m = n = k
+//   conv       dot(weight, unpack_patch2col(...)) without the column matrix
+//              and by Winograd, against unpacking into a column matrix first
+//   tune=FILE  time every backend and packed blocking for each shape, the
+//              four transposes included, and write the fastest to FILE; run with
+//              MSHADOW_GEMM_TUNING_FILE=FILE to make dot() use it
+//   dtype      float32, float64, float16 or bfloat16
+//   LIST       comma separated sizes, e.g. m=1,64,256
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "mshadow/tensor.h"
+
+using namespace mshadow;
+using namespace mshadow::expr;
+
+// seconds per call of f, measured over at least 50ms
+template<typename F>
+double TimeIt(F f) {
+  typedef std::chrono::high_resolution_clock Clock;
+  f();
+  long nrep = 1;
+  while (true) {
+    Clock::time_point start = Clock::now();
+    for (long i = 0; i < nrep; ++i) f();
+    double sec = std::chrono::duration<double>(Clock::now() - start).count();
+    if (sec > 0.05) return sec / nrep;
+    nrep *= 2;
+  }
+}
+
+template<int dim, typename DType>
+void Randomize(Tensor<cpu, dim, DType> t) {
+  Tensor<cpu, 2, DType> mat = t.FlatTo2D();
+  for (index_t i = 0; i < mat.size(0); ++i) {
+    for (index_t j = 0; j < mat.size(1); ++j) {
+      mat[i][j] = DType(rand() / static_cast<float>(RAND_MAX) - 0.5f);
+    }
+  }
+}
+
+// matrices of one m x n x k product, stored transposed when asked
+template<typename DType>
+struct Problem {
+  TensorContainer<cpu, 2, DType> lhs, rhs, dst;
+  Problem(index_t m, index_t n, index_t k, bool lt, bool rt)
+      : lhs(lt ? Shape2(k, m) : Shape2(m, k)),
+        rhs(rt ? Shape2(n, k) : Shape2(k, n)),
+        dst(Shape2(m, n)) {
+    Randomize<2, DType>(lhs);
+    Randomize<2, DType>(rhs);
+    Randomize<2, DType>(dst);
+  }
+};
+
+// dst = alpha * dot + beta * dst through DotEngine, beta is 0 or 1
+template<bool lt, bool rt, typename DType>
+void DotThroughEngine(Problem<DType> *p, float alpha, float beta) {
+  Tensor<cpu, 2, DType> dst = p->dst;
+  if (beta == 0.0f) {
+    DotEngine<sv::saveto, cpu, 2, 2, 2, lt, rt, DType>::Eval(&dst, p->lhs, p->rhs, DType(alpha));
+  } else {
+    DotEngine<sv::plusto, cpu, 2, 2, 2, lt, rt, DType>::Eval(&dst, p->lhs, p->rhs, DType(alpha));
+  }
+}
+
+// dst = dot(lhs[.T], rhs[.T]) by the given backend
+template<bool lt, bool rt, typename DType>
+void DotByBackend(Problem<DType> *p, GEMMBackend backend, const GEMMBlocking &blk) {
+  Tensor<cpu, 2, DType> dst = p->dst, lhs = p->lhs, rhs = p->rhs;
+  if (!GEMMDispatch<cpu>::Run<sv::saveto, lt, rt>(backend, blk, &dst, lhs, rhs, DType(1.0f))) {
+    BLASEngine<cpu, DType>::gemm(dst.stream_, rt, lt,
+                                 dst.size(1), dst.size(0), lt ? lhs.size(0) : lhs.size(1),
+                                 DType(1.0f), rhs.dptr_, rhs.stride_, lhs.dptr_, lhs.stride_,
+                                 DType(0.0f), dst.dptr_, dst.stride_);
+  }
+}
+
+// DotByBackend with the transposes as runtime flags
+template<typename DType>
+void DotByBackend(Problem<DType> *p, bool lt, bool rt,
+                  GEMMBackend backend, const GEMMBlocking &blk) {
+  if (lt) {
+    if (rt) {
+      DotByBackend<true, true>(p, backend, blk);
+    } else {
+      DotByBackend<true, false>(p, backend, blk);
+    }
+  } else {
+    if (rt) {
+      DotByBackend<false, true>(p, backend, blk);
+    } else {
+      DotByBackend<false, false>(p, backend, blk);
+    }
+  }
+}
+
+std::string PathName(GEMMBackend backend, const GEMMBlocking &blk) {
+  std::string name = GEMMTuner::BackendName(backend);
+  if (backend == kGEMMPacked) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "(%d,%d,%d)", static_cast<int>(blk.mc),
+             static_cast<int>(blk.kc), static_cast<int>(blk.nc));
+    name += buf;
+  }
+  return name;
+}
+
+template<typename DType>
+void Sweep(const std::vector<index_t> &ms, const std::vector<index_t> &ns,
+           const std::vector<index_t> &ks) {
+  printf("%6s %6s %6s %2s %2s %5s %4s %10s  %s\n",
+         "m", "n", "k", "ta", "tb", "alpha", "beta", "GFLOP/s", "path");
+  for (index_t m : ms) {
+    for (index_t n : ns) {
+      for (index_t k : ks) {
+        for (int t = 0; t < 4; ++t) {
+          const bool lt = (t & 2) != 0, rt = (t & 1) != 0;
+          GEMMBlocking blk;
+          const GEMMBackend backend = GEMMDispatch<cpu>::Choose<DType>(lt, rt, m, n, k, &blk);
+          Problem<DType> p(m, n, k, lt, rt);
+          for (int ab = 0; ab < 2; ++ab) {
+            const float alpha = ab ? 2.0f : 1.0f, beta = ab ? 1.0f : 0.0f;
+            double sec = TimeIt([&]() {
+                switch (t) {
+                  case 0: DotThroughEngine<false, false>(&p, alpha, beta); break;
+                  case 1: DotThroughEngine<false, true>(&p, alpha, beta); break;
+                  case 2: DotThroughEngine<true, false>(&p, alpha, beta); break;
+                  default: DotThroughEngine<true, true>(&p, alpha, beta); break;
+                }
+              });
+            printf("%6d %6d %6d %2d %2d %5.1f %4.1f %10.2f  %s\n",
+                   static_cast<int>(m), static_cast<int>(n), static_cast<int>(k),
+                   lt, rt, alpha, beta, 2.0 * m * n * k / sec * 1e-9,
+                   PathName(backend, blk).c_str());
+          }
+        }
+      }
+    }
+  }
+}
+
+template<typename DType>
+void Small(void) {
+  printf("GFLOP/s with MSHADOW_USE_SMALL_GEMM = %d, MSHADOW_SMALL_GEMM_MAX_MNK = %d\n",
+         MSHADOW_USE_SMALL_GEMM, MSHADOW_SMALL_GEMM_MAX_MNK);
+  printf("%5s %5s %5s %10s %10s %10s  %s\n", "m", "n", "k", "small", "blas", "dot", "faster");
+  const index_t shapes[][3] = {{2, 2, 2}, {3, 3, 3}, {4, 4, 4}, {8, 8, 8}, {12, 12, 12},
+                               {16, 16, 16}, {24, 24, 24}, {32, 32, 32}, {48, 48, 48},
+                               {64, 64, 64}, {16, 64, 16}, {16, 64, 64}, {64, 16, 64},
+                               {1, 256, 64}};
+  for (const index_t *s : shapes) {
+    const index_t m = s[0], n = s[1], k = s[2];
+    Problem<DType> p(m, n, k, false, false);
+    double tsmall = TimeIt([&]() { DotByBackend<false, false>(&p, kGEMMSmall, GEMMBlocking()); });
+    double tblas = TimeIt([&]() { DotByBackend<false, false>(&p, kGEMMBLAS, GEMMBlocking()); });
+    double tdot = TimeIt([&]() { DotThroughEngine<false, false>(&p, 1.0f, 0.0f); });
+    double flop = 2.0 * m * n * k;
+    printf("%5d %5d %5d %10.2f %10.2f %10.2f  %s\n",
+           static_cast<int>(m), static_cast<int>(n), static_cast<int>(k),
+           flop / tsmall * 1e-9, flop / tblas * 1e-9, flop / tdot * 1e-9,
+           tsmall < tblas ? "small" : "blas");
+  }
+}
+
+template<typename DType>
+void Batch(const std::vector<index_t> &sizes, const std::vector<index_t> &batches) {
+  printf("%6s %6s %10s  %s\n", "size", "batch", "GFLOP/s", "path");
+  for (index_t s : sizes) {
+    for (index_t b : batches) {
+      TensorContainer<cpu, 3, DType> lhs(Shape3(b, s, s)), rhs(Shape3(b, s, s)), dst(Shape3(b, s, s));
+      TensorContainer<cpu, 1, DType*> workspace(Shape1(3 * b));
+      Randomize<3, DType>(lhs);
+      Randomize<3, DType>(rhs);
+      double sec = TimeIt([&]() {
+          BatchGEMM<false, false>(dst, lhs, rhs, DType(1.0f), DType(0.0f), workspace);
+        });
+      printf("%6d %6d %10.2f  %s\n", static_cast<int>(s), static_cast<int>(b),
+             2.0 * b * s * s * s / sec * 1e-9, "batched_gemm");
+    }
+  }
+}
+
+template<typename DType>
+void Conv(void) {
+  // batch, in channel, height, width, out channel, kernel, stride, pad
+  const index_t layers[][8] = {{8, 64, 56, 56, 64, 3, 1, 1}, {8, 128, 28, 28, 128, 3, 1, 1},
+                               {8, 256, 14, 14, 256, 3, 1, 1}, {8, 512, 7, 7, 512, 3, 1, 1},
+                               {8, 16, 32, 32, 16, 3, 1, 1}, {8, 3, 32, 32, 16, 3, 1, 1},
+                               {8, 64, 56, 56, 128, 3, 2, 1}, {8, 3, 224, 224, 64, 7, 2, 3}};
+  printf("%4s %4s %4s %4s %4s %2s %2s %10s %10s %10s %10s %10s\n", "n", "c", "h", "w", "o", "k", "s",
+         "col MB", "unpacked", "implicit", "F(2x2)", "F(4x4)");
+  for (const index_t *l : layers) {
+    const index_t n = l[0], c = l[1], h = l[2], w = l[3], o = l[4], k = l[5], s = l[6], p = l[7];
+    const index_t oh = (h + 2 * p - k) / s + 1, ow = (w + 2 * p - k) / s + 1;
+    TensorContainer<cpu, 4, DType> img(Shape4(n, c, h, w));
+    TensorContainer<cpu, 2, DType> weight(Shape2(o, c * k * k)), out(Shape2(o, n * oh * ow));
+    Randomize<4, DType>(img);
+    Randomize<2, DType>(weight);
+    double tcol = TimeIt([&]() {
+        TensorContainer<cpu, 2, DType> col(Shape2(c * k * k, n * oh * ow));
+        col = unpack_patch2col(img, k, k, s, s, 1, 1, p, p);
+        out = dot(weight, col);
+      });
+    double timp = TimeIt([&]() {
+        PatchDotEngine<true>::Eval<sv::saveto>(&out, weight, unpack_patch2col(img, k, k, s, s, 1, 1, p, p));
+      });
+    // Winograd with the filters transformed once, as for inference
+    double twino[2] = {0.0, 0.0};
+    if (k == 3 && s == 1) {
+      for (int t = 0; t < 2; ++t) {
+        WinogradFilter<DType> filter(weight, 2 + 2 * t);
+        twino[t] = TimeIt([&]() { out = dot(filter, unpack_patch2col(img, k, k, s, s, 1, 1, p, p)); });
+      }
+    }
+    const double flop = 2.0 * o * c * k * k * n * oh * ow;
+    printf("%4d %4d %4d %4d %4d %2d %2d %10.1f %10.2f %10.2f %10.2f %10.2f\n",
+           static_cast<int>(n), static_cast<int>(c), static_cast<int>(h), static_cast<int>(w),
+           static_cast<int>(o), static_cast<int>(k), static_cast<int>(s),
+           1.0 * c * k * k * n * oh * ow * sizeof(DType) / (1 << 20),
+           flop / tcol * 1e-9, flop / timp * 1e-9,
+           twino[0] > 0.0 ? flop / twino[0] * 1e-9 : 0.0,
+           twino[1] > 0.0 ? flop / twino[1] * 1e-9 : 0.0);
+  }
+}
+
+template<typename DType>
+void Tune(const std::vector<index_t> &ms, const std::vector<index_t> &ns,
+          const std::vector<index_t> &ks, const char *fname) {
+  const index_t mcs[] = {48, 96, 192}, kcs[] = {128, 256, 512};
+  printf("%6s %6s %6s %2s %2s %10s  %s\n", "m", "n", "k", "ta", "tb", "GFLOP/s", "fastest");
+  for (index_t m : ms) {
+    for (index_t n : ns) {
+      for (index_t k : ks) {
+        std::vector<GEMMTuneEntry> cand;
+        if (PacketCheck<DType, MSHADOW_DEFAULT_PACKET>::kPass && m * n * k <= (1 << 18)) {
+          cand.push_back(GEMMTuneEntry(kGEMMSmall));
+        }
+        cand.push_back(GEMMTuneEntry(kGEMMBLAS));
+        if (DataType<DType>::kFlag != kFloat64) {
+          for (index_t mc : mcs) {
+            for (index_t kc : kcs) {
+              cand.push_back(GEMMTuneEntry(kGEMMPacked, GEMMBlocking(mc, kc, 2048)));
+            }
+          }
+        }
+        for (int t = 0; t < 4; ++t) {
+          const bool lt = (t & 2) != 0, rt = (t & 1) != 0;
+          Problem<DType> p(m, n, k, lt, rt);
+          double best = 0.0;
+          GEMMTuneEntry choice;
+          for (const GEMMTuneEntry &e : cand) {
+            double sec = TimeIt([&]() { DotByBackend(&p, lt, rt, e.backend, e.blocking); });
+            if (best == 0.0 || sec < best) {
+              best = sec;
+              choice = e;
+            }
+          }
+          GEMMTuner::Get()->Set(DataType<DType>::kFlag, lt, rt, m, n, k, choice);
+          printf("%6d %6d %6d %2d %2d %10.2f  %s\n",
+                 static_cast<int>(m), static_cast<int>(n), static_cast<int>(k), lt, rt,
+                 2.0 * m * n * k / best * 1e-9,
+                 PathName(choice.backend, choice.blocking).c_str());
+        }
+      }
+    }
+  }
+  GEMMTuner::Get()->Save(fname);
+  printf("tuning table written to %s\n", fname);
+}
+
+struct Options {
+  bool sweep = false, small = false, batch = false, conv = false;
+  std::string tune, dtype = "float32";
+  std::vector<index_t> m = {1, 16, 64, 256, 1024}, n = {16, 64, 256, 1024};
+  std::vector<index_t> k = {16, 64, 256, 1024}, batches = {1, 8, 64};
+};
+
+std::vector<index_t> ParseList(const char *s) {
+  std::vector<index_t> ret;
+  for (const char *p = s; *p != '\0'; ) {
+    char *end;
+    ret.push_back(static_cast<index_t>(strtol(p, &end, 10)));
+    CHECK(end != p && ret.back() > 0) << "bad size list " << s;
+    p = (*end == ',') ? end + 1 : end;
+  }
+  return ret;
+}
+
+template<typename DType>
+void Run(const Options &opt) {
+  if (opt.small) Small<DType>();
+  if (opt.sweep) Sweep<DType>(opt.m, opt.n, opt.k);
+  if (opt.batch) Batch<DType>({16, 64, 256}, opt.batches);
+  if (opt.conv) Conv<DType>();
+  if (!opt.tune.empty()) Tune<DType>(opt.m, opt.n, opt.k, opt.tune.c_str());
+}
+
+int main(int argc, char *argv[]) {
+  Options opt;
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    if (!strcmp(arg, "sweep")) {
+      opt.sweep = true;
+    } else if (!strcmp(arg, "small")) {
+      opt.small = true;
+    } else if (!strcmp(arg, "batch")) {
+      opt.batch = true;
+    } else if (!strcmp(arg, "conv")) {
+      opt.conv = true;
+    } else if (!strncmp(arg, "tune=", 5)) {
+      opt.tune = arg + 5;
+    } else if (!strncmp(arg, "dtype=", 6)) {
+      opt.dtype = arg + 6;
+    } else if (!strncmp(arg, "m=", 2)) {
+      opt.m = ParseList(arg + 2);
+    } else if (!strncmp(arg, "n=", 2)) {
+      opt.n = ParseList(arg + 2);
+    } else if (!strncmp(arg, "k=", 2)) {
+      opt.k = ParseList(arg + 2);
+    } else if (!strncmp(arg, "batch=", 6)) {
+      opt.batches = ParseList(arg + 6);
+    } else {
+      LOG(FATAL) << "unknown argument " << arg;
+    }
+  }
+  if (!opt.small && !opt.batch && !opt.conv && opt.tune.empty()) opt.sweep = true;
+  InitTensorEngine<cpu>();
+  // tune from scratch rather than on top of a loaded table
+  if (!opt.tune.empty()) GEMMTuner::Get()->Clear();
+  if (opt.dtype == "float32") {
+    Run<float>(opt);
+  } else if (opt.dtype == "float64") {
+    Run<double>(opt);
+  } else if (opt.dtype == "float16") {
+    Run<half::half_t>(opt);
+  } else if (opt.dtype == "bfloat16") {
+    Run<bfloat::bf16_t>(opt);
+  } else {
+    LOG(FATAL) << "unknown dtype " << opt.dtype;
+  }
+  ShutdownTensorEngine<cpu>();
+  return 0;
+}
@@ -447,17 +447,40 @@ class LocalModel : public ISharedModel<xpu, DType> {
       ms_omp_uint ntask = static_cast<ms_omp_uint>(data.size(1));
       #pragma omp parallel for schedule(static) num_threads(nthread_reduction)
       for (ms_omp_uint j = 0; j < ntask; ++j) {
-        for (index_t i = 1; i < data.size(0); ++i) {
-          data[0][j] += data[i][j];
-        }
+        this->ReduceSumRow(data, j);
       }
     } else  //NOLINT(*)
       #endif
     {
+#if MSHADOW_DETERMINISTIC_REDUCE == 2
+      for (index_t j = 0; j < data.size(1); ++j) {
+        this->ReduceSumRow(data, j);
+      }
+#else
       for (index_t i = 1; i < data.size(0); ++i) {
         data[0] += data[i];
       }
+#endif
+    }
+  }
+  // sum row j of all devices into device 0, always in device order,
+  // with Kahan compensation when MSHADOW_DETERMINISTIC_REDUCE == 2
+  inline void ReduceSumRow(Tensor<cpu, 3, DType> data, index_t j) {
+#if MSHADOW_DETERMINISTIC_REDUCE == 2
+    Tensor<cpu, 1, DType> dst = data[0][j];
+    for (index_t x = 0; x < dst.size(0); ++x) {
+      DType val, res;
+      red::sum::SetInitValue(val, res);
+      for (index_t i = 0; i < data.size(0); ++i) {
+        red::sum::Reduce(val, data[i][j][x], res);
+      }
+      dst[x] = val - res;
     }
+#else
+    for (index_t i = 1; i < data.size(0); ++i) {
+      data[0][j] += data[i][j];
+    }
+#endif
   }
 
  private:
@@ -41,6 +41,9 @@ typedef unsigned __int64 uint64_t;
 #else
 #include <inttypes.h>
 #endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 // macro defintiions
 /*!
  * \brief if this macro is define to be 1,
@@ -64,6 +67,65 @@ typedef unsigned __int64 uint64_t;
 #ifndef MSHADOW_MIN_PAD_RATIO
   #define MSHADOW_MIN_PAD_RATIO 2
 #endif
+/*!
+ * \brief
+ *  whether dot of small float/double matrices on CPU is computed by an
+ *  unpacked single threaded kernel instead of BLAS: the shapes with a
+ *  compile time instance (4x4, 8x8, 16x64, ...) and any shape with
+ *  m * n * k up to MSHADOW_SMALL_GEMM_MAX_MNK. The result may differ from
+ *  BLAS in the last bits, so it is off by default
+ */
+#ifndef MSHADOW_USE_SMALL_GEMM
+  #define MSHADOW_USE_SMALL_GEMM 0
+#endif
+/*!
+ * \brief
+ *  m * n * k bound of MSHADOW_USE_SMALL_GEMM for the runtime extent kernel,
+ *  (bench/gemm_bench measures the crossover)
+ */
+#ifndef MSHADOW_SMALL_GEMM_MAX_MNK
+  #define MSHADOW_SMALL_GEMM_MAX_MNK 512
+#endif
+/*!
+ * \brief
+ *  whether dot(weight, unpack_patch2col(img, 3, 3, 1, 1)) of float/double
+ *  with at least MSHADOW_WINOGRAD_MIN_CHANNEL input and output channels
+ *  is computed by Winograd F(4x4, 3x3). It is off by default because the
+ *  result differs from the GEMM by the rounding of the transforms, and the
+ *  weight is transformed again at every call; to transform it once, build a
+ *  WinogradFilter and use dot(filter, unpack_patch2col(...)) instead
+ */
+#ifndef MSHADOW_USE_WINOGRAD
+  #define MSHADOW_USE_WINOGRAD 0
+#endif
+/*! \brief channel bound of MSHADOW_USE_WINOGRAD, measured by bench/gemm_bench conv */
+#ifndef MSHADOW_WINOGRAD_MIN_CHANNEL
+  #define MSHADOW_WINOGRAD_MIN_CHANNEL 8
+#endif
+/*!
+ * \brief
+ *  pool<red::maximum/minimum/sum> on CPU uses two sliding window passes
+ *  instead of a loop over each window when ksize_y * ksize_x is at least
+ *  this ratio times kstride_y * (kstride_x + 1), set it to a large value to disable
+ */
+#ifndef MSHADOW_POOL_SLIDING_RATIO
+  #define MSHADOW_POOL_SLIDING_RATIO 2
+#endif
+/*!
+ * \brief
+ *  the CPU keep-dim reductions (sum_rows, sumall_except_dim, reduce_except_dim)
+ *  split the rows by the thread count, so rounding follows OMP_NUM_THREADS;
+ *  set it to 1 to cut the rows into chunks of MSHADOW_REDUCE_CHUNK rows merged
+ *  in a fixed pairwise tree, giving the same bits for any thread count,
+ *  or to 2 to also sum each chunk of red::sum with Kahan compensation
+ */
+#ifndef MSHADOW_DETERMINISTIC_REDUCE
+  #define MSHADOW_DETERMINISTIC_REDUCE 0
+#endif
+/*! \brief rows per chunk of MSHADOW_DETERMINISTIC_REDUCE */
+#ifndef MSHADOW_REDUCE_CHUNK
+  #define MSHADOW_REDUCE_CHUNK 256
+#endif
 
 #if MSHADOW_STAND_ALONE
   #define MSHADOW_USE_CBLAS 0
@@ -277,6 +339,7 @@ extern "C" {
 
 #include "./half.h"
 #include "./half2.h"
+#include "./bfloat.h"
 #include "./logging.h"
 /*! \brief namespace for mshadow */
 namespace mshadow {
@@ -294,6 +357,14 @@ typedef int64_t index_t;
   /*! \brief openmp index for linux */
   typedef index_t openmp_index_t;
 #endif
+/*! \brief number of threads an openmp parallel region will use, 1 without openmp */
+inline int GetOMPMaxThreads(void) {
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
 
 /*! \brief float point type that will be used in default by mshadow */
 typedef float default_real_t;
@@ -307,6 +378,7 @@ enum TypeFlag {
   kInt32 = 4,
   kInt8  = 5,
   kInt64 = 6,
+  kBfloat16 = 7,
 };
 
 template<typename DType>
@@ -360,6 +432,11 @@ struct DataType<half::half2_t> {
   static const int kLanes = 2;
 };
 template<>
+struct DataType<bfloat::bf16_t> {
+  static const int kFlag = kBfloat16;
+  static const int kLanes = 1;
+};
+template<>
 struct DataType<uint8_t> {
   static const int kFlag = kUint8;
   static const int kLanes = 1;
@@ -432,6 +509,14 @@ struct LayoutType;
 template<>
 struct LayoutType<kNCHW> {
   static const index_t kNdim = 4;
+  /*!
+   * \brief the channel, height and width axes of a tensor of dim dimensions
+   *  are dim - kChannelFromLast, dim - kHeightFromLast and dim - kWidthFromLast,
+   *  so that the leading batch dimensions can be flattened or dropped
+   */
+  static const int kChannelFromLast = 3;
+  static const int kHeightFromLast = 2;
+  static const int kWidthFromLast = 1;
 #if (MSHADOW_USE_CUDA && MSHADOW_USE_CUDNN == 1 && CUDNN_MAJOR >= 4)
   static const cudnnTensorFormat_t kCudnnFlag = CUDNN_TENSOR_NCHW;
 #else
@@ -442,6 +527,9 @@ struct LayoutType<kNCHW> {
 template<>
 struct LayoutType<kNHWC> {
   static const index_t kNdim = 4;
+  static const int kChannelFromLast = 1;
+  static const int kHeightFromLast = 3;
+  static const int kWidthFromLast = 2;
 #if (MSHADOW_USE_CUDA && MSHADOW_USE_CUDNN == 1 && CUDNN_MAJOR >= 4)
   static const cudnnTensorFormat_t kCudnnFlag = CUDNN_TENSOR_NHWC;
 #else
@@ -455,6 +543,11 @@ const int default_layout = kNCHW;
 template<>
 struct LayoutType<kNCDHW> {
   static const index_t kNdim = 5;
+  /*! \brief same as LayoutType<kNCHW>, with the depth axis before height */
+  static const int kChannelFromLast = 4;
+  static const int kDepthFromLast = 3;
+  static const int kHeightFromLast = 2;
+  static const int kWidthFromLast = 1;
 #if (MSHADOW_USE_CUDA && MSHADOW_USE_CUDNN == 1 && CUDNN_MAJOR >= 4)
   static const cudnnTensorFormat_t kCudnnFlag = CUDNN_TENSOR_NCHW;
 #else
@@ -465,6 +558,10 @@ struct LayoutType<kNCDHW> {
 template<>
 struct LayoutType<kNDHWC> {
   static const index_t kNdim = 5;
+  static const int kChannelFromLast = 1;
+  static const int kDepthFromLast = 4;
+  static const int kHeightFromLast = 3;
+  static const int kWidthFromLast = 2;
 #if (MSHADOW_USE_CUDA && MSHADOW_USE_CUDNN == 1 && CUDNN_MAJOR >= 4)
   static const cudnnTensorFormat_t kCudnnFlag = CUDNN_TENSOR_NHWC;
 #else
@@ -620,6 +717,11 @@ template<>
 MSHADOW_XINLINE half::half_t MinValue<half::half_t>(void) {
   return MSHADOW_HALF_MIN;
 }
+/*! \brief minimum value of bf16 */
+template<>
+MSHADOW_XINLINE bfloat::bf16_t MinValue<bfloat::bf16_t>(void) {
+  return MSHADOW_BF16_MIN;
+}
 /*! \brief minimum value of uint8_t */
 template<>
 MSHADOW_XINLINE uint8_t MinValue<uint8_t>(void) {
@@ -662,6 +764,11 @@ template<>
 MSHADOW_XINLINE half::half_t MaxValue<half::half_t>(void) {
   return MSHADOW_HALF_MAX;
 }
+/*! \brief maximum value of bf16 */
+template<>
+MSHADOW_XINLINE bfloat::bf16_t MaxValue<bfloat::bf16_t>(void) {
+  return MSHADOW_BF16_MAX;
+}
 /*! \brief maximum value of uint8_t */
 template<>
 MSHADOW_XINLINE uint8_t MaxValue<uint8_t>(void) {
@@ -1098,6 +1205,8 @@ struct minimum {
 /*! \brief get data type size from type enum */
 inline size_t mshadow_sizeof(int type) {
   int size = 0;
+  // bfloat16 is a storage type only, not part of the type switch
+  if (type == kBfloat16) return sizeof(bfloat::bf16_t);
   MSHADOW_TYPE_SWITCH(type, DType, size = sizeof(DType););
   return size;
 }
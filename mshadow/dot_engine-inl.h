@@ -10,6 +10,7 @@
 #include <vector>
 #include "./base.h"
 #include "./extension/implicit_gemm.h"
+#include "./gemm_cpu-inl.h"
 
 #ifdef __CUDACC__
 #include "./cuda/tensor_gpu-inl.cuh"
@@ -113,6 +114,108 @@ struct BLASEngine {
   }
 };
 
+// 16 bit floating point types on CPU, computed by the packed GEMM in fp32
+template<typename DType>
+struct PackedBLASEngine {
+  inline static bool GetT(bool t) {
+    return t ? true : false;
+  }
+  inline static void SetStream(Stream<cpu> *stream) {
+  }
+  inline static void gemm(Stream<cpu> *stream,
+                          bool transa, bool transb,
+                          int m, int n, int k, DType alpha,
+                          const DType *A, int lda, const DType *B, int ldb,
+                          DType beta, DType *C, int ldc) {
+    // column major C is the row major C^T = op(B)^T * op(A)^T
+    PackedGEMM::Eval(n, m, k, static_cast<float>(alpha),
+                     GEMMMatrix<DType>(B, transb ? 1 : ldb, transb ? ldb : 1),
+                     GEMMMatrix<DType>(A, transa ? lda : 1, transa ? 1 : lda),
+                     static_cast<float>(beta), C, ldc);
+  }
+  inline static void batched_gemm(Stream<cpu> *stream,
+                                  bool transa, bool transb,
+                                  int m, int n, int k, DType alpha,
+                                  const DType *A, int lda, const DType *B, int ldb,
+                                  DType beta, DType *C, int ldc, int batch_count,
+                                  DType **workspace) {
+    for (int i = 0; i < batch_count; ++i) {
+      gemm(stream, transa, transb, m, n, k, alpha,
+           A + i * m * k, lda, B + i * k * n, ldb,
+           beta, C + i * m * n, ldc);
+    }
+  }
+  inline static void gemv(Stream<cpu> *stream,
+                          bool trans, int m, int n,
+                          DType alpha, const DType *A, int lda,
+                          const DType *X, int incX,
+                          DType beta, DType *Y, int incY) {
+    const int ny = trans ? n : m, nx = trans ? m : n;
+    const float falpha = static_cast<float>(alpha), fbeta = static_cast<float>(beta);
+    #pragma omp parallel for
+    for (int i = 0; i < ny; ++i) {
+      float sum = 0.0f;
+      for (int j = 0; j < nx; ++j) {
+        const DType a = trans ? A[j + i * lda] : A[i + j * lda];
+        sum += static_cast<float>(a) * static_cast<float>(X[j * incX]);
+      }
+      const float y = fbeta == 0.0f ? 0.0f : fbeta * static_cast<float>(Y[i * incY]);
+      Y[i * incY] = DType(falpha * sum + y);
+    }
+  }
+  inline static void batched_gemv(Stream<cpu> *stream,
+                                  bool trans, int m, int n,
+                                  DType alpha, const DType *A, int lda,
+                                  const DType *X, int incX,
+                                  DType beta, DType *Y, int incY, int batch_count) {
+    for (int i = 0; i < batch_count; ++i) {
+      gemv(stream, trans, m, n, alpha, A + i * m * n, lda,
+           X + i * (trans ? m : n) * incX, incX,
+           beta, Y + i * (trans ? n : m) * incY, incY);
+    }
+  }
+  inline static void ger(Stream<cpu> *stream,
+                         int m, int n, DType alpha,
+                         const DType *X, int incX,
+                         const DType *Y, int incY, DType *A, int lda) {
+    const float falpha = static_cast<float>(alpha);
+    #pragma omp parallel for
+    for (int j = 0; j < n; ++j) {
+      const float y = falpha * static_cast<float>(Y[j * incY]);
+      for (int i = 0; i < m; ++i) {
+        A[i + j * lda] = DType(static_cast<float>(A[i + j * lda]) +
+                               static_cast<float>(X[i * incX]) * y);
+      }
+    }
+  }
+  inline static void batched_ger(Stream<cpu> *stream,
+                         int m, int n, DType alpha,
+                         const DType *X, int incX,
+                         const DType *Y, int incY, DType *A, int lda, int batch_count) {
+    for (int i = 0; i < batch_count; ++i) {
+      ger(stream, m, n, alpha, X + i * m * incX, incX, Y + i * n * incY, incY,
+          A + i * lda * n, lda);
+    }
+  }
+  inline static void dot(Stream<cpu> *stream,
+                         int n,
+                         const DType* X, int incX,
+                         const DType* Y, int incY,
+                         DType* ret) {
+    float sum = 0.0f;
+    for (int i = 0; i < n; ++i) {
+      sum += static_cast<float>(X[i * incX]) * static_cast<float>(Y[i * incY]);
+    }
+    *ret = DType(sum);
+  }
+};
+template<>
+struct BLASEngine<cpu, half::half_t> : public PackedBLASEngine<half::half_t> {
+};
+template<>
+struct BLASEngine<cpu, bfloat::bf16_t> : public PackedBLASEngine<bfloat::bf16_t> {
+};
+
 #if MSHADOW_STAND_ALONE
 template<>
 struct BLASEngine<cpu, float> {
@@ -806,6 +909,35 @@ struct BLASEngine<gpu, double> {
   }
 };
 #endif  // MSHADOW_USE_CUDA
+#if MSHADOW_STAND_ALONE
+// implicit_dot needs packet support of the element type
+template<bool pass_check>
+struct StandAloneDot {
+  template<bool transpose_left, bool transpose_right, typename xpu, typename DType>
+  inline static bool Eval(Tensor<xpu, 2, DType> *p_dst,
+                          const Tensor<xpu, 2, DType> &lhs,
+                          const Tensor<xpu, 2, DType> &rhs) {
+    Tensor<xpu, 2, DType> &dst = *p_dst;
+    if (!transpose_left && !transpose_right) {
+      dst = expr::implicit_dot(lhs, rhs); return true;
+    } else if (!transpose_left && transpose_right) {
+      dst = expr::implicit_dot(lhs, rhs.T()); return true;
+    } else if (transpose_left && !transpose_right) {
+      dst = expr::implicit_dot(lhs.T(), rhs); return true;
+    }
+    return false;
+  }
+};
+template<>
+struct StandAloneDot<false> {
+  template<bool transpose_left, bool transpose_right, typename xpu, typename DType>
+  inline static bool Eval(Tensor<xpu, 2, DType> *p_dst,
+                          const Tensor<xpu, 2, DType> &lhs,
+                          const Tensor<xpu, 2, DType> &rhs) {
+    return false;
+  }
+};
+#endif  // MSHADOW_STAND_ALONE
 // helper function to decide which shape we are in
 inline Shape<2> GetShape(const Shape<2> &shape, bool transpose) {
   return transpose ? Shape2(shape[1], shape[0]) : shape;
@@ -819,15 +951,16 @@ struct DotEngine<SV, xpu, 2, 2, 2, transpose_left, transpose_right, DType> {
                           const Tensor<xpu, 2, DType> &rhs,
                           DType scale) {
     Tensor<xpu, 2, DType> &dst = *p_dst;
+    // native kernels for tiny or tuned shapes, see GEMMTuner
+    if (GEMMDispatch<xpu>::template Eval<SV, transpose_left, transpose_right>
+        (p_dst, lhs, rhs, scale)) {
+      return;
+    }
 #if MSHADOW_STAND_ALONE
-    if (xpu::kDevMask == cpu::kDevMask && scale == 1.0f) {
-      if (!transpose_left && !transpose_right) {
-        dst = expr::implicit_dot(lhs, rhs); return;
-      } else if (!transpose_left && transpose_right) {
-        dst = expr::implicit_dot(lhs, rhs.T()); return;
-      } else if (transpose_left && !transpose_right) {
-        dst = expr::implicit_dot(lhs.T(), rhs); return;
-      }
+    if (xpu::kDevMask == cpu::kDevMask && scale == 1.0f &&
+        StandAloneDot<PacketCheck<DType, MSHADOW_DEFAULT_PACKET>::kPass>
+        ::template Eval<transpose_left, transpose_right>(&dst, lhs, rhs)) {
+      return;
     }
 #endif
     // set kernel stream
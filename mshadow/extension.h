@@ -11,11 +11,16 @@
 #include "./extension/broadcast.h"
 #include "./extension/unpack_patch2col.h"
 #include "./extension/pack_col2patch.h"
+#include "./extension/unpack_patch2col_3d.h"
+#include "./extension/pack_col2patch_3d.h"
 #include "./extension/reshape.h"
 #include "./extension/swapaxis.h"
 #include "./extension/reduceto1d.h"
 #include "./extension/spatial_pool.h"
 #include "./extension/spatial_unpool.h"
+#include "./extension/spatial_pool_index.h"
+#include "./extension/spatial_pool3d.h"
+#include "./extension/spatial_unpool3d.h"
 #include "./extension/channel_pool.h"
 #include "./extension/channel_unpool.h"
 #include "./extension/pad.h"
@@ -31,11 +36,20 @@
 #include "./extension/take.h"
 #include "./extension/take_grad.h"
 #include "./extension/reduce_with_axis.h"
+#include "./extension/reduce_stats.h"
+#include "./extension/topk.h"
+#include "./extension/segment_reduce.h"
 #include "./extension/broadcast_with_axis.h"
 #include "./extension/spatial_upsampling_nearest.h"
+#include "./extension/spatial_upsampling_bilinear.h"
 #include "./extension/transpose.h"
 #include "./extension/flip.h"
 #include "./extension/complex.h"
 #include "./extension/range.h"
 #include "./extension/mask.h"
+#include "./extension/quantize.h"
+#include "./extension/quantized_dot.h"
+#include "./extension/csr_tensor.h"
+#include "./extension/winograd.h"
+#include "./extension/patch_dot.h"
 #endif  // MSHADOW_EXTENSION_H_
@@ -7,6 +7,7 @@
 #ifndef MSHADOW_EXTENSION_CHANNEL_POOL_H_
 #define MSHADOW_EXTENSION_CHANNEL_POOL_H_
 #include <algorithm>
+#include <vector>
 #include "../extension.h"
 namespace mshadow {
 namespace expr {
@@ -102,7 +103,191 @@ struct Plan<ChannelPoolingExp<Reducer, SrcExp, DType, srcdim>, DType> {
   Plan<SrcExp, DType> src_;
   const index_t channel_, height_, width_, hnsize_, stride_, pad_, src_channel_;
 };
+/*!
+ * \brief CPU channel window sums by a running sum along the channel axis,
+ *  shared by chpool<red::sum> and ch_unpool<red::sum>: output channel c is the
+ *  sum of source channels [begin[c], end[c]), both nondecreasing in c
+ */
+struct ChannelRunningSum {
+  /*!
+   * \brief dst (SV)= scale * window sum + shift
+   * \param dst destination, shape: (num, out_channel, height, width) flattened
+   * \param src plan of the source, shape: (num, in_channel, height, width) flattened
+   * \param resync the sum is summed again from scratch every resync windows,
+   *  so the rounding of the subtractions does not build up
+   */
+  template<typename SV, typename SrcPlan, typename DType>
+  inline static void Eval(Tensor<cpu, 2, DType> dst, const SrcPlan &src,
+                          index_t num, index_t in_channel, index_t out_channel,
+                          index_t height, index_t width,
+                          const std::vector<index_t> &begin, const std::vector<index_t> &end,
+                          index_t resync, DType scale = DType(1.0f), DType shift = DType(0.0f)) {
+    Sweep<SV, PacketCheck<DType, MSHADOW_DEFAULT_PACKET>::kPass ?
+          MSHADOW_DEFAULT_PACKET : packet::kPlain>(dst, src, num, in_channel, out_channel,
+                                                   height, width, begin, end, resync,
+                                                   scale, shift);
+  }
+  /*!
+   * \brief sweep the channels of every (image, row), the rows split in one
+   *  block per thread; each source row is evaluated once into a ring of the
+   *  rows in the window, the sum then adds and subtracts whole rows of the
+   *  ring, packet by packet along the contiguous width
+   */
+  template<typename SV, packet::PacketArch Arch, typename SrcPlan, typename DType>
+  inline static void Sweep(Tensor<cpu, 2, DType> dst, const SrcPlan &src,
+                           index_t num, index_t in_channel, index_t out_channel,
+                           index_t height, index_t width,
+                           const std::vector<index_t> &begin, const std::vector<index_t> &end,
+                           index_t resync, DType scale, DType shift) {
+    typedef packet::Packet<DType, Arch> Packet;
+    const index_t nrow = num * height;
+    if (nrow == 0 || width == 0) return;
+    index_t nwin = 1;
+    for (index_t c = 0; c < out_channel; ++c) {
+      nwin = std::max(nwin, end[c] - begin[c]);
+    }
+    const bool aligned = packet::CheckAlign<Arch>(dst.dptr_) &&
+        packet::CheckAlign<Arch>(dst.stride_ * sizeof(DType));
+    const index_t xend = packet::UpperAlign<DType, MSHADOW_DEFAULT_PACKET>(width);
+    const index_t xlen = packet::LowerAlign<DType, MSHADOW_DEFAULT_PACKET>(width);
+    const index_t nblock = std::min(static_cast<index_t>(GetOMPMaxThreads()), nrow);
+    #pragma omp parallel for num_threads(nblock)
+    for (openmp_index_t blk = 0; blk < nblock; ++blk) {
+      // nwin ring rows, slot cc % nwin holds source channel cc, then the sum;
+      // the padding past width stays zero
+      size_t pitch;
+      DType *ring = static_cast<DType*>(
+          packet::AlignedMallocPitch(&pitch, width * sizeof(DType), nwin + 1));
+      const index_t ld = pitch / sizeof(DType);
+      std::fill(ring, ring + ld * (nwin + 1), DType(0.0f));
+      DType *acc = ring + nwin * ld;
+      for (index_t r = blk * nrow / nblock; r < (blk + 1) * nrow / nblock; ++r) {
+        const index_t n = r / height, y = r % height;
+        index_t cbegin = 0, cend = 0, nslide = resync;
+        for (index_t c = 0; c < out_channel; ++c) {
+          const index_t b = begin[c], e = std::max(begin[c], end[c]);
+          const bool fresh = b >= cend || nslide >= resync;
+          // channels leaving the window, before their slots are reused
+          for (index_t cc = cbegin; cc < b && !fresh; ++cc) {
+            const DType *slot = ring + (cc % nwin) * ld;
+            for (index_t x = 0; x < xend; x += Packet::size) {
+              (Packet::Load(acc + x) - Packet::Load(slot + x)).Store(acc + x);
+            }
+          }
+          for (index_t cc = std::max(b, cend); cc < e; ++cc) {
+            DType *slot = ring + (cc % nwin) * ld;
+            const index_t row = (n * in_channel + cc) * height + y;
+            for (index_t x = 0; x < width; ++x) slot[x] = src.Eval(row, x);
+            for (index_t x = 0; x < xend && !fresh; x += Packet::size) {
+              (Packet::Load(acc + x) + Packet::Load(slot + x)).Store(acc + x);
+            }
+          }
+          if (fresh) {
+            for (index_t x = 0; x < xend; x += Packet::size) {
+              Packet::Fill(DType(0.0f)).Store(acc + x);
+            }
+            for (index_t cc = b; cc < e; ++cc) {
+              const DType *slot = ring + (cc % nwin) * ld;
+              for (index_t x = 0; x < xend; x += Packet::size) {
+                (Packet::Load(acc + x) + Packet::Load(slot + x)).Store(acc + x);
+              }
+            }
+            nslide = 0;
+          } else {
+            ++nslide;
+          }
+          cbegin = b; cend = e;
+          DType *out = dst[(n * out_channel + c) * height + y].dptr_;
+          index_t x = 0;
+          if (aligned) {
+            const Packet pscale = Packet::Fill(scale), pshift = Packet::Fill(shift);
+            for (; x < xlen; x += Packet::size) {
+              packet::Saver<SV, DType, Arch>::Save(out + x, Packet::Load(acc + x) * pscale + pshift);
+            }
+          }
+          for (; x < width; ++x) {
+            SV::template Save<DType>(out[x], acc[x] * scale + shift);
+          }
+        }
+      }
+      packet::AlignedFree(ring);
+    }
+  }
+};
+/*!
+ * \brief dst (SV)= scale * chpool<red::sum>(...) + shift on CPU, with the
+ *  windows of the Plan
+ */
+template<typename SV, int dim, typename DType, typename SrcExp>
+inline void ChannelPoolSumCPU(Tensor<cpu, dim, DType> *dst,
+                              const ChannelPoolingExp<red::sum, SrcExp, DType, dim> &e,
+                              DType scale, DType shift) {
+  const index_t channel = e.shape_[dim - 3];
+  std::vector<index_t> begin(channel), end(channel);
+  for (index_t c = 0; c < channel; ++c) {
+    begin[c] = c * e.stride_ < e.pad_ ? 0 : c * e.stride_ - e.pad_;
+    end[c] = std::min(c * e.stride_ - e.pad_ + e.nsize_, channel);
+  }
+  ChannelRunningSum::Eval<SV>(dst->FlatTo2D(), MakePlan(e.src_),
+                              e.shape_.ProdShape(0, dim - 3), e.src_channel_, channel,
+                              e.shape_[dim - 2], e.shape_[dim - 1],
+                              begin, end, e.nsize_, scale, shift);
+}
 }  // namespace expr
+/*!
+ * \brief tensor = chpool<red::sum>(...) on CPU, by ChannelRunningSum,
+ *  so its cost does not grow with the local size
+ */
+template<typename SV, int dim, typename DType, typename SrcExp>
+struct MapExpCPUEngine<false, SV, Tensor<cpu, dim, DType>, dim, DType,
+                       expr::MakeTensorExp<expr::ChannelPoolingExp<red::sum, SrcExp, DType, dim>,
+                                           SrcExp, dim, DType>,
+                       expr::type::kChainer> {
+  inline static void Map(Tensor<cpu, dim, DType> *dst,
+                         const expr::Exp<expr::MakeTensorExp<
+                           expr::ChannelPoolingExp<red::sum, SrcExp, DType, dim>,
+                           SrcExp, dim, DType>, DType, expr::type::kChainer> &exp) {
+    expr::ChannelPoolSumCPU<SV>(dst, exp.self().real_self(), DType(1.0f), DType(0.0f));
+  }
+};
+/*!
+ * \brief the LRN norm, tensor = chpool<red::sum>(F<square>(x), n) * alpha
+ *  (+ knorm), takes the same path with the scale and shift fused
+ */
+template<typename SV, int dim, typename DType, typename SrcExp>
+struct MapExpCPUEngine<false, SV, Tensor<cpu, dim, DType>, dim, DType,
+                       expr::BinaryMapExp<op::mul, expr::MakeTensorExp<
+                         expr::ChannelPoolingExp<red::sum, SrcExp, DType, dim>,
+                         SrcExp, dim, DType>, expr::ScalarExp<DType>, DType,
+                                          expr::type::kChainer>,
+                       expr::type::kChainer> {
+  typedef expr::BinaryMapExp<op::mul, expr::MakeTensorExp<
+    expr::ChannelPoolingExp<red::sum, SrcExp, DType, dim>, SrcExp, dim, DType>,
+                             expr::ScalarExp<DType>, DType, expr::type::kChainer> E;
+  inline static void Map(Tensor<cpu, dim, DType> *dst,
+                         const expr::Exp<E, DType, expr::type::kChainer> &exp) {
+    expr::ChannelPoolSumCPU<SV>(dst, exp.self().lhs_.real_self(),
+                                exp.self().rhs_.scalar_, DType(0.0f));
+  }
+};
+template<typename SV, int dim, typename DType, typename SrcExp>
+struct MapExpCPUEngine<false, SV, Tensor<cpu, dim, DType>, dim, DType,
+                       expr::BinaryMapExp<op::plus, expr::BinaryMapExp<op::mul,
+                         expr::MakeTensorExp<expr::ChannelPoolingExp<red::sum, SrcExp, DType, dim>,
+                                             SrcExp, dim, DType>,
+                         expr::ScalarExp<DType>, DType, expr::type::kChainer>,
+                                          expr::ScalarExp<DType>, DType, expr::type::kChainer>,
+                       expr::type::kChainer> {
+  typedef expr::BinaryMapExp<op::plus, expr::BinaryMapExp<op::mul,
+    expr::MakeTensorExp<expr::ChannelPoolingExp<red::sum, SrcExp, DType, dim>,
+                        SrcExp, dim, DType>,
+    expr::ScalarExp<DType>, DType, expr::type::kChainer>,
+                             expr::ScalarExp<DType>, DType, expr::type::kChainer> E;
+  inline static void Map(Tensor<cpu, dim, DType> *dst,
+                         const expr::Exp<E, DType, expr::type::kChainer> &exp) {
+    expr::ChannelPoolSumCPU<SV>(dst, exp.self().lhs_.lhs_.real_self(),
+                                exp.self().lhs_.rhs_.scalar_, exp.self().rhs_.scalar_);
+  }
+};
 }  // namespace mshadow
 #endif  // MSHADOW_EXTENSION_CHANNEL_POOL_H_
-
@@ -7,6 +7,7 @@
 #ifndef MSHADOW_EXTENSION_CHANNEL_UNPOOL_H_
 #define MSHADOW_EXTENSION_CHANNEL_UNPOOL_H_
 #include <algorithm>
+#include <vector>
 #include "../extension.h"
 namespace mshadow {
 namespace expr {
@@ -92,7 +93,7 @@ inline ChannelUnpoolingExp<Reducer, SrcExp, DType, ExpInfo<SrcExp>::kDim>
 ch_unpool(const Exp<SrcExp, DType, etype> &data_src,
        const Exp<SrcExp, DType, etype> &data_pooled,
        const Exp<SrcExp, DType, etype> &grad_pooled, index_t nsize) {
-  return ch_unpool(data_src, data_pooled, grad_pooled, nsize, 1, nsize / 2);
+  return ch_unpool<Reducer>(data_src, data_pooled, grad_pooled, nsize, 1, nsize / 2);
 }
 
 
@@ -132,6 +133,33 @@ struct Plan<ChannelUnpoolingExp<Reducer, SrcExp, DType, srcdim>, DType> {
   const index_t channel_, height_, pchannel_, hnsize_, stride_, pad_;
 };
 }  // namespace expr
+/*!
+ * \brief tensor = ch_unpool<red::sum>(...) on CPU; the partial gradient of
+ *  sum is 1, so this is a window sum of grad_pooled, done by ChannelRunningSum
+ */
+template<typename SV, int dim, typename DType, typename SrcExp>
+struct MapExpCPUEngine<false, SV, Tensor<cpu, dim, DType>, dim, DType,
+                       expr::MakeTensorExp<expr::ChannelUnpoolingExp<red::sum, SrcExp, DType, dim>,
+                                           SrcExp, dim, DType>,
+                       expr::type::kChainer> {
+  inline static void Map(Tensor<cpu, dim, DType> *dst,
+                         const expr::Exp<expr::MakeTensorExp<
+                           expr::ChannelUnpoolingExp<red::sum, SrcExp, DType, dim>,
+                           SrcExp, dim, DType>, DType, expr::type::kChainer> &exp) {
+    const expr::ChannelUnpoolingExp<red::sum, SrcExp, DType, dim> &e = exp.self().real_self();
+    const index_t channel = e.shape_[dim - 3];
+    // same windows as the Plan
+    std::vector<index_t> begin(channel), end(channel);
+    for (index_t c = 0; c < channel; ++c) {
+      begin[c] = c < e.nsize_ - e.pad_ ? 0 : (c - (e.nsize_ - e.pad_) + e.kstride_) / e.kstride_;
+      end[c] = std::min((c + e.pad_ + e.kstride_) / e.kstride_, channel);
+    }
+    expr::ChannelRunningSum::Eval<SV>(dst->FlatTo2D(), expr::MakePlan(e.grad_pooled_),
+                                      e.shape_.ProdShape(0, dim - 3), e.pchannel_, channel,
+                                      e.shape_[dim - 2], e.shape_[dim - 1], begin, end,
+                                      (e.nsize_ + e.kstride_ - 1) / e.kstride_);
+  }
+};
 }  // namespace mshadow
 #endif  // MSHADOW_EXTENSION_CHANNEL_UNPOOL_H_
 
@@ -15,10 +15,13 @@ namespace expr {
  * \tparam DType the type of elements
  * \tparam srcdim dimension of src
  */
-template<typename SrcExp, typename DType, int srcdim>
+template<typename SrcExp, typename DType, int srcdim, int layout = kNCHW>
 struct CroppingExp:
-      public MakeTensorExp<CroppingExp<SrcExp, DType, srcdim>,
+      public MakeTensorExp<CroppingExp<SrcExp, DType, srcdim, layout>,
                            SrcExp, srcdim, DType> {
+  /*! \brief height and width axes */
+  static const int kHeightAxis = srcdim - LayoutType<layout>::kHeightFromLast;
+  static const int kWidthAxis = srcdim - LayoutType<layout>::kWidthFromLast;
   /*! \brief source operand */
   const SrcExp &src_;
   /*! \brief pad height */
@@ -27,30 +30,34 @@ struct CroppingExp:
   index_t pad_width_;
   /*! \brief src height */
   index_t src_height_;
+  /*! \brief src width */
+  index_t src_width_;
   /*! \brief constructor */
   explicit CroppingExp(const SrcExp &src, Shape<2> cshape)
       : src_(src) {
     this->shape_ = ShapeCheck<srcdim, SrcExp>::Check(src_);
-    CHECK_GE(this->shape_[srcdim - 2], cshape[0]) << "CroppingExp: height requirement not met";
-    CHECK_GE(this->shape_[srcdim - 1], cshape[1]) << "CroppingExp: width requirement not met";
-    pad_height_ = (this->shape_[srcdim - 2] - cshape[0]) / 2;
-    pad_width_ = (this->shape_[srcdim - 1] - cshape[1]) / 2;
-    src_height_ = this->shape_[srcdim - 2];
-    this->shape_[srcdim - 2] = cshape[0];  // height
-    this->shape_[srcdim - 1] = cshape[1];  // width
+    CHECK_GE(this->shape_[kHeightAxis], cshape[0]) << "CroppingExp: height requirement not met";
+    CHECK_GE(this->shape_[kWidthAxis], cshape[1]) << "CroppingExp: width requirement not met";
+    pad_height_ = (this->shape_[kHeightAxis] - cshape[0]) / 2;
+    pad_width_ = (this->shape_[kWidthAxis] - cshape[1]) / 2;
+    src_height_ = this->shape_[kHeightAxis];
+    src_width_ = this->shape_[kWidthAxis];
+    this->shape_[kHeightAxis] = cshape[0];  // height
+    this->shape_[kWidthAxis] = cshape[1];  // width
   }
   /*! \brief constructor */
   explicit CroppingExp(const SrcExp &src, Shape<2> cshape,
                        index_t start_height, index_t start_width)
       : src_(src), pad_height_(start_height), pad_width_(start_width) {
     this->shape_ = ShapeCheck<srcdim, SrcExp>::Check(src_);
-    CHECK_GE(this->shape_[srcdim - 2], cshape[0] + start_height)
+    CHECK_GE(this->shape_[kHeightAxis], cshape[0] + start_height)
       << "CroppingExp: height requirement not met";
-    CHECK_GE(this->shape_[srcdim - 1], cshape[1] + start_width)
+    CHECK_GE(this->shape_[kWidthAxis], cshape[1] + start_width)
       << "CroppingExp: width requirement not met";
-    src_height_ = this->shape_[srcdim - 2];
-    this->shape_[srcdim - 2] = cshape[0];  // height
-    this->shape_[srcdim - 1] = cshape[1];  // width
+    src_height_ = this->shape_[kHeightAxis];
+    src_width_ = this->shape_[kWidthAxis];
+    this->shape_[kHeightAxis] = cshape[0];  // height
+    this->shape_[kWidthAxis] = cshape[1];  // width
   }
 };  // struct CroppingExp
 /*!
@@ -90,6 +97,38 @@ crop(const Exp<SrcExp, DType, etype> &src, Shape<2> oshape,
   return CroppingExp<SrcExp, DType, ExpInfo<SrcExp>::kDim>
       (src.self(), oshape, start_height, start_width);
 }
+/*!
+ * \brief crop of images in the given layout from the center, e.g. crop<kNHWC>(src, oshape)
+ * \param src original image, shape: (..., height, width, channel) for kNHWC
+ * \param oshape output height and width
+ * \return expression corresponding to cropped result
+ * \tparam layout layout of the image, kNCHW or kNHWC
+ */
+template<int layout, typename SrcExp, typename DType, int etype>
+inline CroppingExp<SrcExp, DType, ExpInfo<SrcExp>::kDim, layout>
+crop(const Exp<SrcExp, DType, etype> &src, Shape<2> oshape) {
+  TypeCheckPass<ExpInfo<SrcExp>::kDim >= LayoutType<layout>::kHeightFromLast>
+      ::Error_Expression_Does_Not_Meet_Dimension_Req();
+  return CroppingExp<SrcExp, DType, ExpInfo<SrcExp>::kDim, layout>(src.self(), oshape);
+}
+/*!
+ * \brief crop of images in the given layout, e.g. crop<kNHWC>(src, oshape, start_height, start_width)
+ * \param src original image, shape: (..., height, width, channel) for kNHWC
+ * \param oshape output height and width
+ * \param start_height start height position to crop
+ * \param start_width start width position to crop
+ * \return expression corresponding to cropped result
+ * \tparam layout layout of the image, kNCHW or kNHWC
+ */
+template<int layout, typename SrcExp, typename DType, int etype>
+inline CroppingExp<SrcExp, DType, ExpInfo<SrcExp>::kDim, layout>
+crop(const Exp<SrcExp, DType, etype> &src, Shape<2> oshape,
+     index_t start_height, index_t start_width) {
+  TypeCheckPass<ExpInfo<SrcExp>::kDim >= LayoutType<layout>::kHeightFromLast>
+      ::Error_Expression_Does_Not_Meet_Dimension_Req();
+  return CroppingExp<SrcExp, DType, ExpInfo<SrcExp>::kDim, layout>
+      (src.self(), oshape, start_height, start_width);
+}
 //----------------------
 // Execution plan
 //----------------------
@@ -114,6 +153,28 @@ struct Plan<CroppingExp<SrcExp, DType, srcdim>, DType> {
   const index_t new_height_;
   const index_t src_height_;
 };
+template<typename SrcExp, typename DType, int srcdim>
+struct Plan<CroppingExp<SrcExp, DType, srcdim, kNHWC>, DType> {
+ public:
+  explicit Plan(const CroppingExp<SrcExp, DType, srcdim, kNHWC> &e)
+      : src_(MakePlan(e.src_)),
+        pad_height_(e.pad_height_), pad_width_(e.pad_width_),
+        new_height_(e.shape_[srcdim - 3]), new_width_(e.shape_[srcdim - 2]),
+        src_height_(e.src_height_), src_width_(e.src_width_) {}
+  MSHADOW_XINLINE DType Eval(index_t i, index_t j) const {
+    const index_t x = i % new_width_;
+    const index_t idivw = i / new_width_;
+    const index_t y = idivw % new_height_;
+    const index_t n = idivw / new_height_;
+    return src_.Eval((n * src_height_ + y + pad_height_) * src_width_ + x + pad_width_, j);
+  }
+
+ private:
+  Plan<SrcExp, DType> src_;
+  const index_t pad_height_, pad_width_;
+  const index_t new_height_, new_width_;
+  const index_t src_height_, src_width_;
+};
 }  // namespace expr
 }  // namespace mshadow
 #endif  // MSHADOW_EXTENSION_CROP_H_
@@ -0,0 +1,303 @@
+/*!
+ *  Copyright (c) 2017 by Contributors
+ * \file csr_tensor.h
+ * \brief sparse matrix in compressed sparse row format, and its
+ *  products with dense matrices and vectors
+ */
+#ifndef MSHADOW_EXTENSION_CSR_TENSOR_H_
+#define MSHADOW_EXTENSION_CSR_TENSOR_H_
+#include <algorithm>
+#include <vector>
+#include "../extension.h"
+
+namespace mshadow {
+/*!
+ * \brief a 2D sparse matrix in compressed sparse row (CSR) format,
+ *  like Tensor it does not own the memory it points to.
+ *  The non-zero entries of row i are data_[indptr_[i] - indptr_[0]], ...,
+ *  data_[indptr_[i + 1] - indptr_[0] - 1], with column indices in indices_.
+ *
+ *  CSRTensor can be an operand of dot:
+ *  dot(csr, dense), dot(csr.T(), dense) and dot(dense, csr.T()),
+ *  where dense is a 2D matrix, or a 1D vector for matrix-vector products
+ * \tparam Device which device the matrix is on, only cpu is implemented
+ * \tparam DType the type of the elements
+ * \tparam IndexType the type of the column indices and row pointers
+ */
+template<typename Device, typename DType, typename IndexType = index_t>
+struct CSRTensor: public expr::RValueExp<CSRTensor<Device, DType, IndexType>, DType> {
+  /*! \brief the non-zero values, of length nnz */
+  DType *data_;
+  /*! \brief column index of each non-zero value, of length nnz */
+  IndexType *indices_;
+  /*! \brief offsets of the rows in data_ and indices_, of length shape_[0] + 1 */
+  IndexType *indptr_;
+  /*! \brief shape of the dense matrix represented */
+  Shape<2> shape_;
+  /*! \brief stream where the computation lies */
+  Stream<Device> *stream_;
+  /*! \brief default constructor */
+  CSRTensor(void) : data_(NULL), indices_(NULL), indptr_(NULL), stream_(NULL) {}
+  /*! \brief constructor from raw pointers and the dense shape */
+  CSRTensor(DType *data, IndexType *indices, IndexType *indptr,
+            const Shape<2> &shape, Stream<Device> *stream = NULL)
+      : data_(data), indices_(indices), indptr_(indptr),
+        shape_(shape), stream_(stream) {}
+  /*! \brief constructor from 1D tensors holding the three arrays */
+  CSRTensor(const Tensor<Device, 1, DType> &data,
+            const Tensor<Device, 1, IndexType> &indices,
+            const Tensor<Device, 1, IndexType> &indptr,
+            const Shape<2> &shape)
+      : data_(data.dptr_), indices_(indices.dptr_), indptr_(indptr.dptr_),
+        shape_(shape), stream_(data.stream_) {
+    CHECK_EQ(data.size(0), indices.size(0)) << "CSRTensor: data and indices size mismatch";
+    CHECK_EQ(indptr.size(0), shape[0] + 1) << "CSRTensor: indptr must have nrow + 1 entries";
+  }
+  /*! \brief number of rows or columns */
+  MSHADOW_XINLINE index_t size(int idx) const {
+    return shape_[idx];
+  }
+  /*! \brief number of stored entries, only valid when indptr_ is on cpu */
+  inline index_t nnz(void) const {
+    return static_cast<index_t>(indptr_[shape_[0]] - indptr_[0]);
+  }
+  /*! \brief set the stream */
+  inline void set_stream(Stream<Device> *stream) {
+    this->stream_ = stream;
+  }
+};
+
+namespace expr {
+/*! \brief products of CSRTensor<cpu> with dense matrices, parallel over rows */
+struct CSRDotCPU {
+  /*!
+   * \brief split the rows of csr into nblock ranges of about equal cost,
+   *  the cost of a row being its number of non-zeros plus one
+   */
+  template<typename DType, typename IndexType>
+  inline static void Partition(const CSRTensor<cpu, DType, IndexType> &csr,
+                               index_t nblock, std::vector<index_t> *bounds) {
+    const index_t nrow = csr.size(0);
+    const IndexType *indptr = csr.indptr_;
+    const double total = static_cast<double>(csr.nnz() + nrow);
+    bounds->resize(nblock + 1);
+    (*bounds)[0] = 0;
+    for (index_t b = 1; b < nblock; ++b) {
+      const double target = total * b / nblock;
+      // smallest row i with cost(i) = indptr[i] - indptr[0] + i >= target
+      index_t lo = (*bounds)[b - 1], hi = nrow;
+      while (lo < hi) {
+        const index_t mid = lo + (hi - lo) / 2;
+        if (static_cast<double>(indptr[mid] - indptr[0] + mid) < target) {
+          lo = mid + 1;
+        } else {
+          hi = mid;
+        }
+      }
+      (*bounds)[b] = lo;
+    }
+    (*bounds)[nblock] = nrow;
+  }
+  /*! \brief number of row ranges to give each thread a few to balance over */
+  inline static index_t NumBlock(index_t nrow) {
+    const index_t nthread = static_cast<index_t>(GetOMPMaxThreads());
+    return std::max(std::min(nrow, 4 * nthread), static_cast<index_t>(1));
+  }
+  /*! \brief dst (SV)= scale * dot(csr, rhs) */
+  template<typename SV, typename DType, typename IndexType>
+  inline static void Dot(Tensor<cpu, 2, DType> dst,
+                         const CSRTensor<cpu, DType, IndexType> &csr,
+                         const Tensor<cpu, 2, DType> &rhs, DType scale) {
+    CHECK(dst.size(0) == csr.size(0) && csr.size(1) == rhs.size(0) &&
+          dst.size(1) == rhs.size(1)) << "dot-csr: matrix shape mismatch";
+    const index_t n = dst.size(1);
+    const index_t nblock = NumBlock(csr.size(0));
+    std::vector<index_t> bounds;
+    Partition(csr, nblock, &bounds);
+    const IndexType base = csr.indptr_[0];
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (openmp_index_t b = 0; b < nblock; ++b) {
+      std::vector<DType> acc(n);
+      for (index_t i = bounds[b]; i < bounds[b + 1]; ++i) {
+        std::fill(acc.begin(), acc.end(), DType(0));
+        for (IndexType z = csr.indptr_[i] - base; z < csr.indptr_[i + 1] - base; ++z) {
+          const DType v = csr.data_[z];
+          const DType *brow = rhs.dptr_ + static_cast<index_t>(csr.indices_[z]) * rhs.stride_;
+          for (index_t j = 0; j < n; ++j) {
+            acc[j] += v * brow[j];
+          }
+        }
+        DType *drow = dst.dptr_ + i * dst.stride_;
+        for (index_t j = 0; j < n; ++j) {
+          SV::Save(drow[j], scale * acc[j]);
+        }
+      }
+    }
+  }
+  /*!
+   * \brief dst (SV)= scale * dot(csr.T(), rhs), rows of rhs are scattered
+   *  into dst, so the threads split the columns of dst instead of the rows;
+   *  when there are fewer column blocks than threads (e.g. a matrix-vector
+   *  product) the rows are split as well, each row block past the first
+   *  scattering into its own accumulator, and the accumulators are added
+   *  to dst in order. Only sv::saveto, sv::plusto and sv::minusto are supported
+   */
+  template<typename SV, typename DType, typename IndexType>
+  inline static void DotTransposed(Tensor<cpu, 2, DType> dst,
+                                   const CSRTensor<cpu, DType, IndexType> &csr,
+                                   const Tensor<cpu, 2, DType> &rhs, DType scale) {
+    CHECK(dst.size(0) == csr.size(1) && csr.size(0) == rhs.size(0) &&
+          dst.size(1) == rhs.size(1)) << "dot-csr: matrix shape mismatch";
+    const index_t nrow = dst.size(0), n = dst.size(1);
+    const DType alpha = DType(SV::AlphaBLAS()) * scale;
+    if (SV::BetaBLAS() == 0.0f) {
+      #pragma omp parallel for
+      for (openmp_index_t i = 0; i < nrow; ++i) {
+        std::fill(dst.dptr_ + i * dst.stride_, dst.dptr_ + i * dst.stride_ + n, DType(0));
+      }
+    }
+    // column blocks of at least 16 elements, so threads do not share cache lines
+    const index_t kMinCol = 16;
+    const index_t nthread = static_cast<index_t>(GetOMPMaxThreads());
+    const index_t ncolblock = std::max(std::min(nthread, n / kMinCol), static_cast<index_t>(1));
+    const index_t nrowblock = std::max(std::min(nthread / ncolblock, csr.size(0)),
+                                       static_cast<index_t>(1));
+    std::vector<index_t> bounds;
+    Partition(csr, nrowblock, &bounds);
+    std::vector<DType> part((nrowblock - 1) * nrow * n, DType(0));
+    const IndexType base = csr.indptr_[0];
+    #pragma omp parallel for num_threads(nrowblock * ncolblock)
+    for (openmp_index_t t = 0; t < nrowblock * ncolblock; ++t) {
+      const index_t rb = t / ncolblock, cb = t % ncolblock;
+      const index_t jbegin = n * cb / ncolblock, jend = n * (cb + 1) / ncolblock;
+      DType *out = rb == 0 ? dst.dptr_ : &part[(rb - 1) * nrow * n];
+      const index_t ldo = rb == 0 ? dst.stride_ : n;
+      for (index_t i = bounds[rb]; i < bounds[rb + 1]; ++i) {
+        const DType *brow = rhs.dptr_ + i * rhs.stride_;
+        for (IndexType z = csr.indptr_[i] - base; z < csr.indptr_[i + 1] - base; ++z) {
+          const DType v = alpha * csr.data_[z];
+          DType *orow = out + static_cast<index_t>(csr.indices_[z]) * ldo;
+          for (index_t j = jbegin; j < jend; ++j) {
+            orow[j] += v * brow[j];
+          }
+        }
+      }
+    }
+    if (nrowblock > 1) {
+      #pragma omp parallel for
+      for (openmp_index_t i = 0; i < nrow; ++i) {
+        DType *drow = dst.dptr_ + i * dst.stride_;
+        for (index_t rb = 1; rb < nrowblock; ++rb) {
+          const DType *prow = &part[((rb - 1) * nrow + i) * n];
+          for (index_t j = 0; j < n; ++j) {
+            drow[j] += prow[j];
+          }
+        }
+      }
+    }
+  }
+  /*! \brief dst (SV)= scale * dot(lhs, csr.T()) */
+  template<typename SV, typename DType, typename IndexType>
+  inline static void DotDense(Tensor<cpu, 2, DType> dst,
+                              const Tensor<cpu, 2, DType> &lhs,
+                              const CSRTensor<cpu, DType, IndexType> &csr, DType scale) {
+    CHECK(dst.size(0) == lhs.size(0) && lhs.size(1) == csr.size(1) &&
+          dst.size(1) == csr.size(0)) << "dot-csr: matrix shape mismatch";
+    const index_t m = dst.size(0);
+    const index_t nblock = NumBlock(csr.size(0));
+    std::vector<index_t> bounds;
+    Partition(csr, nblock, &bounds);
+    const IndexType base = csr.indptr_[0];
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (openmp_index_t b = 0; b < nblock; ++b) {
+      // each block of sparse rows stays in cache while the dense rows pass by
+      for (index_t i = 0; i < m; ++i) {
+        const DType *arow = lhs.dptr_ + i * lhs.stride_;
+        DType *drow = dst.dptr_ + i * dst.stride_;
+        for (index_t j = bounds[b]; j < bounds[b + 1]; ++j) {
+          DType sum = DType(0);
+          for (IndexType z = csr.indptr_[j] - base; z < csr.indptr_[j + 1] - base; ++z) {
+            sum += arow[csr.indices_[z]] * csr.data_[z];
+          }
+          SV::Save(drow[j], scale * sum);
+        }
+      }
+    }
+  }
+  /*! \brief view a vector as a matrix with a single column */
+  template<typename DType>
+  inline static Tensor<cpu, 2, DType> Column(const Tensor<cpu, 1, DType> &vec) {
+    return Tensor<cpu, 2, DType>(vec.dptr_, Shape2(vec.size(0), 1), 1, vec.stream_);
+  }
+};
+
+template<typename SV, typename DType, typename IndexType, bool ltrans>
+struct ExpComplexEngine<SV,
+                        Tensor<cpu, 2, DType>,
+                        DotExp<CSRTensor<cpu, DType, IndexType>,
+                               Tensor<cpu, 2, DType>,
+                               ltrans, false, DType>,
+                        DType> {
+  inline static void Eval(Tensor<cpu, 2, DType> *dst,
+                          const DotExp<CSRTensor<cpu, DType, IndexType>,
+                                       Tensor<cpu, 2, DType>,
+                                       ltrans, false, DType> &exp) {
+    if (ltrans) {
+      CSRDotCPU::DotTransposed<SV>(*dst, exp.lhs_, exp.rhs_, exp.scale_);
+    } else {
+      CSRDotCPU::Dot<SV>(*dst, exp.lhs_, exp.rhs_, exp.scale_);
+    }
+  }
+};
+template<typename SV, typename DType, typename IndexType, bool ltrans>
+struct ExpComplexEngine<SV,
+                        Tensor<cpu, 1, DType>,
+                        DotExp<CSRTensor<cpu, DType, IndexType>,
+                               Tensor<cpu, 1, DType>,
+                               ltrans, false, DType>,
+                        DType> {
+  inline static void Eval(Tensor<cpu, 1, DType> *dst,
+                          const DotExp<CSRTensor<cpu, DType, IndexType>,
+                                       Tensor<cpu, 1, DType>,
+                                       ltrans, false, DType> &exp) {
+    if (ltrans) {
+      CSRDotCPU::DotTransposed<SV>(CSRDotCPU::Column(*dst), exp.lhs_,
+                                   CSRDotCPU::Column(exp.rhs_), exp.scale_);
+    } else {
+      CSRDotCPU::Dot<SV>(CSRDotCPU::Column(*dst), exp.lhs_,
+                         CSRDotCPU::Column(exp.rhs_), exp.scale_);
+    }
+  }
+};
+template<typename SV, typename DType, typename IndexType>
+struct ExpComplexEngine<SV,
+                        Tensor<cpu, 2, DType>,
+                        DotExp<Tensor<cpu, 2, DType>,
+                               CSRTensor<cpu, DType, IndexType>,
+                               false, true, DType>,
+                        DType> {
+  inline static void Eval(Tensor<cpu, 2, DType> *dst,
+                          const DotExp<Tensor<cpu, 2, DType>,
+                                       CSRTensor<cpu, DType, IndexType>,
+                                       false, true, DType> &exp) {
+    CSRDotCPU::DotDense<SV>(*dst, exp.lhs_, exp.rhs_, exp.scale_);
+  }
+};
+template<typename SV, typename DType, typename IndexType>
+struct ExpComplexEngine<SV,
+                        Tensor<cpu, 1, DType>,
+                        DotExp<Tensor<cpu, 1, DType>,
+                               CSRTensor<cpu, DType, IndexType>,
+                               false, true, DType>,
+                        DType> {
+  inline static void Eval(Tensor<cpu, 1, DType> *dst,
+                          const DotExp<Tensor<cpu, 1, DType>,
+                                       CSRTensor<cpu, DType, IndexType>,
+                                       false, true, DType> &exp) {
+    CSRDotCPU::DotDense<SV>(dst->FlatTo2D(), exp.lhs_.FlatTo2D(),
+                            exp.rhs_, exp.scale_);
+  }
+};
+}  // namespace expr
+}  // namespace mshadow
+#endif  // MSHADOW_EXTENSION_CSR_TENSOR_H_
@@ -7,6 +7,7 @@
 #ifndef MSHADOW_EXTENSION_PACK_COL2PATCH_H_
 #define MSHADOW_EXTENSION_PACK_COL2PATCH_H_
 #include <algorithm>
+#include <vector>
 #include "../extension.h"
 namespace mshadow {
 namespace expr {
@@ -17,11 +18,16 @@ namespace expr {
  * \tparam SrcExp source expression
  * \tparam DType the type of elements
  * \tparam dstdim destination dimension
+ * \tparam layout layout of the image, kNCHW or kNHWC
  */
-template<typename SrcExp, typename DType, int dstdim>
+template<typename SrcExp, typename DType, int dstdim, int layout = kNCHW>
 struct PackColToPatchXExp:
-      public MakeTensorExp<PackColToPatchXExp<SrcExp, DType, dstdim>,
+      public MakeTensorExp<PackColToPatchXExp<SrcExp, DType, dstdim, layout>,
                            SrcExp, dstdim, DType> {
+  /*! \brief channel, height and width axes */
+  static const int kChannelAxis = dstdim - LayoutType<layout>::kChannelFromLast;
+  static const int kHeightAxis = dstdim - LayoutType<layout>::kHeightFromLast;
+  static const int kWidthAxis = dstdim - LayoutType<layout>::kWidthFromLast;
   /*! \brief source operand */
   const SrcExp &src_;
   /*! \brief patch height */
@@ -43,14 +49,14 @@ struct PackColToPatchXExp:
        pstride_y_(pstride_y), pstride_x_(pstride_x),
        pdilate_y_(pdilate_y), pdilate_x_(pdilate_x){
     this->shape_ = imshape;
-    const index_t o_height = (imshape[dstdim - 2] -
+    const index_t o_height = (imshape[kHeightAxis] -
         (pdilate_y * (psize_y - 1)+ 1))/pstride_y + 1;
-    const index_t o_width  = (imshape[dstdim - 1] -
+    const index_t o_width  = (imshape[kWidthAxis] -
         (pdilate_x * (psize_x - 1) + 1)) / pstride_x + 1;
     Shape<2> sshape = ShapeCheck<2, SrcExp>::Check(src_);
     CHECK_EQ(sshape[1], o_height * o_width * imshape.ProdShape(0, dstdim - 3))
       << "PackColToPatchExp: src.size(1) mismatch";
-    CHECK_EQ(sshape[0], psize_y * psize_x * imshape[dstdim - 3])
+    CHECK_EQ(sshape[0], psize_y * psize_x * imshape[kChannelAxis])
       << "PackColToPatchExp: src.size(0) mismatch";
   }
 };
@@ -98,6 +104,30 @@ pack_col2patch(const expr::Exp<SrcExp, DType, etype> &src,
                                                    pdilate_y, pdilate_x);
 }
 
+/*!
+ * \brief pack_col2patch of images in the given layout, reverse operation of
+ *  unpack_patch2col<layout>, e.g. pack_col2patch<kNHWC>(mat, imshape, ...)
+ * \param src source matrix
+ * \param imshape shape of target img, (batch, height, width, channel) for kNHWC
+ * \return packed img expression
+ * \tparam layout layout of the image, kNCHW or kNHWC
+ */
+template<int layout, typename SrcExp, typename DType, int dstdim, int etype>
+inline PackColToPatchXExp<SrcExp, DType, dstdim, layout>
+pack_col2patch(const expr::Exp<SrcExp, DType, etype> &src,
+               Shape<dstdim> imshape, index_t psize_y,
+               index_t psize_x, index_t pstride_y, index_t pstride_x,
+               index_t pdilate_y, index_t pdilate_x) {
+  TypeCheckPass<ExpInfo<SrcExp>::kDim == 2>
+      ::Error_Expression_Does_Not_Meet_Dimension_Req();
+  CHECK(imshape[dstdim - LayoutType<layout>::kWidthFromLast] >= psize_x &&
+        imshape[dstdim - LayoutType<layout>::kHeightFromLast] >= psize_y)
+    << "PackColToPatch:image shape smaller than patch size";
+  return PackColToPatchXExp<SrcExp, DType, dstdim, layout>(src.self(), imshape,
+                                                           psize_y, psize_x, pstride_y, pstride_x,
+                                                           pdilate_y, pdilate_x);
+}
+
 //----------------------
 // Execution plan
 //----------------------
@@ -116,28 +146,23 @@ struct Plan<PackColToPatchXExp<SrcExp, DType, dstdim>, DType> {
     // note: i/o convention are same as unpack
   }
   MSHADOW_XINLINE DType Eval(index_t i, index_t j) const {
-    using namespace std;
     const index_t y = i % i_height_;
     const index_t idivh = i / i_height_;
     const index_t c = idivh % i_channel_;
     const index_t n = idivh / i_channel_;
     const index_t x = j;
-
-    const index_t psize_y_dilate = (pdilate_y_ * (psize_y_ - 1) + 1);
-    const index_t psize_x_dilate = (pdilate_x_ * (psize_x_ - 1) + 1);
-
-    const index_t py_min =
-        y < psize_y_dilate ? y % pdilate_y_ : (y-psize_y_dilate + pstride_y_) / pstride_y_;
-    const index_t px_min =
-        x < psize_x_dilate ? x % pdilate_x_ : (x-psize_x_dilate + pstride_x_) / pstride_x_;
-    const index_t py_max = min((y + pstride_y_) / pstride_y_, o_height_);
-    const index_t px_max = min((x + pstride_x_) / pstride_x_, o_width_);
+    // every patch offset (ky, kx) that lands on (y, x) from a patch in range
     DType res = static_cast<DType>(0);
-    for (index_t py = py_min; py < py_max; py += pdilate_y_) {
-      for (index_t px = px_min; px < px_max; px += pdilate_x_) {
-        res += src_.Eval(((c * psize_y_ + (y - py*pstride_y_) / pdilate_y_) * psize_x_ +
-                         (x - px * pstride_x_) / pdilate_x_),
-                         (n * o_height_ + py) * o_width_ + px);
+    for (index_t ky = 0; ky < psize_y_; ++ky) {
+      const index_t ry = y - ky * pdilate_y_;
+      if (ry < 0) break;
+      if (ry % pstride_y_ != 0 || ry / pstride_y_ >= o_height_) continue;
+      for (index_t kx = 0; kx < psize_x_; ++kx) {
+        const index_t rx = x - kx * pdilate_x_;
+        if (rx < 0) break;
+        if (rx % pstride_x_ != 0 || rx / pstride_x_ >= o_width_) continue;
+        res += src_.Eval((c * psize_y_ + ky) * psize_x_ + kx,
+                         (n * o_height_ + ry / pstride_y_) * o_width_ + rx / pstride_x_);
       }
     }
     return res;
@@ -149,6 +174,103 @@ struct Plan<PackColToPatchXExp<SrcExp, DType, dstdim>, DType> {
   const index_t pdilate_y_, pdilate_x_;
   const index_t i_height_, o_height_, o_width_;
 };
+template<typename SrcExp, typename DType, int dstdim>
+struct Plan<PackColToPatchXExp<SrcExp, DType, dstdim, kNHWC>, DType> {
+ public:
+  explicit Plan(const PackColToPatchXExp<SrcExp, DType, dstdim, kNHWC> &e)
+      :src_(MakePlan(e.src_)), psize_y_(e.psize_y_),
+       psize_x_(e.psize_x_), pstride_y_(e.pstride_y_), pstride_x_(e.pstride_x_),
+       i_channel_(e.shape_[dstdim - 1]), pdilate_y_(e.pdilate_y_), pdilate_x_(e.pdilate_x_),
+       i_height_(e.shape_[dstdim - 3]), i_width_(e.shape_[dstdim - 2]),
+       o_height_((i_height_ - (pdilate_y_ * (psize_y_ - 1) + 1)) / pstride_y_ + 1),
+       o_width_((i_width_ - (pdilate_x_ * (psize_x_ - 1) + 1)) / pstride_x_ + 1) {}
+  MSHADOW_XINLINE DType Eval(index_t i, index_t j) const {
+    const index_t x = i % i_width_;
+    const index_t idivw = i / i_width_;
+    const index_t y = idivw % i_height_;
+    const index_t n = idivw / i_height_;
+    const index_t c = j;
+    // every patch offset (ky, kx) that lands on (y, x) from a patch in range
+    DType res = static_cast<DType>(0);
+    for (index_t ky = 0; ky < psize_y_; ++ky) {
+      const index_t ry = y - ky * pdilate_y_;
+      if (ry < 0) break;
+      if (ry % pstride_y_ != 0 || ry / pstride_y_ >= o_height_) continue;
+      for (index_t kx = 0; kx < psize_x_; ++kx) {
+        const index_t rx = x - kx * pdilate_x_;
+        if (rx < 0) break;
+        if (rx % pstride_x_ != 0 || rx / pstride_x_ >= o_width_) continue;
+        res += src_.Eval((ky * psize_x_ + kx) * i_channel_ + c,
+                         (n * o_height_ + ry / pstride_y_) * o_width_ + rx / pstride_x_);
+      }
+    }
+    return res;
+  }
+
+ private:
+  Plan<SrcExp, DType> src_;
+  const index_t psize_y_, psize_x_, pstride_y_, pstride_x_, i_channel_;
+  const index_t pdilate_y_, pdilate_x_;
+  const index_t i_height_, i_width_, o_height_, o_width_;
+};
+/*!
+ * \brief col2im by scatter: each image plane walks its rows of the column
+ *  matrix once and accumulates them into the plane, planes run in parallel
+ */
+template<typename SrcExp, typename DType, int dstdim>
+struct PackColToPatchScatter {
+  template<typename SV>
+  inline static void Eval(Tensor<cpu, dstdim, DType> *dst,
+                          const PackColToPatchXExp<SrcExp, DType, dstdim> &e) {
+    Plan<SrcExp, DType> src = MakePlan(e.src_);
+    const index_t i_channel = e.shape_[dstdim - 3];
+    const index_t i_height = e.shape_[dstdim - 2], i_width = e.shape_[dstdim - 1];
+    const index_t o_height = (i_height - (e.pdilate_y_ * (e.psize_y_ - 1) + 1)) /
+        e.pstride_y_ + 1;
+    const index_t o_width = (i_width - (e.pdilate_x_ * (e.psize_x_ - 1) + 1)) /
+        e.pstride_x_ + 1;
+    const index_t nplane = e.shape_.ProdShape(0, dstdim - 2);
+    Tensor<cpu, 2, DType> out = dst->FlatTo2D();
+    #pragma omp parallel for
+    for (openmp_index_t p = 0; p < nplane; ++p) {
+      const index_t c = p % i_channel, n = p / i_channel;
+      std::vector<DType> buf(i_height * i_width, DType(0.0f));
+      for (index_t ky = 0; ky < e.psize_y_; ++ky) {
+        for (index_t kx = 0; kx < e.psize_x_; ++kx) {
+          const index_t row = (c * e.psize_y_ + ky) * e.psize_x_ + kx;
+          for (index_t oy = 0; oy < o_height; ++oy) {
+            DType *brow = &buf[(oy * e.pstride_y_ + ky * e.pdilate_y_) * i_width +
+                               kx * e.pdilate_x_];
+            const index_t col = (n * o_height + oy) * o_width;
+            for (index_t ox = 0; ox < o_width; ++ox) {
+              brow[ox * e.pstride_x_] += src.Eval(row, col + ox);
+            }
+          }
+        }
+      }
+      for (index_t y = 0; y < i_height; ++y) {
+        DType *orow = out.dptr_ + (p * i_height + y) * out.stride_;
+        for (index_t x = 0; x < i_width; ++x) {
+          SV::template Save<DType>(orow[x], buf[y * i_width + x]);
+        }
+      }
+    }
+  }
+};
 }  // namespace expr
+/*! \brief tensor = pack_col2patch(...) on CPU is computed by scatter */
+template<typename SV, int dim, typename DType, typename SrcExp>
+struct MapExpCPUEngine<false, SV, Tensor<cpu, dim, DType>, dim, DType,
+                       expr::MakeTensorExp<expr::PackColToPatchXExp<SrcExp, DType, dim>,
+                                           SrcExp, dim, DType>,
+                       expr::type::kChainer> {
+  inline static void Map(Tensor<cpu, dim, DType> *dst,
+                         const expr::Exp<expr::MakeTensorExp<
+                           expr::PackColToPatchXExp<SrcExp, DType, dim>, SrcExp, dim, DType>,
+                                         DType, expr::type::kChainer> &exp) {
+    expr::PackColToPatchScatter<SrcExp, DType, dim>
+        ::template Eval<SV>(dst, exp.self().real_self());
+  }
+};
 }  // namespace mshadow
 #endif  // MSHADOW_EXTENSION_PACK_COL2PATCH_H_
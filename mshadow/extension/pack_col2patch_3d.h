@@ -0,0 +1,135 @@
+/*!
+ *  Copyright (c) 2017 by Contributors
+ * \file pack_col2patch_3d.h
+ * \brief support for packing volumetric patches, reverse of unpack_patch2col_3d
+ */
+#ifndef MSHADOW_EXTENSION_PACK_COL2PATCH_3D_H_
+#define MSHADOW_EXTENSION_PACK_COL2PATCH_3D_H_
+#include "../extension.h"
+namespace mshadow {
+namespace expr {
+/*!
+ * \brief reverse operation of UnpackPatchToColXExp3D,
+ *    used to backprop gradient back to a batch of volumes in kNCDHW layout
+ * \tparam SrcExp source expression
+ * \tparam DType the type of elements
+ * \tparam dstdim destination dimension
+ */
+template<typename SrcExp, typename DType, int dstdim>
+struct PackColToPatchXExp3D:
+      public MakeTensorExp<PackColToPatchXExp3D<SrcExp, DType, dstdim>,
+                           SrcExp, dstdim, DType> {
+  /*! \brief channel and depth axes, height and width follow depth */
+  static const int kChannelAxis = dstdim - LayoutType<kNCDHW>::kChannelFromLast;
+  static const int kDepthAxis = dstdim - LayoutType<kNCDHW>::kDepthFromLast;
+  /*! \brief source operand */
+  const SrcExp &src_;
+  /*! \brief patch size in depth, height and width */
+  Shape<3> psize_;
+  /*! \brief patch stride */
+  Shape<3> pstride_;
+  /*! \brief patch dilate */
+  Shape<3> pdilate_;
+  /*! \brief zero padding on both sides */
+  Shape<3> ppad_;
+  /*! \brief depth, height and width of the unpacked output */
+  Shape<3> oshape_;
+  /*! \brief constructor */
+  PackColToPatchXExp3D(const SrcExp &src, Shape<dstdim> imshape,
+                       Shape<3> psize, Shape<3> pstride,
+                       Shape<3> pdilate, Shape<3> ppad)
+      : src_(src), psize_(psize), pstride_(pstride), pdilate_(pdilate), ppad_(ppad) {
+    this->shape_ = imshape;
+    for (int k = 0; k < 3; ++k) {
+      const index_t extent = pdilate[k] * (psize[k] - 1) + 1;
+      CHECK(imshape[kDepthAxis + k] + 2 * ppad[k] >= extent)
+        << "PackColToPatch3D: padded volume smaller than patch size";
+      oshape_[k] = (imshape[kDepthAxis + k] + 2 * ppad[k] - extent) / pstride[k] + 1;
+    }
+    Shape<2> sshape = ShapeCheck<2, SrcExp>::Check(src_);
+    CHECK_EQ(sshape[1], oshape_.Size() * imshape.ProdShape(0, kChannelAxis))
+      << "PackColToPatch3D: src.size(1) mismatch";
+    CHECK_EQ(sshape[0], psize.Size() * imshape[kChannelAxis])
+      << "PackColToPatch3D: src.size(0) mismatch";
+  }
+};
+/*!
+ * \brief reverse operation of unpack_patch2col_3d, can be used to implement
+ *  3-D deconvolution, every column entry is added back to the voxel it was
+ *  unpacked from, entries from the padding are dropped
+ * \param mat source matrix
+ * \param imshape shape of target volume
+ * \param psize patch size in depth, height and width
+ * \param pstride stride of each patch
+ * \param pdilate dilate of each patch
+ * \param ppad zero padding of each side
+ * \return packed volume expression
+ * \tparam SrcExp source expression
+ * \tparam DType the type of elements
+ * \tparam dstdim destination dimension
+ * \tparam etype type of expression
+ */
+template<typename SrcExp, typename DType, int dstdim, int etype>
+inline PackColToPatchXExp3D<SrcExp, DType, dstdim>
+pack_col2patch_3d(const Exp<SrcExp, DType, etype> &mat, Shape<dstdim> imshape,
+                  Shape<3> psize, Shape<3> pstride,
+                  Shape<3> pdilate = Shape3(1, 1, 1), Shape<3> ppad = Shape3(0, 0, 0)) {
+  TypeCheckPass<ExpInfo<SrcExp>::kDim == 2>
+      ::Error_Expression_Does_Not_Meet_Dimension_Req();
+  TypeCheckPass<dstdim >= 4>
+      ::Error_Expression_Does_Not_Meet_Dimension_Req();
+  return PackColToPatchXExp3D<SrcExp, DType, dstdim>
+      (mat.self(), imshape, psize, pstride, pdilate, ppad);
+}
+//----------------------
+// Execution plan
+//----------------------
+template<typename SrcExp, typename DType, int dstdim>
+struct Plan<PackColToPatchXExp3D<SrcExp, DType, dstdim>, DType> {
+ public:
+  explicit Plan(const PackColToPatchXExp3D<SrcExp, DType, dstdim> &e)
+      : src_(MakePlan(e.src_)),
+        psize_(e.psize_), pstride_(e.pstride_), pdilate_(e.pdilate_), ppad_(e.ppad_),
+        oshape_(e.oshape_), i_channel_(e.shape_[dstdim - 4]),
+        i_depth_(e.shape_[dstdim - 3]), i_height_(e.shape_[dstdim - 2]) {}
+  MSHADOW_XINLINE DType Eval(index_t i, index_t j) const {
+    const index_t y = i % i_height_;
+    const index_t idivh = i / i_height_;
+    const index_t z = idivh % i_depth_;
+    const index_t idivd = idivh / i_depth_;
+    const index_t c = idivd % i_channel_;
+    const index_t n = idivd / i_channel_;
+
+    // the patch at output p covers the voxel with tap k when
+    // p * stride - pad + k * dilate hits it
+    DType res = static_cast<DType>(0);
+    for (index_t kz = 0; kz < psize_[0]; ++kz) {
+      const index_t nz = z + ppad_[0] - kz * pdilate_[0];
+      if (nz < 0) break;
+      if (nz % pstride_[0] != 0 || nz / pstride_[0] >= oshape_[0]) continue;
+      for (index_t ky = 0; ky < psize_[1]; ++ky) {
+        const index_t ny = y + ppad_[1] - ky * pdilate_[1];
+        if (ny < 0) break;
+        if (ny % pstride_[1] != 0 || ny / pstride_[1] >= oshape_[1]) continue;
+        const index_t row = ((c * psize_[0] + kz) * psize_[1] + ky) * psize_[2];
+        const index_t col = ((n * oshape_[0] + nz / pstride_[0]) * oshape_[1]
+                             + ny / pstride_[1]) * oshape_[2];
+        for (index_t kx = 0; kx < psize_[2]; ++kx) {
+          const index_t nx = j + ppad_[2] - kx * pdilate_[2];
+          if (nx < 0) break;
+          if (nx % pstride_[2] != 0 || nx / pstride_[2] >= oshape_[2]) continue;
+          res += src_.Eval(row + kx, col + nx / pstride_[2]);
+        }
+      }
+    }
+    return res;
+  }
+
+ private:
+  Plan<SrcExp, DType> src_;
+  const Shape<3> psize_, pstride_, pdilate_, ppad_, oshape_;
+  const index_t i_channel_, i_depth_, i_height_;
+};
+}  // namespace expr
+}  // namespace mshadow
+#endif  // MSHADOW_EXTENSION_PACK_COL2PATCH_3D_H_
@@ -15,10 +15,13 @@ namespace expr {
  * \tparam DType the type of elements
  * \tparam srcdim dimension of src
  */
-template<typename SrcExp, typename DType, int srcdim>
+template<typename SrcExp, typename DType, int srcdim, int layout = kNCHW>
 struct PaddingExp:
-      public MakeTensorExp<PaddingExp<SrcExp, DType, srcdim>,
+      public MakeTensorExp<PaddingExp<SrcExp, DType, srcdim, layout>,
                            SrcExp, srcdim, DType> {
+  /*! \brief height and width axes */
+  static const int kHeightAxis = srcdim - LayoutType<layout>::kHeightFromLast;
+  static const int kWidthAxis = srcdim - LayoutType<layout>::kWidthFromLast;
   /*! \brief source operand */
   const SrcExp &src_;
   /*! \brief pad size in y */
@@ -33,10 +36,10 @@ struct PaddingExp:
   PaddingExp(const SrcExp &src, index_t pad_y, index_t pad_x)
       : src_(src), pad_y_(pad_y), pad_x_(pad_x) {
     this->shape_ = ShapeCheck<srcdim, SrcExp>::Check(src_);
-    src_height_ = this->shape_[srcdim - 2];
-    src_width_  = this->shape_[srcdim - 1];
-    this->shape_[srcdim - 2] += pad_y * 2;  // height
-    this->shape_[srcdim - 1] += pad_x * 2;  // width
+    src_height_ = this->shape_[kHeightAxis];
+    src_width_  = this->shape_[kWidthAxis];
+    this->shape_[kHeightAxis] += pad_y * 2;  // height
+    this->shape_[kWidthAxis] += pad_x * 2;  // width
   }
 };
 /*!
@@ -73,6 +76,29 @@ pad(const Exp<SrcExp, DType, etype> &src, index_t pad_y, index_t pad_x) {
   return PaddingExp<SrcExp, DType, ExpInfo<SrcExp>::kDim>
       (src.self(), pad_y, pad_x);
 }
+/*!
+ * \brief padding of images in the given layout, e.g. pad<kNHWC>(src, pad)
+ * \param src original image, shape: (..., height, width, channel) for kNHWC
+ * \param pad padding size
+ * \return expression corresponding to padded result
+ * \tparam layout layout of the image, kNCHW or kNHWC
+ */
+template<int layout, typename SrcExp, typename DType, int etype>
+inline PaddingExp<SrcExp, DType, ExpInfo<SrcExp>::kDim, layout>
+pad(const Exp<SrcExp, DType, etype> &src, index_t pad) {
+  TypeCheckPass<ExpInfo<SrcExp>::kDim >= LayoutType<layout>::kHeightFromLast>
+      ::Error_Expression_Does_Not_Meet_Dimension_Req();
+  return PaddingExp<SrcExp, DType, ExpInfo<SrcExp>::kDim, layout>(src.self(), pad, pad);
+}
+/*! \brief same as pad<layout>, with different padding in y and x */
+template<int layout, typename SrcExp, typename DType, int etype>
+inline PaddingExp<SrcExp, DType, ExpInfo<SrcExp>::kDim, layout>
+pad(const Exp<SrcExp, DType, etype> &src, index_t pad_y, index_t pad_x) {
+  TypeCheckPass<ExpInfo<SrcExp>::kDim >= LayoutType<layout>::kHeightFromLast>
+      ::Error_Expression_Does_Not_Meet_Dimension_Req();
+  return PaddingExp<SrcExp, DType, ExpInfo<SrcExp>::kDim, layout>
+      (src.self(), pad_y, pad_x);
+}
 //----------------------
 // Execution plan
 //----------------------
@@ -106,6 +132,35 @@ struct Plan<PaddingExp<SrcExp, DType, srcdim>, DType> {
   const index_t src_height_;
   const index_t src_width_;
 };
+template<typename SrcExp, typename DType, int srcdim>
+struct Plan<PaddingExp<SrcExp, DType, srcdim, kNHWC>, DType> {
+ public:
+  explicit Plan(const PaddingExp<SrcExp, DType, srcdim, kNHWC> &e)
+      : src_(MakePlan(e.src_)),
+        pad_y_(e.pad_y_), pad_x_(e.pad_x_),
+        new_height_(e.shape_[srcdim - 3]), new_width_(e.shape_[srcdim - 2]),
+        src_height_(e.src_height_), src_width_(e.src_width_) {}
+  MSHADOW_XINLINE DType Eval(index_t i, index_t j) const {
+    const index_t x = i % new_width_;
+    const index_t idivw = i / new_width_;
+    const index_t y = idivw % new_height_;
+    const index_t n = idivw / new_height_;
+    if (y < pad_y_ || x < pad_x_) return static_cast<DType>(0);
+    const index_t h = y - pad_y_;
+    const index_t w = x - pad_x_;
+    if (h < src_height_ && w < src_width_) {
+      return src_.Eval((n * src_height_ + h) * src_width_ + w, j);
+    } else {
+      return static_cast<DType>(0);
+    }
+  }
+
+ private:
+  Plan<SrcExp, DType> src_;
+  const index_t pad_y_, pad_x_;
+  const index_t new_height_, new_width_;
+  const index_t src_height_, src_width_;
+};
 }  // namespace expr
 }  // namespace mshadow
 #endif  // MSHADOW_EXTENSION_PAD_H_
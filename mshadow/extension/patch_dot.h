@@ -0,0 +1,196 @@
+/*!
+ *  Copyright (c) 2017 by Contributors
+ * \file patch_dot.h
+ * \brief convolution as dot(weight, unpack_patch2col(img, ...)) without
+ *  materializing the unpacked column matrix
+ */
+#ifndef MSHADOW_EXTENSION_PATCH_DOT_H_
+#define MSHADOW_EXTENSION_PATCH_DOT_H_
+#include <algorithm>
+#include <vector>
+#include "../extension.h"
+#include "../gemm_cpu-inl.h"
+#include "./winograd.h"
+
+namespace mshadow {
+namespace expr {
+/*!
+ * \brief dot(weight, unpack_patch2col(img, ...)), the product of a weight
+ *  matrix with the patch columns of an image
+ * \tparam SrcExp type of the image expression
+ * \tparam DType the type of elements
+ * \tparam srcdim dimension of the image
+ */
+template<typename SrcExp, typename DType, int srcdim>
+struct PatchDotExp:
+      public Exp<PatchDotExp<SrcExp, DType, srcdim>,
+                 DType, type::kComplex> {
+  /*! \brief weight, shape[0]: out_channel, shape[1]: in_channel * psize_y * psize_x */
+  const Tensor<cpu, 2, DType> &weight_;
+  /*! \brief the unpacked patches */
+  const UnpackPatchToColXExp<SrcExp, DType, srcdim> &col_;
+  /*! \brief constructor */
+  PatchDotExp(const Tensor<cpu, 2, DType> &weight,
+              const UnpackPatchToColXExp<SrcExp, DType, srcdim> &col)
+      : weight_(weight), col_(col) {}
+};
+/*!
+ * \brief convolution output = dot(weight, unpack_patch2col(img, ...)),
+ *  computed by the packed CPU GEMM, which unpacks the patches one panel at
+ *  a time into its packing buffers, so the column matrix of
+ *  in_channel * psize_y * psize_x rows is never allocated;
+ *  pass pad_y, pad_x to unpack_patch2col for padding.
+ *  Accumulation is in fp32, double falls back to BLAS on chunks of columns.
+ *  With MSHADOW_USE_WINOGRAD, 3x3 patches with stride 1 and enough
+ *  channels go to Winograd instead.
+ * \param weight shape[0]: out_channel, shape[1]: in_channel * psize_y * psize_x
+ * \param col the patches, see unpack_patch2col
+ * \return output; shape[0]: out_channel, shape[1]: out_height * out_width * num_of_images
+ */
+template<typename SrcExp, typename DType, int srcdim>
+inline PatchDotExp<SrcExp, DType, srcdim>
+dot(const Tensor<cpu, 2, DType> &weight,
+    const UnpackPatchToColXExp<SrcExp, DType, srcdim> &col) {
+  return PatchDotExp<SrcExp, DType, srcdim>(weight, col);
+}
+/*!
+ * \brief the column matrix of unpack_patch2col as a GEMM operand:
+ *  column j of the matrix is slice j, row i is depth i, see GEMMMatrix
+ */
+template<typename SrcExp, typename DType, int srcdim>
+struct PatchColMatrix {
+  /*! \brief constructor */
+  explicit PatchColMatrix(const UnpackPatchToColXExp<SrcExp, DType, srcdim> &e)
+      : src_(MakePlan(e.img_)),
+        psize_y_(e.psize_y_), psize_x_(e.psize_x_),
+        pstride_y_(e.pstride_y_), pstride_x_(e.pstride_x_),
+        pdilate_y_(e.pdilate_y_), pdilate_x_(e.pdilate_x_), pad_y_(e.pad_y_), pad_x_(e.pad_x_),
+        i_channel_(e.i_channel_), i_height_(e.i_height_), i_width_(e.i_width_),
+        o_height_(e.o_height_), o_width_(e.o_width_) {}
+  /*!
+   * \brief pack columns [s0, s0 + ns) over rows [d0, d0 + nd) in fp32,
+   *  in the sliver layout of GEMMMatrix::Pack
+   */
+  template<int width>
+  inline void Pack(index_t s0, index_t d0, index_t ns, index_t nd, float *buf) const {
+    index_t ybase[width], xbase[width], nbase[width];
+    for (index_t s = 0; s < ns; s += width) {
+      float *out = buf + s * nd;
+      const index_t w = std::min(static_cast<index_t>(width), ns - s);
+      for (index_t r = 0; r < w; ++r) {
+        Locate(s0 + s + r, &ybase[r], &xbase[r], &nbase[r]);
+      }
+      for (index_t d = 0; d < nd; ++d, out += width) {
+        index_t c, dy, dx;
+        Offset(d0 + d, &c, &dy, &dx);
+        for (index_t r = 0; r < w; ++r) {
+          const index_t y = ybase[r] + dy, x = xbase[r] + dx;
+          out[r] = (y >= 0 && y < i_height_ && x >= 0 && x < i_width_) ?
+              static_cast<float>(src_.Eval((nbase[r] + c) * i_height_ + y, x)) : 0.0f;
+        }
+        for (index_t r = w; r < width; ++r) out[r] = 0.0f;
+      }
+    }
+  }
+  /*! \brief unpack columns [j0, j0 + ncol) into the row major dst, with row stride ld */
+  inline void Unpack(index_t j0, index_t ncol, DType *dst, index_t ld) const {
+    const index_t nrow = psize_y_ * psize_x_ * i_channel_;
+    #pragma omp parallel for
+    for (openmp_index_t i = 0; i < nrow; ++i) {
+      index_t c, dy, dx;
+      Offset(i, &c, &dy, &dx);
+      for (index_t j = 0; j < ncol; ++j) {
+        index_t y, x, n;
+        Locate(j0 + j, &y, &x, &n);
+        y += dy; x += dx;
+        dst[i * ld + j] = (y >= 0 && y < i_height_ && x >= 0 && x < i_width_) ?
+            src_.Eval((n + c) * i_height_ + y, x) : DType(0.0f);
+      }
+    }
+  }
+
+ private:
+  Plan<SrcExp, DType> src_;
+  const index_t psize_y_, psize_x_, pstride_y_, pstride_x_;
+  const index_t pdilate_y_, pdilate_x_, pad_y_, pad_x_;
+  const index_t i_channel_, i_height_, i_width_, o_height_, o_width_;
+  // top left corner of the patch of column j, and the first channel row of its image,
+  // the corner is negative inside the padding
+  MSHADOW_XINLINE void Locate(index_t j, index_t *y, index_t *x, index_t *nbase) const {
+    const index_t jdivw = j / o_width_;
+    *x = (j % o_width_) * pstride_x_ - pad_x_;
+    *y = (jdivw % o_height_) * pstride_y_ - pad_y_;
+    *nbase = jdivw / o_height_ * i_channel_;
+  }
+  // channel and offset inside the patch of row i
+  MSHADOW_XINLINE void Offset(index_t i, index_t *c, index_t *dy, index_t *dx) const {
+    const index_t idivp = i / psize_x_;
+    *dx = i % psize_x_ * pdilate_x_;
+    *dy = idivp % psize_y_ * pdilate_y_;
+    *c = idivp / psize_y_;
+  }
+};
+/*! \brief evaluate PatchDotExp, by the packed GEMM if DType fits in fp32 */
+template<bool packed>
+struct PatchDotEngine {
+  template<typename SV, typename SrcExp, typename DType, int srcdim>
+  inline static void Eval(Tensor<cpu, 2, DType> *dst,
+                          const Tensor<cpu, 2, DType> &weight,
+                          const UnpackPatchToColXExp<SrcExp, DType, srcdim> &col) {
+    PackedGEMM::Eval(weight.size(0), col.shape_[1], col.shape_[0], SV::AlphaBLAS(),
+                     GEMMMatrix<DType>(weight.dptr_, weight.stride_, 1),
+                     PatchColMatrix<SrcExp, DType, srcdim>(col),
+                     SV::BetaBLAS(), dst->dptr_, dst->stride_);
+  }
+};
+template<>
+struct PatchDotEngine<false> {
+  template<typename SV, typename SrcExp, typename DType, int srcdim>
+  inline static void Eval(Tensor<cpu, 2, DType> *dst,
+                          const Tensor<cpu, 2, DType> &weight,
+                          const UnpackPatchToColXExp<SrcExp, DType, srcdim> &col) {
+    // unpack chunks of about 1M elements, and multiply them by BLAS
+    const index_t nrow = col.shape_[0], ncol = col.shape_[1];
+    const index_t chunk = std::min(ncol, std::max(static_cast<index_t>(16),
+                                                  (static_cast<index_t>(1) << 20) / nrow));
+    PatchColMatrix<SrcExp, DType, srcdim> mat(col);
+    std::vector<DType> buf(nrow * chunk);
+    for (index_t j0 = 0; j0 < ncol; j0 += chunk) {
+      const index_t ncur = std::min(chunk, ncol - j0);
+      Tensor<cpu, 2, DType> part(&buf[0], Shape2(nrow, ncur), ncur, dst->stream_);
+      Tensor<cpu, 2, DType> out(dst->dptr_ + j0, Shape2(dst->size(0), ncur),
+                                dst->stride_, dst->stream_);
+      mat.Unpack(j0, ncur, part.dptr_, part.stride_);
+      DotEngine<SV, cpu, 2, 2, 2, false, false, DType>::Eval(&out, weight, part, DType(1.0f));
+    }
+  }
+};
+template<typename SV, typename SrcExp, typename DType, int srcdim>
+struct ExpComplexEngine<SV,
+                        Tensor<cpu, 2, DType>,
+                        PatchDotExp<SrcExp, DType, srcdim>,
+                        DType> {
+  inline static void Eval(Tensor<cpu, 2, DType> *dst,
+                          const PatchDotExp<SrcExp, DType, srcdim> &exp) {
+    CHECK(dst->size(0) == exp.weight_.size(0) &&
+          exp.weight_.size(1) == exp.col_.shape_[0] &&
+          dst->size(1) == exp.col_.shape_[1])
+        << "dot-patch: matrix shape mismatch";
+#if MSHADOW_USE_WINOGRAD
+    if ((DataType<DType>::kFlag == kFloat32 || DataType<DType>::kFlag == kFloat64) &&
+        WinogradEligible(exp.col_) &&
+        exp.col_.i_channel_ >= MSHADOW_WINOGRAD_MIN_CHANNEL &&
+        exp.weight_.size(0) >= MSHADOW_WINOGRAD_MIN_CHANNEL) {
+      // F(4x4, 3x3) beats F(2x2, 3x3) down to 7x7 outputs, see bench/gemm_bench conv
+      WinogradFilter<DType> filter(exp.weight_, 4);
+      WinogradEngine::Eval<SV>(dst, filter, exp.col_);
+      return;
+    }
+#endif  // MSHADOW_USE_WINOGRAD
+    PatchDotEngine<DataType<DType>::kFlag != kFloat64>
+        ::template Eval<SV>(dst, exp.weight_, exp.col_);
+  }
+};
+}  // namespace expr
+}  // namespace mshadow
+#endif  // MSHADOW_EXTENSION_PATCH_DOT_H_
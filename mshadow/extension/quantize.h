@@ -0,0 +1,248 @@
+/*!
+ *  Copyright (c) 2017 by Contributors
+ * \file quantize.h
+ * \brief affine quantization, dequantization and requantization expressions,
+ *   with per-tensor or per-channel scale and zero point
+ */
+#ifndef MSHADOW_EXTENSION_QUANTIZE_H_
+#define MSHADOW_EXTENSION_QUANTIZE_H_
+#include "../extension.h"
+
+namespace mshadow {
+namespace op {
+/*!
+ * \brief round a to nearest (half away from zero), add the zero point and
+ *  saturate into the range of DType
+ */
+template<typename DType>
+MSHADOW_XINLINE DType SaturateCast(float a, int32_t zero_point) {
+  // keep the rounded value inside the range of int64 but beyond that of int32
+  const float bound = 4611686018427387904.0f;
+  a = a < -bound ? -bound : (a > bound ? bound : a);
+  const int64_t lo = red::limits::MinValue<DType>();
+  const int64_t hi = red::limits::MaxValue<DType>();
+  // a +- 0.5 is exact in double, in float it rounds 0.49999997f and odd values above 2^23 up
+  int64_t q = static_cast<int64_t>(a >= 0.0f ? static_cast<double>(a) + 0.5
+                                             : static_cast<double>(a) - 0.5) + zero_point;
+  return static_cast<DType>(q < lo ? lo : (q > hi ? hi : q));
+}
+/*! \brief quantize: saturate(round(a / scale) + zero_point) */
+struct quantize {
+  template<typename DType, typename SrcDType>
+  MSHADOW_XINLINE static DType Map(SrcDType a, float scale, int32_t zero_point) {
+    return SaturateCast<DType>(static_cast<float>(a) / scale, zero_point);
+  }
+};
+/*! \brief requantize: saturate(round(a * multiplier) + zero_point) */
+struct requantize {
+  template<typename DType, typename SrcDType>
+  MSHADOW_XINLINE static DType Map(SrcDType a, float multiplier, int32_t zero_point) {
+    return SaturateCast<DType>(static_cast<float>(a) * multiplier, zero_point);
+  }
+};
+/*! \brief dequantize: (a - zero_point) * scale */
+struct dequantize {
+  template<typename DType, typename SrcDType>
+  MSHADOW_XINLINE static DType Map(SrcDType a, float scale, int32_t zero_point) {
+    return DType((static_cast<float>(a) - static_cast<float>(zero_point)) * scale);
+  }
+};
+}  // namespace op
+
+namespace expr {
+/*!
+ * \brief affine (de)quantization of an expression into another data type
+ *  the scale and zero point are either shared by the whole tensor or
+ *  given per channel, where channel is one axis of the source
+ * \tparam OP the affine mapping, op::quantize, op::requantize or op::dequantize
+ * \tparam DstDType data type of the result
+ * \tparam SrcExp source expression
+ * \tparam SrcDType data type of the source expression
+ */
+template<typename OP, typename DstDType, typename SrcExp, typename SrcDType>
+struct QuantizeExp:
+      public Exp<QuantizeExp<OP, DstDType, SrcExp, SrcDType>,
+                 DstDType, type::kChainer> {
+  /*! \brief source operand */
+  const SrcExp &src_;
+  /*! \brief per-tensor scale */
+  float scale_;
+  /*! \brief per-tensor zero point */
+  int32_t zero_point_;
+  /*! \brief per-channel scales, NULL for per-tensor mode */
+  const float *scales_;
+  /*! \brief per-channel zero points, NULL for per-tensor mode */
+  const int32_t *zero_points_;
+  /*! \brief number of channels */
+  index_t nchannel_;
+  /*! \brief product of the dimensions between channel axis and the last axis */
+  index_t trailing_;
+  /*! \brief whether the channel axis is the last axis */
+  bool last_axis_;
+  /*! \brief constructor of per-tensor mode */
+  QuantizeExp(const SrcExp &src, float scale, int32_t zero_point)
+      : src_(src), scale_(scale), zero_point_(zero_point),
+        scales_(NULL), zero_points_(NULL),
+        nchannel_(1), trailing_(1), last_axis_(false) {}
+  /*! \brief constructor of per-channel mode */
+  template<int srcdim>
+  QuantizeExp(const SrcExp &src, const float *scales, const int32_t *zero_points,
+              index_t nchannel, const Shape<srcdim> &sshape, int axis)
+      : src_(src), scale_(1.0f), zero_point_(0),
+        scales_(scales), zero_points_(zero_points), nchannel_(nchannel) {
+    CHECK(axis >= 0 && axis < srcdim) << "quantize: channel axis out of range";
+    CHECK_EQ(sshape[axis], nchannel)
+        << "quantize: number of scales must match the size of channel axis";
+    last_axis_ = (axis == srcdim - 1);
+    trailing_ = 1;
+    for (int i = axis + 1; i < srcdim - 1; ++i) {
+      trailing_ *= sshape[i];
+    }
+  }
+};
+/*!
+ * \brief quantize src with a per-tensor scale and zero point
+ *  out = saturate(round(src / scale) + zero_point)
+ * \param src source expression, usually float
+ * \param scale quantization step
+ * \param zero_point the quantized value that represents real zero
+ * \tparam DstDType quantized type, e.g. int8_t or uint8_t
+ */
+template<typename DstDType, typename SrcExp, typename SrcDType, int etype>
+inline QuantizeExp<op::quantize, DstDType, SrcExp, SrcDType>
+quantize(const Exp<SrcExp, SrcDType, etype> &src, float scale, int32_t zero_point = 0) {
+  return QuantizeExp<op::quantize, DstDType, SrcExp, SrcDType>(src.self(), scale, zero_point);
+}
+/*!
+ * \brief quantize src with a scale and zero point per channel
+ * \param src source expression, usually float
+ * \param scales quantization step of each channel
+ * \param zero_points zero point of each channel
+ * \param axis the channel axis of src
+ * \tparam DstDType quantized type, e.g. int8_t or uint8_t
+ */
+template<typename DstDType, typename SrcExp, typename SrcDType, int etype, typename Device>
+inline QuantizeExp<op::quantize, DstDType, SrcExp, SrcDType>
+quantize(const Exp<SrcExp, SrcDType, etype> &src,
+         const Tensor<Device, 1, float> &scales,
+         const Tensor<Device, 1, int32_t> &zero_points, int axis = 0) {
+  TypeCheckPass<(ExpInfo<SrcExp>::kDevMask & Device::kDevMask) != 0>
+      ::Error_All_Tensor_in_Exp_Must_Have_Same_Type();
+  CHECK_EQ(scales.size(0), zero_points.size(0));
+  return QuantizeExp<op::quantize, DstDType, SrcExp, SrcDType>
+      (src.self(), scales.dptr_, zero_points.dptr_, scales.size(0),
+       ShapeCheck<ExpInfo<SrcExp>::kDim, SrcExp>::Check(src.self()), axis);
+}
+/*!
+ * \brief requantize an int32 accumulator, e.g. the result of quantized_dot,
+ *  out = saturate(round(src * multiplier) + zero_point), where multiplier is
+ *  usually lhs_scale * rhs_scale / out_scale
+ * \param src source expression, usually int32_t
+ * \param multiplier the real multiplier
+ * \param zero_point zero point of the output
+ * \tparam DstDType quantized type, e.g. int8_t or uint8_t
+ */
+template<typename DstDType, typename SrcExp, typename SrcDType, int etype>
+inline QuantizeExp<op::requantize, DstDType, SrcExp, SrcDType>
+requantize(const Exp<SrcExp, SrcDType, etype> &src, float multiplier, int32_t zero_point = 0) {
+  return QuantizeExp<op::requantize, DstDType, SrcExp, SrcDType>
+      (src.self(), multiplier, zero_point);
+}
+/*!
+ * \brief requantize an int32 accumulator with a multiplier and zero point per channel
+ * \param src source expression, usually int32_t
+ * \param multipliers the real multiplier of each channel
+ * \param zero_points zero point of each channel
+ * \param axis the channel axis of src
+ * \tparam DstDType quantized type, e.g. int8_t or uint8_t
+ */
+template<typename DstDType, typename SrcExp, typename SrcDType, int etype, typename Device>
+inline QuantizeExp<op::requantize, DstDType, SrcExp, SrcDType>
+requantize(const Exp<SrcExp, SrcDType, etype> &src,
+           const Tensor<Device, 1, float> &multipliers,
+           const Tensor<Device, 1, int32_t> &zero_points, int axis = 0) {
+  TypeCheckPass<(ExpInfo<SrcExp>::kDevMask & Device::kDevMask) != 0>
+      ::Error_All_Tensor_in_Exp_Must_Have_Same_Type();
+  CHECK_EQ(multipliers.size(0), zero_points.size(0));
+  return QuantizeExp<op::requantize, DstDType, SrcExp, SrcDType>
+      (src.self(), multipliers.dptr_, zero_points.dptr_, multipliers.size(0),
+       ShapeCheck<ExpInfo<SrcExp>::kDim, SrcExp>::Check(src.self()), axis);
+}
+/*!
+ * \brief dequantize src with a per-tensor scale and zero point
+ *  out = (src - zero_point) * scale
+ * \tparam DstDType real type of the output, e.g. float
+ */
+template<typename DstDType, typename SrcExp, typename SrcDType, int etype>
+inline QuantizeExp<op::dequantize, DstDType, SrcExp, SrcDType>
+dequantize(const Exp<SrcExp, SrcDType, etype> &src, float scale, int32_t zero_point = 0) {
+  return QuantizeExp<op::dequantize, DstDType, SrcExp, SrcDType>
+      (src.self(), scale, zero_point);
+}
+/*!
+ * \brief dequantize src with a scale and zero point per channel
+ * \tparam DstDType real type of the output, e.g. float
+ */
+template<typename DstDType, typename SrcExp, typename SrcDType, int etype, typename Device>
+inline QuantizeExp<op::dequantize, DstDType, SrcExp, SrcDType>
+dequantize(const Exp<SrcExp, SrcDType, etype> &src,
+           const Tensor<Device, 1, float> &scales,
+           const Tensor<Device, 1, int32_t> &zero_points, int axis = 0) {
+  TypeCheckPass<(ExpInfo<SrcExp>::kDevMask & Device::kDevMask) != 0>
+      ::Error_All_Tensor_in_Exp_Must_Have_Same_Type();
+  CHECK_EQ(scales.size(0), zero_points.size(0));
+  return QuantizeExp<op::dequantize, DstDType, SrcExp, SrcDType>
+      (src.self(), scales.dptr_, zero_points.dptr_, scales.size(0),
+       ShapeCheck<ExpInfo<SrcExp>::kDim, SrcExp>::Check(src.self()), axis);
+}
+
+//----------------------
+// Execution plan
+//----------------------
+template<typename OP, typename DstDType, typename SrcExp, typename SrcDType>
+struct Plan<QuantizeExp<OP, DstDType, SrcExp, SrcDType>, DstDType> {
+ public:
+  explicit Plan(const QuantizeExp<OP, DstDType, SrcExp, SrcDType> &e)
+      : src_(MakePlan(e.src_)), scale_(e.scale_), zero_point_(e.zero_point_),
+        scales_(e.scales_), zero_points_(e.zero_points_),
+        nchannel_(e.nchannel_), trailing_(e.trailing_), last_axis_(e.last_axis_) {}
+  MSHADOW_XINLINE DstDType Eval(index_t y, index_t x) const {
+    if (scales_ == NULL) {
+      return OP::template Map<DstDType>(src_.Eval(y, x), scale_, zero_point_);
+    }
+    const index_t c = last_axis_ ? x : (y / trailing_) % nchannel_;
+    return OP::template Map<DstDType>(src_.Eval(y, x), scales_[c], zero_points_[c]);
+  }
+
+ private:
+  Plan<SrcExp, SrcDType> src_;
+  const float scale_;
+  const int32_t zero_point_;
+  const float *scales_;
+  const int32_t *zero_points_;
+  const index_t nchannel_, trailing_;
+  const bool last_axis_;
+};
+
+template<typename OP, typename DstDType, typename SrcExp, typename SrcDType>
+inline Plan<QuantizeExp<OP, DstDType, SrcExp, SrcDType>, DstDType>
+MakePlan(const QuantizeExp<OP, DstDType, SrcExp, SrcDType> &e) {
+  return Plan<QuantizeExp<OP, DstDType, SrcExp, SrcDType>, DstDType>(e);
+}
+
+template<int dim, typename OP, typename DstDType, typename SrcExp, typename SrcDType>
+struct ShapeCheck<dim, QuantizeExp<OP, DstDType, SrcExp, SrcDType> > {
+  inline static Shape<dim>
+  Check(const QuantizeExp<OP, DstDType, SrcExp, SrcDType> &t) {
+    return ShapeCheck<dim, SrcExp>::Check(t.src_);
+  }
+};
+
+template<typename OP, typename DstDType, typename SrcExp, typename SrcDType>
+struct ExpInfo<QuantizeExp<OP, DstDType, SrcExp, SrcDType> > {
+  static const int kDim = ExpInfo<SrcExp>::kDim;
+  static const int kDevMask = ExpInfo<SrcExp>::kDevMask;
+};
+}  // namespace expr
+}  // namespace mshadow
+#endif  // MSHADOW_EXTENSION_QUANTIZE_H_
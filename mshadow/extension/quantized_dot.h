@@ -0,0 +1,232 @@
+/*!
+ *  Copyright (c) 2017 by Contributors
+ * \file quantized_dot.h
+ * \brief matrix multiplication of 8-bit integer matrices with int32 accumulation
+ */
+#ifndef MSHADOW_EXTENSION_QUANTIZED_DOT_H_
+#define MSHADOW_EXTENSION_QUANTIZED_DOT_H_
+#include <algorithm>
+#include <vector>
+#include "../extension.h"
+#if MSHADOW_USE_SSE || defined(__AVX2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__) || (defined(__AVX512BW__) && defined(__AVX512VNNI__))
+#include <immintrin.h>
+#endif
+
+namespace mshadow {
+namespace expr {
+/*!
+ * \brief matrix multiplication of two int8_t/uint8_t matrices,
+ *  the products are accumulated and returned in int32_t
+ * \tparam TA type of lhs, Tensor<Device, 2, int8_t/uint8_t>
+ * \tparam TB type of rhs, Tensor<Device, 2, int8_t/uint8_t>
+ * \tparam ltrans whether lhs is transposed
+ * \tparam rtrans whether rhs is transposed
+ */
+template<typename TA, typename TB, bool ltrans, bool rtrans>
+struct QuantizedDotExp:
+      public Exp<QuantizedDotExp<TA, TB, ltrans, rtrans>,
+                 int32_t, type::kComplex> {
+  /*! \brief lhs operand */
+  const TA &lhs_;
+  /*! \brief rhs operand */
+  const TB &rhs_;
+  /*! \brief constructor */
+  QuantizedDotExp(const TA &lhs, const TB &rhs) : lhs_(lhs), rhs_(rhs) {}
+};
+/*!
+ * \brief int32 result of dot(lhs, rhs), where lhs and rhs are 8-bit integer
+ *  matrices; use requantize to bring the result back to 8 bits
+ */
+template<typename TA, typename TB, typename LDType, typename RDType>
+inline QuantizedDotExp<TA, TB, false, false>
+quantized_dot(const RValueExp<TA, LDType> &lhs, const RValueExp<TB, RDType> &rhs) {
+  return QuantizedDotExp<TA, TB, false, false>(lhs.self(), rhs.self());
+}
+/*! \brief int32 result of dot(lhs.T(), rhs) */
+template<typename TA, typename TB, typename LDType, typename RDType>
+inline QuantizedDotExp<TA, TB, true, false>
+quantized_dot(const TransposeExp<TA, LDType> &lhs, const RValueExp<TB, RDType> &rhs) {
+  return QuantizedDotExp<TA, TB, true, false>(lhs.exp, rhs.self());
+}
+/*! \brief int32 result of dot(lhs, rhs.T()) */
+template<typename TA, typename TB, typename LDType, typename RDType>
+inline QuantizedDotExp<TA, TB, false, true>
+quantized_dot(const RValueExp<TA, LDType> &lhs, const TransposeExp<TB, RDType> &rhs) {
+  return QuantizedDotExp<TA, TB, false, true>(lhs.self(), rhs.exp);
+}
+/*! \brief int32 result of dot(lhs.T(), rhs.T()) */
+template<typename TA, typename TB, typename LDType, typename RDType>
+inline QuantizedDotExp<TA, TB, true, true>
+quantized_dot(const TransposeExp<TA, LDType> &lhs, const TransposeExp<TB, RDType> &rhs) {
+  return QuantizedDotExp<TA, TB, true, true>(lhs.exp, rhs.exp);
+}
+
+/*!
+ * \brief CPU kernel of quantized_dot
+ *  Both operands are packed into int16 rows along the reduction dimension,
+ *  zero padded to kAlign, so every product pair is summed exactly into int32
+ *  by a widening multiply-add (pmaddwd, or vpdpwssd when AVX512-VNNI is on).
+ */
+struct QuantizedDotCPU {
+  /*! \brief padding of the reduction dimension, in int16 elements */
+  static const index_t kAlign = 32;
+  /*! \brief rows of lhs processed together */
+  static const index_t kBlockM = 16;
+  /*! \brief rows of packed rhs processed together */
+  static const index_t kBlockN = 64;
+  /*!
+   * \brief pack op(src) as nrow rows of length kpad
+   * \tparam trans whether the rows of op(src) are the columns of src
+   */
+  template<bool trans, typename DType>
+  inline static void Pack(int16_t *dst, index_t nrow, index_t kpad,
+                          const Tensor<cpu, 2, DType> &src) {
+    const index_t nvalid = trans ? src.size(1) : src.size(0);
+    const index_t k = trans ? src.size(0) : src.size(1);
+    #pragma omp parallel for
+    for (openmp_index_t i = 0; i < nrow; ++i) {
+      int16_t *row = dst + i * kpad;
+      index_t p = 0;
+      if (i < nvalid) {
+        for (; p < k; ++p) {
+          row[p] = static_cast<int16_t>(trans ? src[p][i] : src[i][p]);
+        }
+      }
+      for (; p < kpad; ++p) row[p] = 0;
+    }
+  }
+  /*! \brief out[t] = sum_p a[p] * b[t * kpad + p], t = 0..3 */
+  inline static void Dot1x4(const int16_t *a, const int16_t *b,
+                            index_t kpad, int32_t out[4]) {
+    const int16_t *b0 = b, *b1 = b + kpad, *b2 = b + 2 * kpad, *b3 = b + 3 * kpad;
+#if defined(__AVX512BW__) && defined(__AVX512VNNI__)
+    __m512i s0 = _mm512_setzero_si512(), s1 = s0, s2 = s0, s3 = s0;
+    for (index_t p = 0; p < kpad; p += 32) {
+      __m512i va = _mm512_loadu_si512(a + p);
+      s0 = _mm512_dpwssd_epi32(s0, va, _mm512_loadu_si512(b0 + p));
+      s1 = _mm512_dpwssd_epi32(s1, va, _mm512_loadu_si512(b1 + p));
+      s2 = _mm512_dpwssd_epi32(s2, va, _mm512_loadu_si512(b2 + p));
+      s3 = _mm512_dpwssd_epi32(s3, va, _mm512_loadu_si512(b3 + p));
+    }
+    out[0] = _mm512_reduce_add_epi32(s0);
+    out[1] = _mm512_reduce_add_epi32(s1);
+    out[2] = _mm512_reduce_add_epi32(s2);
+    out[3] = _mm512_reduce_add_epi32(s3);
+#elif defined(__AVX2__)
+    __m256i s0 = _mm256_setzero_si256(), s1 = s0, s2 = s0, s3 = s0;
+    for (index_t p = 0; p < kpad; p += 16) {
+      __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + p));
+      s0 = _mm256_add_epi32(s0, _mm256_madd_epi16(
+          va, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b0 + p))));
+      s1 = _mm256_add_epi32(s1, _mm256_madd_epi16(
+          va, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b1 + p))));
+      s2 = _mm256_add_epi32(s2, _mm256_madd_epi16(
+          va, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b2 + p))));
+      s3 = _mm256_add_epi32(s3, _mm256_madd_epi16(
+          va, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b3 + p))));
+    }
+    __m128i t0 = _mm_add_epi32(_mm256_castsi256_si128(s0), _mm256_extracti128_si256(s0, 1));
+    __m128i t1 = _mm_add_epi32(_mm256_castsi256_si128(s1), _mm256_extracti128_si256(s1, 1));
+    __m128i t2 = _mm_add_epi32(_mm256_castsi256_si128(s2), _mm256_extracti128_si256(s2, 1));
+    __m128i t3 = _mm_add_epi32(_mm256_castsi256_si128(s3), _mm256_extracti128_si256(s3, 1));
+    Transpose4Sum(t0, t1, t2, t3, out);
+#elif MSHADOW_USE_SSE
+    __m128i s0 = _mm_setzero_si128(), s1 = s0, s2 = s0, s3 = s0;
+    for (index_t p = 0; p < kpad; p += 8) {
+      __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + p));
+      s0 = _mm_add_epi32(s0, _mm_madd_epi16(
+          va, _mm_loadu_si128(reinterpret_cast<const __m128i*>(b0 + p))));
+      s1 = _mm_add_epi32(s1, _mm_madd_epi16(
+          va, _mm_loadu_si128(reinterpret_cast<const __m128i*>(b1 + p))));
+      s2 = _mm_add_epi32(s2, _mm_madd_epi16(
+          va, _mm_loadu_si128(reinterpret_cast<const __m128i*>(b2 + p))));
+      s3 = _mm_add_epi32(s3, _mm_madd_epi16(
+          va, _mm_loadu_si128(reinterpret_cast<const __m128i*>(b3 + p))));
+    }
+    Transpose4Sum(s0, s1, s2, s3, out);
+#else
+    int32_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for (index_t p = 0; p < kpad; ++p) {
+      const int32_t va = a[p];
+      s0 += va * b0[p]; s1 += va * b1[p];
+      s2 += va * b2[p]; s3 += va * b3[p];
+    }
+    out[0] = s0; out[1] = s1; out[2] = s2; out[3] = s3;
+#endif
+  }
+#if MSHADOW_USE_SSE || defined(__AVX2__)
+  /*! \brief out[t] = horizontal sum of s_t */
+  inline static void Transpose4Sum(__m128i s0, __m128i s1, __m128i s2, __m128i s3,
+                                   int32_t out[4]) {
+    __m128i t01l = _mm_unpacklo_epi32(s0, s1), t01h = _mm_unpackhi_epi32(s0, s1);
+    __m128i t23l = _mm_unpacklo_epi32(s2, s3), t23h = _mm_unpackhi_epi32(s2, s3);
+    __m128i t01 = _mm_add_epi32(t01l, t01h), t23 = _mm_add_epi32(t23l, t23h);
+    __m128i sum = _mm_add_epi32(_mm_unpacklo_epi64(t01, t23), _mm_unpackhi_epi64(t01, t23));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), sum);
+  }
+#endif
+  /*! \brief dst (SV)= op(lhs) * op(rhs) */
+  template<typename SV, bool ltrans, bool rtrans, typename LDType, typename RDType>
+  inline static void Eval(Tensor<cpu, 2, int32_t> *p_dst,
+                          const Tensor<cpu, 2, LDType> &lhs,
+                          const Tensor<cpu, 2, RDType> &rhs) {
+    TypeCheckPass<sizeof(LDType) == 1 && sizeof(RDType) == 1>
+        ::Error_All_Tensor_in_Exp_Must_Have_Same_Type();
+    Tensor<cpu, 2, int32_t> &dst = *p_dst;
+    const index_t m = ltrans ? lhs.size(1) : lhs.size(0);
+    const index_t k = ltrans ? lhs.size(0) : lhs.size(1);
+    const index_t kr = rtrans ? rhs.size(1) : rhs.size(0);
+    const index_t n = rtrans ? rhs.size(0) : rhs.size(1);
+    CHECK(dst.size(0) == m && dst.size(1) == n && k == kr)
+        << "quantized_dot: matrix shape mismatch";
+    if (m == 0 || n == 0) return;
+    const index_t kpad = (k + kAlign - 1) / kAlign * kAlign;
+    const index_t npad = (n + 3) / 4 * 4;
+    std::vector<int16_t> apack(m * kpad), bpack(npad * kpad);
+    Pack<ltrans>(&apack[0], m, kpad, lhs);
+    // rows of the packed rhs are the columns of op(rhs)
+    Pack<!rtrans>(&bpack[0], npad, kpad, rhs);
+    const index_t nblock = (m + kBlockM - 1) / kBlockM;
+    #pragma omp parallel for
+    for (openmp_index_t ib = 0; ib < nblock; ++ib) {
+      const index_t ibegin = ib * kBlockM;
+      const index_t iend = std::min(ibegin + kBlockM, m);
+      for (index_t jb = 0; jb < npad; jb += kBlockN) {
+        const index_t jend = std::min(jb + kBlockN, npad);
+        for (index_t i = ibegin; i < iend; ++i) {
+          const int16_t *a = &apack[i * kpad];
+          int32_t *out = dst[i].dptr_;
+          for (index_t j = jb; j < jend; j += 4) {
+            int32_t acc[4];
+            Dot1x4(a, &bpack[j * kpad], kpad, acc);
+            const index_t nj = std::min(n - j, static_cast<index_t>(4));
+            for (index_t t = 0; t < nj; ++t) {
+              SV::Save(out[j + t], acc[t]);
+            }
+          }
+        }
+      }
+    }
+  }
+};
+
+template<typename SV, typename LDType, typename RDType, bool ltrans, bool rtrans>
+struct ExpComplexEngine<SV,
+                        Tensor<cpu, 2, int32_t>,
+                        QuantizedDotExp<Tensor<cpu, 2, LDType>,
+                                        Tensor<cpu, 2, RDType>,
+                                        ltrans, rtrans>,
+                        int32_t> {
+  inline static void Eval(Tensor<cpu, 2, int32_t> *dst,
+                          const QuantizedDotExp<Tensor<cpu, 2, LDType>,
+                                                Tensor<cpu, 2, RDType>,
+                                                ltrans, rtrans> &exp) {
+    QuantizedDotCPU::Eval<SV, ltrans, rtrans>(dst, exp.lhs_, exp.rhs_);
+  }
+};
+}  // namespace expr
+}  // namespace mshadow
+#endif  // MSHADOW_EXTENSION_QUANTIZED_DOT_H_
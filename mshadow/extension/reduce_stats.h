@@ -0,0 +1,454 @@
+/*!
+ *  Copyright (c) 2017 by Contributors
+ * \file reduce_stats.h
+ * \brief reductions producing two statistics in one pass over the source,
+ *  e.g. mean and variance for normalization layers
+ */
+#ifndef MSHADOW_EXTENSION_REDUCE_STATS_H_
+#define MSHADOW_EXTENSION_REDUCE_STATS_H_
+#include <algorithm>
+#include <vector>
+#include "../extension.h"
+
+namespace mshadow {
+namespace red {
+/*!
+ * \brief statistic reducers, used by ReduceStatsExceptDim and ReduceStatsWithAxis;
+ *  a statistic folds blocks of evaluated values into a State:
+ *  AddRun folds n consecutive values with indices idx, idx + 1, ...,
+ *  AddRows folds nrow rows of ncol values (row stride ld) column by column,
+ *  row r having index idx + r; partial states of consecutive ranges are
+ *  combined with Merge, and Save writes the two outputs
+ */
+/*!
+ * \brief (mean, variance), the variance is the biased one; every block is
+ *  centered on its own mean and merged by the update of Chan et al.,
+ *  which keeps the precision of Welford's algorithm
+ */
+struct mean_var {
+  template<typename DType>
+  struct State {
+    DType mean, m2;
+    index_t n;
+  };
+  template<typename DType>
+  MSHADOW_XINLINE static void SetInitValue(State<DType> &s) { // NOLINT(*)
+    s.mean = DType(0); s.m2 = DType(0); s.n = 0;
+  }
+  template<typename DType>
+  MSHADOW_XINLINE static void Merge(State<DType> &s, const State<DType> &rhs) { // NOLINT(*)
+    if (rhs.n == 0) return;
+    if (s.n == 0) {
+      s = rhs; return;
+    }
+    const index_t n = s.n + rhs.n;
+    const DType d = rhs.mean - s.mean;
+    const DType w = DType(rhs.n) / DType(n);
+    s.mean += d * w;
+    s.m2 += rhs.m2 + d * d * DType(s.n) * w;
+    s.n = n;
+  }
+  template<typename DType>
+  inline static void AddRun(State<DType> &s, const DType *v, // NOLINT(*)
+                            index_t n, index_t idx) {
+    if (n == 0) return;
+    // kLane independent partial sums, so that the loops can be vectorized
+    const index_t kLane = 8;
+    const index_t nlane = n / kLane * kLane;
+    DType sum[kLane], m2[kLane];
+    for (index_t l = 0; l < kLane; ++l) sum[l] = m2[l] = DType(0);
+    for (index_t i = 0; i < nlane; i += kLane) {
+      for (index_t l = 0; l < kLane; ++l) sum[l] += v[i + l];
+    }
+    for (index_t i = nlane; i < n; ++i) sum[0] += v[i];
+    for (index_t l = 1; l < kLane; ++l) sum[0] += sum[l];
+    State<DType> b;
+    b.mean = sum[0] / DType(n);
+    for (index_t i = 0; i < nlane; i += kLane) {
+      for (index_t l = 0; l < kLane; ++l) m2[l] += (v[i + l] - b.mean) * (v[i + l] - b.mean);
+    }
+    for (index_t i = nlane; i < n; ++i) m2[0] += (v[i] - b.mean) * (v[i] - b.mean);
+    for (index_t l = 1; l < kLane; ++l) m2[0] += m2[l];
+    b.m2 = m2[0]; b.n = n;
+    Merge(s, b);
+  }
+  template<typename DType>
+  inline static void AddRows(State<DType> *s, const DType *v, index_t nrow, // NOLINT(*)
+                             index_t ncol, index_t ld, index_t idx) {
+    if (nrow == 0) return;
+    // columns are independent, kLane of them are swept row by row at once
+    const index_t kLane = 16;
+    index_t j0 = 0;
+    for (; j0 + kLane <= ncol; j0 += kLane) {
+      AddColumns<kLane>(s + j0, v + j0, nrow, kLane, ld);
+    }
+    if (j0 < ncol) AddColumns<kLane>(s + j0, v + j0, nrow, ncol - j0, ld);
+  }
+  /*! \brief fold nc <= kLane columns, the full width case is vectorized */
+  template<int kLane, typename DType>
+  inline static void AddColumns(State<DType> *s, const DType *v, index_t nrow, // NOLINT(*)
+                                index_t nc, index_t ld) {
+    const DType scale = DType(1) / DType(nrow);
+    DType mean[kLane], m2[kLane];
+    for (index_t j = 0; j < kLane; ++j) mean[j] = m2[j] = DType(0);
+    for (index_t r = 0; r < nrow; ++r) {
+      for (index_t j = 0; j < nc; ++j) mean[j] += v[r * ld + j];
+    }
+    for (index_t j = 0; j < nc; ++j) mean[j] *= scale;
+    for (index_t r = 0; r < nrow; ++r) {
+      for (index_t j = 0; j < nc; ++j) {
+        m2[j] += (v[r * ld + j] - mean[j]) * (v[r * ld + j] - mean[j]);
+      }
+    }
+    for (index_t j = 0; j < nc; ++j) {
+      State<DType> b;
+      b.mean = mean[j]; b.m2 = m2[j]; b.n = nrow;
+      Merge(s[j], b);
+    }
+  }
+  template<typename DType>
+  MSHADOW_XINLINE static void Save(const State<DType> &s, DType &mean, DType &var) { // NOLINT(*)
+    mean = s.mean;
+    var = s.n == 0 ? DType(0) : s.m2 / DType(s.n);
+  }
+};
+/*!
+ * \brief base of statistics defined by a per value update Add(s, v, idx),
+ *  provides the block folds
+ */
+template<typename Stat>
+struct StatByValue {
+  template<typename State, typename DType>
+  inline static void AddRun(State &s, const DType *v, index_t n, index_t idx) { // NOLINT(*)
+    for (index_t i = 0; i < n; ++i) Stat::Add(s, v[i], idx + i);
+  }
+  template<typename State, typename DType>
+  inline static void AddRows(State *s, const DType *v, index_t nrow,
+                             index_t ncol, index_t ld, index_t idx) {
+    for (index_t r = 0; r < nrow; ++r) {
+      for (index_t j = 0; j < ncol; ++j) Stat::Add(s[j], v[r * ld + j], idx + r);
+    }
+  }
+};
+/*! \brief (sum, sum of squares) */
+struct sum_sumsq : public StatByValue<sum_sumsq> {
+  template<typename DType>
+  struct State {
+    DType sum, sumsq;
+  };
+  template<typename DType>
+  MSHADOW_XINLINE static void SetInitValue(State<DType> &s) { // NOLINT(*)
+    s.sum = DType(0); s.sumsq = DType(0);
+  }
+  template<typename DType>
+  MSHADOW_XINLINE static void Add(State<DType> &s, DType v, index_t idx) { // NOLINT(*)
+    s.sum += v; s.sumsq += v * v;
+  }
+  template<typename DType>
+  MSHADOW_XINLINE static void Merge(State<DType> &s, const State<DType> &rhs) { // NOLINT(*)
+    s.sum += rhs.sum; s.sumsq += rhs.sumsq;
+  }
+  template<typename DType>
+  MSHADOW_XINLINE static void Save(const State<DType> &s, DType &sum, DType &sumsq) { // NOLINT(*)
+    sum = s.sum; sumsq = s.sumsq;
+  }
+};
+/*! \brief (minimum, maximum), NaN is skipped like in red::minimum and red::maximum */
+struct min_max : public StatByValue<min_max> {
+  template<typename DType>
+  struct State {
+    DType min, max;
+  };
+  template<typename DType>
+  MSHADOW_XINLINE static void SetInitValue(State<DType> &s) { // NOLINT(*)
+    minimum::SetInitValue(s.min); maximum::SetInitValue(s.max);
+  }
+  template<typename DType>
+  MSHADOW_XINLINE static void Add(State<DType> &s, DType v, index_t idx) { // NOLINT(*)
+    if (v < s.min) s.min = v;
+    if (v > s.max) s.max = v;
+  }
+  template<typename DType>
+  MSHADOW_XINLINE static void Merge(State<DType> &s, const State<DType> &rhs) { // NOLINT(*)
+    Add(s, rhs.min, 0); Add(s, rhs.max, 0);
+  }
+  template<typename DType>
+  MSHADOW_XINLINE static void Save(const State<DType> &s, DType &min, DType &max) { // NOLINT(*)
+    min = s.min; max = s.max;
+  }
+};
+/*!
+ * \brief (maximum, index of the first maximum), the index is the one
+ *  reduce_with_axis<red::maximum, true> gives
+ */
+struct max_argmax : public StatByValue<max_argmax> {
+  template<typename DType>
+  struct State {
+    DType max;
+    index_t idx;
+  };
+  template<typename DType>
+  MSHADOW_XINLINE static void SetInitValue(State<DType> &s) { // NOLINT(*)
+    maximum::SetInitValue(s.max); s.idx = 0;
+  }
+  template<typename DType>
+  MSHADOW_XINLINE static void Add(State<DType> &s, DType v, index_t idx) { // NOLINT(*)
+    if (v > s.max) {
+      s.max = v; s.idx = idx;
+    }
+  }
+  /*! \brief rhs holds the later range, ties keep s */
+  template<typename DType>
+  MSHADOW_XINLINE static void Merge(State<DType> &s, const State<DType> &rhs) { // NOLINT(*)
+    if (rhs.max > s.max) s = rhs;
+  }
+  template<typename DType>
+  MSHADOW_XINLINE static void Save(const State<DType> &s, DType &max, DType &idx) { // NOLINT(*)
+    max = s.max; idx = static_cast<DType>(static_cast<int>(s.idx));
+  }
+};
+}  // namespace red
+
+namespace expr {
+/*!
+ * \brief CPU kernels folding source rows into statistic states, the source
+ *  is evaluated into blocks of at most kBlock values first
+ */
+template<typename Stat, typename DType>
+struct ReduceStatsCPU {
+  typedef typename Stat::template State<DType> State;
+  /*! \brief block size of evaluated values */
+  static const index_t kBlock = 512;
+  /*! \brief fold row[x_begin, x_end) into s, element x has index idx + x */
+  template<typename SrcExp>
+  inline static void AddRun(const Plan<SrcExp, DType> &splan, index_t row,
+                            index_t x_begin, index_t x_end, index_t idx, State *s) {
+    DType buf[kBlock];
+    for (index_t x0 = x_begin; x0 < x_end; x0 += kBlock) {
+      const index_t n = std::min(kBlock, x_end - x0);
+      for (index_t i = 0; i < n; ++i) buf[i] = splan.Eval(row, x0 + i);
+      Stat::AddRun(*s, buf, n, idx + x0);
+    }
+  }
+  /*!
+   * \brief fold columns [x_begin, x_end) of the nrow source rows
+   *  row0, row0 + stride, ... element-wise into s[0, x_end - x_begin),
+   *  row r has index idx + r
+   */
+  template<typename SrcExp>
+  inline static void AddRows(const Plan<SrcExp, DType> &splan, index_t row0, index_t stride,
+                             index_t nrow, index_t x_begin, index_t x_end,
+                             index_t idx, State *s) {
+    // tall blocks, each block costs a Merge per column
+    const index_t kCol = 32, kRow = 64;
+    DType buf[kCol * kRow];
+    for (index_t r0 = 0; r0 < nrow; r0 += kRow) {
+      const index_t nr = std::min(kRow, nrow - r0);
+      for (index_t x0 = x_begin; x0 < x_end; x0 += kCol) {
+        const index_t ncol = std::min(kCol, x_end - x0);
+        for (index_t r = 0; r < nr; ++r) {
+          const index_t row = row0 + (r0 + r) * stride;
+          for (index_t j = 0; j < ncol; ++j) buf[r * kCol + j] = splan.Eval(row, x0 + j);
+        }
+        Stat::AddRows(s + (x0 - x_begin), buf, nr, ncol, kCol, idx + r0);
+      }
+    }
+  }
+  /*!
+   * \brief statistics of each slice (n, c, :) of a source seen as
+   *  (nrow, nchannel, nsub rows of length width); slices are split into
+   *  chunks of rows, merged in order
+   */
+  template<typename SrcExp>
+  inline static void ExceptDimHigh(Tensor<cpu, 1, DType> out0, Tensor<cpu, 1, DType> out1,
+                                   const SrcExp &src, index_t nrow, index_t nchannel,
+                                   index_t nsub, index_t width) {
+    Plan<SrcExp, DType> splan = MakePlan(src);
+    const index_t nrun = nrow * nsub;
+#if MSHADOW_DETERMINISTIC_REDUCE
+    const index_t nchunk = std::max(static_cast<index_t>(1),
+        (nrun + MSHADOW_REDUCE_CHUNK - 1) / MSHADOW_REDUCE_CHUNK);
+#else
+    const index_t nchunk = std::max(static_cast<index_t>(1), std::min(nrun,
+        (4 * static_cast<index_t>(GetOMPMaxThreads()) + nchannel - 1) / nchannel));
+#endif
+    std::vector<State> part(nchannel * nchunk);
+    #pragma omp parallel for
+    for (openmp_index_t t = 0; t < nchannel * nchunk; ++t) {
+      const index_t c = t / nchunk, chunk = t % nchunk;
+      const index_t begin = nrun * chunk / nchunk, end = nrun * (chunk + 1) / nchunk;
+      State s; Stat::SetInitValue(s);
+      if (width >= kBlock) {
+        for (index_t r = begin; r < end; ++r) {
+          const index_t n = r / nsub, sub = r % nsub;
+          AddRun(splan, (n * nchannel + c) * nsub + sub, 0, width, r * width, &s);
+        }
+      } else {
+        // short rows are gathered into one block, their indices are consecutive
+        DType buf[kBlock];
+        const index_t nbuf = kBlock / width;
+        for (index_t r0 = begin; r0 < end; r0 += nbuf) {
+          const index_t r1 = std::min(r0 + nbuf, end);
+          for (index_t r = r0; r < r1; ++r) {
+            const index_t row = (r / nsub * nchannel + c) * nsub + r % nsub;
+            DType *p = buf + (r - r0) * width;
+            for (index_t x = 0; x < width; ++x) p[x] = splan.Eval(row, x);
+          }
+          Stat::AddRun(s, buf, (r1 - r0) * width, r0 * width);
+        }
+      }
+      part[t] = s;
+    }
+    for (index_t c = 0; c < nchannel; ++c) {
+      State s = part[c * nchunk];
+      for (index_t chunk = 1; chunk < nchunk; ++chunk) {
+        Stat::Merge(s, part[c * nchunk + chunk]);
+      }
+      Stat::Save(s, out0[c], out1[c]);
+    }
+  }
+  /*!
+   * \brief statistics of each column of a nrow x width source, over bands
+   *  of rows merged in order
+   */
+  template<typename SrcExp>
+  inline static void ExceptDimLowest(Tensor<cpu, 1, DType> out0, Tensor<cpu, 1, DType> out1,
+                                     const SrcExp &src, index_t nrow, index_t width) {
+    Plan<SrcExp, DType> splan = MakePlan(src);
+#if MSHADOW_DETERMINISTIC_REDUCE
+    const index_t nband = std::max(static_cast<index_t>(1),
+        (nrow + MSHADOW_REDUCE_CHUNK - 1) / MSHADOW_REDUCE_CHUNK);
+#else
+    const index_t nband = std::max(static_cast<index_t>(1),
+        std::min(static_cast<index_t>(GetOMPMaxThreads()), nrow / 16));
+#endif
+    std::vector<State> part(nband * width);
+    #pragma omp parallel for
+    for (openmp_index_t b = 0; b < nband; ++b) {
+      State *s = &part[b * width];
+      for (index_t x = 0; x < width; ++x) Stat::SetInitValue(s[x]);
+      const index_t begin = nrow * b / nband, end = nrow * (b + 1) / nband;
+      AddRows(splan, begin, 1, end - begin, 0, width, begin, s);
+    }
+    #pragma omp parallel for
+    for (openmp_index_t x = 0; x < width; ++x) {
+      State s = part[x];
+      for (index_t b = 1; b < nband; ++b) {
+        Stat::Merge(s, part[b * width + x]);
+      }
+      Stat::Save(s, out0[x], out1[x]);
+    }
+  }
+  /*! \brief reduce the last axis: output x holds the statistics of source row x */
+  template<typename SrcExp>
+  inline static void AxisLast(Tensor<cpu, 2, DType> out0, Tensor<cpu, 2, DType> out1,
+                              const SrcExp &src, index_t outer, index_t size) {
+    Plan<SrcExp, DType> splan = MakePlan(src);
+    const index_t width = out0.size(1);
+    #pragma omp parallel for
+    for (openmp_index_t x = 0; x < outer; ++x) {
+      State s; Stat::SetInitValue(s);
+      AddRun(splan, x, 0, size, 0, &s);
+      Stat::Save(s, out0[x / width][x % width], out1[x / width][x % width]);
+    }
+  }
+  /*!
+   * \brief trailing > 1: each output row folds size source rows of length last,
+   *  split into column blocks when the rows are too few to keep the threads busy
+   */
+  template<typename SrcExp>
+  inline static void AxisOuter(Tensor<cpu, 2, DType> out0, Tensor<cpu, 2, DType> out1,
+                               const SrcExp &src, index_t outer, index_t size,
+                               index_t trailing) {
+    Plan<SrcExp, DType> splan = MakePlan(src);
+    const index_t last = out0.size(1), nsub = trailing / last;
+    const index_t nrow = outer * nsub;
+    const index_t nblock = std::max(static_cast<index_t>(1),
+        std::min(GetOMPMaxThreads() / nrow, last / 256));
+    #pragma omp parallel for
+    for (openmp_index_t t = 0; t < nrow * nblock; ++t) {
+      const index_t r = t / nblock, b = t % nblock;
+      const index_t x_begin = last * b / nblock, x_end = last * (b + 1) / nblock;
+      // source row of (x, k, sub) is (x * size + k) * nsub + sub
+      const index_t base = r / nsub * size * nsub + r % nsub;
+      std::vector<State> s(x_end - x_begin);
+      for (index_t j = 0; j < x_end - x_begin; ++j) Stat::SetInitValue(s[j]);
+      AddRows(splan, base, nsub, size, x_begin, x_end, 0, &s[0]);
+      for (index_t x = x_begin; x < x_end; ++x) {
+        Stat::Save(s[x - x_begin], out0[r][x], out1[r][x]);
+      }
+    }
+  }
+};
+template<typename Stat, typename DType>
+const index_t ReduceStatsCPU<Stat, DType>::kBlock;
+}  // namespace expr
+
+/*!
+ * \brief two statistics of the source over all dimensions except dimkeep,
+ *  computed in one pass, the multi-output counterpart of sumall_except_dim;
+ *  e.g. ReduceStatsExceptDim<red::mean_var, 1>(mean, var, data) gives the
+ *  batch norm statistics of a (batch, channel, height, width) tensor.
+ *  For red::max_argmax the index is the row-major position among the
+ *  reduced elements
+ * \param out0 first statistic, shape: (src.size(dimkeep),)
+ * \param out1 second statistic, shape: (src.size(dimkeep),)
+ * \param src source expression
+ * \tparam Stat statistic reducer, e.g. red::mean_var
+ * \tparam dimkeep the dimension that will be kept
+ */
+template<typename Stat, int dimkeep, typename SrcExp, typename DType, int etype>
+inline void ReduceStatsExceptDim(Tensor<cpu, 1, DType> out0, Tensor<cpu, 1, DType> out1,
+                                 const expr::Exp<SrcExp, DType, etype> &src) {
+  static const int dim = expr::ExpInfo<SrcExp>::kDim;
+  expr::TypeCheckPass<(dimkeep >= 0 && dimkeep < dim)>
+      ::Error_Expression_Does_Not_Meet_Dimension_Req();
+  Shape<dim> sshape = expr::ShapeCheck<dim, SrcExp>::Check(src.self());
+  CHECK_EQ(out0.size(0), sshape[dimkeep]) << "ReduceStatsExceptDim: out0 shape mismatch";
+  CHECK_EQ(out1.size(0), sshape[dimkeep]) << "ReduceStatsExceptDim: out1 shape mismatch";
+  if (dimkeep == dim - 1) {
+    expr::ReduceStatsCPU<Stat, DType>::ExceptDimLowest(
+        out0, out1, src.self(), sshape.ProdShape(0, dim - 1), sshape[dim - 1]);
+  } else {
+    const index_t last = sshape[dim - 1];
+    expr::ReduceStatsCPU<Stat, DType>::ExceptDimHigh(
+        out0, out1, src.self(), sshape.ProdShape(0, dimkeep), sshape[dimkeep],
+        sshape.ProdShape(dimkeep + 1, dim) / last, last);
+  }
+}
+/*!
+ * \brief two statistics of the source along axis, computed in one pass, the
+ *  multi-output counterpart of reduce_with_axis (dimdst = dimsrc - 1) and
+ *  reduce_keepdim (dimdst = dimsrc); e.g.
+ *  ReduceStatsWithAxis<red::mean_var>(mean, var, data, 1) gives the layer norm
+ *  statistics of a (batch, hidden) matrix. For red::max_argmax the index
+ *  is the position along axis
+ * \param out0 first statistic
+ * \param out1 second statistic
+ * \param src source expression
+ * \param axis the axis to reduce
+ * \tparam Stat statistic reducer, e.g. red::mean_var
+ */
+template<typename Stat, int dimdst, typename SrcExp, typename DType, int etype>
+inline void ReduceStatsWithAxis(Tensor<cpu, dimdst, DType> out0,
+                                Tensor<cpu, dimdst, DType> out1,
+                                const expr::Exp<SrcExp, DType, etype> &src, int axis) {
+  static const int dimsrc = expr::ExpInfo<SrcExp>::kDim;
+  expr::TypeCheckPass<dimdst == dimsrc || dimdst == dimsrc - 1>
+      ::Error_Expression_Does_Not_Meet_Dimension_Req();
+  // the reduction expression does the shape arithmetic
+  expr::ReduceWithAxisExp<red::sum, SrcExp, DType, dimsrc, false, dimdst> e(src.self(), axis);
+  CHECK_EQ(out0.shape_, e.shape_) << "ReduceStatsWithAxis: out0 shape mismatch";
+  CHECK_EQ(out1.shape_, e.shape_) << "ReduceStatsWithAxis: out1 shape mismatch";
+  const index_t outer = e.shape_.Size() / e.trailing_;
+  // trailing is also 1 when the axis is followed by dimensions of size 1
+  if (e.trailing_ == 1 && e.last_ == e.size_) {
+    expr::ReduceStatsCPU<Stat, DType>::AxisLast(
+        out0.FlatTo2D(), out1.FlatTo2D(), src.self(), outer, e.size_);
+  } else {
+    expr::ReduceStatsCPU<Stat, DType>::AxisOuter(
+        out0.FlatTo2D(), out1.FlatTo2D(), src.self(), outer, e.size_, e.trailing_);
+  }
+}
+}  // namespace mshadow
+#endif  // MSHADOW_EXTENSION_REDUCE_STATS_H_
@@ -7,7 +7,10 @@
 #ifndef MSHADOW_EXTENSION_REDUCE_WITH_AXIS_H_
 #define MSHADOW_EXTENSION_REDUCE_WITH_AXIS_H_
 
+#include <algorithm>
+#include <vector>
 #include "../extension.h"
+#include "../packet-inl.h"
 
 namespace mshadow {
 namespace expr {
@@ -131,6 +134,239 @@ struct Plan<ReduceWithAxisExp<Reducer, SrcExp, DType, dimsrc, mask, dimdst>, DTy
   Plan<SrcExp, DType> src_;
   const index_t last_dst_dim_, trailing_, size_, last_;
 };
+/*! \brief whether mask (the index of the result) can be found after the reduction */
+template<typename Reducer>
+struct ReduceAxisPacketMask {
+  static const bool kEnabled = false;
+};
+template<>
+struct ReduceAxisPacketMask<red::maximum> {
+  static const bool kEnabled = true;
+};
+template<>
+struct ReduceAxisPacketMask<red::minimum> {
+  static const bool kEnabled = true;
+};
+/*!
+ * \brief row kernels of the reduce_with_axis CPU engine, scalar version
+ *  reading the source through its plan without index arithmetic
+ */
+template<typename Reducer, bool mask, bool pass_packet>
+struct ReduceAxisRowCPU {
+  /*! \brief reduce the contiguous source row, index of the result kept in idx */
+  template<typename SrcExp, typename DType>
+  inline static void ReduceRow(const SrcExp &src, index_t row, index_t size,
+                               DType *p_res, index_t *p_idx) {
+    Plan<SrcExp, DType> splan = MakePlan(src);
+    DType res; Reducer::SetInitValue(res);
+    index_t idx = 0;
+    for (index_t k = 0; k < size; ++k) {
+      if (mask) {
+        DType tmp = res;
+        Reducer::Reduce(res, splan.Eval(row, k));
+        if (tmp != res) idx = k;
+      } else {
+        Reducer::Reduce(res, splan.Eval(row, k));
+      }
+    }
+    *p_res = res; *p_idx = idx;
+  }
+  /*!
+   * \brief fold columns [x_begin, x_end) of the source rows base + k * nsub,
+   *  k in [0, size), element-wise into acc
+   */
+  template<typename SrcExp, typename DType>
+  inline static void FoldRows(const SrcExp &src, index_t base, index_t nsub, index_t size,
+                              index_t x_begin, index_t x_end, DType *acc, index_t *idx) {
+    Plan<SrcExp, DType> splan = MakePlan(src);
+    const index_t n = x_end - x_begin;
+    for (index_t j = 0; j < n; ++j) Reducer::SetInitValue(acc[j]);
+    for (index_t k = 0; k < size; ++k) {
+      const index_t row = base + k * nsub;
+      for (index_t j = 0; j < n; ++j) {
+        if (mask) {
+          DType tmp = acc[j];
+          Reducer::Reduce(acc[j], splan.Eval(row, x_begin + j));
+          if (tmp != acc[j]) idx[j] = k;
+        } else {
+          Reducer::Reduce(acc[j], splan.Eval(row, x_begin + j));
+        }
+      }
+    }
+  }
+};
+/*!
+ * \brief packet version, source rows are aligned; the mask of a last axis
+ *  reduction is the first position holding the result, which is where the
+ *  scalar scan settles for maximum and minimum
+ */
+template<typename Reducer, bool mask>
+struct ReduceAxisRowCPU<Reducer, mask, true> {
+  template<typename SrcExp, typename DType>
+  inline static void ReduceRow(const SrcExp &src, index_t row, index_t size,
+                               DType *p_res, index_t *p_idx) {
+    typedef packet::Packet<DType, MSHADOW_DEFAULT_PACKET> Packet;
+    typedef packet::PacketReducer<Reducer, DType, MSHADOW_DEFAULT_PACKET> PReducer;
+    PacketPlan<SrcExp, DType, MSHADOW_DEFAULT_PACKET> splan =
+        MakePacketPlan<MSHADOW_DEFAULT_PACKET>(src);
+    const index_t klen = packet::LowerAlign<DType, MSHADOW_DEFAULT_PACKET>(size);
+    DType res; Reducer::SetInitValue(res);
+    Packet acc = Packet::Fill(res);
+    for (index_t k = 0; k < klen; k += Packet::size) {
+      PReducer::Reduce(acc, splan.EvalPacket(row, k));
+    }
+    MSHADOW_ALIGNED(16) DType lanes[Packet::size];
+    acc.Store(lanes);
+    for (index_t l = 0; l < Packet::size; ++l) {
+      Reducer::Reduce(res, lanes[l]);
+    }
+    for (index_t k = klen; k < size; ++k) {
+      Reducer::Reduce(res, splan.Eval(row, k));
+    }
+    index_t idx = 0;
+    if (mask) {
+      for (index_t k = 0; k < size; ++k) {
+        if (splan.Eval(row, k) == res) {
+          idx = k; break;
+        }
+      }
+    }
+    *p_res = res; *p_idx = idx;
+  }
+  template<typename SrcExp, typename DType>
+  inline static void FoldRows(const SrcExp &src, index_t base, index_t nsub, index_t size,
+                              index_t x_begin, index_t x_end, DType *acc, index_t *idx) {
+    if (mask) {
+      ReduceAxisRowCPU<Reducer, mask, false>::FoldRows(src, base, nsub, size,
+                                                       x_begin, x_end, acc, idx);
+      return;
+    }
+    // x_begin is packet aligned, acc need not be
+    typedef packet::Packet<DType, MSHADOW_DEFAULT_PACKET> Packet;
+    typedef packet::PacketReducer<Reducer, DType, MSHADOW_DEFAULT_PACKET> PReducer;
+    PacketPlan<SrcExp, DType, MSHADOW_DEFAULT_PACKET> splan =
+        MakePacketPlan<MSHADOW_DEFAULT_PACKET>(src);
+    const index_t n = x_end - x_begin;
+    const index_t nlen = packet::LowerAlign<DType, MSHADOW_DEFAULT_PACKET>(n);
+    DType init; Reducer::SetInitValue(init);
+    MSHADOW_ALIGNED(16) DType lanes[Packet::size];
+    for (index_t j = 0; j < nlen; j += Packet::size) {
+      Packet res = Packet::Fill(init);
+      for (index_t k = 0; k < size; ++k) {
+        PReducer::Reduce(res, splan.EvalPacket(base + k * nsub, x_begin + j));
+      }
+      res.Store(lanes);
+      for (index_t l = 0; l < Packet::size; ++l) acc[j + l] = lanes[l];
+    }
+    for (index_t j = nlen; j < n; ++j) {
+      acc[j] = init;
+      for (index_t k = 0; k < size; ++k) {
+        Reducer::Reduce(acc[j], splan.Eval(base + k * nsub, x_begin + j));
+      }
+    }
+  }
+};
+/*!
+ * \brief CPU engine of reduce_with_axis, the source is seen as
+ *  (outer, size, trailing) where trailing is 1 or a multiple of the source
+ *  row length, so every reduction reads whole contiguous rows
+ */
+template<typename Reducer, bool mask, bool pass_packet>
+struct ReduceAxisCPU {
+  typedef ReduceAxisRowCPU<Reducer, mask, pass_packet> RowKernel;
+  /*! \brief trailing == 1: output x is the reduction of source row x */
+  template<typename SV, typename SrcExp, typename DType>
+  inline static void EvalLastAxis(Tensor<cpu, 2, DType> dst, const SrcExp &src,
+                                  index_t outer, index_t size) {
+    const index_t width = dst.size(1);
+    #pragma omp parallel for
+    for (openmp_index_t x = 0; x < outer; ++x) {
+      DType res;
+      index_t idx;
+      RowKernel::ReduceRow(src, x, size, &res, &idx);
+      SV::template Save<DType>(dst[x / width][x % width],
+                               mask ? static_cast<DType>(static_cast<int>(idx)) : res);
+    }
+  }
+  /*!
+   * \brief trailing > 1: each of the outer * trailing / last output rows folds
+   *  size source rows, split into column blocks when the rows are too few
+   *  to keep the threads busy
+   */
+  template<typename SV, typename SrcExp, typename DType>
+  inline static void EvalOuterAxis(Tensor<cpu, 2, DType> dst, const SrcExp &src,
+                                   index_t outer, index_t size, index_t trailing) {
+    const index_t last = dst.size(1), nsub = trailing / last;
+    const index_t nrow = outer * nsub;
+    const index_t align = packet::UpperAlign<DType, MSHADOW_DEFAULT_PACKET>(1);
+    const index_t nblock = std::max(static_cast<index_t>(1),
+        std::min(GetOMPMaxThreads() / nrow, last / 256));
+    const index_t block = ((last + nblock - 1) / nblock + align - 1) / align * align;
+    #pragma omp parallel for
+    for (openmp_index_t t = 0; t < nrow * nblock; ++t) {
+      const index_t r = t / nblock, x_begin = t % nblock * block;
+      const index_t x_end = std::min(x_begin + block, last);
+      if (x_begin >= x_end) continue;
+      // source row of (x, k, sub) is (x * size + k) * nsub + sub
+      const index_t base = r / nsub * size * nsub + r % nsub;
+      std::vector<DType> acc(x_end - x_begin);
+      std::vector<index_t> idx(mask ? x_end - x_begin : 1, 0);
+      RowKernel::FoldRows(src, base, nsub, size, x_begin, x_end, &acc[0], &idx[0]);
+      DType *out = dst[r].dptr_;
+      for (index_t j = x_begin; j < x_end; ++j) {
+        SV::template Save<DType>(out[j], mask ?
+            static_cast<DType>(static_cast<int>(idx[j - x_begin])) : acc[j - x_begin]);
+      }
+    }
+  }
+  /*!
+   * \brief last is the source row length; trailing is also 1 when the axis
+   *  is followed by dimensions of size 1, those are folds of one column
+   */
+  template<typename SV, typename SrcExp, typename DType>
+  inline static void Eval(Tensor<cpu, 2, DType> dst, const SrcExp &src,
+                          index_t outer, index_t size, index_t trailing, index_t last) {
+    if (trailing == 1 && last == size) {
+      EvalLastAxis<SV>(dst, src, outer, size);
+    } else {
+      EvalOuterAxis<SV>(dst, src, outer, size, trailing);
+    }
+  }
+};
 }  // namespace expr
+/*!
+ * \brief tensor = reduce_with_axis(...) or reduce_keepdim(...) on CPU is
+ *  computed by ReduceAxisCPU, by packets when the source packs and is aligned
+ */
+template<typename SV, typename Reducer, typename SrcExp, typename DType,
+         int dimsrc, bool mask, int dimdst>
+struct MapExpCPUEngine<false, SV, Tensor<cpu, dimdst, DType>, dimdst, DType,
+                       expr::MakeTensorExp<expr::ReduceWithAxisExp<Reducer, SrcExp, DType,
+                                                                   dimsrc, mask, dimdst>,
+                                           SrcExp, dimdst, DType>,
+                       expr::type::kChainer> {
+  inline static void Map(Tensor<cpu, dimdst, DType> *dst,
+                         const expr::Exp<expr::MakeTensorExp<
+                           expr::ReduceWithAxisExp<Reducer, SrcExp, DType, dimsrc, mask, dimdst>,
+                           SrcExp, dimdst, DType>, DType, expr::type::kChainer> &exp) {
+    using namespace expr;
+    const ReduceWithAxisExp<Reducer, SrcExp, DType, dimsrc, mask, dimdst> &e =
+        exp.self().real_self();
+    const bool kPacket = PacketCheck<SrcExp, MSHADOW_DEFAULT_PACKET>::kPass &&
+        packet::PacketReducer<Reducer, DType, MSHADOW_DEFAULT_PACKET>::kEnabled &&
+        (!mask || ReduceAxisPacketMask<Reducer>::kEnabled);
+    const bool pass_packet = kPacket &&
+        PacketAlignCheck<dimsrc, SrcExp, MSHADOW_DEFAULT_PACKET>::Check(e.src_);
+    const index_t outer = e.shape_.Size() / e.trailing_;
+    Tensor<cpu, 2, DType> out = dst->FlatTo2D();
+    if (pass_packet) {
+      ReduceAxisCPU<Reducer, mask, kPacket>::template Eval<SV>(
+          out, e.src_, outer, e.size_, e.trailing_, e.last_);
+    } else {
+      ReduceAxisCPU<Reducer, mask, false>::template Eval<SV>(
+          out, e.src_, outer, e.size_, e.trailing_, e.last_);
+    }
+  }
+};
 }  // namespace mshadow
 #endif  // MSHADOW_EXTENSION_REDUCE_WITH_AXIS_H_
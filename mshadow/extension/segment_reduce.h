@@ -0,0 +1,458 @@
+/*!
+ *  Copyright (c) 2017 by Contributors
+ * \file segment_reduce.h
+ * \brief reduction over and broadcasting to variable-length segments of the
+ *  first axis, for sequences packed into one tensor with an offsets vector
+ */
+#ifndef MSHADOW_EXTENSION_SEGMENT_REDUCE_H_
+#define MSHADOW_EXTENSION_SEGMENT_REDUCE_H_
+#include <algorithm>
+#include <vector>
+#include "../extension.h"
+#include "../packet-inl.h"
+
+namespace mshadow {
+namespace expr {
+/*!
+ * \brief reduce every segment [offsets[s], offsets[s + 1]) of the first axis
+ *  of src, the result has shape[0] = number of segments
+ * \tparam Reducer type of reducer
+ * \tparam SrcExp type of source expression
+ * \tparam IndexExp type of the offsets expression
+ * \tparam DType data type
+ * \tparam IType type of the offsets
+ * \tparam dim dimension of source and result
+ * \tparam normalize whether the result is divided by the segment length
+ */
+template<typename Reducer, typename SrcExp, typename IndexExp, typename DType,
+         typename IType, int dim, bool normalize>
+struct SegmentReduceExp:
+    public MakeTensorExp<SegmentReduceExp<Reducer, SrcExp, IndexExp, DType, IType,
+                                          dim, normalize>, SrcExp, dim, DType> {
+  /*! \brief source operand */
+  const SrcExp &src_;
+  /*! \brief segment offsets, nseg + 1 non-decreasing entries */
+  const IndexExp &offsets_;
+  /*! \brief number of source rows per position of the first axis */
+  index_t inner_;
+  /*! \brief number of positions of the first axis of the source */
+  index_t size_;
+  /*! constructor */
+  SegmentReduceExp(const SrcExp &src, const IndexExp &offsets)
+      : src_(src), offsets_(offsets) {
+    Shape<dim> sshape = ShapeCheck<dim, SrcExp>::Check(src_);
+    Shape<1> oshape = ShapeCheck<1, IndexExp>::Check(offsets_);
+    CHECK_GE(oshape[0], 1U) << "SegmentReduce: offsets must have nseg + 1 entries";
+    this->shape_ = sshape;
+    this->shape_[0] = oshape[0] - 1;
+    this->inner_ = sshape.ProdShape(1, dim - 1);
+    this->size_ = sshape[0];
+  }
+};
+/*!
+ * \brief reduce the segments of the first axis of src,
+ *  empty segments give the initial value of the reducer
+ * \param src source of at least two dimensions, segments are packed along
+ *  its first axis; a vector is reshaped to (size, 1)
+ * \param offsets segment boundaries, nseg + 1 non-decreasing positions,
+ *  on the device of src
+ * \tparam Reducer type of reducer
+ */
+template<typename Reducer, typename SrcExp, typename IndexExp, typename DType,
+         typename IType, int e1, int e2>
+inline SegmentReduceExp<Reducer, SrcExp, IndexExp, DType, IType,
+                        ExpInfo<SrcExp>::kDim, false>
+segment_reduce(const Exp<SrcExp, DType, e1> &src, const Exp<IndexExp, IType, e2> &offsets) {
+  TypeCheckPass<ExpInfo<SrcExp>::kDim >= 2 && ExpInfo<IndexExp>::kDim == 1>
+      ::Error_Expression_Does_Not_Meet_Dimension_Req();
+  return SegmentReduceExp<Reducer, SrcExp, IndexExp, DType, IType,
+                          ExpInfo<SrcExp>::kDim, false>(src.self(), offsets.self());
+}
+/*!
+ * \brief mean over the segments of the first axis of src,
+ *  empty segments give 0
+ * \param src source of at least two dimensions, segments are packed along
+ *  its first axis
+ * \param offsets segment boundaries, nseg + 1 non-decreasing positions
+ */
+template<typename SrcExp, typename IndexExp, typename DType, typename IType, int e1, int e2>
+inline SegmentReduceExp<red::sum, SrcExp, IndexExp, DType, IType,
+                        ExpInfo<SrcExp>::kDim, true>
+segment_mean(const Exp<SrcExp, DType, e1> &src, const Exp<IndexExp, IType, e2> &offsets) {
+  TypeCheckPass<ExpInfo<SrcExp>::kDim >= 2 && ExpInfo<IndexExp>::kDim == 1>
+      ::Error_Expression_Does_Not_Meet_Dimension_Req();
+  return SegmentReduceExp<red::sum, SrcExp, IndexExp, DType, IType,
+                          ExpInfo<SrcExp>::kDim, true>(src.self(), offsets.self());
+}
+/*!
+ * \brief copy entry s of the first axis of src to every position of
+ *  segment s, the reverse of segment_reduce; positions outside the segments are 0
+ * \tparam SrcExp type of source expression
+ * \tparam IndexExp type of the offsets expression
+ * \tparam DType data type
+ * \tparam IType type of the offsets
+ * \tparam dim dimension of source and result
+ */
+template<typename SrcExp, typename IndexExp, typename DType, typename IType, int dim>
+struct SegmentBroadcastExp:
+    public MakeTensorExp<SegmentBroadcastExp<SrcExp, IndexExp, DType, IType, dim>,
+                         SrcExp, dim, DType> {
+  /*! \brief source operand */
+  const SrcExp &src_;
+  /*! \brief segment offsets, nseg + 1 non-decreasing entries */
+  const IndexExp &offsets_;
+  /*! \brief number of rows per position of the first axis */
+  index_t inner_;
+  /*! \brief number of segments */
+  index_t nseg_;
+  /*! \brief whether the value is divided by the segment length */
+  bool normalize_;
+  /*! constructor */
+  SegmentBroadcastExp(const SrcExp &src, const IndexExp &offsets, index_t size, bool normalize)
+      : src_(src), offsets_(offsets), normalize_(normalize) {
+    Shape<dim> sshape = ShapeCheck<dim, SrcExp>::Check(src_);
+    Shape<1> oshape = ShapeCheck<1, IndexExp>::Check(offsets_);
+    CHECK_EQ(oshape[0], sshape[0] + 1)
+      << "SegmentBroadcast: offsets must have src.size(0) + 1 entries";
+    this->shape_ = sshape;
+    this->shape_[0] = size;
+    this->inner_ = sshape.ProdShape(1, dim - 1);
+    this->nseg_ = sshape[0];
+  }
+};
+/*!
+ * \brief broadcast the per segment values of src to the positions of their
+ *  segments, the gradient of segment_reduce<red::sum>, or of segment_mean
+ *  when normalize is set
+ * \param src per segment values of at least two dimensions, shape[0] = nseg
+ * \param offsets segment boundaries, nseg + 1 non-decreasing positions
+ * \param size length of the first axis of the result
+ * \param normalize divide by the segment length
+ */
+template<typename SrcExp, typename IndexExp, typename DType, typename IType, int e1, int e2>
+inline SegmentBroadcastExp<SrcExp, IndexExp, DType, IType, ExpInfo<SrcExp>::kDim>
+segment_broadcast(const Exp<SrcExp, DType, e1> &src, const Exp<IndexExp, IType, e2> &offsets,
+                  index_t size, bool normalize = false) {
+  TypeCheckPass<ExpInfo<SrcExp>::kDim >= 2 && ExpInfo<IndexExp>::kDim == 1>
+      ::Error_Expression_Does_Not_Meet_Dimension_Req();
+  return SegmentBroadcastExp<SrcExp, IndexExp, DType, IType, ExpInfo<SrcExp>::kDim>
+      (src.self(), offsets.self(), size, normalize);
+}
+//----------------------
+// Execution plan
+//----------------------
+template<typename Reducer, typename SrcExp, typename IndexExp, typename DType,
+         typename IType, int dim, bool normalize>
+struct Plan<SegmentReduceExp<Reducer, SrcExp, IndexExp, DType, IType, dim, normalize>, DType> {
+ public:
+  explicit Plan(const SegmentReduceExp<Reducer, SrcExp, IndexExp, DType,
+                                       IType, dim, normalize> &e)
+      : src_(MakePlan(e.src_)), offsets_(MakePlan(e.offsets_)), inner_(e.inner_) {}
+  MSHADOW_XINLINE DType Eval(index_t i, index_t j) const {
+    const index_t s = i / inner_, r = i % inner_;
+    const index_t begin = static_cast<index_t>(offsets_.Eval(0, s));
+    const index_t end = static_cast<index_t>(offsets_.Eval(0, s + 1));
+    DType res; Reducer::SetInitValue(res);
+    for (index_t k = begin; k < end; ++k) {
+      Reducer::Reduce(res, src_.Eval(k * inner_ + r, j));
+    }
+    if (normalize && end > begin) res /= static_cast<DType>(end - begin);
+    return res;
+  }
+
+ private:
+  Plan<SrcExp, DType> src_;
+  Plan<IndexExp, IType> offsets_;
+  const index_t inner_;
+};
+template<typename SrcExp, typename IndexExp, typename DType, typename IType, int dim>
+struct Plan<SegmentBroadcastExp<SrcExp, IndexExp, DType, IType, dim>, DType> {
+ public:
+  explicit Plan(const SegmentBroadcastExp<SrcExp, IndexExp, DType, IType, dim> &e)
+      : src_(MakePlan(e.src_)), offsets_(MakePlan(e.offsets_)),
+        inner_(e.inner_), nseg_(e.nseg_), normalize_(e.normalize_) {}
+  MSHADOW_XINLINE DType Eval(index_t i, index_t j) const {
+    const index_t k = i / inner_, r = i % inner_;
+    // the segment holding position k is the last one starting at or before k
+    index_t lo = 0, hi = nseg_;
+    while (lo < hi) {
+      const index_t mid = (lo + hi) / 2;
+      if (static_cast<index_t>(offsets_.Eval(0, mid + 1)) <= k) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    if (lo == nseg_ || static_cast<index_t>(offsets_.Eval(0, lo)) > k) {
+      return DType(0.0f);
+    }
+    DType res = src_.Eval(lo * inner_ + r, j);
+    if (normalize_) {
+      res /= static_cast<DType>(offsets_.Eval(0, lo + 1) - offsets_.Eval(0, lo));
+    }
+    return res;
+  }
+
+ private:
+  Plan<SrcExp, DType> src_;
+  Plan<IndexExp, IType> offsets_;
+  const index_t inner_, nseg_;
+  const bool normalize_;
+};
+/*! \brief read and check the offsets of a segmented expression on the host */
+template<typename IndexExp, typename IType>
+inline std::vector<index_t> SegmentOffsetsCPU(const IndexExp &offsets, index_t size) {
+  Shape<1> oshape = ShapeCheck<1, IndexExp>::Check(offsets);
+  Plan<IndexExp, IType> oplan = MakePlan(offsets);
+  std::vector<index_t> off(oshape[0]);
+  for (index_t s = 0; s < oshape[0]; ++s) {
+    off[s] = static_cast<index_t>(oplan.Eval(0, s));
+    CHECK(s == 0 ? off[s] >= 0 : off[s] >= off[s - 1])
+      << "Segment: offsets must be non-decreasing from 0";
+  }
+  CHECK_LE(off.back(), size) << "Segment: offsets exceed the first axis";
+  return off;
+}
+/*!
+ * \brief row kernel of the segmented reduction: fold source rows
+ *  [begin, end) into acc, row r going to acc row (r - begin) % inner
+ */
+template<typename Reducer, bool pass_packet>
+struct SegmentRowsCPU {
+  template<typename SrcExp, typename DType>
+  inline static void Fold(const SrcExp &src, index_t begin, index_t end, index_t inner,
+                          index_t last, DType *acc, index_t stride) {
+    Plan<SrcExp, DType> splan = MakePlan(src);
+    for (index_t row = begin, r = 0; row < end; ++row) {
+      DType *a = acc + r * stride;
+      for (index_t j = 0; j < last; ++j) {
+        Reducer::Reduce(a[j], splan.Eval(row, j));
+      }
+      if (++r == inner) r = 0;
+    }
+  }
+};
+/*! \brief packet version, source rows and acc rows are aligned */
+template<typename Reducer>
+struct SegmentRowsCPU<Reducer, true> {
+  template<typename SrcExp, typename DType>
+  inline static void Fold(const SrcExp &src, index_t begin, index_t end, index_t inner,
+                          index_t last, DType *acc, index_t stride) {
+    typedef packet::Packet<DType, MSHADOW_DEFAULT_PACKET> Packet;
+    typedef packet::PacketReducer<Reducer, DType, MSHADOW_DEFAULT_PACKET> PReducer;
+    PacketPlan<SrcExp, DType, MSHADOW_DEFAULT_PACKET> splan =
+        MakePacketPlan<MSHADOW_DEFAULT_PACKET>(src);
+    const index_t xlen = packet::LowerAlign<DType, MSHADOW_DEFAULT_PACKET>(last);
+    for (index_t row = begin, r = 0; row < end; ++row) {
+      DType *a = acc + r * stride;
+      for (index_t j = 0; j < xlen; j += Packet::size) {
+        Packet res = Packet::Load(a + j);
+        PReducer::Reduce(res, splan.EvalPacket(row, j));
+        res.Store(a + j);
+      }
+      for (index_t j = xlen; j < last; ++j) {
+        Reducer::Reduce(a[j], splan.Eval(row, j));
+      }
+      if (++r == inner) r = 0;
+    }
+  }
+};
+/*!
+ * \brief CPU engine of segment_reduce. The work is cut into tasks of about
+ *  the same number of rows: short segments are grouped whole into a task,
+ *  long ones are split into pieces reduced into partial buffers, then
+ *  merged in order, so skewed lengths still keep every thread busy
+ */
+template<typename Reducer, bool normalize, bool pass_packet>
+struct SegmentReduceCPU {
+  /*! \brief segments [seg_begin, seg_end) whole, or a piece of segment seg_begin */
+  struct Task {
+    index_t seg_begin, seg_end, pos_begin, pos_end, slot;
+  };
+  template<typename SV, typename SrcExp, typename DType>
+  inline static void Eval(Tensor<cpu, 2, DType> dst, const SrcExp &src,
+                          const std::vector<index_t> &off, index_t inner) {
+    const index_t nseg = static_cast<index_t>(off.size()) - 1, last = dst.size(1);
+    // grain in positions of the first axis, an empty segment counts as one
+#if MSHADOW_DETERMINISTIC_REDUCE
+    const index_t grain = std::max(static_cast<index_t>(1), MSHADOW_REDUCE_CHUNK / inner);
+#else
+    const index_t nthread = GetOMPMaxThreads();
+    const index_t grain = nthread == 1 ? off[nseg] - off[0] + nseg :
+        std::max(static_cast<index_t>(1),
+                 (off[nseg] - off[0] + nseg + 4 * nthread - 1) / (4 * nthread));
+#endif
+    std::vector<Task> tasks;
+    // split segments as (segment, first slot, number of pieces)
+    std::vector<index_t> split;
+    index_t nslot = 0, cost = 0;
+    for (index_t s = 0; s < nseg; ++s) {
+      const index_t len = off[s + 1] - off[s];
+      if (len > grain) {
+        const index_t npiece = (len + grain - 1) / grain;
+        for (index_t p = 0; p < npiece; ++p) {
+          Task t = {s, s + 1, off[s] + len * p / npiece, off[s] + len * (p + 1) / npiece,
+                    nslot + p};
+          tasks.push_back(t);
+        }
+        split.push_back(s); split.push_back(nslot); split.push_back(npiece);
+        nslot += npiece;
+        cost = 0;
+        continue;
+      }
+      if (cost == 0) {
+        Task t = {s, s, 0, 0, -1};
+        tasks.push_back(t);
+      }
+      tasks.back().seg_end = s + 1;
+      cost += std::max(len, static_cast<index_t>(1));
+      if (cost >= grain) cost = 0;
+    }
+    const index_t nrow = std::max(nslot, static_cast<index_t>(1)) * inner;
+    size_t pitch;
+    DType *partial = static_cast<DType*>(
+        packet::AlignedMallocPitch(&pitch, last * sizeof(DType), nrow));
+    const index_t stride = pitch / sizeof(DType);
+    DType init; Reducer::SetInitValue(init);
+    #pragma omp parallel for
+    for (openmp_index_t i = 0; i < static_cast<index_t>(tasks.size()); ++i) {
+      const Task &t = tasks[i];
+      if (t.slot >= 0) {
+        DType *acc = partial + t.slot * inner * stride;
+        std::fill(acc, acc + inner * stride, init);
+        SegmentRowsCPU<Reducer, pass_packet>::Fold(src, t.pos_begin * inner, t.pos_end * inner,
+                                                   inner, last, acc, stride);
+        continue;
+      }
+      size_t acc_pitch;
+      DType *acc = static_cast<DType*>(
+          packet::AlignedMallocPitch(&acc_pitch, last * sizeof(DType), inner));
+      const index_t acc_stride = acc_pitch / sizeof(DType);
+      for (index_t s = t.seg_begin; s < t.seg_end; ++s) {
+        std::fill(acc, acc + inner * acc_stride, init);
+        SegmentRowsCPU<Reducer, pass_packet>::Fold(src, off[s] * inner, off[s + 1] * inner,
+                                                   inner, last, acc, acc_stride);
+        Save<SV>(dst, acc, s, inner, last, acc_stride, off[s + 1] - off[s]);
+      }
+      packet::AlignedFree(acc);
+    }
+    // merge the pieces of each split segment in order
+    const index_t nsplit = static_cast<index_t>(split.size()) / 3;
+    #pragma omp parallel for
+    for (openmp_index_t i = 0; i < nsplit * inner; ++i) {
+      const index_t s = split[i / inner * 3], r = i % inner;
+      const index_t slot = split[i / inner * 3 + 1], npiece = split[i / inner * 3 + 2];
+      DType *acc = partial + (slot * inner + r) * stride;
+      for (index_t p = 1; p < npiece; ++p) {
+        DType *src_acc = partial + ((slot + p) * inner + r) * stride;
+        for (index_t j = 0; j < last; ++j) Reducer::Merge(acc[j], src_acc[j]);
+      }
+      Save<SV>(dst, acc, s * inner + r, 1, last, stride, off[s + 1] - off[s]);
+    }
+    packet::AlignedFree(partial);
+  }
+
+ private:
+  /*! \brief save nrow accumulated rows to dst rows starting at row */
+  template<typename SV, typename DType>
+  inline static void Save(Tensor<cpu, 2, DType> dst, const DType *acc, index_t seg,
+                          index_t nrow, index_t last, index_t stride, index_t len) {
+    const DType scale = static_cast<DType>(std::max(len, static_cast<index_t>(1)));
+    for (index_t r = 0; r < nrow; ++r) {
+      DType *out = dst[seg * nrow + r].dptr_;
+      const DType *a = acc + r * stride;
+      for (index_t j = 0; j < last; ++j) {
+        SV::template Save<DType>(out[j], normalize ? a[j] / scale : a[j]);
+      }
+    }
+  }
+};
+}  // namespace expr
+/*!
+ * \brief tensor = segment_reduce(...) on CPU is computed by SegmentReduceCPU,
+ *  by packets when the source packs and is aligned
+ */
+template<typename SV, typename Reducer, typename SrcExp, typename IndexExp, typename DType,
+         typename IType, int dim, bool normalize>
+struct MapExpCPUEngine<false, SV, Tensor<cpu, dim, DType>, dim, DType,
+                       expr::MakeTensorExp<expr::SegmentReduceExp<Reducer, SrcExp, IndexExp,
+                                                                  DType, IType, dim, normalize>,
+                                           SrcExp, dim, DType>,
+                       expr::type::kChainer> {
+  inline static void Map(Tensor<cpu, dim, DType> *dst,
+                         const expr::Exp<expr::MakeTensorExp<
+                           expr::SegmentReduceExp<Reducer, SrcExp, IndexExp, DType, IType,
+                                                  dim, normalize>,
+                           SrcExp, dim, DType>, DType, expr::type::kChainer> &exp) {
+    using namespace expr;
+    const SegmentReduceExp<Reducer, SrcExp, IndexExp, DType, IType, dim, normalize> &e =
+        exp.self().real_self();
+    const std::vector<index_t> off = SegmentOffsetsCPU<IndexExp, IType>(e.offsets_, e.size_);
+    const bool kPacket = PacketCheck<SrcExp, MSHADOW_DEFAULT_PACKET>::kPass &&
+        packet::PacketReducer<Reducer, DType, MSHADOW_DEFAULT_PACKET>::kEnabled;
+    const bool pass_packet = kPacket &&
+        PacketAlignCheck<dim, SrcExp, MSHADOW_DEFAULT_PACKET>::Check(e.src_);
+    Tensor<cpu, 2, DType> out = dst->FlatTo2D();
+    if (pass_packet) {
+      SegmentReduceCPU<Reducer, normalize, kPacket>::template Eval<SV>(
+          out, e.src_, off, e.inner_);
+    } else {
+      SegmentReduceCPU<Reducer, normalize, false>::template Eval<SV>(
+          out, e.src_, off, e.inner_);
+    }
+  }
+};
+/*!
+ * \brief tensor = segment_broadcast(...) on CPU walks the segments instead of
+ *  searching the segment of every element; the positions are cut evenly
+ *  over the threads whatever the segment lengths
+ */
+template<typename SV, typename SrcExp, typename IndexExp, typename DType,
+         typename IType, int dim>
+struct MapExpCPUEngine<false, SV, Tensor<cpu, dim, DType>, dim, DType,
+                       expr::MakeTensorExp<expr::SegmentBroadcastExp<SrcExp, IndexExp,
+                                                                     DType, IType, dim>,
+                                           SrcExp, dim, DType>,
+                       expr::type::kChainer> {
+  inline static void Map(Tensor<cpu, dim, DType> *dst,
+                         const expr::Exp<expr::MakeTensorExp<
+                           expr::SegmentBroadcastExp<SrcExp, IndexExp, DType, IType, dim>,
+                           SrcExp, dim, DType>, DType, expr::type::kChainer> &exp) {
+    using namespace expr;
+    const SegmentBroadcastExp<SrcExp, IndexExp, DType, IType, dim> &e = exp.self().real_self();
+    const std::vector<index_t> off =
+        SegmentOffsetsCPU<IndexExp, IType>(e.offsets_, e.shape_[0]);
+    Tensor<cpu, 2, DType> out = dst->FlatTo2D();
+    Plan<SrcExp, DType> splan = MakePlan(e.src_);
+    const index_t size = e.shape_[0], inner = e.inner_, last = out.size(1);
+    const index_t ntask = std::max(static_cast<index_t>(1),
+        std::min(size, 4 * static_cast<index_t>(GetOMPMaxThreads())));
+    #pragma omp parallel for
+    for (openmp_index_t t = 0; t < ntask; ++t) {
+      const index_t begin = size * t / ntask, end = size * (t + 1) / ntask;
+      // first segment ending after begin
+      index_t s = std::upper_bound(off.begin() + 1, off.end(), begin) - off.begin() - 1;
+      for (index_t k = begin; k < end; ++k) {
+        while (s < e.nseg_ && off[s + 1] <= k) ++s;
+        const bool inside = s < e.nseg_ && off[s] <= k;
+        const DType len = inside ? static_cast<DType>(off[s + 1] - off[s]) : DType(1.0f);
+        for (index_t r = 0; r < inner; ++r) {
+          DType *o = out[k * inner + r].dptr_;
+          if (!inside) {
+            for (index_t j = 0; j < last; ++j) SV::template Save<DType>(o[j], DType(0.0f));
+          } else if (e.normalize_) {
+            for (index_t j = 0; j < last; ++j) {
+              SV::template Save<DType>(o[j], splan.Eval(s * inner + r, j) / len);
+            }
+          } else {
+            for (index_t j = 0; j < last; ++j) {
+              SV::template Save<DType>(o[j], splan.Eval(s * inner + r, j));
+            }
+          }
+        }
+      }
+    }
+  }
+};
+}  // namespace mshadow
+#endif  // MSHADOW_EXTENSION_SEGMENT_REDUCE_H_
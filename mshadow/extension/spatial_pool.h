@@ -7,6 +7,7 @@
 #ifndef MSHADOW_EXTENSION_SPATIAL_POOL_H_
 #define MSHADOW_EXTENSION_SPATIAL_POOL_H_
 #include <algorithm>
+#include <vector>
 #include "../extension.h"
 namespace mshadow {
 namespace expr {
@@ -16,11 +17,15 @@ namespace expr {
  * \tparam SrcExp source expression to be pooled from
  * \tparam DType the content data type
  * \tparam srcdim dimension of src
+ * \tparam layout layout of the image, kNCHW or kNHWC
  */
-template<typename Reducer, typename SrcExp, typename DType, int srcdim>
+template<typename Reducer, typename SrcExp, typename DType, int srcdim, int layout = kNCHW>
 struct PoolingExp:
-      public MakeTensorExp<PoolingExp<Reducer, SrcExp, DType, srcdim>,
+      public MakeTensorExp<PoolingExp<Reducer, SrcExp, DType, srcdim, layout>,
                            SrcExp, srcdim, DType> {
+  /*! \brief height and width axes */
+  static const int kHeightAxis = srcdim - LayoutType<layout>::kHeightFromLast;
+  static const int kWidthAxis = srcdim - LayoutType<layout>::kWidthFromLast;
   /*! \brief source operand */
   const SrcExp &src_;
   /*! \brief kernel size in height */
@@ -41,13 +46,13 @@ struct PoolingExp:
              : src_(src), ksize_y_(ksize_y), ksize_x_(ksize_x),
                kstride_y_(kstride_y), kstride_x_(kstride_x) {
     Shape<srcdim> sshape = ShapeCheck<srcdim, SrcExp>::Check(src_);
-    CHECK(sshape[srcdim - 1] >= ksize_x && sshape[srcdim - 2] >= ksize_y)
+    CHECK(sshape[kWidthAxis] >= ksize_x && sshape[kHeightAxis] >= ksize_y)
       << "PoolingExp: kernel must be smaller than image";
-    this->src_height_ = sshape[srcdim - 2];
-    this->src_width_  = sshape[srcdim - 1];
+    this->src_height_ = sshape[kHeightAxis];
+    this->src_width_  = sshape[kWidthAxis];
     this->shape_ = sshape;
-    this->shape_[srcdim - 2] = (src_height_ - ksize_y) / kstride_y + 1;
-    this->shape_[srcdim - 1] = (src_width_  - ksize_x) / kstride_x + 1;
+    this->shape_[kHeightAxis] = (src_height_ - ksize_y) / kstride_y + 1;
+    this->shape_[kWidthAxis] = (src_width_  - ksize_x) / kstride_x + 1;
   }
   /*! \brief constructor, specify shape */
   PoolingExp(const SrcExp &src, Shape<2> pshape,
@@ -55,13 +60,13 @@ struct PoolingExp:
              : src_(src), ksize_y_(ksize_y), ksize_x_(ksize_x),
                kstride_y_(kstride_y), kstride_x_(kstride_x) {
     Shape<srcdim> sshape = ShapeCheck<srcdim, SrcExp>::Check(src_);
-    CHECK(sshape[srcdim - 1] >= ksize_x && sshape[srcdim - 2] >= ksize_y)
+    CHECK(sshape[kWidthAxis] >= ksize_x && sshape[kHeightAxis] >= ksize_y)
       << "PoolingExp: kernel must be smaller than image";
-    this->src_height_ = sshape[srcdim - 2];
-    this->src_width_  = sshape[srcdim - 1];
+    this->src_height_ = sshape[kHeightAxis];
+    this->src_width_  = sshape[kWidthAxis];
     this->shape_ = sshape;
-    this->shape_[srcdim - 2] = pshape[0];
-    this->shape_[srcdim - 1] = pshape[1];
+    this->shape_[kHeightAxis] = pshape[0];
+    this->shape_[kWidthAxis] = pshape[1];
   }
 };
 /*!
@@ -110,6 +115,40 @@ pool(const Exp<SrcExp, DType, etype> &src, Shape<2> pshape,
   return PoolingExp<Reducer, SrcExp, DType, ExpInfo<SrcExp>::kDim>
      (src.self(), pshape, ksize_y, ksize_x, kstride_y, kstride_x);
 }
+/*!
+ * \brief pooling of images in the given layout, e.g. pool<red::maximum, kNHWC>(src, ...)
+ * \param src source image, shape: (batch, channel, height, width) for kNCHW,
+ *  (batch, height, width, channel) for kNHWC
+ * \param ksize_y kernel size in height
+ * \param ksize_x kernel size in width
+ * \param kstride_y stride in y directory
+ * \param kstride_x stride in x directory
+ * \return expression of pooled result, in the same layout
+ * \tparam Reducer reducer type
+ * \tparam layout layout of the image, kNCHW or kNHWC
+ */
+template<typename Reducer, int layout, typename SrcExp, typename DType, int etype>
+inline PoolingExp<Reducer, SrcExp, DType, ExpInfo<SrcExp>::kDim, layout>
+pool(const Exp<SrcExp, DType, etype> &src,
+     index_t ksize_y, index_t ksize_x, index_t kstride_y, index_t kstride_x) {
+  TypeCheckPass<ExpInfo<SrcExp>::kDim >= LayoutType<layout>::kHeightFromLast>
+      ::Error_Expression_Does_Not_Meet_Dimension_Req();
+  return PoolingExp<Reducer, SrcExp, DType, ExpInfo<SrcExp>::kDim, layout>
+      (src.self(), ksize_y, ksize_x, kstride_y, kstride_x);
+}
+/*!
+ * \brief same as pool<Reducer, layout>, except the output height and width
+ *  are specified by pshape
+ */
+template<typename Reducer, int layout, typename SrcExp, typename DType, int etype>
+inline PoolingExp<Reducer, SrcExp, DType, ExpInfo<SrcExp>::kDim, layout>
+pool(const Exp<SrcExp, DType, etype> &src, Shape<2> pshape,
+     index_t ksize_y, index_t ksize_x, index_t kstride_y, index_t kstride_x) {
+  TypeCheckPass<ExpInfo<SrcExp>::kDim >= LayoutType<layout>::kHeightFromLast>
+      ::Error_Expression_Does_Not_Meet_Dimension_Req();
+  return PoolingExp<Reducer, SrcExp, DType, ExpInfo<SrcExp>::kDim, layout>
+      (src.self(), pshape, ksize_y, ksize_x, kstride_y, kstride_x);
+}
 //----------------------
 // Execution plan
 //----------------------
@@ -147,6 +186,199 @@ struct Plan<PoolingExp< Reducer, SrcExp, DType, srcdim>, DType> {
   const index_t src_height_, src_width_;
   const index_t new_height_;
 };
+template<typename Reducer, typename SrcExp, typename DType, int srcdim>
+struct Plan<PoolingExp<Reducer, SrcExp, DType, srcdim, kNHWC>, DType> {
+ public:
+  explicit Plan(const PoolingExp<Reducer, SrcExp, DType, srcdim, kNHWC> &e)
+      : src_(MakePlan(e.src_)),
+        ksize_y_(e.ksize_y_), ksize_x_(e.ksize_x_),
+        kstride_y_(e.kstride_y_), kstride_x_(e.kstride_x_),
+        src_height_(e.src_height_), src_width_(e.src_width_),
+        new_height_(e.shape_[srcdim - 3]), new_width_(e.shape_[srcdim - 2]) {}
+  MSHADOW_XINLINE DType Eval(index_t i, index_t j) const {
+    using namespace std;
+    const index_t px = i % new_width_;
+    const index_t idivw = i / new_width_;
+    const index_t py = idivw % new_height_;
+    const index_t n = idivw / new_height_;
+    const index_t y_start = py * kstride_y_;
+    const index_t y_end = min(y_start + ksize_y_, src_height_);
+    const index_t x_start = px * kstride_x_;
+    const index_t x_end = min(x_start + ksize_x_, src_width_);
+
+    DType res; Reducer::SetInitValue(res);
+    for (index_t y = y_start; y < y_end; ++y) {
+      for (index_t x = x_start; x < x_end; ++x) {
+        Reducer::Reduce(res, src_.Eval((n * src_height_ + y) * src_width_ + x, j));
+      }
+    }
+    return res;
+  }
+
+ private:
+  Plan<SrcExp, DType> src_;
+  const index_t ksize_y_, ksize_x_, kstride_y_, kstride_x_;
+  const index_t src_height_, src_width_;
+  const index_t new_height_, new_width_;
+};
+/*!
+ * \brief 1D sliding window reduction used by the separable pooling kernel,
+ *  specialized for the reducers it supports
+ * \tparam Reducer reduction method during pooling
+ * \tparam DType the content data type
+ */
+template<typename Reducer, typename DType>
+struct PoolSlide {
+  /*! \brief whether Reducer is supported */
+  static const bool kSupported = false;
+};
+/*!
+ * \brief max/min over sliding windows by a monotonic deque, every element
+ *  enters and leaves the deque once, whatever the window size
+ */
+template<typename Reducer, typename DType>
+struct PoolSlideDeque {
+  static const bool kSupported = true;
+  /*! \brief type of the intermediate result between the two passes */
+  typedef DType TempType;
+  /*! \brief type of the workspace of Slide */
+  typedef index_t WorkType;
+  /*!
+   * \brief out[j * ostride] = reduce of in[i * istride] over the window
+   *  [j * kstride, min(j * kstride + ksize, n)), j < m, stored by SV
+   */
+  template<typename SV, typename IType, typename OType>
+  inline static void Slide(const IType *in, index_t n, index_t istride,
+                           OType *out, index_t m, index_t ostride,
+                           index_t ksize, index_t kstride, std::vector<WorkType> *work) {
+    if (work->size() < static_cast<size_t>(n)) work->resize(n);
+    index_t *dq = &(*work)[0];
+    index_t head = 0, tail = 0, next = 0;
+    for (index_t j = 0; j < m; ++j) {
+      const index_t start = j * kstride, end = std::min(start + ksize, n);
+      for (; next < end; ++next) {
+        const IType v = in[next * istride];
+        // drop the elements that can no longer be the result
+        while (tail != head) {
+          IType res = in[dq[tail - 1] * istride];
+          Reducer::Reduce(res, v);
+          if (!(res == v)) break;
+          --tail;
+        }
+        dq[tail++] = next;
+      }
+      while (head != tail && dq[head] < start) ++head;
+      IType res;
+      if (head != tail) {
+        res = in[dq[head] * istride];
+      } else {
+        Reducer::SetInitValue(res);
+      }
+      SV::template Save<OType>(out[j * ostride], static_cast<OType>(res));
+    }
+  }
+};
+/*! \brief sums over sliding windows by differences of prefix sums, kept in double */
+template<typename DType>
+struct PoolSlideSum {
+  static const bool kSupported = true;
+  typedef double TempType;
+  typedef double WorkType;
+  template<typename SV, typename IType, typename OType>
+  inline static void Slide(const IType *in, index_t n, index_t istride,
+                           OType *out, index_t m, index_t ostride,
+                           index_t ksize, index_t kstride, std::vector<WorkType> *work) {
+    if (work->size() < static_cast<size_t>(n + 1)) work->resize(n + 1);
+    double *prefix = &(*work)[0];
+    prefix[0] = 0.0;
+    for (index_t i = 0; i < n; ++i) {
+      prefix[i + 1] = prefix[i] + static_cast<double>(in[i * istride]);
+    }
+    for (index_t j = 0; j < m; ++j) {
+      const index_t start = std::min(j * kstride, n);
+      const index_t end = std::min(j * kstride + ksize, n);
+      SV::template Save<OType>(out[j * ostride],
+                               static_cast<OType>(prefix[end] - prefix[start]));
+    }
+  }
+};
+template<typename DType>
+struct PoolSlide<red::maximum, DType> : public PoolSlideDeque<red::maximum, DType> {};
+template<typename DType>
+struct PoolSlide<red::minimum, DType> : public PoolSlideDeque<red::minimum, DType> {};
+template<typename DType>
+struct PoolSlide<red::sum, DType> : public PoolSlideSum<DType> {};
+/*!
+ * \brief CPU pooling as two 1D sliding window passes, over the rows of each
+ *  image plane then over the columns of the result, its cost does not grow
+ *  with the window area; used when the window is large relative to the stride
+ */
+template<typename Reducer, typename DType,
+         bool supported = PoolSlide<Reducer, DType>::kSupported>
+struct PoolSlidingCPU {
+  /*! \brief returns false if the pooling is to be done by its Plan */
+  template<typename SV, int dim, typename SrcExp>
+  inline static bool Eval(Tensor<cpu, dim, DType> *dst,
+                          const PoolingExp<Reducer, SrcExp, DType, dim> &e) {
+    return false;
+  }
+};
+template<typename Reducer, typename DType>
+struct PoolSlidingCPU<Reducer, DType, true> {
+  template<typename SV, int dim, typename SrcExp>
+  inline static bool Eval(Tensor<cpu, dim, DType> *dst,
+                          const PoolingExp<Reducer, SrcExp, DType, dim> &e) {
+    // the Plan costs ksize_y * ksize_x per output, the two passes about
+    // kstride_y * (kstride_x + 1), both measured on 8x64x56x56 images
+    if (e.ksize_y_ * e.ksize_x_ <
+        MSHADOW_POOL_SLIDING_RATIO * e.kstride_y_ * (e.kstride_x_ + 1)) {
+      return false;
+    }
+    typedef PoolSlide<Reducer, DType> Slide;
+    typedef typename Slide::TempType TempType;
+    typedef typename Slide::WorkType WorkType;
+    Plan<SrcExp, DType> src = MakePlan(e.src_);
+    const index_t height = e.src_height_, width = e.src_width_;
+    const index_t pheight = e.shape_[dim - 2], pwidth = e.shape_[dim - 1];
+    const index_t nplane = e.shape_.ProdShape(0, dim - 2);
+    Tensor<cpu, 2, DType> out = dst->FlatTo2D();
+    #pragma omp parallel for
+    for (openmp_index_t p = 0; p < nplane; ++p) {
+      std::vector<DType> row(width);
+      std::vector<TempType> temp(height * pwidth);
+      std::vector<WorkType> work;
+      for (index_t y = 0; y < height; ++y) {
+        for (index_t x = 0; x < width; ++x) {
+          row[x] = src.Eval(p * height + y, x);
+        }
+        Slide::template Slide<sv::saveto>(&row[0], width, 1, &temp[y * pwidth], pwidth, 1,
+                                          e.ksize_x_, e.kstride_x_, &work);
+      }
+      DType *optr = out.dptr_ + p * pheight * out.stride_;
+      for (index_t x = 0; x < pwidth; ++x) {
+        Slide::template Slide<SV>(&temp[x], height, pwidth, optr + x, pheight, out.stride_,
+                                  e.ksize_y_, e.kstride_y_, &work);
+      }
+    }
+    return true;
+  }
+};
 }  // namespace expr
+/*! \brief tensor = pool<Reducer>(...) on CPU, by sliding windows for large windows */
+template<typename SV, int dim, typename DType, typename Reducer, typename SrcExp>
+struct MapExpCPUEngine<false, SV, Tensor<cpu, dim, DType>, dim, DType,
+                       expr::MakeTensorExp<expr::PoolingExp<Reducer, SrcExp, DType, dim>,
+                                           SrcExp, dim, DType>,
+                       expr::type::kChainer> {
+  inline static void Map(Tensor<cpu, dim, DType> *dst,
+                         const expr::Exp<expr::MakeTensorExp<
+                           expr::PoolingExp<Reducer, SrcExp, DType, dim>, SrcExp, dim, DType>,
+                                         DType, expr::type::kChainer> &exp) {
+    if (!expr::PoolSlidingCPU<Reducer, DType>
+        ::template Eval<SV>(dst, exp.self().real_self())) {
+      MapPlan<SV>(dst, expr::MakePlan(exp.self()));
+    }
+  }
+};
 }  // namespace mshadow
 #endif  // MSHADOW_EXTENSION_SPATIAL_POOL_H_
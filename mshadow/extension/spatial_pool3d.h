@@ -0,0 +1,125 @@
+/*!
+ *  Copyright (c) 2017 by Contributors
+ * \file spatial_pool3d.h
+ * \brief support for volumetric pooling over depth, height and width
+ */
+#ifndef MSHADOW_EXTENSION_SPATIAL_POOL3D_H_
+#define MSHADOW_EXTENSION_SPATIAL_POOL3D_H_
+#include "../extension.h"
+namespace mshadow {
+namespace expr {
+/*!
+ * \brief volumetric pooling expression, do reduction over local 3-D patches
+ *  of a volume in kNCDHW layout
+ * \tparam Reducer reduction method during pooling
+ * \tparam SrcExp source expression to be pooled from
+ * \tparam DType the content data type
+ * \tparam srcdim dimension of src
+ */
+template<typename Reducer, typename SrcExp, typename DType, int srcdim>
+struct PoolingExp3D:
+      public MakeTensorExp<PoolingExp3D<Reducer, SrcExp, DType, srcdim>,
+                           SrcExp, srcdim, DType> {
+  /*! \brief depth, height and width axes */
+  static const int kDepthAxis = srcdim - LayoutType<kNCDHW>::kDepthFromLast;
+  static const int kHeightAxis = srcdim - LayoutType<kNCDHW>::kHeightFromLast;
+  static const int kWidthAxis = srcdim - LayoutType<kNCDHW>::kWidthFromLast;
+  /*! \brief source operand */
+  const SrcExp &src_;
+  /*! \brief kernel size in depth, height and width */
+  Shape<3> ksize_;
+  /*! \brief kernel stride */
+  Shape<3> kstride_;
+  /*! \brief kernel dilation */
+  Shape<3> kdilate_;
+  /*! \brief implicit padding on both sides, padded elements are skipped */
+  Shape<3> kpad_;
+  /*! \brief source depth, height and width */
+  Shape<3> src_shape_;
+  /*! \brief constructor */
+  PoolingExp3D(const SrcExp &src, Shape<3> ksize, Shape<3> kstride,
+               Shape<3> kdilate, Shape<3> kpad)
+      : src_(src), ksize_(ksize), kstride_(kstride), kdilate_(kdilate), kpad_(kpad) {
+    Shape<srcdim> sshape = ShapeCheck<srcdim, SrcExp>::Check(src_);
+    src_shape_ = Shape3(sshape[kDepthAxis], sshape[kHeightAxis], sshape[kWidthAxis]);
+    this->shape_ = sshape;
+    for (int k = 0; k < 3; ++k) {
+      const index_t extent = kdilate[k] * (ksize[k] - 1) + 1;
+      CHECK(src_shape_[k] + 2 * kpad[k] >= extent)
+        << "PoolingExp3D: kernel must be smaller than padded volume";
+      CHECK_LT(kpad[k], extent) << "PoolingExp3D: padding must be smaller than kernel";
+      this->shape_[kDepthAxis + k] =
+          (src_shape_[k] + 2 * kpad[k] - extent) / kstride[k] + 1;
+    }
+  }
+};
+/*!
+ * \brief volumetric pooling of subregions, the 3-D counterpart of pool;
+ *  a window is reduced over the elements inside the volume,
+ *  padded positions do not take part in the reduction
+ * \param src source volume, shape: (batch, channel, depth, height, width)
+ * \param ksize kernel size in depth, height and width
+ * \param kstride stride in depth, height and width
+ * \param kdilate dilation in depth, height and width
+ * \param kpad padding of depth, height and width on both sides
+ * \return expression of pooled result
+ * \tparam Reducer reducer type
+ * \tparam SrcExp source expression
+ * \tparam DType the content data type
+ * \tparam etype type of expression
+ */
+template<typename Reducer, typename SrcExp, typename DType, int etype>
+inline PoolingExp3D<Reducer, SrcExp, DType, ExpInfo<SrcExp>::kDim>
+pool3d(const Exp<SrcExp, DType, etype> &src, Shape<3> ksize, Shape<3> kstride,
+       Shape<3> kdilate = Shape3(1, 1, 1), Shape<3> kpad = Shape3(0, 0, 0)) {
+  TypeCheckPass<ExpInfo<SrcExp>::kDim >= 3>
+      ::Error_Expression_Does_Not_Meet_Dimension_Req();
+  return PoolingExp3D<Reducer, SrcExp, DType, ExpInfo<SrcExp>::kDim>
+      (src.self(), ksize, kstride, kdilate, kpad);
+}
+//----------------------
+// Execution plan
+//----------------------
+template<typename Reducer, typename SrcExp, typename DType, int srcdim>
+struct Plan<PoolingExp3D<Reducer, SrcExp, DType, srcdim>, DType> {
+ public:
+  explicit Plan(const PoolingExp3D<Reducer, SrcExp, DType, srcdim> &e)
+      : src_(MakePlan(e.src_)),
+        ksize_(e.ksize_), kstride_(e.kstride_), kdilate_(e.kdilate_), kpad_(e.kpad_),
+        src_shape_(e.src_shape_),
+        new_depth_(e.shape_[srcdim - 3]), new_height_(e.shape_[srcdim - 2]) {}
+  MSHADOW_XINLINE DType Eval(index_t i, index_t j) const {
+    const index_t py = i % new_height_;
+    const index_t idivh = i / new_height_;
+    const index_t pz = idivh % new_depth_;
+    const index_t c = idivh / new_depth_;
+    const index_t z_start = pz * kstride_[0] - kpad_[0];
+    const index_t y_start = py * kstride_[1] - kpad_[1];
+    const index_t x_start = j * kstride_[2] - kpad_[2];
+
+    DType res; Reducer::SetInitValue(res);
+    for (index_t kz = 0; kz < ksize_[0]; ++kz) {
+      const index_t z = z_start + kz * kdilate_[0];
+      if (z < 0 || z >= src_shape_[0]) continue;
+      for (index_t ky = 0; ky < ksize_[1]; ++ky) {
+        const index_t y = y_start + ky * kdilate_[1];
+        if (y < 0 || y >= src_shape_[1]) continue;
+        const index_t row = (c * src_shape_[0] + z) * src_shape_[1] + y;
+        for (index_t kx = 0; kx < ksize_[2]; ++kx) {
+          const index_t x = x_start + kx * kdilate_[2];
+          if (x < 0 || x >= src_shape_[2]) continue;
+          Reducer::Reduce(res, src_.Eval(row, x));
+        }
+      }
+    }
+    return res;
+  }
+
+ private:
+  Plan<SrcExp, DType> src_;
+  const Shape<3> ksize_, kstride_, kdilate_, kpad_, src_shape_;
+  const index_t new_depth_, new_height_;
+};
+}  // namespace expr
+}  // namespace mshadow
+#endif  // MSHADOW_EXTENSION_SPATIAL_POOL3D_H_
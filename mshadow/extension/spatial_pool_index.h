@@ -0,0 +1,115 @@
+/*!
+ *  Copyright (c) 2017 by Contributors
+ * \file spatial_pool_index.h
+ * \brief max pooling that records the argmax of each window,
+ *  and the unpooling that scatters the gradient back through it
+ */
+#ifndef MSHADOW_EXTENSION_SPATIAL_POOL_INDEX_H_
+#define MSHADOW_EXTENSION_SPATIAL_POOL_INDEX_H_
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include "../extension.h"
+namespace mshadow {
+/*!
+ * \brief CPU: max pooling over ksize_y x ksize_x windows, same as
+ *  dst = pool<red::maximum>(src, dst shape, ...), that also writes the position
+ *  of each maximum inside its image plane, y * width + x, to index;
+ *  the first maximum of a window wins
+ * \param dst pooled output, shape: (..., pooled_height, pooled_width)
+ * \param index argmax of each window, same shape as dst
+ * \param src source image, shape: (..., height, width)
+ * \param ksize_y kernel size in height
+ * \param ksize_x kernel size in width
+ * \param kstride_y stride in y directory
+ * \param kstride_x stride in x directory
+ * \tparam IndexType type of the index, must hold height * width - 1
+ */
+template<int dim, typename DType, typename IndexType>
+inline void MaxPoolWithIndex(Tensor<cpu, dim, DType> dst,
+                             Tensor<cpu, dim, IndexType> index,
+                             const Tensor<cpu, dim, DType> &src,
+                             index_t ksize_y, index_t ksize_x,
+                             index_t kstride_y, index_t kstride_x) {
+  const index_t height = src.size(dim - 2), width = src.size(dim - 1);
+  const index_t pheight = dst.size(dim - 2), pwidth = dst.size(dim - 1);
+  CHECK_EQ(dst.shape_, index.shape_) << "MaxPoolWithIndex: index shape mismatch";
+  CHECK_EQ(dst.shape_.ProdShape(0, dim - 2), src.shape_.ProdShape(0, dim - 2))
+      << "MaxPoolWithIndex: pool and src shape mismatch";
+  CHECK(height >= ksize_y && width >= ksize_x)
+      << "MaxPoolWithIndex: kernel must be smaller than image";
+  CHECK((pheight - 1) * kstride_y < height && (pwidth - 1) * kstride_x < width)
+      << "MaxPoolWithIndex: pooled shape exceeds the image";
+  CHECK_LE(static_cast<double>(height * width - 1),
+           static_cast<double>(std::numeric_limits<IndexType>::max()))
+      << "MaxPoolWithIndex: IndexType can not hold the image plane";
+  const index_t nplane = src.shape_.ProdShape(0, dim - 2);
+  Tensor<cpu, 2, DType> in = src.FlatTo2D(), out = dst.FlatTo2D();
+  Tensor<cpu, 2, IndexType> arg = index.FlatTo2D();
+  #pragma omp parallel for
+  for (openmp_index_t p = 0; p < nplane; ++p) {
+    for (index_t py = 0; py < pheight; ++py) {
+      const index_t y_start = py * kstride_y;
+      const index_t y_end = std::min(y_start + ksize_y, height);
+      DType *orow = out[p * pheight + py].dptr_;
+      IndexType *irow = arg[p * pheight + py].dptr_;
+      for (index_t px = 0; px < pwidth; ++px) {
+        const index_t x_start = px * kstride_x;
+        const index_t x_end = std::min(x_start + ksize_x, width);
+        DType res = in[p * height + y_start][x_start];
+        index_t pos = y_start * width + x_start;
+        for (index_t y = y_start; y < y_end; ++y) {
+          const DType *srow = in[p * height + y].dptr_;
+          for (index_t x = x_start; x < x_end; ++x) {
+            if (srow[x] > res) {
+              res = srow[x]; pos = y * width + x;
+            }
+          }
+        }
+        orow[px] = res;
+        irow[px] = static_cast<IndexType>(pos);
+      }
+    }
+  }
+}
+/*!
+ * \brief CPU: gradient of MaxPoolWithIndex, each pooled gradient is added to
+ *  the source pixel its index points to, in one pass over grad_pooled;
+ *  the result is stored into dst by Saver
+ * \param dst gradient of the source image, shape: (..., height, width)
+ * \param index argmax written by MaxPoolWithIndex
+ * \param grad_pooled gradient of the pooled output, same shape as index
+ * \tparam Saver storage method, e.g. sv::saveto or sv::plusto
+ */
+template<typename Saver, int dim, typename DType, typename IndexType>
+inline void UnpoolWithIndex(Tensor<cpu, dim, DType> dst,
+                            const Tensor<cpu, dim, IndexType> &index,
+                            const Tensor<cpu, dim, DType> &grad_pooled) {
+  const index_t height = dst.size(dim - 2), width = dst.size(dim - 1);
+  const index_t pheight = index.size(dim - 2), pwidth = index.size(dim - 1);
+  CHECK_EQ(index.shape_, grad_pooled.shape_) << "UnpoolWithIndex: pooled shape mismatch";
+  CHECK_EQ(dst.shape_.ProdShape(0, dim - 2), index.shape_.ProdShape(0, dim - 2))
+      << "UnpoolWithIndex: pool and src shape mismatch";
+  const index_t nplane = dst.shape_.ProdShape(0, dim - 2);
+  Tensor<cpu, 2, DType> out = dst.FlatTo2D(), grad = grad_pooled.FlatTo2D();
+  Tensor<cpu, 2, IndexType> arg = index.FlatTo2D();
+  #pragma omp parallel for
+  for (openmp_index_t p = 0; p < nplane; ++p) {
+    std::vector<DType> buf(height * width, DType(0.0f));
+    for (index_t py = 0; py < pheight; ++py) {
+      const IndexType *irow = arg[p * pheight + py].dptr_;
+      const DType *grow = grad[p * pheight + py].dptr_;
+      for (index_t px = 0; px < pwidth; ++px) {
+        buf[static_cast<index_t>(irow[px])] += grow[px];
+      }
+    }
+    for (index_t y = 0; y < height; ++y) {
+      DType *orow = out[p * height + y].dptr_;
+      for (index_t x = 0; x < width; ++x) {
+        Saver::template Save<DType>(orow[x], buf[y * width + x]);
+      }
+    }
+  }
+}
+}  // namespace mshadow
+#endif  // MSHADOW_EXTENSION_SPATIAL_POOL_INDEX_H_
@@ -16,11 +16,15 @@ namespace expr {
  * \tparam SrcExp source expression to be pooled from
  * \tparam DType the content data type
  * \tparam srcdim dimension of src
+ * \tparam layout layout of the image, kNCHW or kNHWC
  */
-template<typename Reducer, typename SrcExp, typename DType, int srcdim>
+template<typename Reducer, typename SrcExp, typename DType, int srcdim, int layout = kNCHW>
 struct UnPoolingExp:
-      public MakeTensorExp<UnPoolingExp<Reducer, SrcExp, DType, srcdim>,
+      public MakeTensorExp<UnPoolingExp<Reducer, SrcExp, DType, srcdim, layout>,
                            SrcExp, srcdim, DType> {
+  /*! \brief height and width axes */
+  static const int kHeightAxis = srcdim - LayoutType<layout>::kHeightFromLast;
+  static const int kWidthAxis = srcdim - LayoutType<layout>::kWidthFromLast;
   /*! \brief source input, corresponds to src in pooling */
   const SrcExp &data_src_;
   /*! \brief result of pooled data, corresponds to result of pooling */
@@ -53,11 +57,12 @@ struct UnPoolingExp:
     CHECK_EQ(pshape, ShapeCheckSrcDimSrcExp::Check(data_pooled))
       << "UnPoolingExp: pooled shape mismatch";
     Shape<srcdim> sshape = ShapeCheck<srcdim, SrcExp>::Check(data_src);
-    for (int k = 0;  k < srcdim - 2; ++k) {
+    for (int k = 0;  k < srcdim; ++k) {
+      if (k == kHeightAxis || k == kWidthAxis) continue;
       CHECK_EQ(pshape[k], sshape[k]) << "UnPoolingExp: pool and src shape mismatch";
     }
-    pshape_x_ = pshape[srcdim - 1];
-    pshape_y_ = pshape[srcdim - 2];
+    pshape_x_ = pshape[kWidthAxis];
+    pshape_y_ = pshape[kHeightAxis];
     this->shape_ = sshape;
   }
 };
@@ -87,6 +92,22 @@ unpool(const Exp<SrcExp, DType, etype> &data_src,
       (data_src.self(), data_pooled.self(), grad_pooled.self(),
        ksize_y, ksize_x, kstride_y, kstride_x);
 }
+/*!
+ * \brief unpooling gradient of images in the given layout,
+ *  e.g. unpool<red::maximum, kNHWC>(data_src, data_pooled, grad_pooled, ...)
+ * \tparam Reducer reducer type
+ * \tparam layout layout of the image, kNCHW or kNHWC
+ */
+template<typename Reducer, int layout, typename SrcExp, typename DType, int etype>
+inline UnPoolingExp<Reducer, SrcExp, DType, ExpInfo<SrcExp>::kDim, layout>
+unpool(const Exp<SrcExp, DType, etype> &data_src,
+       const Exp<SrcExp, DType, etype> &data_pooled,
+       const Exp<SrcExp, DType, etype> &grad_pooled,
+       index_t ksize_y, index_t ksize_x, index_t kstride_y, index_t kstride_x) {
+  return UnPoolingExp<Reducer, SrcExp, DType, ExpInfo<SrcExp>::kDim, layout>
+      (data_src.self(), data_pooled.self(), grad_pooled.self(),
+       ksize_y, ksize_x, kstride_y, kstride_x);
+}
 //----------------------
 // Execution plan
 //----------------------
@@ -130,6 +151,47 @@ struct Plan<UnPoolingExp<Reducer, SrcExp, DType, srcdim>, DType> {
   const index_t ksize_y_, ksize_x_;
   const index_t kstride_y_, kstride_x_;
 };
+template<typename Reducer, typename SrcExp, typename DType, int srcdim>
+struct Plan<UnPoolingExp<Reducer, SrcExp, DType, srcdim, kNHWC>, DType> {
+ public:
+  explicit Plan(const UnPoolingExp<Reducer, SrcExp, DType, srcdim, kNHWC> &e)
+      : data_src_(MakePlan(e.data_src_)), data_pooled_(MakePlan(e.data_pooled_)),
+        grad_pooled_(MakePlan(e.grad_pooled_)),
+        sshape_y_(e.shape_[srcdim - 3]), sshape_x_(e.shape_[srcdim - 2]),
+        pshape_y_(e.pshape_y_),  pshape_x_(e.pshape_x_),
+        ksize_y_(e.ksize_y_), ksize_x_(e.ksize_x_),
+        kstride_y_(e.kstride_y_), kstride_x_(e.kstride_x_) {}
+  MSHADOW_XINLINE DType Eval(index_t i, index_t j) const {
+    using namespace std;
+    const index_t x = i % sshape_x_;
+    const index_t idivw = i / sshape_x_;
+    const index_t y = idivw % sshape_y_;
+    const index_t n = idivw / sshape_y_;
+    const DType vsrc = data_src_.Eval(i, j);
+    const index_t py_min =
+        y < ksize_y_ ? 0 : (y - ksize_y_ + kstride_y_) / kstride_y_;
+    const index_t px_min =
+        x < ksize_x_ ? 0 : (x - ksize_x_ + kstride_x_) / kstride_x_;
+    const index_t py_max = min((y + kstride_y_) / kstride_y_, pshape_y_);
+    const index_t px_max = min((x + kstride_x_) / kstride_x_, pshape_x_);
+
+    DType val = static_cast<DType>(0);
+    for (index_t py = py_min; py < py_max; ++py) {
+      for (index_t px = px_min; px < px_max; ++px) {
+        const index_t pi = (n * pshape_y_ + py) * pshape_x_ + px;
+        val += Reducer::PartialGrad(vsrc, data_pooled_.Eval(pi, j)) *
+                                    grad_pooled_.Eval(pi, j);
+      }
+    }
+    return val;
+  }
+
+ private:
+  Plan<SrcExp, DType> data_src_, data_pooled_, grad_pooled_;
+  const index_t sshape_y_, sshape_x_, pshape_y_, pshape_x_;
+  const index_t ksize_y_, ksize_x_;
+  const index_t kstride_y_, kstride_x_;
+};
 }  // namespace expr
 }  // namespace mshadow
 #endif  // MSHADOW_EXTENSION_SPATIAL_UNPOOL_H_
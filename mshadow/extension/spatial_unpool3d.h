@@ -0,0 +1,147 @@
+/*!
+ *  Copyright (c) 2017 by Contributors
+ * \file spatial_unpool3d.h
+ * \brief support for the gradient of volumetric pooling
+ */
+#ifndef MSHADOW_EXTENSION_SPATIAL_UNPOOL3D_H_
+#define MSHADOW_EXTENSION_SPATIAL_UNPOOL3D_H_
+#include "../extension.h"
+namespace mshadow {
+namespace expr {
+/*!
+ * \brief volumetric unpooling expr, reverse operation of pool3d,
+ *  used to pass gradient back
+ * \tparam Reducer reduction method during pooling
+ * \tparam SrcExp source expression to be pooled from
+ * \tparam DType the content data type
+ * \tparam srcdim dimension of src
+ */
+template<typename Reducer, typename SrcExp, typename DType, int srcdim>
+struct UnPoolingExp3D:
+      public MakeTensorExp<UnPoolingExp3D<Reducer, SrcExp, DType, srcdim>,
+                           SrcExp, srcdim, DType> {
+  /*! \brief depth, height and width axes */
+  static const int kDepthAxis = srcdim - LayoutType<kNCDHW>::kDepthFromLast;
+  /*! \brief source input, corresponds to src in pooling */
+  const SrcExp &data_src_;
+  /*! \brief result of pooled data, corresponds to result of pooling */
+  const SrcExp &data_pooled_;
+  /*! \brief gradient data of pooled part, to be propgate down */
+  const SrcExp &grad_pooled_;
+  /*! \brief kernel size in depth, height and width */
+  Shape<3> ksize_;
+  /*! \brief kernel stride */
+  Shape<3> kstride_;
+  /*! \brief kernel dilation */
+  Shape<3> kdilate_;
+  /*! \brief implicit padding on both sides */
+  Shape<3> kpad_;
+  /*! \brief depth, height and width of the pooled volume */
+  Shape<3> pshape_;
+  /*! \brief constructor */
+  UnPoolingExp3D(const SrcExp &data_src, const SrcExp &data_pooled,
+                 const SrcExp &grad_pooled, Shape<3> ksize, Shape<3> kstride,
+                 Shape<3> kdilate, Shape<3> kpad)
+      : data_src_(data_src), data_pooled_(data_pooled), grad_pooled_(grad_pooled),
+        ksize_(ksize), kstride_(kstride), kdilate_(kdilate), kpad_(kpad) {
+    Shape<srcdim> pshape = ShapeCheck<srcdim, SrcExp>::Check(grad_pooled);
+    typedef ShapeCheck<srcdim, SrcExp> ShapeCheckSrcDimSrcExp;
+    CHECK_EQ(pshape, ShapeCheckSrcDimSrcExp::Check(data_pooled))
+      << "UnPoolingExp3D: pooled shape mismatch";
+    Shape<srcdim> sshape = ShapeCheck<srcdim, SrcExp>::Check(data_src);
+    for (int k = 0; k < kDepthAxis; ++k) {
+      CHECK_EQ(pshape[k], sshape[k]) << "UnPoolingExp3D: pool and src shape mismatch";
+    }
+    for (int k = 0; k < 3; ++k) {
+      const index_t extent = kdilate[k] * (ksize[k] - 1) + 1;
+      CHECK(sshape[kDepthAxis + k] + 2 * kpad[k] >= extent &&
+            pshape[kDepthAxis + k] ==
+            (sshape[kDepthAxis + k] + 2 * kpad[k] - extent) / kstride[k] + 1)
+        << "UnPoolingExp3D: pooled shape does not match the kernel, stride and pad";
+    }
+    pshape_ = Shape3(pshape[kDepthAxis], pshape[kDepthAxis + 1], pshape[kDepthAxis + 2]);
+    this->shape_ = sshape;
+  }
+};
+/*!
+ * \brief gradient of pool3d, backprop gradient value back,
+ *  reverse operation of volumetric pooling
+ * \param data_src source input, corresponds to src in pooling
+ * \param data_pooled result of pooled data, corresponds to result of pooling
+ * \param grad_pooled gradient data of pooled part, to be propgate down
+ * \param ksize kernel size in depth, height and width
+ * \param kstride stride in depth, height and width
+ * \param kdilate dilation in depth, height and width
+ * \param kpad padding of depth, height and width on both sides
+ * \return expression corresponding to unpooled volume, storing backproped gradient
+ * \tparam Reducer reducer type
+ * \tparam SrcExp source expression
+ * \tparam DType the content data type
+ * \tparam etype type of expression
+ */
+template<typename Reducer, typename SrcExp, typename DType, int etype>
+inline UnPoolingExp3D<Reducer, SrcExp, DType, ExpInfo<SrcExp>::kDim>
+unpool3d(const Exp<SrcExp, DType, etype> &data_src,
+         const Exp<SrcExp, DType, etype> &data_pooled,
+         const Exp<SrcExp, DType, etype> &grad_pooled,
+         Shape<3> ksize, Shape<3> kstride,
+         Shape<3> kdilate = Shape3(1, 1, 1), Shape<3> kpad = Shape3(0, 0, 0)) {
+  TypeCheckPass<ExpInfo<SrcExp>::kDim >= 3>
+      ::Error_Expression_Does_Not_Meet_Dimension_Req();
+  return UnPoolingExp3D<Reducer, SrcExp, DType, ExpInfo<SrcExp>::kDim>
+      (data_src.self(), data_pooled.self(), grad_pooled.self(),
+       ksize, kstride, kdilate, kpad);
+}
+//----------------------
+// Execution plan
+//----------------------
+template<typename Reducer, typename SrcExp, typename DType, int srcdim>
+struct Plan<UnPoolingExp3D<Reducer, SrcExp, DType, srcdim>, DType> {
+ public:
+  explicit Plan(const UnPoolingExp3D<Reducer, SrcExp, DType, srcdim> &e)
+      : data_src_(MakePlan(e.data_src_)), data_pooled_(MakePlan(e.data_pooled_)),
+        grad_pooled_(MakePlan(e.grad_pooled_)),
+        ksize_(e.ksize_), kstride_(e.kstride_), kdilate_(e.kdilate_), kpad_(e.kpad_),
+        pshape_(e.pshape_),
+        sshape_z_(e.shape_[srcdim - 3]), sshape_y_(e.shape_[srcdim - 2]) {}
+  MSHADOW_XINLINE DType Eval(index_t i, index_t j) const {
+    const index_t y = i % sshape_y_;
+    const index_t idivh = i / sshape_y_;
+    const index_t z = idivh % sshape_z_;
+    const index_t c = idivh / sshape_z_;
+    const DType vsrc = data_src_.Eval(i, j);
+
+    // window p covers the source position when p * stride - pad + k * dilate
+    // hits it for some tap k
+    DType val = static_cast<DType>(0);
+    for (index_t kz = 0; kz < ksize_[0]; ++kz) {
+      const index_t nz = z + kpad_[0] - kz * kdilate_[0];
+      if (nz < 0) break;
+      if (nz % kstride_[0] != 0 || nz / kstride_[0] >= pshape_[0]) continue;
+      for (index_t ky = 0; ky < ksize_[1]; ++ky) {
+        const index_t ny = y + kpad_[1] - ky * kdilate_[1];
+        if (ny < 0) break;
+        if (ny % kstride_[1] != 0 || ny / kstride_[1] >= pshape_[1]) continue;
+        const index_t prow = (c * pshape_[0] + nz / kstride_[0]) * pshape_[1]
+            + ny / kstride_[1];
+        for (index_t kx = 0; kx < ksize_[2]; ++kx) {
+          const index_t nx = j + kpad_[2] - kx * kdilate_[2];
+          if (nx < 0) break;
+          if (nx % kstride_[2] != 0 || nx / kstride_[2] >= pshape_[2]) continue;
+          const index_t px = nx / kstride_[2];
+          val += Reducer::PartialGrad(vsrc, data_pooled_.Eval(prow, px)) *
+                                      grad_pooled_.Eval(prow, px);
+        }
+      }
+    }
+    return val;
+  }
+
+ private:
+  Plan<SrcExp, DType> data_src_, data_pooled_, grad_pooled_;
+  const Shape<3> ksize_, kstride_, kdilate_, kpad_, pshape_;
+  const index_t sshape_z_, sshape_y_;
+};
+}  // namespace expr
+}  // namespace mshadow
+#endif  // MSHADOW_EXTENSION_SPATIAL_UNPOOL3D_H_
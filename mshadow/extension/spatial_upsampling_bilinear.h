@@ -0,0 +1,343 @@
+/*!
+ * Copyright (c) 2017 by Contributors
+ * \file spatial_upsampling_bilinear.h
+ * \brief bilinear upsampling by an integer scale, and its gradient
+ */
+#ifndef MSHADOW_EXTENSION_SPATIAL_UPSAMPLING_BILINEAR_H_
+#define MSHADOW_EXTENSION_SPATIAL_UPSAMPLING_BILINEAR_H_
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "../extension.h"
+
+namespace mshadow {
+namespace expr {
+/*!
+ * \brief source taps of output position y of bilinear upsampling,
+ *  with pixel centers aligned: y maps to (y + 0.5) / scale - 0.5,
+ *  clamped to the source, and is interpolated between y0 and y1 by weight w
+ */
+MSHADOW_XINLINE void UpSamplingBilinearTaps(index_t y, index_t scale, index_t size,
+                                            index_t *y0, index_t *y1, float *w) {
+  float sy = (static_cast<float>(y) + 0.5f) / static_cast<float>(scale) - 0.5f;
+  if (sy < 0.0f) sy = 0.0f;
+  *y0 = static_cast<index_t>(sy);
+  if (*y0 >= size - 1) {
+    *y0 = *y1 = size - 1;
+    *w = 0.0f;
+  } else {
+    *y1 = *y0 + 1;
+    *w = sy - static_cast<float>(*y0);
+  }
+}
+/*! \brief bilinear upsampling
+ *  \tparam SrcExp source expression
+ *  \tparam DType data type
+ *  \tparam srcdim source dimension
+ */
+template<typename SrcExp, typename DType, int srcdim>
+struct UpSamplingBilinearExp :
+  public MakeTensorExp<UpSamplingBilinearExp<SrcExp, DType, srcdim>,
+                       SrcExp, srcdim, DType> {
+  /*! \brief source oprand */
+  const SrcExp &src_;
+  /*! \brief up sampling scale */
+  index_t scale_;
+  /*! \brief constructor */
+  UpSamplingBilinearExp(const SrcExp &src, index_t scale)
+    : src_(src), scale_(scale) {
+    this->shape_ = ShapeCheck<srcdim, SrcExp>::Check(src_);
+    this->shape_[srcdim - 2] *= scale_;
+    this->shape_[srcdim - 1] *= scale_;
+  }
+};
+/*! \brief gradient of bilinear upsampling
+ *  \tparam SrcExp source expression, the gradient of the upsampled output
+ *  \tparam DType data type
+ *  \tparam srcdim source dimension
+ */
+template<typename SrcExp, typename DType, int srcdim>
+struct UpSamplingBilinearGradExp :
+  public MakeTensorExp<UpSamplingBilinearGradExp<SrcExp, DType, srcdim>,
+                       SrcExp, srcdim, DType> {
+  /*! \brief source oprand */
+  const SrcExp &grad_;
+  /*! \brief up sampling scale */
+  index_t scale_;
+  /*! \brief constructor */
+  UpSamplingBilinearGradExp(const SrcExp &grad, index_t scale)
+    : grad_(grad), scale_(scale) {
+    this->shape_ = ShapeCheck<srcdim, SrcExp>::Check(grad_);
+    CHECK(this->shape_[srcdim - 2] % scale_ == 0 && this->shape_[srcdim - 1] % scale_ == 0)
+      << "UpSamplingBilinearGrad: gradient shape is not a multiple of scale";
+    this->shape_[srcdim - 2] /= scale_;
+    this->shape_[srcdim - 1] /= scale_;
+  }
+};
+/*!
+ * \brief bilinear upsampling by an integer scale, pixel centers are aligned:
+ *  out(y, x) is interpolated at ((y + 0.5) / scale - 0.5, (x + 0.5) / scale - 0.5),
+ *  clamped to the image
+ * \param src source image, shape: (..., height, width)
+ * \param scale up sampling scale
+ */
+template<typename SrcExp, typename DType, int etype>
+inline UpSamplingBilinearExp<SrcExp, DType, ExpInfo<SrcExp>::kDim>
+upsampling_bilinear(const Exp<SrcExp, DType, etype> &src, index_t scale) {
+  TypeCheckPass<ExpInfo<SrcExp>::kDim >= 2>
+    ::Error_Expression_Does_Not_Meet_Dimension_Req();
+  return UpSamplingBilinearExp<SrcExp, DType, ExpInfo<SrcExp>::kDim>(src.self(), scale);
+}
+/*!
+ * \brief gradient of upsampling_bilinear
+ * \param grad gradient of the upsampled output, shape: (..., height * scale, width * scale)
+ * \param scale up sampling scale
+ */
+template<typename SrcExp, typename DType, int etype>
+inline UpSamplingBilinearGradExp<SrcExp, DType, ExpInfo<SrcExp>::kDim>
+upsampling_bilinear_grad(const Exp<SrcExp, DType, etype> &grad, index_t scale) {
+  TypeCheckPass<ExpInfo<SrcExp>::kDim >= 2>
+    ::Error_Expression_Does_Not_Meet_Dimension_Req();
+  return UpSamplingBilinearGradExp<SrcExp, DType, ExpInfo<SrcExp>::kDim>(grad.self(), scale);
+}
+//----------------------
+// Execution plan
+//----------------------
+template<typename SrcExp, typename DType, int srcdim>
+struct Plan<UpSamplingBilinearExp<SrcExp, DType, srcdim>, DType> {
+ public:
+  explicit Plan(const UpSamplingBilinearExp<SrcExp, DType, srcdim> &e)
+    : src_(MakePlan(e.src_)),
+      scale_(e.scale_),
+      new_height_(e.shape_[srcdim - 2]),
+      src_height_(e.shape_[srcdim - 2] / e.scale_),
+      src_width_(e.shape_[srcdim - 1] / e.scale_) {}
+  MSHADOW_XINLINE DType Eval(index_t i, index_t j) const {
+    const index_t y = i % new_height_;
+    const index_t c = i / new_height_;
+    index_t y0, y1, x0, x1;
+    float wy, wx;
+    UpSamplingBilinearTaps(y, scale_, src_height_, &y0, &y1, &wy);
+    UpSamplingBilinearTaps(j, scale_, src_width_, &x0, &x1, &wx);
+    const index_t r0 = c * src_height_ + y0, r1 = c * src_height_ + y1;
+    const float top = static_cast<float>(src_.Eval(r0, x0)) * (1.0f - wx) +
+        static_cast<float>(src_.Eval(r0, x1)) * wx;
+    const float bottom = static_cast<float>(src_.Eval(r1, x0)) * (1.0f - wx) +
+        static_cast<float>(src_.Eval(r1, x1)) * wx;
+    return DType(top * (1.0f - wy) + bottom * wy);
+  }
+
+ private:
+  Plan<SrcExp, DType> src_;
+  const index_t scale_;
+  const index_t new_height_;
+  const index_t src_height_, src_width_;
+};
+template<typename SrcExp, typename DType, int srcdim>
+struct Plan<UpSamplingBilinearGradExp<SrcExp, DType, srcdim>, DType> {
+ public:
+  explicit Plan(const UpSamplingBilinearGradExp<SrcExp, DType, srcdim> &e)
+    : grad_(MakePlan(e.grad_)),
+      scale_(e.scale_),
+      height_(e.shape_[srcdim - 2]), width_(e.shape_[srcdim - 1]) {}
+  MSHADOW_XINLINE DType Eval(index_t i, index_t j) const {
+    // only output rows and columns within one source pixel of y, x take part
+    const index_t y = i % height_;
+    const index_t c = i / height_;
+    const index_t oy_begin = y > 0 ? (y - 1) * scale_ : 0;
+    const index_t oy_end = (y + 2 < height_ ? y + 2 : height_) * scale_;
+    const index_t ox_begin = j > 0 ? (j - 1) * scale_ : 0;
+    const index_t ox_end = (j + 2 < width_ ? j + 2 : width_) * scale_;
+    float res = 0.0f;
+    for (index_t oy = oy_begin; oy < oy_end; ++oy) {
+      index_t y0, y1;
+      float wy;
+      UpSamplingBilinearTaps(oy, scale_, height_, &y0, &y1, &wy);
+      const float ky = (y0 == y ? 1.0f - wy : 0.0f) + (y1 == y ? wy : 0.0f);
+      if (ky == 0.0f) continue;
+      const index_t row = c * height_ * scale_ + oy;
+      for (index_t ox = ox_begin; ox < ox_end; ++ox) {
+        index_t x0, x1;
+        float wx;
+        UpSamplingBilinearTaps(ox, scale_, width_, &x0, &x1, &wx);
+        const float kx = (x0 == j ? 1.0f - wx : 0.0f) + (x1 == j ? wx : 0.0f);
+        res += ky * kx * static_cast<float>(grad_.Eval(row, ox));
+      }
+    }
+    return DType(res);
+  }
+
+ private:
+  Plan<SrcExp, DType> grad_;
+  const index_t scale_;
+  const index_t height_, width_;
+};
+/*! \brief per column taps of bilinear upsampling, shared by all rows */
+struct UpSamplingBilinearColumns {
+  std::vector<index_t> x0, x1;
+  std::vector<float> wx;
+  UpSamplingBilinearColumns(index_t width, index_t scale, index_t src_width)
+      : x0(width), x1(width), wx(width) {
+    for (index_t x = 0; x < width; ++x) {
+      UpSamplingBilinearTaps(x, scale, src_width, &x0[x], &x1[x], &wx[x]);
+    }
+  }
+};
+/*!
+ * \brief CPU: bilinear upsampling plane by plane, a source row is
+ *  interpolated along x once into a row buffer and kept while consecutive
+ *  output rows interpolate between the same pair of source rows; the blend
+ *  of the two rows runs in float packets
+ */
+struct UpSamplingBilinearRows {
+  template<typename SV, int dim, typename SrcExp, typename DType>
+  inline static void Eval(Tensor<cpu, dim, DType> *dst,
+                          const UpSamplingBilinearExp<SrcExp, DType, dim> &e) {
+    typedef packet::Packet<float, MSHADOW_DEFAULT_PACKET> Packet;
+    Plan<SrcExp, DType> src = MakePlan(e.src_);
+    const index_t scale = e.scale_;
+    const index_t height = e.shape_[dim - 2], width = e.shape_[dim - 1];
+    const index_t src_height = height / scale, src_width = width / scale;
+    const index_t nplane = e.shape_.ProdShape(0, dim - 2);
+    const index_t xend = packet::UpperAlign<float, MSHADOW_DEFAULT_PACKET>(width);
+    const UpSamplingBilinearColumns cols(width, scale, src_width);
+    Tensor<cpu, 2, DType> out = dst->FlatTo2D();
+    #pragma omp parallel for
+    for (openmp_index_t p = 0; p < nplane; ++p) {
+      // rows lo, hi and their blend, then the source row
+      size_t pitch;
+      float *buf = static_cast<float*>(
+          packet::AlignedMallocPitch(&pitch, width * sizeof(float), 4));
+      const index_t ld = pitch / sizeof(float);
+      std::fill(buf, buf + 4 * ld, 0.0f);
+      float *lo = buf, *hi = buf + ld, *mix = buf + 2 * ld, *srow = buf + 3 * ld;
+      index_t lo_row = -1, hi_row = -1;
+      std::vector<DType> res(width);
+      for (index_t y = 0; y < height; ++y) {
+        index_t y0, y1;
+        float wy;
+        UpSamplingBilinearTaps(y, scale, src_height, &y0, &y1, &wy);
+        if (lo_row != y0) {
+          if (hi_row == y0) {
+            std::swap(lo, hi);
+            std::swap(lo_row, hi_row);
+          } else {
+            Interpolate(src, p * src_height + y0, cols, width, src_width, srow, lo);
+            lo_row = y0;
+          }
+        }
+        if (hi_row != y1) {
+          Interpolate(src, p * src_height + y1, cols, width, src_width, srow, hi);
+          hi_row = y1;
+        }
+        const Packet pwy = Packet::Fill(wy);
+        for (index_t x = 0; x < xend; x += Packet::size) {
+          const Packet plo = Packet::Load(lo + x);
+          (plo + pwy * (Packet::Load(hi + x) - plo)).Store(mix + x);
+        }
+        for (index_t x = 0; x < width; ++x) res[x] = DType(mix[x]);
+        UpSamplingRowSaver<SV>::Save(out[p * height + y].dptr_, &res[0], width);
+      }
+      packet::AlignedFree(buf);
+    }
+  }
+
+ private:
+  /*! \brief the source row is evaluated once into srow, then gathered by the taps */
+  template<typename SrcExp, typename DType>
+  inline static void Interpolate(const Plan<SrcExp, DType> &src, index_t row,
+                                 const UpSamplingBilinearColumns &cols,
+                                 index_t width, index_t src_width, float *srow, float *dst) {
+    for (index_t x = 0; x < src_width; ++x) {
+      srow[x] = static_cast<float>(src.Eval(row, x));
+    }
+    for (index_t x = 0; x < width; ++x) {
+      const float v0 = srow[cols.x0[x]], v1 = srow[cols.x1[x]];
+      dst[x] = v0 + cols.wx[x] * (v1 - v0);
+    }
+  }
+};
+/*!
+ * \brief CPU: gradient of bilinear upsampling plane by plane, each gradient
+ *  row is reduced along x once, then added to its two source rows in float
+ *  packets
+ */
+struct UpSamplingBilinearGradRows {
+  template<typename SV, int dim, typename SrcExp, typename DType>
+  inline static void Eval(Tensor<cpu, dim, DType> *dst,
+                          const UpSamplingBilinearGradExp<SrcExp, DType, dim> &e) {
+    typedef packet::Packet<float, MSHADOW_DEFAULT_PACKET> Packet;
+    Plan<SrcExp, DType> grad = MakePlan(e.grad_);
+    const index_t scale = e.scale_;
+    const index_t height = e.shape_[dim - 2], width = e.shape_[dim - 1];
+    const index_t o_height = height * scale, o_width = width * scale;
+    const index_t nplane = e.shape_.ProdShape(0, dim - 2);
+    const UpSamplingBilinearColumns cols(o_width, scale, width);
+    const index_t xend = packet::UpperAlign<float, MSHADOW_DEFAULT_PACKET>(width);
+    Tensor<cpu, 2, DType> out = dst->FlatTo2D();
+    #pragma omp parallel for
+    for (openmp_index_t p = 0; p < nplane; ++p) {
+      // height rows of the plane sum, then the reduced gradient row
+      size_t pitch;
+      float *acc = static_cast<float*>(
+          packet::AlignedMallocPitch(&pitch, width * sizeof(float), height + 1));
+      const index_t ld = pitch / sizeof(float);
+      std::fill(acc, acc + (height + 1) * ld, 0.0f);
+      float *row = acc + height * ld;
+      for (index_t oy = 0; oy < o_height; ++oy) {
+        std::fill(row, row + width, 0.0f);
+        for (index_t ox = 0; ox < o_width; ++ox) {
+          const float g = static_cast<float>(grad.Eval(p * o_height + oy, ox));
+          row[cols.x0[ox]] += g * (1.0f - cols.wx[ox]);
+          row[cols.x1[ox]] += g * cols.wx[ox];
+        }
+        index_t y0, y1;
+        float wy;
+        UpSamplingBilinearTaps(oy, scale, height, &y0, &y1, &wy);
+        float *a0 = acc + y0 * ld, *a1 = acc + y1 * ld;
+        const Packet pw0 = Packet::Fill(1.0f - wy), pw1 = Packet::Fill(wy);
+        for (index_t x = 0; x < xend; x += Packet::size) {
+          const Packet r = Packet::Load(row + x);
+          (Packet::Load(a0 + x) + r * pw0).Store(a0 + x);
+          (Packet::Load(a1 + x) + r * pw1).Store(a1 + x);
+        }
+      }
+      for (index_t y = 0; y < height; ++y) {
+        DType *orow = out[p * height + y].dptr_;
+        for (index_t x = 0; x < width; ++x) {
+          SV::template Save<DType>(orow[x], DType(acc[y * ld + x]));
+        }
+      }
+      packet::AlignedFree(acc);
+    }
+  }
+};
+}  // namespace expr
+/*! \brief tensor = upsampling_bilinear(...) on CPU reuses interpolated rows */
+template<typename SV, int dim, typename DType, typename SrcExp>
+struct MapExpCPUEngine<false, SV, Tensor<cpu, dim, DType>, dim, DType,
+                       expr::MakeTensorExp<expr::UpSamplingBilinearExp<SrcExp, DType, dim>,
+                                           SrcExp, dim, DType>,
+                       expr::type::kChainer> {
+  inline static void Map(Tensor<cpu, dim, DType> *dst,
+                         const expr::Exp<expr::MakeTensorExp<
+                           expr::UpSamplingBilinearExp<SrcExp, DType, dim>, SrcExp, dim, DType>,
+                                         DType, expr::type::kChainer> &exp) {
+    expr::UpSamplingBilinearRows::Eval<SV>(dst, exp.self().real_self());
+  }
+};
+/*! \brief tensor = upsampling_bilinear_grad(...) on CPU is computed by scatter */
+template<typename SV, int dim, typename DType, typename SrcExp>
+struct MapExpCPUEngine<false, SV, Tensor<cpu, dim, DType>, dim, DType,
+                       expr::MakeTensorExp<expr::UpSamplingBilinearGradExp<SrcExp, DType, dim>,
+                                           SrcExp, dim, DType>,
+                       expr::type::kChainer> {
+  inline static void Map(Tensor<cpu, dim, DType> *dst,
+                         const expr::Exp<expr::MakeTensorExp<
+                           expr::UpSamplingBilinearGradExp<SrcExp, DType, dim>,
+                           SrcExp, dim, DType>, DType, expr::type::kChainer> &exp) {
+    expr::UpSamplingBilinearGradRows::Eval<SV>(dst, exp.self().real_self());
+  }
+};
+}  // namespace mshadow
+#endif  // MSHADOW_EXTENSION_SPATIAL_UPSAMPLING_BILINEAR_H_
@@ -6,6 +6,8 @@
 */
 #ifndef MSHADOW_EXTENSION_SPATIAL_UPSAMPLING_NEAREST_H_
 #define MSHADOW_EXTENSION_SPATIAL_UPSAMPLING_NEAREST_H_
+#include <cstring>
+#include <vector>
 #include "../extension.h"
 
 namespace mshadow {
@@ -42,6 +44,17 @@ upsampling_nearest(const Exp<SrcExp, DType, etype> &src, index_t scale) {
     ::Error_Expression_Does_Not_Meet_Dimension_Req();
   return UpSamplingNearestExp<SrcExp, DType, ExpInfo<SrcExp>::kDim>(src.self(), scale);
 }
+/*!
+ * \brief gradient of upsampling_nearest, each input pixel receives the sum
+ *  of its scale x scale block of grad
+ * \param grad gradient of the upsampled output
+ * \param scale up sampling scale
+ */
+template<typename SrcExp, typename DType, int etype>
+inline PoolingExp<red::sum, SrcExp, DType, ExpInfo<SrcExp>::kDim>
+upsampling_nearest_grad(const Exp<SrcExp, DType, etype> &grad, index_t scale) {
+  return pool<red::sum>(grad, scale, scale, scale, scale);
+}
 
 template<typename SrcExp, typename DType, int srcdim>
 struct Plan<UpSamplingNearestExp<SrcExp, DType, srcdim>, DType> {
@@ -66,6 +79,62 @@ struct Plan<UpSamplingNearestExp<SrcExp, DType, srcdim>, DType> {
   const index_t new_height_;
   const index_t src_height_;
 };
+/*! \brief store a row of n elements by SV, whole rows are copied by memcpy for saveto */
+template<typename SV>
+struct UpSamplingRowSaver {
+  template<typename DType>
+  inline static void Save(DType *dst, const DType *src, index_t n) {
+    for (index_t i = 0; i < n; ++i) {
+      SV::template Save<DType>(dst[i], src[i]);
+    }
+  }
+};
+template<>
+struct UpSamplingRowSaver<sv::saveto> {
+  template<typename DType>
+  inline static void Save(DType *dst, const DType *src, index_t n) {
+    std::memcpy(dst, src, n * sizeof(DType));
+  }
+};
+/*!
+ * \brief CPU: evaluate upsampling_nearest one source row at a time,
+ *  the row is widened once and stored to its scale output rows
+ */
+struct UpSamplingNearestRows {
+  template<typename SV, int dim, typename SrcExp, typename DType>
+  inline static void Eval(Tensor<cpu, dim, DType> *dst,
+                          const UpSamplingNearestExp<SrcExp, DType, dim> &e) {
+    Plan<SrcExp, DType> src = MakePlan(e.src_);
+    const index_t scale = e.scale_;
+    const index_t width = e.shape_[dim - 1], src_width = width / scale;
+    const index_t src_rows = e.shape_.ProdShape(0, dim - 1) / scale;
+    Tensor<cpu, 2, DType> out = dst->FlatTo2D();
+    #pragma omp parallel for
+    for (openmp_index_t r = 0; r < src_rows; ++r) {
+      std::vector<DType> row(width);
+      for (index_t w = 0; w < src_width; ++w) {
+        const DType v = src.Eval(r, w);
+        for (index_t k = 0; k < scale; ++k) row[w * scale + k] = v;
+      }
+      for (index_t k = 0; k < scale; ++k) {
+        UpSamplingRowSaver<SV>::Save(out[r * scale + k].dptr_, &row[0], width);
+      }
+    }
+  }
+};
 }  // namespace expr
+/*! \brief tensor = upsampling_nearest(...) on CPU is computed by rows */
+template<typename SV, int dim, typename DType, typename SrcExp>
+struct MapExpCPUEngine<false, SV, Tensor<cpu, dim, DType>, dim, DType,
+                       expr::MakeTensorExp<expr::UpSamplingNearestExp<SrcExp, DType, dim>,
+                                           SrcExp, dim, DType>,
+                       expr::type::kChainer> {
+  inline static void Map(Tensor<cpu, dim, DType> *dst,
+                         const expr::Exp<expr::MakeTensorExp<
+                           expr::UpSamplingNearestExp<SrcExp, DType, dim>, SrcExp, dim, DType>,
+                                         DType, expr::type::kChainer> &exp) {
+    expr::UpSamplingNearestRows::Eval<SV>(dst, exp.self().real_self());
+  }
+};
 }  // namespace mshadow
 #endif  // MSHADOW_EXTENSION_SPATIAL_UPSAMPLING_NEAREST_H_
@@ -0,0 +1,268 @@
+/*!
+ *  Copyright (c) 2017 by Contributors
+ * \file topk.h
+ * \brief top-k selection, argmax and argmin along an axis with integer indices
+ */
+#ifndef MSHADOW_EXTENSION_TOPK_H_
+#define MSHADOW_EXTENSION_TOPK_H_
+#include <algorithm>
+#include <vector>
+#include "../extension.h"
+
+namespace mshadow {
+namespace expr {
+/*!
+ * \brief CPU selection of the k first values of a line in the order
+ *  largest (or smallest) first; equal values keep the lower index first
+ *  and NaN ranks after every number
+ */
+template<bool largest, typename DType>
+struct TopKCPU {
+  /*! \brief k up to which a sorted insertion list is used */
+  static const index_t kSmallK = 32;
+  /*! \brief number of values checked against the k-th at once */
+  static const index_t kBlock = 16;
+  /*! \brief number of partial extremes kept by the k = 1 scan */
+  static const index_t kLane = 8;
+  /*! \brief whether a ranks before b */
+  MSHADOW_XINLINE static bool Better(DType a, DType b) {
+    return (largest ? a > b : a < b) || (b != b && a == a);
+  }
+  /*! \brief k = 1: the extreme value by a vectorizable scan, then its first position */
+  inline static void SelectOne(const DType *buf, index_t n, DType *val, index_t *idx) {
+    // independent lanes so the scan is not one serial dependency chain
+    DType lane[kLane];
+    for (index_t j = 0; j < kLane; ++j) lane[j] = buf[0];
+    index_t i = 0;
+    for (; i + kLane <= n; i += kLane) {
+      for (index_t j = 0; j < kLane; ++j) {
+        lane[j] = (largest ? buf[i + j] > lane[j] : buf[i + j] < lane[j]) ? buf[i + j] : lane[j];
+      }
+    }
+    DType m = lane[0];
+    for (index_t j = 1; j < kLane; ++j) {
+      m = (largest ? lane[j] > m : lane[j] < m) ? lane[j] : m;
+    }
+    for (; i < n; ++i) {
+      m = (largest ? buf[i] > m : buf[i] < m) ? buf[i] : m;
+    }
+    // a leading NaN is only kept when no number follows
+    index_t best = 0;
+    if (m != m) {
+      for (index_t j = 1; j < n; ++j) {
+        if (buf[j] == buf[j]) {
+          m = buf[j]; best = j; break;
+        }
+      }
+      for (index_t j = best + 1; j < n; ++j) {
+        m = (largest ? buf[j] > m : buf[j] < m) ? buf[j] : m;
+      }
+    }
+    if (m == m) {
+      while (!(buf[best] == m)) ++best;
+    }
+    *val = buf[best]; *idx = best;
+  }
+  /*!
+   * \brief small k: a sorted list of the best k, once it is full whole
+   *  blocks that cannot beat the k-th value are skipped
+   */
+  inline static void SelectSmall(const DType *buf, index_t n, index_t k,
+                                 DType *val, index_t *idx) {
+    index_t cnt = 0;
+    for (index_t i = 0; i < n;) {
+      if (cnt == k && i + kBlock <= n && val[k - 1] == val[k - 1]) {
+        const DType thr = val[k - 1];
+        bool any = false;
+        for (index_t j = 0; j < kBlock; ++j) {
+          any |= largest ? buf[i + j] > thr : buf[i + j] < thr;
+        }
+        if (!any) {
+          i += kBlock; continue;
+        }
+        for (index_t j = 0; j < kBlock; ++j) Insert(buf[i + j], i + j, k, &cnt, val, idx);
+        i += kBlock;
+      } else {
+        Insert(buf[i], i, k, &cnt, val, idx);
+        ++i;
+      }
+    }
+  }
+  /*! \brief large k: quickselect of the k best positions, then sort them */
+  inline static void SelectLarge(const DType *buf, index_t n, index_t k,
+                                 DType *val, index_t *idx, std::vector<index_t> *perm) {
+    perm->resize(n);
+    for (index_t i = 0; i < n; ++i) (*perm)[i] = i;
+    Compare cmp(buf);
+    if (k < n) std::nth_element(perm->begin(), perm->begin() + k, perm->end(), cmp);
+    std::sort(perm->begin(), perm->begin() + k, cmp);
+    for (index_t j = 0; j < k; ++j) {
+      idx[j] = (*perm)[j]; val[j] = buf[idx[j]];
+    }
+  }
+  /*! \brief select the top k of buf[0, n) into val[0, k) and idx[0, k) */
+  inline static void Select(const DType *buf, index_t n, index_t k,
+                            DType *val, index_t *idx, std::vector<index_t> *perm) {
+    if (k == 1) {
+      SelectOne(buf, n, val, idx);
+    } else if (k <= kSmallK) {
+      SelectSmall(buf, n, k, val, idx);
+    } else {
+      SelectLarge(buf, n, k, val, idx, perm);
+    }
+  }
+  /*!
+   * \brief top k of every line along the axis of a source seen as
+   *  (outer, size, trailing), trailing being 1 or a multiple of the source
+   *  row length last, the line is a source row when the axis is the last;
+   *  the outputs are seen likewise as (outer, k, trailing),
+   *  values is skipped when it has no data
+   */
+  template<typename SrcExp, typename IndexType>
+  inline static void Eval(Tensor<cpu, 2, DType> values, Tensor<cpu, 2, IndexType> indices,
+                          const SrcExp &src, index_t outer, index_t size,
+                          index_t trailing, index_t last, index_t k) {
+    Plan<SrcExp, DType> splan = MakePlan(src);
+    // trailing is also 1 when the axis is followed by dimensions of size 1
+    const bool contiguous = trailing == 1 && last == size;
+    const index_t nline = outer * trailing, nsub = contiguous ? 1 : trailing / last;
+    const index_t ntask = std::max(static_cast<index_t>(1),
+        std::min(nline, 4 * static_cast<index_t>(GetOMPMaxThreads())));
+    const index_t width = indices.size(1);
+    #pragma omp parallel for
+    for (openmp_index_t t = 0; t < ntask; ++t) {
+      std::vector<DType> buf(size), val(k);
+      std::vector<index_t> idx(k), perm;
+      const index_t begin = nline * t / ntask, end = nline * (t + 1) / ntask;
+      for (index_t l = begin; l < end; ++l) {
+        const index_t x = l / trailing, y = l % trailing;
+        if (contiguous) {
+          for (index_t i = 0; i < size; ++i) buf[i] = splan.Eval(x, i);
+        } else {
+          // element i of the line is in source row (x * size + i) * nsub + y / last
+          const index_t row = x * size * nsub + y / last, col = y % last;
+          for (index_t i = 0; i < size; ++i) buf[i] = splan.Eval(row + i * nsub, col);
+        }
+        Select(&buf[0], size, k, &val[0], &idx[0], &perm);
+        for (index_t j = 0; j < k; ++j) {
+          const index_t o = (x * k + j) * trailing + y;
+          indices[o / width][o % width] = static_cast<IndexType>(idx[j]);
+          if (values.dptr_ != NULL) values[o / width][o % width] = val[j];
+        }
+      }
+    }
+  }
+
+ private:
+  struct Compare {
+    const DType *buf;
+    explicit Compare(const DType *buf) : buf(buf) {}
+    inline bool operator()(index_t a, index_t b) const {
+      if (Better(buf[a], buf[b])) return true;
+      if (Better(buf[b], buf[a])) return false;
+      return a < b;
+    }
+  };
+  inline static void Insert(DType v, index_t i, index_t k, index_t *cnt,
+                            DType *val, index_t *idx) {
+    index_t p;
+    if (*cnt < k) {
+      p = (*cnt)++;
+    } else {
+      if (!Better(v, val[k - 1])) return;
+      p = k - 1;
+    }
+    for (; p > 0 && Better(v, val[p - 1]); --p) {
+      val[p] = val[p - 1]; idx[p] = idx[p - 1];
+    }
+    val[p] = v; idx[p] = i;
+  }
+};
+/*! \brief shape arithmetic of the selection along axis, shared by TopK and ArgMax */
+template<typename SrcExp, typename DType, int dimsrc, typename IndexType, int dimdst>
+inline void TopKEval(Tensor<cpu, dimdst, DType> values, Tensor<cpu, dimdst, IndexType> indices,
+                     const SrcExp &src, index_t k, int axis, bool largest) {
+  Shape<dimsrc> sshape = ShapeCheck<dimsrc, SrcExp>::Check(src);
+  CHECK(axis >= 0 && axis < dimsrc) << "TopK: axis out of bound";
+  CHECK(k >= 1 && k <= sshape[axis]) << "TopK: k must be in [1, size of axis]";
+  const index_t size = sshape[axis], trailing = sshape.ProdShape(axis + 1, dimsrc);
+  const index_t outer = sshape.ProdShape(0, axis), last = sshape[dimsrc - 1];
+  // the shape of src with shape[axis] = k, or without axis for dimdst = dimsrc - 1
+  Shape<dimdst> oshape;
+  for (int i = 0, j = 0; i < dimsrc; ++i) {
+    if (i != axis) {
+      oshape[j++] = sshape[i];
+    } else if (dimdst == dimsrc) {
+      oshape[j++] = k;
+    }
+  }
+  CHECK_EQ(indices.shape_, oshape) << "TopK: indices shape mismatch";
+  if (values.dptr_ != NULL) {
+    CHECK_EQ(values.shape_, indices.shape_) << "TopK: values shape mismatch";
+  }
+  if (largest) {
+    TopKCPU<true, DType>::Eval(values.FlatTo2D(), indices.FlatTo2D(), src,
+                               outer, size, trailing, last, k);
+  } else {
+    TopKCPU<false, DType>::Eval(values.FlatTo2D(), indices.FlatTo2D(), src,
+                                outer, size, trailing, last, k);
+  }
+}
+}  // namespace expr
+
+/*!
+ * \brief CPU: the k largest (or smallest) elements along axis, sorted, with
+ *  their positions along axis; equal values keep the lower position first
+ *  and NaN ranks after every number. The outputs have the shape of src
+ *  with shape[axis] = k
+ * \param values the selected values
+ * \param indices the positions of the selected values along axis
+ * \param src source expression
+ * \param k number of elements to select
+ * \param axis the axis to select along
+ * \param largest select the largest elements, otherwise the smallest
+ * \tparam IndexType integer type of the indices
+ */
+template<int dim, typename IndexType, typename SrcExp, typename DType, int etype>
+inline void TopK(Tensor<cpu, dim, DType> values, Tensor<cpu, dim, IndexType> indices,
+                 const expr::Exp<SrcExp, DType, etype> &src, index_t k, int axis,
+                 bool largest = true) {
+  expr::TypeCheckPass<expr::ExpInfo<SrcExp>::kDim == dim>
+      ::Error_Expression_Does_Not_Meet_Dimension_Req();
+  CHECK(values.dptr_ != NULL) << "TopK: values must be allocated";
+  expr::TopKEval<SrcExp, DType, dim>(values, indices, src.self(), k, axis, largest);
+}
+/*!
+ * \brief CPU: position of the maximum along axis as integers, the first
+ *  one on ties; the shape is that of reduce_with_axis (dimdst = dimsrc - 1)
+ *  or reduce_keepdim (dimdst = dimsrc)
+ * \param indices the positions of the maxima
+ * \param src source expression
+ * \param axis the axis to reduce
+ */
+template<int dimdst, typename IndexType, typename SrcExp, typename DType, int etype>
+inline void ArgMax(Tensor<cpu, dimdst, IndexType> indices,
+                   const expr::Exp<SrcExp, DType, etype> &src, int axis) {
+  static const int dimsrc = expr::ExpInfo<SrcExp>::kDim;
+  expr::TypeCheckPass<dimdst == dimsrc || dimdst == dimsrc - 1>
+      ::Error_Expression_Does_Not_Meet_Dimension_Req();
+  Tensor<cpu, dimdst, DType> none(NULL, indices.shape_);
+  expr::TopKEval<SrcExp, DType, dimsrc>(none, indices, src.self(), 1, axis, true);
+}
+/*!
+ * \brief CPU: position of the minimum along axis as integers, see ArgMax
+ * \param indices the positions of the minima
+ * \param src source expression
+ * \param axis the axis to reduce
+ */
+template<int dimdst, typename IndexType, typename SrcExp, typename DType, int etype>
+inline void ArgMin(Tensor<cpu, dimdst, IndexType> indices,
+                   const expr::Exp<SrcExp, DType, etype> &src, int axis) {
+  static const int dimsrc = expr::ExpInfo<SrcExp>::kDim;
+  expr::TypeCheckPass<dimdst == dimsrc || dimdst == dimsrc - 1>
+      ::Error_Expression_Does_Not_Meet_Dimension_Req();
+  Tensor<cpu, dimdst, DType> none(NULL, indices.shape_);
+  expr::TopKEval<SrcExp, DType, dimsrc>(none, indices, src.self(), 1, axis, false);
+}
+}  // namespace mshadow
+#endif  // MSHADOW_EXTENSION_TOPK_H_
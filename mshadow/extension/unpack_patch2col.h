@@ -6,6 +6,7 @@
  */
 #ifndef MSHADOW_EXTENSION_UNPACK_PATCH2COL_H_
 #define MSHADOW_EXTENSION_UNPACK_PATCH2COL_H_
+#include <algorithm>
 #include "../extension.h"
 namespace mshadow {
 namespace expr {
@@ -17,10 +18,14 @@ namespace expr {
  * \tparam SrcExp source expression
  * \tparam dstdim destination dimension
  */
-template<typename SrcExp, typename DType, int srcdim>
+template<typename SrcExp, typename DType, int srcdim, int layout = kNCHW>
 struct UnpackPatchToColXExp:
-      public MakeTensorExp<UnpackPatchToColXExp<SrcExp, DType, srcdim>,
+      public MakeTensorExp<UnpackPatchToColXExp<SrcExp, DType, srcdim, layout>,
                            SrcExp, 2, DType>{
+  /*! \brief channel, height and width axes */
+  static const int kChannelAxis = srcdim - LayoutType<layout>::kChannelFromLast;
+  static const int kHeightAxis = srcdim - LayoutType<layout>::kHeightFromLast;
+  static const int kWidthAxis = srcdim - LayoutType<layout>::kWidthFromLast;
   /*! \brief source operand */
   const SrcExp &img_;
   /*! \brief patch height */
@@ -33,12 +38,19 @@ struct UnpackPatchToColXExp:
   /*! \brief patch dilate */
   index_t pdilate_y_;
   index_t pdilate_x_;
+  /*! \brief implicit zero padding of the image in y and x */
+  index_t pad_y_;
+  index_t pad_x_;
   /*! \brief number of input channel */
   index_t i_channel_;
   /*! \brief height of img */
   index_t i_height_;
   /*! \brief width of img */
   index_t i_width_;
+  /*! \brief height of output */
+  index_t o_height_;
+  /*! \brief width of output */
+  index_t o_width_;
   /*! \brief constructor */
   UnpackPatchToColXExp(const SrcExp &img,
                        index_t psize_y,
@@ -46,23 +58,27 @@ struct UnpackPatchToColXExp:
                        index_t pstride_y,
                        index_t pstride_x,
                        index_t pdilate_y,
-                       index_t pdilate_x)
+                       index_t pdilate_x,
+                       index_t pad_y = 0,
+                       index_t pad_x = 0)
       : img_(img), psize_y_(psize_y), psize_x_(psize_x),
       pstride_y_(pstride_y), pstride_x_(pstride_x),
-      pdilate_y_(pdilate_y), pdilate_x_(pdilate_x){
+      pdilate_y_(pdilate_y), pdilate_x_(pdilate_x),
+      pad_y_(pad_y), pad_x_(pad_x) {
     Shape<srcdim> imshape = ShapeCheck<srcdim, SrcExp>::Check(img_);
-    CHECK(imshape[srcdim - 1] >= psize_x && imshape[srcdim - 2] >= psize_y)
+    CHECK(imshape[kWidthAxis] + 2 * pad_x >= psize_x &&
+          imshape[kHeightAxis] + 2 * pad_y >= psize_y)
       << "UnpackPatchToCol:image shape smaller than patch size";
-    this->i_channel_ = imshape[srcdim - 3];
-    this->i_height_  = imshape[srcdim - 2];
-    this->i_width_   = imshape[srcdim - 1];
+    this->i_channel_ = imshape[kChannelAxis];
+    this->i_height_  = imshape[kHeightAxis];
+    this->i_width_   = imshape[kWidthAxis];
     // calculate number of batches
     const index_t num = imshape.ProdShape(0, srcdim - 3);
-    const index_t o_height = (i_height_ -
+    this->o_height_ = (i_height_ + 2 * pad_y -
         (pdilate_y * (psize_y - 1) + 1)) / pstride_y + 1;
-    const index_t o_width  = (i_width_  -
+    this->o_width_  = (i_width_ + 2 * pad_x -
         (pdilate_x * (psize_x - 1) + 1)) / pstride_x + 1;
-    this->shape_[1] = o_height * o_width * num;
+    this->shape_[1] = o_height_ * o_width_ * num;
     this->shape_[0] = psize_y * psize_x * i_channel_;
   }
 };
@@ -109,6 +125,47 @@ unpack_patch2col(const Exp<SrcExp, DType, etype> &img,
   return UnpackPatchToColXExp<SrcExp, DType, ExpInfo<SrcExp>::kDim>
       (img.self(), psize_y, psize_x, pstride_y_, pstride_x_, pdilate_y_, pdilate_x_);
 }
+/*!
+ * \brief same as unpack_patch2col(pad(img, pad_y, pad_x), ...) without the
+ *  padding expression: taps that fall outside the image read as 0, so
+ *  out_height = (in_height + 2 * pad_y - (pdilate_y * (psize_y - 1) + 1)) / pstride_y + 1
+ * \param pad_y zero padding of the top and bottom
+ * \param pad_x zero padding of the left and right
+ */
+template<typename SrcExp, typename DType, int etype>
+inline UnpackPatchToColXExp<SrcExp, DType, ExpInfo<SrcExp>::kDim>
+unpack_patch2col(const Exp<SrcExp, DType, etype> &img,
+                 index_t psize_y, index_t psize_x, index_t pstride_y, index_t pstride_x,
+                 index_t pdilate_y, index_t pdilate_x, index_t pad_y, index_t pad_x) {
+  TypeCheckPass<ExpInfo<SrcExp>::kDim >= 3>
+      ::Error_Expression_Does_Not_Meet_Dimension_Req();
+  return UnpackPatchToColXExp<SrcExp, DType, ExpInfo<SrcExp>::kDim>
+      (img.self(), psize_y, psize_x, pstride_y, pstride_x, pdilate_y, pdilate_x,
+       pad_y, pad_x);
+}
+/*!
+ * \brief unpack_patch2col of images in the given layout,
+ *  e.g. unpack_patch2col<kNHWC>(img, ...), for kNHWC row
+ *  (ky * psize_x + kx) * in_channel + c of the matrix holds channel c at
+ *  patch offset (ky, kx), matching weights of shape (out_channel, psize_y, psize_x, in_channel)
+ * \param img source image, shape: (batch, height, width, channel) for kNHWC
+ * \param pad_y zero padding of the top and bottom
+ * \param pad_x zero padding of the left and right
+ * \return mat target matrix; shape[0]: in_channel*psize_y*psize_x  shape[1]: out_height*out_width * num_of_images
+ * \tparam layout layout of the image, kNCHW or kNHWC
+ */
+template<int layout, typename SrcExp, typename DType, int etype>
+inline UnpackPatchToColXExp<SrcExp, DType, ExpInfo<SrcExp>::kDim, layout>
+unpack_patch2col(const Exp<SrcExp, DType, etype> &img,
+                 index_t psize_y, index_t psize_x, index_t pstride_y, index_t pstride_x,
+                 index_t pdilate_y, index_t pdilate_x,
+                 index_t pad_y = 0, index_t pad_x = 0) {
+  TypeCheckPass<ExpInfo<SrcExp>::kDim >= 3>
+      ::Error_Expression_Does_Not_Meet_Dimension_Req();
+  return UnpackPatchToColXExp<SrcExp, DType, ExpInfo<SrcExp>::kDim, layout>
+      (img.self(), psize_y, psize_x, pstride_y, pstride_x, pdilate_y, pdilate_x,
+       pad_y, pad_x);
+}
 //----------------------
 // Execution plan
 //----------------------
@@ -120,20 +177,20 @@ struct Plan<UnpackPatchToColXExp<SrcExp, DType, srcdim>, DType> {
        psize_y_(e.psize_y_), psize_x_(e.psize_x_),
        pstride_y_(e.pstride_y_), pstride_x_(e.pstride_x_),
        i_channel_(e.i_channel_), pdilate_y_(e.pdilate_y_), pdilate_x_(e.pdilate_x_),
+       pad_y_(e.pad_y_), pad_x_(e.pad_x_),
        i_height_(e.i_height_), i_width_(e.i_width_),
-       o_height_((i_height_ - (pdilate_y_ * (psize_y_ - 1) + 1)) / pstride_y_ + 1),
-       o_width_((i_width_ - (pdilate_x_ * (psize_x_ - 1) + 1)) / pstride_x_ + 1) {}
+       o_height_(e.o_height_), o_width_(e.o_width_) {}
   MSHADOW_XINLINE DType Eval(index_t i, index_t j) const {
-    const index_t x_offset = i % psize_x_ * pdilate_x_;
+    const index_t x_offset = i % psize_x_ * pdilate_x_ - pad_x_;
     const index_t idivp    = i / psize_x_;
-    const index_t y_offset = idivp % psize_y_ * pdilate_y_;
+    const index_t y_offset = idivp % psize_y_ * pdilate_y_ - pad_y_;
     const index_t c = idivp / psize_y_;
     const index_t x = (j % o_width_) * pstride_x_ + x_offset;
     const index_t jdivw = j / o_width_;
     const index_t y = (jdivw % o_height_) * pstride_y_ + y_offset;
     const index_t n = jdivw / o_height_;
 
-    if (x < i_width_ && y < i_height_) {
+    if (x >= 0 && x < i_width_ && y >= 0 && y < i_height_) {
       return src_.Eval((n * i_channel_  + c) * i_height_ + y, x);
     } else {
       return DType(0.0f);
@@ -143,9 +200,101 @@ struct Plan<UnpackPatchToColXExp<SrcExp, DType, srcdim>, DType> {
  private:
   Plan<SrcExp, DType> src_;
   const index_t psize_y_, psize_x_, pstride_y_, pstride_x_, i_channel_;
-  const index_t pdilate_y_, pdilate_x_;
+  const index_t pdilate_y_, pdilate_x_, pad_y_, pad_x_;
+  const index_t i_height_, i_width_, o_height_, o_width_;
+};
+template<typename SrcExp, typename DType, int srcdim>
+struct Plan<UnpackPatchToColXExp<SrcExp, DType, srcdim, kNHWC>, DType> {
+ public:
+  explicit Plan(const UnpackPatchToColXExp<SrcExp, DType, srcdim, kNHWC> &e)
+      :src_(MakePlan(e.img_)),
+       psize_x_(e.psize_x_), pstride_y_(e.pstride_y_), pstride_x_(e.pstride_x_),
+       i_channel_(e.i_channel_), pdilate_y_(e.pdilate_y_), pdilate_x_(e.pdilate_x_),
+       pad_y_(e.pad_y_), pad_x_(e.pad_x_),
+       i_height_(e.i_height_), i_width_(e.i_width_),
+       o_height_(e.o_height_), o_width_(e.o_width_) {}
+  MSHADOW_XINLINE DType Eval(index_t i, index_t j) const {
+    const index_t c = i % i_channel_;
+    const index_t idivc = i / i_channel_;
+    const index_t x_offset = idivc % psize_x_ * pdilate_x_ - pad_x_;
+    const index_t y_offset = idivc / psize_x_ * pdilate_y_ - pad_y_;
+    const index_t x = (j % o_width_) * pstride_x_ + x_offset;
+    const index_t jdivw = j / o_width_;
+    const index_t y = (jdivw % o_height_) * pstride_y_ + y_offset;
+    const index_t n = jdivw / o_height_;
+
+    if (x >= 0 && x < i_width_ && y >= 0 && y < i_height_) {
+      return src_.Eval((n * i_height_ + y) * i_width_ + x, c);
+    } else {
+      return DType(0.0f);
+    }
+  }
+
+ private:
+  Plan<SrcExp, DType> src_;
+  const index_t psize_x_, pstride_y_, pstride_x_, i_channel_;
+  const index_t pdilate_y_, pdilate_x_, pad_y_, pad_x_;
   const index_t i_height_, i_width_, o_height_, o_width_;
 };
+/*!
+ * \brief CPU: evaluate unpack_patch2col one output row segment at a time,
+ *  a segment is the o_width columns of one row of the matrix that share an
+ *  image row y; segments whose y is in the padding are zero, the others are
+ *  split into a left border, an interior read without bounds checks and a
+ *  right border
+ */
+struct UnpackPatchToColRows {
+  template<typename SV, typename SrcExp, typename DType, int srcdim>
+  inline static void Eval(Tensor<cpu, 2, DType> dst,
+                          const UnpackPatchToColXExp<SrcExp, DType, srcdim> &e) {
+    Plan<SrcExp, DType> src = MakePlan(e.img_);
+    const index_t nrow = e.shape_[0], nseg = e.shape_[1] / e.o_width_;
+    const index_t o_height = e.o_height_, o_width = e.o_width_;
+    const index_t height = e.i_height_, width = e.i_width_;
+    const index_t stride_x = e.pstride_x_;
+    #pragma omp parallel for
+    for (openmp_index_t rs = 0; rs < nrow * nseg; ++rs) {
+      const index_t i = rs / nseg, s = rs % nseg;
+      const index_t x_offset = i % e.psize_x_ * e.pdilate_x_ - e.pad_x_;
+      const index_t idivp = i / e.psize_x_;
+      const index_t y_offset = idivp % e.psize_y_ * e.pdilate_y_ - e.pad_y_;
+      const index_t c = idivp / e.psize_y_;
+      const index_t y = s % o_height * e.pstride_y_ + y_offset;
+      const index_t n = s / o_height;
+      DType *out = dst[i].dptr_ + s * o_width;
+      // interior columns [lo, hi) have 0 <= x < width
+      index_t lo = 0, hi = 0;
+      if (y >= 0 && y < height && x_offset < width) {
+        lo = x_offset < 0 ? std::min((stride_x - 1 - x_offset) / stride_x, o_width) : 0;
+        hi = std::min((width - 1 - x_offset) / stride_x + 1, o_width);
+        hi = std::max(hi, lo);
+      }
+      for (index_t ox = 0; ox < lo; ++ox) {
+        SV::template Save<DType>(out[ox], DType(0.0f));
+      }
+      const index_t row = (n * e.i_channel_ + c) * height + y;
+      for (index_t ox = lo; ox < hi; ++ox) {
+        SV::template Save<DType>(out[ox], src.Eval(row, ox * stride_x + x_offset));
+      }
+      for (index_t ox = hi; ox < o_width; ++ox) {
+        SV::template Save<DType>(out[ox], DType(0.0f));
+      }
+    }
+  }
+};
 }  // namespace expr
+/*! \brief tensor = unpack_patch2col(...) on CPU is computed by row segments */
+template<typename SV, typename SrcExp, typename DType, int srcdim>
+struct MapExpCPUEngine<false, SV, Tensor<cpu, 2, DType>, 2, DType,
+                       expr::MakeTensorExp<expr::UnpackPatchToColXExp<SrcExp, DType, srcdim>,
+                                           SrcExp, 2, DType>,
+                       expr::type::kChainer> {
+  inline static void Map(Tensor<cpu, 2, DType> *dst,
+                         const expr::Exp<expr::MakeTensorExp<
+                           expr::UnpackPatchToColXExp<SrcExp, DType, srcdim>,
+                           SrcExp, 2, DType>, DType, expr::type::kChainer> &exp) {
+    expr::UnpackPatchToColRows::Eval<SV>(*dst, exp.self().real_self());
+  }
+};
 }  // namespace mshadow
 #endif  // MSHADOW_EXTENSION_UNPACK_PATCH2COL_H_
@@ -0,0 +1,129 @@
+/*!
+ *  Copyright (c) 2017 by Contributors
+ * \file unpack_patch2col_3d.h
+ * \brief support for unpacking volumetric patches, for 3-D convolution
+ */
+#ifndef MSHADOW_EXTENSION_UNPACK_PATCH2COL_3D_H_
+#define MSHADOW_EXTENSION_UNPACK_PATCH2COL_3D_H_
+#include "../extension.h"
+namespace mshadow {
+namespace expr {
+/*!
+ * \brief unpack local (overlap) 3-D patches of a batch of volumes in kNCDHW
+ *  layout to columns of a matrix, the 3-D counterpart of UnpackPatchToColXExp
+ * \tparam SrcExp source expression
+ * \tparam DType the type of elements
+ * \tparam srcdim source dimension
+ */
+template<typename SrcExp, typename DType, int srcdim>
+struct UnpackPatchToColXExp3D:
+      public MakeTensorExp<UnpackPatchToColXExp3D<SrcExp, DType, srcdim>,
+                           SrcExp, 2, DType> {
+  /*! \brief channel and depth axes, height and width follow depth */
+  static const int kChannelAxis = srcdim - LayoutType<kNCDHW>::kChannelFromLast;
+  static const int kDepthAxis = srcdim - LayoutType<kNCDHW>::kDepthFromLast;
+  /*! \brief source operand */
+  const SrcExp &img_;
+  /*! \brief patch size in depth, height and width */
+  Shape<3> psize_;
+  /*! \brief patch stride */
+  Shape<3> pstride_;
+  /*! \brief patch dilate */
+  Shape<3> pdilate_;
+  /*! \brief zero padding on both sides */
+  Shape<3> ppad_;
+  /*! \brief number of input channel */
+  index_t i_channel_;
+  /*! \brief depth, height and width of img */
+  Shape<3> ishape_;
+  /*! \brief depth, height and width of the output */
+  Shape<3> oshape_;
+  /*! \brief constructor */
+  UnpackPatchToColXExp3D(const SrcExp &img, Shape<3> psize, Shape<3> pstride,
+                         Shape<3> pdilate, Shape<3> ppad)
+      : img_(img), psize_(psize), pstride_(pstride), pdilate_(pdilate), ppad_(ppad) {
+    Shape<srcdim> imshape = ShapeCheck<srcdim, SrcExp>::Check(img_);
+    this->i_channel_ = imshape[kChannelAxis];
+    for (int k = 0; k < 3; ++k) {
+      ishape_[k] = imshape[kDepthAxis + k];
+      const index_t extent = pdilate[k] * (psize[k] - 1) + 1;
+      CHECK(ishape_[k] + 2 * ppad[k] >= extent)
+        << "UnpackPatchToCol3D: padded volume smaller than patch size";
+      oshape_[k] = (ishape_[k] + 2 * ppad[k] - extent) / pstride[k] + 1;
+    }
+    // calculate number of batches
+    const index_t num = imshape.ProdShape(0, kChannelAxis);
+    this->shape_[1] = oshape_.Size() * num;
+    this->shape_[0] = psize.Size() * i_channel_;
+  }
+};
+/*!
+ * \brief unpack local (overlap) 3-D patches of volumes to columns of a matrix,
+ *  can be used to implement 3-D convolution, output = dot(weight, mat):
+ *
+ *  weight; shape[0]: out_channel, shape[1]: in_channel * psize[0] * psize[1] * psize[2]
+ *  output; shape[0]: out_channel, shape[1]: out_depth * out_height * out_width * num
+ *  out_depth = (in_depth + 2 * pad[0] - (dilate[0] * (psize[0] - 1) + 1)) / stride[0] + 1,
+ *  likewise for height and width; padded elements read as 0
+ *
+ * \param img source volume, shape: (batch, channel, depth, height, width)
+ * \param psize patch size in depth, height and width
+ * \param pstride stride of each patch
+ * \param pdilate dilate of each patch
+ * \param ppad zero padding of each side
+ * \return unpacked mat expression
+ * \tparam SrcExp source expression
+ * \tparam DType the type of elements
+ * \tparam etype type of expression
+ */
+template<typename SrcExp, typename DType, int etype>
+inline UnpackPatchToColXExp3D<SrcExp, DType, ExpInfo<SrcExp>::kDim>
+unpack_patch2col_3d(const Exp<SrcExp, DType, etype> &img,
+                    Shape<3> psize, Shape<3> pstride,
+                    Shape<3> pdilate = Shape3(1, 1, 1), Shape<3> ppad = Shape3(0, 0, 0)) {
+  TypeCheckPass<ExpInfo<SrcExp>::kDim >= 4>
+      ::Error_Expression_Does_Not_Meet_Dimension_Req();
+  return UnpackPatchToColXExp3D<SrcExp, DType, ExpInfo<SrcExp>::kDim>
+      (img.self(), psize, pstride, pdilate, ppad);
+}
+//----------------------
+// Execution plan
+//----------------------
+template<typename SrcExp, typename DType, int srcdim>
+struct Plan<UnpackPatchToColXExp3D<SrcExp, DType, srcdim>, DType> {
+ public:
+  explicit Plan(const UnpackPatchToColXExp3D<SrcExp, DType, srcdim> &e)
+      : src_(MakePlan(e.img_)),
+        psize_(e.psize_), pstride_(e.pstride_), pdilate_(e.pdilate_), ppad_(e.ppad_),
+        i_channel_(e.i_channel_), ishape_(e.ishape_), oshape_(e.oshape_) {}
+  MSHADOW_XINLINE DType Eval(index_t i, index_t j) const {
+    const index_t x_offset = i % psize_[2] * pdilate_[2];
+    const index_t idivx = i / psize_[2];
+    const index_t y_offset = idivx % psize_[1] * pdilate_[1];
+    const index_t idivy = idivx / psize_[1];
+    const index_t z_offset = idivy % psize_[0] * pdilate_[0];
+    const index_t c = idivy / psize_[0];
+    const index_t x = (j % oshape_[2]) * pstride_[2] - ppad_[2] + x_offset;
+    const index_t jdivw = j / oshape_[2];
+    const index_t y = (jdivw % oshape_[1]) * pstride_[1] - ppad_[1] + y_offset;
+    const index_t jdivh = jdivw / oshape_[1];
+    const index_t z = (jdivh % oshape_[0]) * pstride_[0] - ppad_[0] + z_offset;
+    const index_t n = jdivh / oshape_[0];
+
+    if (x >= 0 && x < ishape_[2] && y >= 0 && y < ishape_[1] &&
+        z >= 0 && z < ishape_[0]) {
+      return src_.Eval(((n * i_channel_ + c) * ishape_[0] + z) * ishape_[1] + y, x);
+    } else {
+      return DType(0.0f);
+    }
+  }
+
+ private:
+  Plan<SrcExp, DType> src_;
+  const Shape<3> psize_, pstride_, pdilate_, ppad_;
+  const index_t i_channel_;
+  const Shape<3> ishape_, oshape_;
+};
+}  // namespace expr
+}  // namespace mshadow
+#endif  // MSHADOW_EXTENSION_UNPACK_PATCH2COL_3D_H_
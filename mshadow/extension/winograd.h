@@ -0,0 +1,307 @@
+/*!
+ *  Copyright (c) 2017 by Contributors
+ * \file winograd.h
+ * \brief Winograd F(2x2, 3x3) and F(4x4, 3x3) convolution,
+ *  for 3x3 patches with stride 1 and no dilation
+ *
+ *  The output is computed in m x m tiles from (m + 2) x (m + 2) input tiles:
+ *    Y = AT * [(G g GT) .* (BT d B)] * A
+ *  the elementwise product summed over input channels becomes one GEMM per
+ *  each of the (m + 2)^2 transform positions, computed by BatchGEMM.
+ */
+#ifndef MSHADOW_EXTENSION_WINOGRAD_H_
+#define MSHADOW_EXTENSION_WINOGRAD_H_
+#include <algorithm>
+#include <vector>
+#include "../extension.h"
+
+namespace mshadow {
+namespace expr {
+/*! \brief transform matrices of Winograd F(m x m, 3 x 3), G in double as it is not exact in float */
+template<int m>
+struct WinogradTile;
+template<>
+struct WinogradTile<2> {
+  static const int kAlpha = 4;
+  inline static const double (&G(void))[4][3] {
+    static const double g[4][3] = {{1.0, 0.0, 0.0}, {0.5, 0.5, 0.5},
+                                   {0.5, -0.5, 0.5}, {0.0, 0.0, 1.0}};
+    return g;
+  }
+  inline static const float (&BT(void))[4][4] {
+    static const float bt[4][4] = {{1.0f, 0.0f, -1.0f, 0.0f}, {0.0f, 1.0f, 1.0f, 0.0f},
+                                   {0.0f, -1.0f, 1.0f, 0.0f}, {0.0f, 1.0f, 0.0f, -1.0f}};
+    return bt;
+  }
+  inline static const float (&AT(void))[2][4] {
+    static const float at[2][4] = {{1.0f, 1.0f, 1.0f, 0.0f}, {0.0f, 1.0f, -1.0f, -1.0f}};
+    return at;
+  }
+};
+template<>
+struct WinogradTile<4> {
+  static const int kAlpha = 6;
+  inline static const double (&G(void))[6][3] {
+    static const double g[6][3] = {
+      {1.0 / 4, 0.0, 0.0}, {-1.0 / 6, -1.0 / 6, -1.0 / 6},
+      {-1.0 / 6, 1.0 / 6, -1.0 / 6}, {1.0 / 24, 1.0 / 12, 1.0 / 6},
+      {1.0 / 24, -1.0 / 12, 1.0 / 6}, {0.0, 0.0, 1.0}};
+    return g;
+  }
+  inline static const float (&BT(void))[6][6] {
+    static const float bt[6][6] = {
+      {4.0f, 0.0f, -5.0f, 0.0f, 1.0f, 0.0f}, {0.0f, -4.0f, -4.0f, 1.0f, 1.0f, 0.0f},
+      {0.0f, 4.0f, -4.0f, -1.0f, 1.0f, 0.0f}, {0.0f, -2.0f, -1.0f, 2.0f, 1.0f, 0.0f},
+      {0.0f, 2.0f, -1.0f, -2.0f, 1.0f, 0.0f}, {0.0f, 4.0f, 0.0f, -5.0f, 0.0f, 1.0f}};
+    return bt;
+  }
+  inline static const float (&AT(void))[4][6] {
+    static const float at[4][6] = {
+      {1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f}, {0.0f, 1.0f, -1.0f, 2.0f, -2.0f, 0.0f},
+      {0.0f, 1.0f, 1.0f, 4.0f, 4.0f, 0.0f}, {0.0f, 1.0f, -1.0f, 8.0f, -8.0f, 1.0f}};
+    return at;
+  }
+};
+/*! \brief type the transforms of DType are computed in */
+template<typename DType>
+struct WinogradAccType {
+  typedef float type;
+};
+template<>
+struct WinogradAccType<double> {
+  typedef double type;
+};
+/*!
+ * \brief 3x3 filters transformed for Winograd F(m x m, 3 x 3),
+ *  keep it across calls to transform the filters only once, e.g. for inference
+ * \tparam DType the type of elements
+ */
+template<typename DType>
+struct WinogradFilter {
+  /*! \brief output tile size m, 2 or 4 */
+  int tile_;
+  /*! \brief number of output channels */
+  index_t out_channel_;
+  /*! \brief number of input channels */
+  index_t in_channel_;
+  /*! \brief transformed filters, shape (m + 2)^2 x out_channel x in_channel */
+  std::vector<DType> data_;
+  /*! \brief empty filter */
+  WinogradFilter(void) : tile_(0), out_channel_(0), in_channel_(0) {}
+  /*!
+   * \brief transform weight
+   * \param weight shape[0]: out_channel, shape[1]: in_channel * 3 * 3
+   * \param tile output tile size, 2 or 4
+   */
+  WinogradFilter(const Tensor<cpu, 2, DType> &weight, int tile) {
+    this->Transform(weight, tile);
+  }
+  /*! \brief transform weight, see the constructor */
+  inline void Transform(const Tensor<cpu, 2, DType> &weight, int tile) {
+    CHECK(tile == 2 || tile == 4) << "Winograd: tile must be 2 or 4";
+    CHECK_EQ(weight.size(1) % 9, 0U) << "Winograd: weight must hold 3x3 filters";
+    tile_ = tile;
+    out_channel_ = weight.size(0);
+    in_channel_ = weight.size(1) / 9;
+    if (tile == 2) {
+      TransformTile<2>(weight);
+    } else {
+      TransformTile<4>(weight);
+    }
+  }
+  /*! \brief transformed filters as a batch of matrices */
+  inline Tensor<cpu, 3, DType> matrices(void) const {
+    const index_t alpha = tile_ + 2;
+    return Tensor<cpu, 3, DType>(const_cast<DType*>(&data_[0]),
+                                 Shape3(alpha * alpha, out_channel_, in_channel_));
+  }
+
+ private:
+  template<int m>
+  inline void TransformTile(const Tensor<cpu, 2, DType> &weight) {
+    typedef typename WinogradAccType<DType>::type AType;
+    const int alpha = WinogradTile<m>::kAlpha;
+    const double (&g)[alpha][3] = WinogradTile<m>::G();
+    const index_t nfilter = out_channel_ * in_channel_;
+    data_.resize(alpha * alpha * nfilter);
+    #pragma omp parallel for
+    for (openmp_index_t f = 0; f < nfilter; ++f) {
+      const DType *w = weight.dptr_ + (f / in_channel_) * weight.stride_ + (f % in_channel_) * 9;
+      // U = G w GT
+      AType gw[alpha][3];
+      for (int i = 0; i < alpha; ++i) {
+        for (int j = 0; j < 3; ++j) {
+          gw[i][j] = AType(g[i][0]) * AType(w[j]) + AType(g[i][1]) * AType(w[3 + j]) +
+              AType(g[i][2]) * AType(w[6 + j]);
+        }
+      }
+      for (int i = 0; i < alpha; ++i) {
+        for (int j = 0; j < alpha; ++j) {
+          data_[(i * alpha + j) * nfilter + f] =
+              DType(gw[i][0] * AType(g[j][0]) + gw[i][1] * AType(g[j][1]) + gw[i][2] * AType(g[j][2]));
+        }
+      }
+    }
+  }
+};
+/*!
+ * \brief dot(filter, unpack_patch2col(img, 3, 3, 1, 1)) with a transformed filter
+ * \tparam SrcExp type of the image expression
+ * \tparam DType the type of elements
+ * \tparam srcdim dimension of the image
+ */
+template<typename SrcExp, typename DType, int srcdim>
+struct WinogradDotExp:
+      public Exp<WinogradDotExp<SrcExp, DType, srcdim>,
+                 DType, type::kComplex> {
+  /*! \brief transformed filters */
+  const WinogradFilter<DType> &filter_;
+  /*! \brief the unpacked patches */
+  const UnpackPatchToColXExp<SrcExp, DType, srcdim> &col_;
+  /*! \brief constructor */
+  WinogradDotExp(const WinogradFilter<DType> &filter,
+                 const UnpackPatchToColXExp<SrcExp, DType, srcdim> &col)
+      : filter_(filter), col_(col) {}
+};
+/*!
+ * \brief 3x3 convolution with filters transformed in advance,
+ *  output = dot(filter, unpack_patch2col(img, 3, 3, 1, 1)),
+ *  see dot(weight, unpack_patch2col(...)) for the shapes
+ */
+template<typename SrcExp, typename DType, int srcdim>
+inline WinogradDotExp<SrcExp, DType, srcdim>
+dot(const WinogradFilter<DType> &filter,
+    const UnpackPatchToColXExp<SrcExp, DType, srcdim> &col) {
+  return WinogradDotExp<SrcExp, DType, srcdim>(filter, col);
+}
+/*! \brief whether a convolution can be computed by Winograd F(m x m, 3 x 3) */
+template<typename SrcExp, typename DType, int srcdim>
+inline bool WinogradEligible(const UnpackPatchToColXExp<SrcExp, DType, srcdim> &col) {
+  return col.psize_y_ == 3 && col.psize_x_ == 3 &&
+      col.pstride_y_ == 1 && col.pstride_x_ == 1 &&
+      col.pdilate_y_ == 1 && col.pdilate_x_ == 1;
+}
+/*! \brief the Winograd convolution, in chunks of tiles */
+struct WinogradEngine {
+  template<typename SV, typename SrcExp, typename DType, int srcdim>
+  inline static void Eval(Tensor<cpu, 2, DType> *p_dst,
+                          const WinogradFilter<DType> &filter,
+                          const UnpackPatchToColXExp<SrcExp, DType, srcdim> &col) {
+    CHECK(WinogradEligible(col)) << "Winograd: only 3x3 patches with stride 1, dilate 1";
+    CHECK(filter.in_channel_ == col.i_channel_ && p_dst->size(0) == filter.out_channel_ &&
+          p_dst->size(1) == col.shape_[1]) << "Winograd: shape mismatch";
+    if (filter.tile_ == 2) {
+      Eval<SV, 2>(p_dst, filter, col);
+    } else {
+      Eval<SV, 4>(p_dst, filter, col);
+    }
+  }
+
+ private:
+  template<typename SV, int m, typename SrcExp, typename DType, int srcdim>
+  inline static void Eval(Tensor<cpu, 2, DType> *p_dst,
+                          const WinogradFilter<DType> &filter,
+                          const UnpackPatchToColXExp<SrcExp, DType, srcdim> &col) {
+    typedef typename WinogradAccType<DType>::type AType;
+    const int alpha = WinogradTile<m>::kAlpha;
+    const float (&bt)[alpha][alpha] = WinogradTile<m>::BT();
+    const float (&at)[m][alpha] = WinogradTile<m>::AT();
+    Tensor<cpu, 2, DType> &dst = *p_dst;
+    Plan<SrcExp, DType> src = MakePlan(col.img_);
+    const index_t nchannel = col.i_channel_, nfilter = filter.out_channel_;
+    const index_t height = col.i_height_, width = col.i_width_;
+    const index_t o_height = col.o_height_, o_width = col.o_width_;
+    const index_t pad_y = col.pad_y_, pad_x = col.pad_x_;
+    const index_t num = col.shape_[1] / (o_height * o_width);
+    const index_t t_height = (o_height + m - 1) / m, t_width = (o_width + m - 1) / m;
+    const index_t ntile = num * t_height * t_width;
+    // tiles per chunk, so the transformed chunk stays around 2M elements
+    const index_t chunk = std::min(ntile, std::max(static_cast<index_t>(16),
+        (static_cast<index_t>(1) << 21) / (alpha * alpha * (nchannel + nfilter))));
+    std::vector<DType> vbuf(alpha * alpha * nchannel * chunk);
+    std::vector<DType> mbuf(alpha * alpha * nfilter * chunk);
+    std::vector<DType*> wbuf(3 * alpha * alpha);
+    Tensor<cpu, 1, DType*> workspace(&wbuf[0], Shape1(3 * alpha * alpha));
+    for (index_t t0 = 0; t0 < ntile; t0 += chunk) {
+      const index_t nt = std::min(chunk, ntile - t0);
+      Tensor<cpu, 3, DType> v(&vbuf[0], Shape3(alpha * alpha, nchannel, nt));
+      Tensor<cpu, 3, DType> mm(&mbuf[0], Shape3(alpha * alpha, nfilter, nt));
+      // V = BT d B of every input tile and channel
+      #pragma omp parallel for
+      for (openmp_index_t ct = 0; ct < nchannel * nt; ++ct) {
+        const index_t c = ct / nt, t = ct % nt;
+        index_t n, y0, x0;
+        Locate(t0 + t, t_height, t_width, m, &n, &y0, &x0);
+        AType d[alpha][alpha], tmp[alpha][alpha];
+        for (int i = 0; i < alpha; ++i) {
+          for (int j = 0; j < alpha; ++j) {
+            const index_t y = y0 + i - pad_y, x = x0 + j - pad_x;
+            d[i][j] = (y >= 0 && y < height && x >= 0 && x < width) ?
+                AType(src.Eval((n * nchannel + c) * height + y, x)) : AType(0);
+          }
+        }
+        for (int i = 0; i < alpha; ++i) {
+          for (int j = 0; j < alpha; ++j) {
+            AType s = 0;
+            for (int k = 0; k < alpha; ++k) s += bt[i][k] * d[k][j];
+            tmp[i][j] = s;
+          }
+        }
+        for (int i = 0; i < alpha; ++i) {
+          for (int j = 0; j < alpha; ++j) {
+            AType s = 0;
+            for (int k = 0; k < alpha; ++k) s += tmp[i][k] * bt[j][k];
+            v.dptr_[((i * alpha + j) * nchannel + c) * nt + t] = DType(s);
+          }
+        }
+      }
+      // M = U V for each of the alpha^2 positions
+      BatchGEMM<false, false>(mm, filter.matrices(), v, DType(1.0f), DType(0.0f), workspace);
+      // Y = AT M A
+      #pragma omp parallel for
+      for (openmp_index_t ot = 0; ot < nfilter * nt; ++ot) {
+        const index_t o = ot / nt, t = ot % nt;
+        index_t n, y0, x0;
+        Locate(t0 + t, t_height, t_width, m, &n, &y0, &x0);
+        AType tmp[m][alpha];
+        for (int i = 0; i < m; ++i) {
+          for (int j = 0; j < alpha; ++j) {
+            AType s = 0;
+            for (int k = 0; k < alpha; ++k) {
+              s += at[i][k] * AType(mm.dptr_[((k * alpha + j) * nfilter + o) * nt + t]);
+            }
+            tmp[i][j] = s;
+          }
+        }
+        DType *out = dst.dptr_ + o * dst.stride_ + n * o_height * o_width;
+        for (int i = 0; i < m && y0 + i < o_height; ++i) {
+          for (int j = 0; j < m && x0 + j < o_width; ++j) {
+            AType s = 0;
+            for (int k = 0; k < alpha; ++k) s += tmp[i][k] * at[j][k];
+            SV::Save(out[(y0 + i) * o_width + x0 + j], DType(s));
+          }
+        }
+      }
+    }
+  }
+  // image and top left corner of tile t
+  inline static void Locate(index_t t, index_t t_height, index_t t_width, int m,
+                            index_t *n, index_t *y0, index_t *x0) {
+    *x0 = t % t_width * m;
+    *y0 = t / t_width % t_height * m;
+    *n = t / t_width / t_height;
+  }
+};
+template<typename SV, typename SrcExp, typename DType, int srcdim>
+struct ExpComplexEngine<SV,
+                        Tensor<cpu, 2, DType>,
+                        WinogradDotExp<SrcExp, DType, srcdim>,
+                        DType> {
+  inline static void Eval(Tensor<cpu, 2, DType> *dst,
+                          const WinogradDotExp<SrcExp, DType, srcdim> &exp) {
+    WinogradEngine::Eval<SV>(dst, exp.filter_, exp.col_);
+  }
+};
+}  // namespace expr
+}  // namespace mshadow
+#endif  // MSHADOW_EXTENSION_WINOGRAD_H_
@@ -0,0 +1,663 @@
+/*!
+ *  Copyright (c) 2017 by Contributors
+ * \file gemm_cpu-inl.h
+ * \brief native CPU GEMM kernels: a packed GEMM with fp32 accumulation,
+ *  used for element types that have no BLAS routine (half_t, bf16_t),
+ *  and unpacked kernels for small matrices
+ *
+ *  C = alpha * A * B + beta * C, with C row major, is computed in the usual
+ *  blocked fashion: a kc x nc panel of B and a mc x kc block of A are
+ *  converted to fp32 and packed into kNR / kMR wide slivers, then a
+ *  kMR x kNR register tile is accumulated by the micro kernel.
+ */
+#ifndef MSHADOW_GEMM_CPU_INL_H_
+#define MSHADOW_GEMM_CPU_INL_H_
+#include <vector>
+#include <map>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <utility>
+#include <algorithm>
+#include "./base.h"
+#include "./packet-inl.h"
+
+namespace mshadow {
+namespace expr {
+/*! \brief cache blocking of the packed CPU GEMM, in elements */
+struct GEMMBlocking {
+  /*! \brief rows of A packed by one thread */
+  index_t mc;
+  /*! \brief depth of the packed panels */
+  index_t kc;
+  /*! \brief columns of B packed at once */
+  index_t nc;
+  /*! \brief constructor */
+  GEMMBlocking(index_t mc = 96, index_t kc = 256, index_t nc = 2048)
+      : mc(mc), kc(kc), nc(nc) {}
+};
+/*! \brief convert n elements of src, with stride, into fp32 */
+template<typename DType>
+struct GEMMConvert {
+  inline static void Run(const DType *src, index_t stride, index_t n, float *dst) {
+    for (index_t i = 0; i < n; ++i) {
+      dst[i] = static_cast<float>(src[i * stride]);
+    }
+  }
+};
+template<>
+struct GEMMConvert<half::half_t> {
+  inline static void Run(const half::half_t *src, index_t stride, index_t n, float *dst) {
+    index_t i = 0;
+#if MSHADOW_USE_F16C
+    if (stride == 1) {
+      for (; i + 4 <= n; i += 4) {
+        __m128i h = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_ps(dst + i, _mm_cvtph_ps(h));
+      }
+    }
+#endif  // MSHADOW_USE_F16C
+    for (; i < n; ++i) {
+      dst[i] = static_cast<float>(src[i * stride]);
+    }
+  }
+};
+template<>
+struct GEMMConvert<bfloat::bf16_t> {
+  inline static void Run(const bfloat::bf16_t *src, index_t stride, index_t n, float *dst) {
+    index_t i = 0;
+#if MSHADOW_USE_SSE
+    if (stride == 1) {
+      const __m128i zero = _mm_setzero_si128();
+      for (; i + 4 <= n; i += 4) {
+        __m128i h = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_ps(dst + i, _mm_castsi128_ps(_mm_unpacklo_epi16(zero, h)));
+      }
+    }
+#endif  // MSHADOW_USE_SSE
+    for (; i < n; ++i) {
+      dst[i] = static_cast<float>(src[i * stride]);
+    }
+  }
+};
+/*!
+ * \brief dense operand of the packed GEMM
+ *  A is seen as m slices of depth k, B as n slices of depth k,
+ *  element (s, d) is dptr_[s * sstride_ + d * dstride_]
+ *  Other operands (e.g. implicit im2col) only need to provide Pack.
+ */
+template<typename DType>
+struct GEMMMatrix {
+  /*! \brief data pointer */
+  const DType *dptr_;
+  /*! \brief stride between slices */
+  index_t sstride_;
+  /*! \brief stride along the depth */
+  index_t dstride_;
+  /*! \brief constructor */
+  GEMMMatrix(const DType *dptr, index_t sstride, index_t dstride)
+      : dptr_(dptr), sstride_(sstride), dstride_(dstride) {}
+  /*!
+   * \brief pack slices [s0, s0 + ns) over depth [d0, d0 + nd) in fp32,
+   *  as slivers of width, buf[(s / width * nd + d) * width + s % width],
+   *  slices beyond ns are zero filled up to a multiple of width
+   */
+  template<int width>
+  inline void Pack(index_t s0, index_t d0, index_t ns, index_t nd, float *buf) const {
+    std::vector<float> tmp(sstride_ == 1 ? 0 : nd);
+    for (index_t s = 0; s < ns; s += width) {
+      float *out = buf + s * nd;
+      const index_t w = std::min(static_cast<index_t>(width), ns - s);
+      if (sstride_ == 1) {
+        for (index_t d = 0; d < nd; ++d) {
+          GEMMConvert<DType>::Run(dptr_ + s0 + s + (d0 + d) * dstride_, 1, w, out + d * width);
+          for (index_t r = w; r < width; ++r) out[d * width + r] = 0.0f;
+        }
+      } else {
+        for (index_t r = 0; r < w; ++r) {
+          GEMMConvert<DType>::Run(dptr_ + (s0 + s + r) * sstride_ + d0 * dstride_,
+                                  dstride_, nd, &tmp[0]);
+          for (index_t d = 0; d < nd; ++d) out[d * width + r] = tmp[d];
+        }
+        for (index_t r = w; r < width; ++r) {
+          for (index_t d = 0; d < nd; ++d) out[d * width + r] = 0.0f;
+        }
+      }
+    }
+  }
+};
+/*! \brief the packed GEMM */
+struct PackedGEMM {
+  /*! \brief rows of the register tile */
+  static const int kMR = 4;
+  /*! \brief columns of the register tile */
+  static const int kNR = 8;
+  /*! \brief tile = a_sliver * b_sliver over depth kc */
+  inline static void Kernel(index_t kc, const float *a, const float *b, float *tile) {
+    typedef packet::Packet<float, MSHADOW_DEFAULT_PACKET> Packet;
+    const int kVec = kNR / Packet::size;
+    Packet acc[kMR][kVec];
+    for (int r = 0; r < kMR; ++r) {
+      for (int q = 0; q < kVec; ++q) acc[r][q] = Packet::Fill(0.0f);
+    }
+    for (index_t p = 0; p < kc; ++p, a += kMR, b += kNR) {
+      Packet bv[kVec];
+      for (int q = 0; q < kVec; ++q) bv[q] = Packet::LoadUnAligned(b + q * Packet::size);
+      for (int r = 0; r < kMR; ++r) {
+        Packet av = Packet::Fill(a[r]);
+        for (int q = 0; q < kVec; ++q) acc[r][q] = acc[r][q] + av * bv[q];
+      }
+    }
+    for (int r = 0; r < kMR; ++r) {
+      for (int q = 0; q < kVec; ++q) acc[r][q].Store(tile + r * kNR + q * Packet::size);
+    }
+  }
+  /*!
+   * \brief C = alpha * op(A) * op(B) + beta * C, C is m x n row major
+   * \param a op(A), m slices of depth k
+   * \param b op(B)^T, n slices of depth k
+   * \param c pointer to C
+   * \param ldc row stride of C
+   * \param blk cache blocking
+   * \tparam OpA, OpB operand types, see GEMMMatrix
+   * \tparam DType element type of C, accumulation is always in fp32
+   */
+  template<typename OpA, typename OpB, typename DType>
+  inline static void Eval(index_t m, index_t n, index_t k, float alpha,
+                          const OpA &a, const OpB &b, float beta,
+                          DType *c, index_t ldc,
+                          const GEMMBlocking &blk = GEMMBlocking()) {
+    if (m == 0 || n == 0) return;
+    if (k == 0) {
+      for (index_t i = 0; i < m; ++i) {
+        for (index_t j = 0; j < n; ++j) {
+          c[i * ldc + j] = beta == 0.0f ? DType(0.0f) : DType(beta * static_cast<float>(c[i * ldc + j]));
+        }
+      }
+      return;
+    }
+    const index_t kc = std::min(std::max(blk.kc, static_cast<index_t>(1)), k);
+    const index_t nc = std::min(RoundUp(std::max(blk.nc, static_cast<index_t>(kNR)), kNR),
+                                RoundUp(n, kNR));
+    // give every thread at least one block of rows
+    const index_t nthread = GetOMPMaxThreads();
+    const index_t mc = std::max(static_cast<index_t>(kMR),
+                                std::min(RoundUp(std::max(blk.mc, static_cast<index_t>(1)), kMR),
+                                         RoundUp((m + nthread - 1) / nthread, kMR)));
+    const index_t nblock = (m + mc - 1) / mc;
+    // fp32 accumulator when C itself is not fp32 and k is split
+    const bool use_acc = !IsFloat(c) && k > kc;
+    std::vector<float> acc(use_acc ? m * nc : 0);
+    std::vector<float> bpack(kc * nc);
+    for (index_t jc = 0; jc < n; jc += nc) {
+      const index_t ncur = std::min(nc, n - jc);
+      for (index_t pc = 0; pc < k; pc += kc) {
+        const index_t kcur = std::min(kc, k - pc);
+        const bool first = (pc == 0), last = (pc + kcur == k);
+        const index_t nsliver = (ncur + kNR - 1) / kNR;
+        #pragma omp parallel for
+        for (openmp_index_t s = 0; s < nsliver; ++s) {
+          b.template Pack<kNR>(jc + s * kNR, pc, std::min(static_cast<index_t>(kNR), ncur - s * kNR),
+                               kcur, &bpack[s * kNR * kcur]);
+        }
+        #pragma omp parallel for
+        for (openmp_index_t ib = 0; ib < nblock; ++ib) {
+          const index_t i0 = ib * mc;
+          const index_t mcur = std::min(mc, m - i0);
+          std::vector<float> apack(RoundUp(mcur, kMR) * kcur);
+          a.template Pack<kMR>(i0, pc, mcur, kcur, &apack[0]);
+          MSHADOW_ALIGNED(16) float tile[kMR * kNR];
+          for (index_t jr = 0; jr < ncur; jr += kNR) {
+            const index_t cols = std::min(static_cast<index_t>(kNR), ncur - jr);
+            for (index_t ir = 0; ir < mcur; ir += kMR) {
+              const index_t rows = std::min(static_cast<index_t>(kMR), mcur - ir);
+              Kernel(kcur, &apack[ir * kcur], &bpack[jr * kcur], tile);
+              for (index_t r = 0; r < rows; ++r) {
+                DType *crow = c + (i0 + ir + r) * ldc + jc + jr;
+                float *arow = use_acc ? &acc[(i0 + ir + r) * nc + jr] : NULL;
+                for (index_t j = 0; j < cols; ++j) {
+                  float v = alpha * tile[r * kNR + j];
+                  if (first && beta != 0.0f) v += beta * static_cast<float>(crow[j]);
+                  if (!use_acc) {
+                    crow[j] = first ? DType(v) : DType(static_cast<float>(crow[j]) + v);
+                  } else {
+                    arow[j] = first ? v : arow[j] + v;
+                    if (last) crow[j] = DType(arow[j]);
+                  }
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+ private:
+  inline static index_t RoundUp(index_t x, index_t align) {
+    return (x + align - 1) / align * align;
+  }
+  inline static bool IsFloat(const float *c) { return true; }
+  template<typename DType>
+  inline static bool IsFloat(const DType *c) { return false; }
+};
+/*!
+ * \brief single threaded GEMM for small matrices, without packing,
+ *  dst (SV)= scale * dot(lhs[.T], rhs[.T])
+ *  M, N, K are compile time extents of the rows of dst, the columns of dst
+ *  and the reduction, 0 means the extent is only known at runtime;
+ *  with all three fixed the loops are fully unrolled into registers.
+ *  DType must have packet support (float, double).
+ */
+template<int M, int N, int K>
+struct SmallDotEngine {
+  template<typename SV, bool transpose_left, bool transpose_right, typename DType>
+  inline static void Eval(Tensor<cpu, 2, DType> *p_dst,
+                          const Tensor<cpu, 2, DType> &lhs,
+                          const Tensor<cpu, 2, DType> &rhs,
+                          DType scale) {
+    typedef packet::Packet<DType, MSHADOW_DEFAULT_PACKET> Packet;
+    const index_t kP = Packet::size;
+    Tensor<cpu, 2, DType> &dst = *p_dst;
+    const index_t m = M ? M : dst.size(0);
+    const index_t n = N ? N : dst.size(1);
+    const index_t k = K ? K : (transpose_left ? lhs.size(0) : lhs.size(1));
+    CHECK(dst.size(0) == m && dst.size(1) == n &&
+          (transpose_left ? lhs.size(1) : lhs.size(0)) == m &&
+          (transpose_left ? lhs.size(0) : lhs.size(1)) == k &&
+          (transpose_right ? rhs.size(1) : rhs.size(0)) == k &&
+          (transpose_right ? rhs.size(0) : rhs.size(1)) == n)
+        << "dot-gemm: matrix shape mismatch";
+    const DType *a = lhs.dptr_, *b = rhs.dptr_;
+    const index_t lda = lhs.stride_, ldb = rhs.stride_, ldd = dst.stride_;
+    if (!transpose_right) {
+      // register tiles of up to 4 rows, rows of rhs are loaded as packets
+      for (index_t i0 = 0; i0 < m; i0 += 4) {
+        const DType *ai = transpose_left ? a + i0 : a + i0 * lda;
+        DType *di = dst.dptr_ + i0 * ldd;
+        switch (std::min(m - i0, static_cast<index_t>(4))) {
+          case 4: Row<SV, transpose_left, 4>(n, k, ai, lda, b, ldb, di, ldd, scale); break;
+          case 3: Row<SV, transpose_left, 3>(n, k, ai, lda, b, ldb, di, ldd, scale); break;
+          case 2: Row<SV, transpose_left, 2>(n, k, ai, lda, b, ldb, di, ldd, scale); break;
+          default: Row<SV, transpose_left, 1>(n, k, ai, lda, b, ldb, di, ldd, scale); break;
+        }
+      }
+    } else {
+      // rows of rhs are the columns of op(rhs): inner products
+      for (index_t i = 0; i < m; ++i) {
+        for (index_t j = 0; j < n; ++j) {
+          const DType *brow = b + j * ldb;
+          DType sum = DType(0);
+          index_t p = 0;
+          if (!transpose_left) {
+            const DType *arow = a + i * lda;
+            Packet acc = Packet::Fill(DType(0));
+            for (; p + kP <= k; p += kP) {
+              acc = acc + Packet::LoadUnAligned(arow + p) * Packet::LoadUnAligned(brow + p);
+            }
+            sum = acc.Sum();
+          }
+          for (; p < k; ++p) {
+            sum += (transpose_left ? a[p * lda + i] : a[i * lda + p]) * brow[p];
+          }
+          SV::Save(dst.dptr_[i * ldd + j], scale * sum);
+        }
+      }
+    }
+  }
+
+ private:
+  // nrow rows of dst, n columns
+  template<typename SV, bool transpose_left, int nrow, typename DType>
+  MSHADOW_CINLINE static void Row(index_t n, index_t k,
+                                  const DType *a, index_t lda,
+                                  const DType *b, index_t ldb,
+                                  DType *d, index_t ldd, DType scale) {
+    typedef packet::Packet<DType, MSHADOW_DEFAULT_PACKET> Packet;
+    const index_t kP = Packet::size;
+    index_t j = 0;
+    for (; j + 2 * kP <= n; j += 2 * kP) {
+      Tile<SV, transpose_left, nrow, 2>(k, a, lda, b + j, ldb, d + j, ldd, scale);
+    }
+    for (; j + kP <= n; j += kP) {
+      Tile<SV, transpose_left, nrow, 1>(k, a, lda, b + j, ldb, d + j, ldd, scale);
+    }
+    for (; j < n; ++j) {
+      for (int r = 0; r < nrow; ++r) {
+        DType sum = DType(0);
+        for (index_t p = 0; p < k; ++p) {
+          sum += (transpose_left ? a[p * lda + r] : a[r * lda + p]) * b[p * ldb + j];
+        }
+        SV::Save(d[r * ldd + j], scale * sum);
+      }
+    }
+  }
+  // nrow x (nvec * Packet::size) tile of dst
+  template<typename SV, bool transpose_left, int nrow, int nvec, typename DType>
+  MSHADOW_CINLINE static void Tile(index_t k,
+                                   const DType *a, index_t lda,
+                                   const DType *b, index_t ldb,
+                                   DType *d, index_t ldd, DType scale) {
+    typedef packet::Packet<DType, MSHADOW_DEFAULT_PACKET> Packet;
+    const index_t kP = Packet::size;
+    Packet acc[nrow][nvec];
+    for (int r = 0; r < nrow; ++r) {
+      for (int q = 0; q < nvec; ++q) acc[r][q] = Packet::Fill(DType(0));
+    }
+    for (index_t p = 0; p < k; ++p) {
+      Packet bv[nvec];
+      for (int q = 0; q < nvec; ++q) bv[q] = Packet::LoadUnAligned(b + p * ldb + q * kP);
+      for (int r = 0; r < nrow; ++r) {
+        Packet av = Packet::Fill(transpose_left ? a[p * lda + r] : a[r * lda + p]);
+        for (int q = 0; q < nvec; ++q) acc[r][q] = acc[r][q] + av * bv[q];
+      }
+    }
+    MSHADOW_ALIGNED(16) DType tmp[nvec * kP];
+    for (int r = 0; r < nrow; ++r) {
+      for (int q = 0; q < nvec; ++q) acc[r][q].Store(tmp + q * kP);
+      for (index_t t = 0; t < nvec * kP; ++t) SV::Save(d[r * ldd + t], scale * tmp[t]);
+    }
+  }
+};
+/*! \brief evaluate a dot on xpu by SmallDotEngine, if DType has packet support */
+template<typename xpu, bool pass_check>
+struct SmallDotDispatch {
+  inline static bool HasFixed(index_t m, index_t n, index_t k) {
+    return false;
+  }
+  template<typename SV, bool transpose_left, bool transpose_right, typename DType>
+  inline static bool Eval(Tensor<xpu, 2, DType> *p_dst,
+                          const Tensor<xpu, 2, DType> &lhs,
+                          const Tensor<xpu, 2, DType> &rhs,
+                          DType scale) {
+    return false;
+  }
+};
+template<>
+struct SmallDotDispatch<cpu, true> {
+  /*! \brief whether m x n x k has a compile time instance */
+  inline static bool HasFixed(index_t m, index_t n, index_t k) {
+    if (m == n && n == k) return m == 2 || m == 3 || m == 4 || m == 8;
+    return m == 16 && n == 64 && (k == 16 || k == 64);
+  }
+  template<typename SV, bool transpose_left, bool transpose_right, typename DType>
+  inline static bool Eval(Tensor<cpu, 2, DType> *p_dst,
+                          const Tensor<cpu, 2, DType> &lhs,
+                          const Tensor<cpu, 2, DType> &rhs,
+                          DType scale) {
+    const index_t m = p_dst->size(0), n = p_dst->size(1);
+    const index_t k = transpose_left ? lhs.size(0) : lhs.size(1);
+    if (m == n && n == k) {
+      switch (m) {
+        case 2:
+          SmallDotEngine<2, 2, 2>::Eval<SV, transpose_left, transpose_right>(p_dst, lhs, rhs, scale);
+          return true;
+        case 3:
+          SmallDotEngine<3, 3, 3>::Eval<SV, transpose_left, transpose_right>(p_dst, lhs, rhs, scale);
+          return true;
+        case 4:
+          SmallDotEngine<4, 4, 4>::Eval<SV, transpose_left, transpose_right>(p_dst, lhs, rhs, scale);
+          return true;
+        case 8:
+          SmallDotEngine<8, 8, 8>::Eval<SV, transpose_left, transpose_right>(p_dst, lhs, rhs, scale);
+          return true;
+        default: break;
+      }
+    }
+    if (m == 16 && n == 64) {
+      switch (k) {
+        case 16:
+          SmallDotEngine<16, 64, 16>::Eval<SV, transpose_left, transpose_right>(p_dst, lhs, rhs, scale);
+          return true;
+        case 64:
+          SmallDotEngine<16, 64, 64>::Eval<SV, transpose_left, transpose_right>(p_dst, lhs, rhs, scale);
+          return true;
+        default: break;
+      }
+    }
+    SmallDotEngine<0, 0, 0>::Eval<SV, transpose_left, transpose_right>(p_dst, lhs, rhs, scale);
+    return true;
+  }
+};
+/*! \brief CPU implementations a 2D dot can be computed by */
+enum GEMMBackend {
+  /*! \brief the built-in choice: BLAS, or the small kernel with MSHADOW_USE_SMALL_GEMM */
+  kGEMMDefault = 0,
+  /*! \brief SmallDotEngine */
+  kGEMMSmall = 1,
+  /*! \brief BLASEngine, i.e. cblas/MKL, or implicit_dot when stand alone */
+  kGEMMBLAS = 2,
+  /*! \brief PackedGEMM with the blocking of the tuning entry, fp32 accumulation */
+  kGEMMPacked = 3
+};
+/*! \brief backend and blocking for one shape class */
+struct GEMMTuneEntry {
+  /*! \brief backend to use */
+  GEMMBackend backend;
+  /*! \brief blocking of kGEMMPacked */
+  GEMMBlocking blocking;
+  /*! \brief constructor */
+  GEMMTuneEntry(GEMMBackend backend = kGEMMDefault,
+                const GEMMBlocking &blocking = GEMMBlocking())
+      : backend(backend), blocking(blocking) {}
+};
+/*!
+ * \brief table of the fastest GEMM backend per element type, transposes and
+ *  shape class, the shape class of (m, n, k) being
+ *  (ceil(log2 m), ceil(log2 n), ceil(log2 k)).
+ *
+ *  The table is read once, at the first dot, from the file named by the
+ *  environment variable MSHADOW_GEMM_TUNING_FILE, as written by
+ *  bench/gemm_bench --tune. Each line of the file is
+ *    dtype ta tb log2m log2n log2k backend mc kc nc
+ *  ta and tb being 1 for a transposed lhs and rhs,
+ *  e.g. "float32 0 1 6 6 8 packed 96 256 2048"; lines starting with # are ignored.
+ *  Shapes without an entry use kGEMMDefault.
+ */
+class GEMMTuner {
+ public:
+  /*! \brief the table of this process */
+  inline static GEMMTuner *Get(void) {
+    static GEMMTuner inst;
+    return &inst;
+  }
+  /*! \brief shape class of one extent, ceil(log2 x) */
+  inline static int ShapeClass(index_t x) {
+    int c = 0;
+    while (c < 62 && (static_cast<index_t>(1) << c) < x) ++c;
+    return c;
+  }
+  /*! \brief whether there is no entry, dot() then skips the lookup */
+  inline bool Empty(void) const {
+    return table_.empty();
+  }
+  /*! \brief look up the entry of a dot with element type flag dtype */
+  inline bool Lookup(int dtype, bool transpose_left, bool transpose_right,
+                     index_t m, index_t n, index_t k, GEMMTuneEntry *entry) const {
+    Table::const_iterator it = table_.find(Key(dtype, transpose_left, transpose_right, m, n, k));
+    if (it == table_.end()) return false;
+    *entry = it->second;
+    return true;
+  }
+  /*! \brief set the entry of the shape class of (m, n, k) */
+  inline void Set(int dtype, bool transpose_left, bool transpose_right,
+                  index_t m, index_t n, index_t k, const GEMMTuneEntry &entry) {
+    table_[Key(dtype, transpose_left, transpose_right, m, n, k)] = entry;
+  }
+  /*! \brief remove all entries */
+  inline void Clear(void) {
+    table_.clear();
+  }
+  /*! \brief add the entries of a tuning file */
+  inline void Load(const char *fname) {
+    std::ifstream fi(fname);
+    CHECK(fi.good()) << "GEMMTuner: cannot open " << fname;
+    std::string line;
+    for (int lineno = 1; std::getline(fi, line); ++lineno) {
+      if (line.empty() || line[0] == '#') continue;
+      std::istringstream is(line);
+      std::string dtype, backend;
+      int ta, tb, cm, cn, ck;
+      GEMMTuneEntry entry;
+      is >> dtype >> ta >> tb >> cm >> cn >> ck >> backend
+         >> entry.blocking.mc >> entry.blocking.kc >> entry.blocking.nc;
+      CHECK(!is.fail()) << "GEMMTuner: " << fname << ":" << lineno << ": cannot parse " << line;
+      entry.backend = static_cast<GEMMBackend>(FindName(BackendNames(), 4, backend));
+      table_[std::make_pair(TypeFlag(dtype),
+                            ((ta != 0) << 25) | ((tb != 0) << 24) |
+                            (cm << 16) | (cn << 8) | ck)] = entry;
+    }
+  }
+  /*! \brief write all entries to a tuning file */
+  inline void Save(const char *fname) const {
+    std::ofstream fo(fname);
+    CHECK(fo.good()) << "GEMMTuner: cannot open " << fname;
+    fo << "# dtype ta tb log2m log2n log2k backend mc kc nc\n";
+    for (Table::const_iterator it = table_.begin(); it != table_.end(); ++it) {
+      const int c = it->first.second;
+      fo << TypeName(it->first.first) << ' '
+         << ((c >> 25) & 1) << ' ' << ((c >> 24) & 1) << ' '
+         << ((c >> 16) & 255) << ' ' << ((c >> 8) & 255) << ' ' << (c & 255) << ' '
+         << BackendNames()[it->second.backend] << ' '
+         << it->second.blocking.mc << ' ' << it->second.blocking.kc << ' '
+         << it->second.blocking.nc << '\n';
+    }
+  }
+  /*! \brief name of a backend */
+  inline static const char *BackendName(GEMMBackend backend) {
+    return BackendNames()[backend];
+  }
+
+ private:
+  typedef std::map<std::pair<int, int>, GEMMTuneEntry> Table;
+  Table table_;
+  GEMMTuner(void) {
+    const char *fname = getenv("MSHADOW_GEMM_TUNING_FILE");
+    if (fname != NULL && fname[0] != '\0') Load(fname);
+  }
+  inline static std::pair<int, int> Key(int dtype, bool transpose_left, bool transpose_right,
+                                        index_t m, index_t n, index_t k) {
+    return std::make_pair(dtype, (transpose_left << 25) | (transpose_right << 24) |
+                          (ShapeClass(m) << 16) | (ShapeClass(n) << 8) | ShapeClass(k));
+  }
+  // names of the element types that can be tuned
+  inline static const char *TypeName(int flag) {
+    switch (flag) {
+      case kFloat32: return "float32";
+      case kFloat64: return "float64";
+      case kFloat16: return "float16";
+      case kBfloat16: return "bfloat16";
+      default: LOG(FATAL) << "GEMMTuner: unsupported type flag " << flag; return "";
+    }
+  }
+  inline static int TypeFlag(const std::string &name) {
+    const int flags[] = {kFloat32, kFloat64, kFloat16, kBfloat16};
+    for (int i = 0; i < 4; ++i) {
+      if (name == TypeName(flags[i])) return flags[i];
+    }
+    LOG(FATAL) << "GEMMTuner: unknown type " << name;
+    return 0;
+  }
+  inline static const char **BackendNames(void) {
+    static const char *names[] = {"default", "small", "blas", "packed"};
+    return names;
+  }
+  inline static int FindName(const char **names, int count, const std::string &name) {
+    for (int i = 0; i < count; ++i) {
+      if (name == names[i]) return i;
+    }
+    LOG(FATAL) << "GEMMTuner: unknown name " << name;
+    return 0;
+  }
+};
+/*!
+ * \brief pick the backend of dot on xpu and evaluate it,
+ *  returns false when the caller should use BLASEngine
+ */
+template<typename xpu>
+struct GEMMDispatch {
+  template<typename SV, bool transpose_left, bool transpose_right, typename DType>
+  inline static bool Eval(Tensor<xpu, 2, DType> *p_dst,
+                          const Tensor<xpu, 2, DType> &lhs,
+                          const Tensor<xpu, 2, DType> &rhs,
+                          DType scale) {
+    return false;
+  }
+};
+template<>
+struct GEMMDispatch<cpu> {
+  /*!
+   * \brief the backend a m x n x k dot(lhs[.T], rhs[.T]) of DType goes to,
+   *  with the tuning table consulted first
+   */
+  template<typename DType>
+  inline static GEMMBackend Choose(bool transpose_left, bool transpose_right,
+                                   index_t m, index_t n, index_t k, GEMMBlocking *blk) {
+    const int flag = DataType<DType>::kFlag;
+    const GEMMTuner *tuner = GEMMTuner::Get();
+    GEMMTuneEntry entry;
+    if (!tuner->Empty() &&
+        tuner->Lookup(flag, transpose_left, transpose_right, m, n, k, &entry)) {
+      *blk = entry.blocking;
+    }
+    const bool packet = PacketCheck<DType, MSHADOW_DEFAULT_PACKET>::kPass;
+    GEMMBackend backend = entry.backend;
+    if (backend == kGEMMDefault) {
+      backend = MSHADOW_USE_SMALL_GEMM && packet &&
+          (m * n * k <= MSHADOW_SMALL_GEMM_MAX_MNK ||
+           SmallDotDispatch<cpu, PacketCheck<DType, MSHADOW_DEFAULT_PACKET>::kPass>
+           ::HasFixed(m, n, k)) ? kGEMMSmall : kGEMMBLAS;
+    }
+    // the packed GEMM accumulates in fp32, too little for double
+    if ((backend == kGEMMSmall && !packet) ||
+        (backend == kGEMMPacked && flag == kFloat64)) {
+      backend = kGEMMBLAS;
+    }
+    return backend;
+  }
+  /*! \brief dst (SV)= scale * dot(lhs[.T], rhs[.T]) by backend, false for kGEMMBLAS */
+  template<typename SV, bool transpose_left, bool transpose_right, typename DType>
+  inline static bool Run(GEMMBackend backend, const GEMMBlocking &blk,
+                         Tensor<cpu, 2, DType> *p_dst,
+                         const Tensor<cpu, 2, DType> &lhs,
+                         const Tensor<cpu, 2, DType> &rhs,
+                         DType scale) {
+    Tensor<cpu, 2, DType> &dst = *p_dst;
+    const index_t m = dst.size(0), n = dst.size(1);
+    const index_t k = transpose_left ? lhs.size(0) : lhs.size(1);
+    switch (backend) {
+      case kGEMMSmall:
+        return SmallDotDispatch<cpu, PacketCheck<DType, MSHADOW_DEFAULT_PACKET>::kPass>
+            ::template Eval<SV, transpose_left, transpose_right>(p_dst, lhs, rhs, scale);
+      case kGEMMPacked:
+        CHECK(m == (transpose_left ? lhs.size(1) : lhs.size(0)) &&
+              k == (transpose_right ? rhs.size(1) : rhs.size(0)) &&
+              n == (transpose_right ? rhs.size(0) : rhs.size(1)))
+            << "dot-gemm: matrix shape mismatch";
+        PackedGEMM::Eval(m, n, k, static_cast<float>(scale) * SV::AlphaBLAS(),
+                         GEMMMatrix<DType>(lhs.dptr_, transpose_left ? 1 : lhs.stride_,
+                                           transpose_left ? lhs.stride_ : 1),
+                         GEMMMatrix<DType>(rhs.dptr_, transpose_right ? rhs.stride_ : 1,
+                                           transpose_right ? 1 : rhs.stride_),
+                         SV::BetaBLAS(), dst.dptr_, dst.stride_, blk);
+        return true;
+      default:
+        return false;
+    }
+  }
+  template<typename SV, bool transpose_left, bool transpose_right, typename DType>
+  inline static bool Eval(Tensor<cpu, 2, DType> *p_dst,
+                          const Tensor<cpu, 2, DType> &lhs,
+                          const Tensor<cpu, 2, DType> &rhs,
+                          DType scale) {
+    const index_t m = p_dst->size(0), n = p_dst->size(1);
+    const index_t k = transpose_left ? lhs.size(0) : lhs.size(1);
+    GEMMBlocking blk;
+    return Run<SV, transpose_left, transpose_right>(
+        Choose<DType>(transpose_left, transpose_right, m, n, k, &blk), blk,
+        p_dst, lhs, rhs, scale);
+  }
+};
+}  // namespace expr
+}  // namespace mshadow
+#endif  // MSHADOW_GEMM_CPU_INL_H_
@@ -180,6 +180,39 @@ struct PacketOp<op::identity, DType, Arch> {
 };
 
 
+/*!
+ * \brief packet version of a reducer in red::, Reduce(dst, src) folds src
+ *  into dst lane by lane, the same as Reducer::Reduce on each lane
+ */
+template<typename Reducer, typename DType, PacketArch Arch>
+struct PacketReducer {
+  static const bool kEnabled = false;
+};
+template<typename DType, PacketArch Arch>
+struct PacketReducer<red::sum, DType, Arch> {
+  static const bool kEnabled = true;
+  MSHADOW_CINLINE static void Reduce(Packet<DType, Arch> &dst,  // NOLINT(*)
+                                     const Packet<DType, Arch> &src) {
+    dst = dst + src;
+  }
+};
+template<typename DType, PacketArch Arch>
+struct PacketReducer<red::maximum, DType, Arch> {
+  static const bool kEnabled = true;
+  MSHADOW_CINLINE static void Reduce(Packet<DType, Arch> &dst,  // NOLINT(*)
+                                     const Packet<DType, Arch> &src) {
+    dst = Max(dst, src);
+  }
+};
+template<typename DType, PacketArch Arch>
+struct PacketReducer<red::minimum, DType, Arch> {
+  static const bool kEnabled = true;
+  MSHADOW_CINLINE static void Reduce(Packet<DType, Arch> &dst,  // NOLINT(*)
+                                     const Packet<DType, Arch> &src) {
+    dst = Min(dst, src);
+  }
+};
+
 // savers to do storage
 template<typename SV, typename TFloat, PacketArch Arch>
 struct Saver{
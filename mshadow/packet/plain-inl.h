@@ -6,6 +6,7 @@
 #ifndef MSHADOW_PACKET_PLAIN_INL_H_
 #define MSHADOW_PACKET_PLAIN_INL_H_
 
+#include <cmath>
 #include "../base.h"
 #include "../packet-inl.h"
 
@@ -71,6 +72,23 @@ MSHADOW_CINLINE Packet<DType, kPlain> operator/(const Packet<DType, kPlain>& lhs
                                                     const Packet<DType, kPlain>& rhs) {
   return Packet<DType, kPlain>(lhs.data_ / rhs.data_);
 }
+
+template<typename DType>
+MSHADOW_CINLINE Packet<DType, kPlain> Max(const Packet<DType, kPlain>& lhs,
+                                          const Packet<DType, kPlain>& rhs) {
+  return rhs.data_ > lhs.data_ ? rhs : lhs;
+}
+
+template<typename DType>
+MSHADOW_CINLINE Packet<DType, kPlain> Min(const Packet<DType, kPlain>& lhs,
+                                          const Packet<DType, kPlain>& rhs) {
+  return rhs.data_ < lhs.data_ ? rhs : lhs;
+}
+
+template<typename DType>
+MSHADOW_CINLINE Packet<DType, kPlain> Exp(const Packet<DType, kPlain>& src) {
+  return Packet<DType, kPlain>(std::exp(src.data_));
+}
 }  // namespace packet
 }  // namespace mshadow
 #endif  // MSHADOW_PACKET_PLAIN_INL_H_
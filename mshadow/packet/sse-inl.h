@@ -8,6 +8,8 @@
 #define MSHADOW_PACKET_SSE_INL_H_
 
 #include <emmintrin.h>
+#include <cmath>
+#include <limits>
 #include "../base.h"
 #include "../packet-inl.h"
 
@@ -142,6 +144,65 @@ MSHADOW_CINLINE Packet<double, kSSE2> operator/(const Packet<double, kSSE2>& lhs
   return Packet<double, kSSE2>(_mm_div_pd(lhs.data_, rhs.data_));
 }
 
+// elementwise max and min, lhs is kept where the two are unordered,
+// the same as std::max(lhs, rhs) and std::min(lhs, rhs)
+MSHADOW_CINLINE Packet<float, kSSE2> Max(const Packet<float, kSSE2>& lhs,
+                                         const Packet<float, kSSE2>& rhs) {
+  return Packet<float, kSSE2>(_mm_max_ps(rhs.data_, lhs.data_));
+}
+
+MSHADOW_CINLINE Packet<double, kSSE2> Max(const Packet<double, kSSE2>& lhs,
+                                          const Packet<double, kSSE2>& rhs) {
+  return Packet<double, kSSE2>(_mm_max_pd(rhs.data_, lhs.data_));
+}
+
+MSHADOW_CINLINE Packet<float, kSSE2> Min(const Packet<float, kSSE2>& lhs,
+                                         const Packet<float, kSSE2>& rhs) {
+  return Packet<float, kSSE2>(_mm_min_ps(rhs.data_, lhs.data_));
+}
+
+MSHADOW_CINLINE Packet<double, kSSE2> Min(const Packet<double, kSSE2>& lhs,
+                                          const Packet<double, kSSE2>& rhs) {
+  return Packet<double, kSSE2>(_mm_min_pd(rhs.data_, lhs.data_));
+}
+
+// elementwise exp, float by a degree 6 polynomial after reducing by
+// powers of two (within 2 ulp), 0 below the smallest normal result and
+// inf above 88.376
+MSHADOW_CINLINE Packet<float, kSSE2> Exp(const Packet<float, kSSE2>& src) {
+  const __m128 lo = _mm_set1_ps(-87.33654f), hi = _mm_set1_ps(88.37626f);
+  const __m128 x = _mm_min_ps(_mm_max_ps(src.data_, lo), hi);
+  // x = n * ln2 + r, |r| <= ln2 / 2, ln2 split in two for an exact n * ln2
+  const __m128i n = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f)));
+  const __m128 fn = _mm_cvtepi32_ps(n);
+  __m128 r = _mm_sub_ps(x, _mm_mul_ps(fn, _mm_set1_ps(0.693359375f)));
+  r = _mm_add_ps(r, _mm_mul_ps(fn, _mm_set1_ps(2.12194440e-4f)));
+  __m128 p = _mm_set1_ps(1.9875691500e-4f);
+  p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(1.3981999507e-3f));
+  p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(8.3334519073e-3f));
+  p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(4.1665795894e-2f));
+  p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(1.6666665459e-1f));
+  p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(5.0000001201e-1f));
+  p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(p, r), r), r), _mm_set1_ps(1.0f));
+  const __m128 scale = _mm_castsi128_ps(
+      _mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23));
+  __m128 res = _mm_mul_ps(p, scale);
+  // below the range gives 0, above gives inf, NaN stays NaN
+  res = _mm_andnot_ps(_mm_cmplt_ps(src.data_, lo), res);
+  const __m128 over = _mm_cmpgt_ps(src.data_, hi);
+  res = _mm_or_ps(_mm_andnot_ps(over, res),
+                  _mm_and_ps(over, _mm_set1_ps(std::numeric_limits<float>::infinity())));
+  return Packet<float, kSSE2>(_mm_or_ps(res, _mm_cmpunord_ps(src.data_, src.data_)));
+}
+
+MSHADOW_CINLINE Packet<double, kSSE2> Exp(const Packet<double, kSSE2>& src) {
+  MSHADOW_ALIGNED(16) double lanes[2];
+  src.Store(lanes);
+  lanes[0] = std::exp(lanes[0]);
+  lanes[1] = std::exp(lanes[1]);
+  return Packet<double, kSSE2>::Load(lanes);
+}
+
 }  // namespace packet
 }  // namespace mshadow
 #endif  // MSHADOW_PACKET_SSE_INL_H_
@@ -781,6 +781,14 @@ inline void Copy(Tensor<gpu, dim, DType> dst,
  */
 template<typename DType>
 inline void Softmax(Tensor<cpu, 2, DType> dst, const Tensor<cpu, 2, DType> &energy);
+/*!
+ * \brief CPU: log softmax: dst[i][j] = energy[i][j] - log(sum_j exp(energy[i][j])),
+ *  dst may be energy
+ * \param dst destination
+ * \param energy input energy
+ */
+template<typename DType>
+inline void LogSoftmax(Tensor<cpu, 2, DType> dst, const Tensor<cpu, 2, DType> &energy);
 /*!
  * \brief CPU/GPU: normalize softmax: dst[i][j] = exp(energy[i][j]) /(sum_j exp(energy[i][j]))
  * \param dst destination
@@ -916,6 +924,28 @@ inline void VectorizedSort(Tensor<Device, 1, VDType> values, Tensor<Device, 1, S
 
 // function declarations to support expression, no need to understand them
 // these functions do not need to be directly used
+/*!
+ * \brief CPU engine of MapExp, extensions specialize it to evaluate
+ *  an expression with a kernel over the whole tensor
+ * \tparam pass_check whether the expression can be packetized
+ */
+template<bool pass_check, typename Saver,
+         typename R, int dim,
+         typename DType, typename E, int etype>
+struct MapExpCPUEngine;
+namespace expr {
+template<typename ExpType, typename DType>
+class Plan;
+}  // namespace expr
+/*!
+ * \brief CPU: map a plan to a tensor, element by element
+ * \param dst destination
+ * \param plan plan of the expression
+ */
+template<typename Saver, typename R, int dim,
+         typename DType, typename E>
+inline void MapPlan(TRValue<R, cpu, dim, DType> *dst,
+                    const expr::Plan<E, DType> &plan);
 /*!
  * \brief CPU/GPU: map a expression to a tensor, this function calls MapPlan
  * \tparam Saver specify storage method
@@ -1022,6 +1052,52 @@ template<typename Saver, typename Reducer, int dimkeep,
 inline void MapReduceKeepHighDim(TRValue<R, gpu, 1, DType> *dst,
                                  const expr::Exp<E, DType, etype> &exp,
                                  DType scale = 1);
+/*!
+ * \brief CPU: map a expression, do reduction of all its elements to a scalar,
+ *  in one parallel pass
+ * \tparam Reducer specify a reducer method
+ * \tparam DType the type of elements in the tensor
+ * \tparam E specifies the expression type, not need to specify this parameter during usage
+ * \tparam etype expression type
+ * \param exp expression
+ * \return the reduced value
+ * \sa namespace mshadow::red, mshadow::expr
+ */
+template<typename Reducer, typename DType, typename E, int etype>
+inline DType MapReduceAll(const expr::Exp<E, DType, etype> &exp);
+/*!
+ * \brief CPU: sum of all elements of an expression
+ * \param exp expression
+ */
+template<typename DType, typename E, int etype>
+inline DType sumall(const expr::Exp<E, DType, etype> &exp);
+/*!
+ * \brief CPU: maximum of all elements of an expression
+ * \param exp expression
+ */
+template<typename DType, typename E, int etype>
+inline DType maxall(const expr::Exp<E, DType, etype> &exp);
+/*!
+ * \brief CPU: minimum of all elements of an expression
+ * \param exp expression
+ */
+template<typename DType, typename E, int etype>
+inline DType minall(const expr::Exp<E, DType, etype> &exp);
+/*!
+ * \brief CPU: euclidean norm of all elements of an expression, scaled by the
+ *  largest magnitude so that it does not overflow when the norm is in range
+ * \param exp expression
+ */
+template<typename DType, typename E, int etype>
+inline DType norm2(const expr::Exp<E, DType, etype> &exp);
+/*!
+ * \brief CPU: sum of the element-wise product of two expressions of the same shape
+ * \param lhs left operand
+ * \param rhs right operand
+ */
+template<typename DType, typename EL, int etl, typename ER, int etr>
+inline DType dot_all(const expr::Exp<EL, DType, etl> &lhs,
+                     const expr::Exp<ER, DType, etr> &rhs);
 /*!
  * \brief CPU/GPU: 1 dimension vector dot
  * \param dst Length 1 vector, used to hold the result.
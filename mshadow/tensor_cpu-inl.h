@@ -6,6 +6,7 @@
  */
 #ifndef MSHADOW_TENSOR_CPU_INL_H_
 #define MSHADOW_TENSOR_CPU_INL_H_
+#include <algorithm>
 #include <cstring>
 #include <functional>
 #include <utility>
@@ -200,6 +201,132 @@ inline void MapExp(TRValue<R, cpu, dim, DType> *dst,
   ::Map(dst->ptrself(), exp);
 }
 
+/*!
+ * \brief reduce rows [begin, end) of columns [x_begin, x_end) of a 2D
+ *  expression into acc, row by row, so each row is read contiguously
+ */
+template<typename Reducer, bool pass_packet>
+struct ReduceRowBandCPU {
+  template<typename E, typename DType, int etype>
+  inline static void Eval(const expr::Exp<E, DType, etype> &exp,
+                          index_t begin, index_t end, index_t x_begin, index_t x_end,
+                          DType *acc) {
+    expr::Plan<E, DType> splan = MakePlan(exp.self());
+    for (index_t x = x_begin; x < x_end; ++x) {
+      acc[x] = splan.Eval(begin, x);
+    }
+    for (index_t y = begin + 1; y < end; ++y) {
+      for (index_t x = x_begin; x < x_end; ++x) {
+        Reducer::Reduce(acc[x], splan.Eval(y, x));
+      }
+    }
+  }
+};
+template<typename Reducer>
+struct ReduceRowBandCPU<Reducer, true> {
+  template<typename E, typename DType, int etype>
+  inline static void Eval(const expr::Exp<E, DType, etype> &exp,
+                          index_t begin, index_t end, index_t x_begin, index_t x_end,
+                          DType *acc) {
+    // x_begin and acc are packet aligned, the tail goes through the scalar path
+    typedef packet::Packet<DType, MSHADOW_DEFAULT_PACKET> Packet;
+    const index_t xlen = x_begin +
+        packet::LowerAlign<DType, MSHADOW_DEFAULT_PACKET>(x_end - x_begin);
+    expr::PacketPlan<E, DType, MSHADOW_DEFAULT_PACKET> splan =
+        expr::MakePacketPlan<MSHADOW_DEFAULT_PACKET>(exp.self());
+    for (index_t x = x_begin; x < xlen; x += Packet::size) {
+      splan.EvalPacket(begin, x).Store(acc + x);
+    }
+    for (index_t y = begin + 1; y < end; ++y) {
+      for (index_t x = x_begin; x < xlen; x += Packet::size) {
+        Packet res = Packet::Load(acc + x);
+        packet::PacketReducer<Reducer, DType, MSHADOW_DEFAULT_PACKET>
+            ::Reduce(res, splan.EvalPacket(y, x));
+        res.Store(acc + x);
+      }
+    }
+    ReduceRowBandCPU<Reducer, false>::Eval(exp, begin, end, xlen, x_end, acc);
+  }
+};
+
+/*!
+ * \brief compensated reduction of the CPU keep-dim reductions, enabled for
+ *  red::sum with MSHADOW_DETERMINISTIC_REDUCE == 2; a partial is a value and
+ *  a residual, value + residual being the exact sum
+ */
+template<typename Reducer>
+struct ReduceKahanCPU {
+  static const bool kEnabled = false;
+  template<typename E, typename DType, int etype>
+  inline static void RowBand(const expr::Exp<E, DType, etype> &exp,
+                             index_t begin, index_t end, index_t x_begin, index_t x_end,
+                             DType *acc, DType *res) {}
+  template<typename E, typename DType, int etype>
+  inline static void ChannelRows(const expr::Exp<E, DType, etype> &exp, const Shape<4> &pshape,
+                                 index_t c, index_t begin, index_t end,
+                                 DType *val, DType *res) {}
+  template<typename E, typename DType, int etype>
+  inline static void Range(const expr::Exp<E, DType, etype> &exp, index_t ncol,
+                           index_t begin, index_t end, DType *val, DType *res) {}
+  template<typename DType>
+  inline static void Merge(DType &dst, DType &dst_res, // NOLINT(*)
+                           DType &src, DType &src_res) {} // NOLINT(*)
+};
+template<>
+struct ReduceKahanCPU<red::sum> {
+  static const bool kEnabled = MSHADOW_DETERMINISTIC_REDUCE == 2;
+  /*! \brief as ReduceRowBandCPU, with the residual of each column in res */
+  template<typename E, typename DType, int etype>
+  inline static void RowBand(const expr::Exp<E, DType, etype> &exp,
+                             index_t begin, index_t end, index_t x_begin, index_t x_end,
+                             DType *acc, DType *res) {
+    expr::Plan<E, DType> splan = MakePlan(exp.self());
+    for (index_t x = x_begin; x < x_end; ++x) {
+      acc[x] = splan.Eval(begin, x); res[x] = DType(0);
+    }
+    for (index_t y = begin + 1; y < end; ++y) {
+      for (index_t x = x_begin; x < x_end; ++x) {
+        red::sum::Reduce(acc[x], splan.Eval(y, x), res[x]);
+      }
+    }
+    // red::sum::Reduce keeps acc - res, Merge keeps acc + res
+    for (index_t x = x_begin; x < x_end; ++x) res[x] = -res[x];
+  }
+  /*! \brief as ReduceChannelRowsCPU, with the residual in res */
+  template<typename E, typename DType, int etype>
+  inline static void ChannelRows(const expr::Exp<E, DType, etype> &exp, const Shape<4> &pshape,
+                                 index_t c, index_t begin, index_t end,
+                                 DType *val, DType *res) {
+    expr::Plan<E, DType> splan = MakePlan(exp.self());
+    DType v, r;
+    red::sum::SetInitValue(v, r);
+    for (index_t i = begin; i < end; ++i) {
+      const index_t row = ((i / pshape[2]) * pshape[1] + c) * pshape[2] + i % pshape[2];
+      for (index_t x = 0; x < pshape[3]; ++x) {
+        red::sum::Reduce(v, splan.Eval(row, x), r);
+      }
+    }
+    *val = v; *res = -r;
+  }
+  /*! \brief as ReduceAllCPU, with the residual in res */
+  template<typename E, typename DType, int etype>
+  inline static void Range(const expr::Exp<E, DType, etype> &exp, index_t ncol,
+                           index_t begin, index_t end, DType *val, DType *res) {
+    expr::Plan<E, DType> splan = MakePlan(exp.self());
+    DType v, r;
+    red::sum::SetInitValue(v, r);
+    for (index_t i = begin; i < end; ++i) {
+      red::sum::Reduce(v, splan.Eval(i / ncol, i % ncol), r);
+    }
+    *val = v; *res = -r;
+  }
+  template<typename DType>
+  inline static void Merge(DType &dst, DType &dst_res, // NOLINT(*)
+                           DType &src, DType &src_res) { // NOLINT(*)
+    red::sum::Merge(dst, dst_res, src, src_res);
+  }
+};
+
 template<typename Saver, typename Reducer,
          typename R, typename DType, typename E, int etype>
 inline void MapReduceKeepLowest(TRValue<R, cpu, 1, DType> *dst,
@@ -212,21 +339,130 @@ inline void MapReduceKeepLowest(TRValue<R, cpu, 1, DType> *dst,
   Shape<1> dshape = expr::ShapeCheck<1, R>::Check(dst->self());
   CHECK_EQ(eshape[1], dshape[0]) << "MapReduceKeepLowest::reduction dimension do not match";
   CHECK_NE(eshape[0], 0U) << "can not reduce over empty tensor";
-  // execution
+  // execution: the rows are cut into bands, one per thread, and wide
+  // matrices into column blocks as well; each band is reduced row by row
+  // into its own partial vector, then the partials are merged in a tree.
+  // The deterministic mode cuts bands by MSHADOW_REDUCE_CHUNK instead
+  const index_t nrow = eshape[0], ncol = eshape[1];
+  const index_t nthread = GetOMPMaxThreads();
+  const index_t kReduceMinBlockCols = 256;
+#if MSHADOW_DETERMINISTIC_REDUCE
+  const index_t nband = (nrow + MSHADOW_REDUCE_CHUNK - 1) / MSHADOW_REDUCE_CHUNK;
+#else
+  const index_t kReduceMinBandRows = 16;
+  const index_t nband = std::max(static_cast<index_t>(1),
+                                 std::min(nthread, nrow / kReduceMinBandRows));
+#endif
+  const index_t align = packet::UpperAlign<DType, MSHADOW_DEFAULT_PACKET>(1);
+  const index_t nblock = std::max(static_cast<index_t>(1),
+      std::min(nthread / nband, ncol / kReduceMinBlockCols));
+  const index_t bwidth = (ncol + nblock - 1) / nblock;
+  const index_t block = (bwidth + align - 1) / align * align;
+  const bool kPacket = expr::PacketCheck<E, MSHADOW_DEFAULT_PACKET>::kPass &&
+      packet::PacketReducer<Reducer, DType, MSHADOW_DEFAULT_PACKET>::kEnabled;
+  const bool pass_packet = kPacket &&
+      expr::PacketAlignCheck<expr::ExpInfo<E>::kDim, E, MSHADOW_DEFAULT_PACKET>
+      ::Check(exp.self());
+  const bool kKahan = ReduceKahanCPU<Reducer>::kEnabled;
+  size_t pitch;
+  DType *acc = static_cast<DType*>(packet::AlignedMallocPitch(
+      &pitch, ncol * sizeof(DType), nband));
+  DType *res = kKahan ? static_cast<DType*>(packet::AlignedMallocPitch(
+      &pitch, ncol * sizeof(DType), nband)) : NULL;
+  const index_t stride = static_cast<index_t>(pitch / sizeof(DType));
+#ifndef __CUDACC__
+  #pragma omp parallel for
+#endif
+  for (openmp_index_t t = 0; t < nband * nblock; ++t) {
+    const index_t b = t / nblock, x_begin = t % nblock * block;
+    const index_t x_end = std::min(x_begin + block, ncol);
+    if (x_begin >= x_end) continue;
+    const index_t begin = nrow * b / nband, end = nrow * (b + 1) / nband;
+    if (kKahan) {
+      ReduceKahanCPU<Reducer>::RowBand(exp, begin, end, x_begin, x_end,
+                                       acc + b * stride, res + b * stride);
+    } else if (pass_packet) {
+      ReduceRowBandCPU<Reducer, kPacket>
+          ::Eval(exp, begin, end, x_begin, x_end, acc + b * stride);
+    } else {
+      ReduceRowBandCPU<Reducer, false>
+          ::Eval(exp, begin, end, x_begin, x_end, acc + b * stride);
+    }
+  }
   expr::Plan<R, DType> dplan = MakePlan(dst->self());
-  expr::Plan<E, DType> splan = MakePlan(exp.self());
 #ifndef __CUDACC__
   #pragma omp parallel for
 #endif
-  for (openmp_index_t x = 0; x < eshape[1]; ++x) {
-    DType res = splan.Eval(0, x);
-    for (index_t y = 1; y < eshape[0]; ++y) {
-      Reducer::Reduce(res, splan.Eval(y, x));
+  for (openmp_index_t x = 0; x < ncol; ++x) {
+    for (index_t step = 1; step < nband; step *= 2) {
+      for (index_t b = 0; b + step < nband; b += 2 * step) {
+        if (kKahan) {
+          ReduceKahanCPU<Reducer>::Merge(acc[b * stride + x], res[b * stride + x],
+                                         acc[(b + step) * stride + x],
+                                         res[(b + step) * stride + x]);
+        } else {
+          Reducer::Merge(acc[b * stride + x], acc[(b + step) * stride + x]);
+        }
+      }
     }
-    Saver::template Save<DType>(dplan.REval(0, x), res * scale);
+    if (kKahan) acc[x] += res[x];
+    Saver::template Save<DType>(dplan.REval(0, x), acc[x] * scale);
   }
+  packet::AlignedFree(acc);
+  if (kKahan) packet::AlignedFree(res);
 }
 
+/*!
+ * \brief reduce the rows [begin, end) of channel c of an expression seen as
+ *  pshape = (num, channel, height, width) to one value, row r being
+ *  height row r % height of image r / height
+ */
+template<typename Reducer, bool pass_packet>
+struct ReduceChannelRowsCPU {
+  template<typename E, typename DType, int etype>
+  inline static DType Eval(const expr::Exp<E, DType, etype> &exp, const Shape<4> &pshape,
+                           index_t c, index_t begin, index_t end) {
+    expr::Plan<E, DType> splan = MakePlan(exp.self());
+    DType res; Reducer::SetInitValue(res);
+    for (index_t r = begin; r < end; ++r) {
+      const index_t row = ((r / pshape[2]) * pshape[1] + c) * pshape[2] + r % pshape[2];
+      for (index_t x = 0; x < pshape[3]; ++x) {
+        Reducer::Reduce(res, splan.Eval(row, x));
+      }
+    }
+    return res;
+  }
+};
+template<typename Reducer>
+struct ReduceChannelRowsCPU<Reducer, true> {
+  template<typename E, typename DType, int etype>
+  inline static DType Eval(const expr::Exp<E, DType, etype> &exp, const Shape<4> &pshape,
+                           index_t c, index_t begin, index_t end) {
+    typedef packet::Packet<DType, MSHADOW_DEFAULT_PACKET> Packet;
+    expr::PacketPlan<E, DType, MSHADOW_DEFAULT_PACKET> splan =
+        expr::MakePacketPlan<MSHADOW_DEFAULT_PACKET>(exp.self());
+    const index_t xlen = packet::LowerAlign<DType, MSHADOW_DEFAULT_PACKET>(pshape[3]);
+    DType res; Reducer::SetInitValue(res);
+    Packet acc = Packet::Fill(res);
+    for (index_t r = begin; r < end; ++r) {
+      const index_t row = ((r / pshape[2]) * pshape[1] + c) * pshape[2] + r % pshape[2];
+      for (index_t x = 0; x < xlen; x += Packet::size) {
+        packet::PacketReducer<Reducer, DType, MSHADOW_DEFAULT_PACKET>
+            ::Reduce(acc, splan.EvalPacket(row, x));
+      }
+      for (index_t x = xlen; x < pshape[3]; ++x) {
+        Reducer::Reduce(res, splan.Eval(row, x));
+      }
+    }
+    MSHADOW_ALIGNED(16) DType lanes[Packet::size];
+    acc.Store(lanes);
+    for (index_t k = 0; k < Packet::size; ++k) {
+      Reducer::Reduce(res, lanes[k]);
+    }
+    return res;
+  }
+};
+
 template<typename Saver, typename Reducer, int dimkeep,
          typename R, typename DType, typename E, int etype>
 inline void MapReduceKeepHighDim(TRValue<R, cpu, 1, DType> *dst,
@@ -245,43 +481,383 @@ inline void MapReduceKeepHighDim(TRValue<R, cpu, 1, DType> *dst,
                            eshape[dimkeep],
                            eshape.ProdShape(dimkeep + 1, EShape::kSubdim),
                            eshape[EShape::kSubdim]);
-  // execution
-  expr::Plan<R, DType> dplan = MakePlan(dst->self());
-  expr::Plan<E, DType> splan = MakePlan(exp.self());
+  // execution: the num * height rows of each channel are split into chunks,
+  // so that few channels still keep every thread busy; each chunk is reduced
+  // to a partial, then the partials of a channel are merged in a tree.
+  // The deterministic mode cuts chunks by MSHADOW_REDUCE_CHUNK instead
+  const index_t nchannel = pshape[1], nrow = pshape[0] * pshape[2];
+#if MSHADOW_DETERMINISTIC_REDUCE
+  const index_t nchunk = std::max(static_cast<index_t>(1),
+      (nrow + MSHADOW_REDUCE_CHUNK - 1) / MSHADOW_REDUCE_CHUNK);
+#else
+  const index_t nthread = GetOMPMaxThreads();
+  const index_t nchunk = std::max(static_cast<index_t>(1),
+      std::min(nrow, (4 * nthread + nchannel - 1) / nchannel));
+#endif
+  const bool kPacket = expr::PacketCheck<E, MSHADOW_DEFAULT_PACKET>::kPass &&
+      packet::PacketReducer<Reducer, DType, MSHADOW_DEFAULT_PACKET>::kEnabled;
+  const bool pass_packet = kPacket &&
+      expr::PacketAlignCheck<expr::ExpInfo<E>::kDim, E, MSHADOW_DEFAULT_PACKET>
+      ::Check(exp.self());
+  const bool kKahan = ReduceKahanCPU<Reducer>::kEnabled;
+  std::vector<DType> partial(nchannel * nchunk);
+  std::vector<DType> residual(kKahan ? nchannel * nchunk : 0);
 #ifndef __CUDACC__
   #pragma omp parallel for
 #endif
-  for (openmp_index_t c = 0; c < pshape[1]; ++c) {
-    DType res; Reducer::SetInitValue(res);
-    for (index_t n = 0; n < pshape[0]; ++n) {
-      DType tres; Reducer::SetInitValue(tres);
-      for (index_t y = 0; y < pshape[2]; ++y) {
-        for (index_t x = 0; x < pshape[3]; ++x) {
-          Reducer::Reduce(tres,
-                          splan.Eval((n * pshape[1] + c) * pshape[2] + y, x));
+  for (openmp_index_t t = 0; t < nchannel * nchunk; ++t) {
+    const index_t c = t / nchunk, k = t % nchunk;
+    const index_t begin = nrow * k / nchunk, end = nrow * (k + 1) / nchunk;
+    if (kKahan) {
+      ReduceKahanCPU<Reducer>::ChannelRows(exp, pshape, c, begin, end,
+                                           &partial[t], &residual[t]);
+    } else if (pass_packet) {
+      partial[t] = ReduceChannelRowsCPU<Reducer, kPacket>::Eval(exp, pshape, c, begin, end);
+    } else {
+      partial[t] = ReduceChannelRowsCPU<Reducer, false>::Eval(exp, pshape, c, begin, end);
+    }
+  }
+  expr::Plan<R, DType> dplan = MakePlan(dst->self());
+  for (index_t c = 0; c < nchannel; ++c) {
+    DType *part = &partial[c * nchunk];
+    for (index_t step = 1; step < nchunk; step *= 2) {
+      for (index_t k = 0; k + step < nchunk; k += 2 * step) {
+        if (kKahan) {
+          ReduceKahanCPU<Reducer>::Merge(part[k], residual[c * nchunk + k],
+                                         part[k + step], residual[c * nchunk + k + step]);
+        } else {
+          Reducer::Merge(part[k], part[k + step]);
         }
       }
-      Reducer::Reduce(res, tres);
     }
+    DType res = part[0];
+    if (kKahan) res += residual[c * nchunk];
     Saver::template Save<DType>(dplan.REval(0, c), DType(res * scale));
   }
 }
 
+/*!
+ * \brief reduce the elements [begin, end) of the row-major 2D view of an
+ *  expression, ncol elements per row, to one value
+ */
+template<typename Reducer, bool pass_packet>
+struct ReduceAllCPU {
+  template<typename E, typename DType, int etype>
+  inline static DType Eval(const expr::Exp<E, DType, etype> &exp, index_t ncol,
+                           index_t begin, index_t end) {
+    expr::Plan<E, DType> splan = MakePlan(exp.self());
+    DType res; Reducer::SetInitValue(res);
+    for (index_t i = begin; i < end;) {
+      const index_t y = i / ncol, x_begin = i % ncol;
+      const index_t x_end = std::min(ncol, x_begin + end - i);
+      for (index_t x = x_begin; x < x_end; ++x) {
+        Reducer::Reduce(res, splan.Eval(y, x));
+      }
+      i += x_end - x_begin;
+    }
+    return res;
+  }
+};
+template<typename Reducer>
+struct ReduceAllCPU<Reducer, true> {
+  template<typename E, typename DType, int etype>
+  inline static DType Eval(const expr::Exp<E, DType, etype> &exp, index_t ncol,
+                           index_t begin, index_t end) {
+    // rows are packet aligned, each row segment has a scalar head and tail
+    typedef packet::Packet<DType, MSHADOW_DEFAULT_PACKET> Packet;
+    expr::PacketPlan<E, DType, MSHADOW_DEFAULT_PACKET> splan =
+        expr::MakePacketPlan<MSHADOW_DEFAULT_PACKET>(exp.self());
+    // four packet accumulators hide the latency of the reduction
+    typedef packet::PacketReducer<Reducer, DType, MSHADOW_DEFAULT_PACKET> PReducer;
+    const index_t kUnroll = 4 * Packet::size;
+    DType res; Reducer::SetInitValue(res);
+    Packet acc[4] = {Packet::Fill(res), Packet::Fill(res), Packet::Fill(res), Packet::Fill(res)};
+    for (index_t i = begin; i < end;) {
+      const index_t y = i / ncol, x_begin = i % ncol;
+      const index_t x_end = std::min(ncol, x_begin + end - i);
+      const index_t xa = std::min(x_end,
+          packet::UpperAlign<DType, MSHADOW_DEFAULT_PACKET>(x_begin));
+      const index_t xb = xa + packet::LowerAlign<DType, MSHADOW_DEFAULT_PACKET>(x_end - xa);
+      const index_t xu = xa + (xb - xa) / kUnroll * kUnroll;
+      for (index_t x = x_begin; x < xa; ++x) {
+        Reducer::Reduce(res, splan.Eval(y, x));
+      }
+      for (index_t x = xa; x < xu; x += kUnroll) {
+        PReducer::Reduce(acc[0], splan.EvalPacket(y, x));
+        PReducer::Reduce(acc[1], splan.EvalPacket(y, x + Packet::size));
+        PReducer::Reduce(acc[2], splan.EvalPacket(y, x + 2 * Packet::size));
+        PReducer::Reduce(acc[3], splan.EvalPacket(y, x + 3 * Packet::size));
+      }
+      for (index_t x = xu; x < xb; x += Packet::size) {
+        PReducer::Reduce(acc[0], splan.EvalPacket(y, x));
+      }
+      for (index_t x = xb; x < x_end; ++x) {
+        Reducer::Reduce(res, splan.Eval(y, x));
+      }
+      i += x_end - x_begin;
+    }
+    PReducer::Reduce(acc[0], acc[1]);
+    PReducer::Reduce(acc[2], acc[3]);
+    PReducer::Reduce(acc[0], acc[2]);
+    MSHADOW_ALIGNED(16) DType lanes[Packet::size];
+    acc[0].Store(lanes);
+    for (index_t k = 0; k < Packet::size; ++k) {
+      Reducer::Reduce(res, lanes[k]);
+    }
+    return res;
+  }
+};
+
+template<typename Reducer, typename DType, typename E, int etype>
+inline DType MapReduceAll(const expr::Exp<E, DType, etype> &exp) {
+  expr::TypeCheckPass<expr::TypeCheck<cpu, expr::ExpInfo<E>::kDim, DType, E>::kMapPass>
+      ::Error_All_Tensor_in_Exp_Must_Have_Same_Type();
+  Shape<2> eshape = expr::ShapeCheck<expr::ExpInfo<E>::kDim, E>
+      ::Check(exp.self()).FlatTo2D();
+  // execution: the elements are cut into ranges, one per thread, which may
+  // end in the middle of a row; the partials are merged in a tree.
+  // The deterministic mode cuts ranges of 256 * MSHADOW_REDUCE_CHUNK instead
+  const index_t ncol = eshape[1], total = eshape.Size();
+#if MSHADOW_DETERMINISTIC_REDUCE
+  const index_t kReduceAllChunk = 256 * MSHADOW_REDUCE_CHUNK;
+  const index_t ntask = std::max(static_cast<index_t>(1),
+      (total + kReduceAllChunk - 1) / kReduceAllChunk);
+#else
+  const index_t kReduceAllMinElems = 4096;
+  const index_t ntask = std::max(static_cast<index_t>(1),
+      std::min(static_cast<index_t>(GetOMPMaxThreads()), total / kReduceAllMinElems));
+#endif
+  const bool kPacket = expr::PacketCheck<E, MSHADOW_DEFAULT_PACKET>::kPass &&
+      packet::PacketReducer<Reducer, DType, MSHADOW_DEFAULT_PACKET>::kEnabled;
+  const bool pass_packet = kPacket &&
+      expr::PacketAlignCheck<expr::ExpInfo<E>::kDim, E, MSHADOW_DEFAULT_PACKET>
+      ::Check(exp.self());
+  const bool kKahan = ReduceKahanCPU<Reducer>::kEnabled;
+  std::vector<DType> partial(ntask), residual(kKahan ? ntask : 0);
+#ifndef __CUDACC__
+  #pragma omp parallel for
+#endif
+  for (openmp_index_t t = 0; t < ntask; ++t) {
+    const index_t begin = total * t / ntask, end = total * (t + 1) / ntask;
+    if (kKahan) {
+      ReduceKahanCPU<Reducer>::Range(exp, ncol, begin, end, &partial[t], &residual[t]);
+    } else if (pass_packet) {
+      partial[t] = ReduceAllCPU<Reducer, kPacket>::Eval(exp, ncol, begin, end);
+    } else {
+      partial[t] = ReduceAllCPU<Reducer, false>::Eval(exp, ncol, begin, end);
+    }
+  }
+  for (index_t step = 1; step < ntask; step *= 2) {
+    for (index_t t = 0; t + step < ntask; t += 2 * step) {
+      if (kKahan) {
+        ReduceKahanCPU<Reducer>::Merge(partial[t], residual[t],
+                                       partial[t + step], residual[t + step]);
+      } else {
+        Reducer::Merge(partial[t], partial[t + step]);
+      }
+    }
+  }
+  return kKahan ? DType(partial[0] + residual[0]) : partial[0];
+}
+
+template<typename DType, typename E, int etype>
+inline DType sumall(const expr::Exp<E, DType, etype> &exp) {
+  return MapReduceAll<red::sum>(exp);
+}
+
+template<typename DType, typename E, int etype>
+inline DType maxall(const expr::Exp<E, DType, etype> &exp) {
+  return MapReduceAll<red::maximum>(exp);
+}
+
+template<typename DType, typename E, int etype>
+inline DType minall(const expr::Exp<E, DType, etype> &exp) {
+  return MapReduceAll<red::minimum>(exp);
+}
+
+template<typename DType, typename E, int etype>
+inline DType norm2(const expr::Exp<E, DType, etype> &exp) {
+  // the elements are divided by the largest magnitude before squaring, so
+  // that the squares stay in range of DType whenever the norm does
+  const double scale = std::max(std::fabs(static_cast<double>(maxall(exp))),
+                                std::fabs(static_cast<double>(minall(exp))));
+  if (!(scale > 0.0) || std::isinf(scale)) {
+    return static_cast<DType>(scale);
+  }
+  const DType sumsq = MapReduceAll<red::sum>((exp.self() / DType(scale)) *
+                                             (exp.self() / DType(scale)));
+  return static_cast<DType>(scale * std::sqrt(static_cast<double>(sumsq)));
+}
+
+template<typename DType, typename EL, int etl, typename ER, int etr>
+inline DType dot_all(const expr::Exp<EL, DType, etl> &lhs,
+                     const expr::Exp<ER, DType, etr> &rhs) {
+  return MapReduceAll<red::sum>(lhs.self() * rhs.self());
+}
+
+/*!
+ * \brief softmax and log-softmax of contiguous rows by packets: a max scan,
+ *  a fused exp and sum leaving exp(x - max) in dst, then a multiply by the
+ *  reciprocal of the sum, or x - max - log(sum). The sum is accumulated per
+ *  kChunk elements and the chunks added in order, so a row split across
+ *  threads gives the same result as a whole one
+ */
 template<typename DType>
-inline void Softmax(Tensor<cpu, 1, DType> dst,
-                    const Tensor<cpu, 1, DType> &energy) {
-  DType mmax = energy[0];
-  for (index_t x = 1; x < dst.size(0); ++x) {
-    if (mmax < energy[x]) mmax = energy[x];
+struct SoftmaxCPU {
+  /*! \brief packet arch, the plain one element packet when DType does not pack */
+  static const packet::PacketArch kArch =
+      expr::PacketCheck<DType, MSHADOW_DEFAULT_PACKET>::kPass ? MSHADOW_DEFAULT_PACKET
+                                                              : packet::kPlain;
+  typedef packet::Packet<DType, kArch> Packet;
+  /*! \brief number of elements summed before adding to the row sum */
+  static const index_t kChunk = 2048;
+  /*! \brief rows at least this wide are split across threads when rows are few */
+  static const index_t kSplitWidth = 4 * kChunk;
+  /*! \brief number of elements before out is packet aligned */
+  inline static index_t AlignHead(const DType *out, index_t n) {
+    const size_t align = static_cast<size_t>(1) << packet::AlignBytes<kArch>::value;
+    const size_t head = (align - reinterpret_cast<size_t>(out) % align) % align / sizeof(DType);
+    return std::min(n, static_cast<index_t>(head));
+  }
+  inline static DType Max(const DType *x, index_t n) {
+    const index_t nlen = packet::LowerAlign<DType, kArch>(n);
+    DType mmax = x[0];
+    Packet acc[2] = {Packet::Fill(mmax), Packet::Fill(mmax)};
+    index_t i = 0;
+    for (; i + 2 * Packet::size <= nlen; i += 2 * Packet::size) {
+      acc[0] = packet::Max(acc[0], Packet::LoadUnAligned(x + i));
+      acc[1] = packet::Max(acc[1], Packet::LoadUnAligned(x + i + Packet::size));
+    }
+    for (; i < nlen; i += Packet::size) {
+      acc[0] = packet::Max(acc[0], Packet::LoadUnAligned(x + i));
+    }
+    MSHADOW_ALIGNED(16) DType lanes[Packet::size];
+    packet::Max(acc[0], acc[1]).Store(lanes);
+    for (index_t k = 0; k < Packet::size; ++k) {
+      if (mmax < lanes[k]) mmax = lanes[k];
+    }
+    for (; i < n; ++i) {
+      if (mmax < x[i]) mmax = x[i];
+    }
+    return mmax;
+  }
+  /*! \brief sum of exp(x - mmax) over at most kChunk elements, stored to out if store */
+  template<bool store>
+  inline static DType ExpSum(const DType *x, DType *out, index_t n, DType mmax) {
+    const index_t head = store ? AlignHead(out, n) : 0;
+    const index_t nlen = head + packet::LowerAlign<DType, kArch>(n - head);
+    const Packet shift = Packet::Fill(mmax);
+    Packet acc = Packet::Fill(DType(0.0f));
+    DType sum = DType(0.0f);
+    for (index_t i = 0; i < head; ++i) {
+      out[i] = std::exp(x[i] - mmax);
+      sum += out[i];
+    }
+    for (index_t i = head; i < nlen; i += Packet::size) {
+      Packet e = packet::Exp(Packet::LoadUnAligned(x + i) - shift);
+      if (store) e.Store(out + i);
+      acc = acc + e;
+    }
+    for (index_t i = nlen; i < n; ++i) {
+      const DType e = std::exp(x[i] - mmax);
+      if (store) out[i] = e;
+      sum += e;
+    }
+    return sum + acc.Sum();
+  }
+  /*! \brief finish elements [begin, end): out *= scale, or out = x - shift for log */
+  template<bool log>
+  inline static void Normalize(const DType *x, DType *out, index_t n, DType scale) {
+    const index_t head = AlignHead(out, n);
+    const index_t nlen = head + packet::LowerAlign<DType, kArch>(n - head);
+    const Packet pscale = Packet::Fill(scale);
+    for (index_t i = 0; i < head; ++i) out[i] = log ? x[i] - scale : out[i] * scale;
+    for (index_t i = head; i < nlen; i += Packet::size) {
+      if (log) {
+        (Packet::LoadUnAligned(x + i) - pscale).Store(out + i);
+      } else {
+        (Packet::Load(out + i) * pscale).Store(out + i);
+      }
+    }
+    for (index_t i = nlen; i < n; ++i) out[i] = log ? x[i] - scale : out[i] * scale;
   }
-  DType sum = DType(0.0f);
-  for (index_t x = 0; x < dst.size(0); ++x) {
-    dst[x] = std::exp(energy[x] - mmax);
-    sum += dst[x];
+  /*! \brief the value Normalize takes once the max and the sum are known */
+  template<bool log>
+  inline static DType Finish(DType mmax, DType sum) {
+    return log ? mmax + std::log(sum) : DType(1.0f) / sum;
+  }
+  /*! \brief one row by the calling thread */
+  template<bool log>
+  inline static void Row(const DType *x, DType *out, index_t n) {
+    const DType mmax = Max(x, n);
+    DType sum = DType(0.0f);
+    for (index_t i = 0; i < n; i += kChunk) {
+      // log-softmax only needs the sum, so x may be dst
+      sum += ExpSum<!log>(x + i, out + i, std::min(kChunk, n - i), mmax);
+    }
+    Normalize<log>(x, out, n, Finish<log>(mmax, sum));
+  }
+  /*! \brief one wide row by all threads, chunk partials merged in order */
+  template<bool log>
+  inline static void SplitRow(const DType *x, DType *out, index_t n) {
+    const index_t nchunk = (n + kChunk - 1) / kChunk;
+    std::vector<DType> part(nchunk);
+#pragma omp parallel for
+    for (openmp_index_t c = 0; c < nchunk; ++c) {
+      part[c] = Max(x + c * kChunk, std::min(kChunk, n - c * kChunk));
+    }
+    DType mmax = part[0];
+    for (index_t c = 1; c < nchunk; ++c) {
+      if (mmax < part[c]) mmax = part[c];
+    }
+#pragma omp parallel for
+    for (openmp_index_t c = 0; c < nchunk; ++c) {
+      part[c] = ExpSum<!log>(x + c * kChunk, out + c * kChunk,
+                             std::min(kChunk, n - c * kChunk), mmax);
+    }
+    DType sum = DType(0.0f);
+    for (index_t c = 0; c < nchunk; ++c) sum += part[c];
+    const DType scale = Finish<log>(mmax, sum);
+#pragma omp parallel for
+    for (openmp_index_t c = 0; c < nchunk; ++c) {
+      Normalize<log>(x + c * kChunk, out + c * kChunk,
+                     std::min(kChunk, n - c * kChunk), scale);
+    }
   }
-  for (index_t x = 0; x < dst.size(0); ++x) {
-    dst[x] /= sum;
+  /*! \brief rows in parallel, or each row split when rows are too few for the threads */
+  template<bool log>
+  inline static void Eval(Tensor<cpu, 2, DType> dst, const Tensor<cpu, 2, DType> &energy) {
+    const index_t nrow = dst.size(0), n = dst.size(1);
+    if (n == 0) return;
+    if (nrow < static_cast<index_t>(GetOMPMaxThreads()) && n >= kSplitWidth) {
+      for (index_t y = 0; y < nrow; ++y) {
+        SplitRow<log>(energy[y].dptr_, dst[y].dptr_, n);
+      }
+      return;
+    }
+#pragma omp parallel for
+    for (openmp_index_t y = 0; y < nrow; ++y) {
+      Row<log>(energy[y].dptr_, dst[y].dptr_, n);
+    }
   }
+};
+template<typename DType>
+const index_t SoftmaxCPU<DType>::kChunk;
+template<typename DType>
+const index_t SoftmaxCPU<DType>::kSplitWidth;
+
+template<typename DType>
+inline void Softmax(Tensor<cpu, 1, DType> dst,
+                    const Tensor<cpu, 1, DType> &energy) {
+  CHECK_EQ(dst.shape_, energy.shape_) << "Softmax: shape mismatch";
+  SoftmaxCPU<DType>::template Eval<false>(dst.FlatTo2D(), energy.FlatTo2D());
+}
+
+template<typename DType>
+inline void LogSoftmax(Tensor<cpu, 1, DType> dst,
+                       const Tensor<cpu, 1, DType> &energy) {
+  CHECK_EQ(dst.shape_, energy.shape_) << "LogSoftmax: shape mismatch";
+  SoftmaxCPU<DType>::template Eval<true>(dst.FlatTo2D(), energy.FlatTo2D());
 }
 
 template<typename DType>
@@ -367,23 +943,129 @@ inline void SmoothSoftmaxGrad(Tensor<cpu, 2, DType> dst,
   }
 }
 
+/*!
+ * \brief CPU softmax over the channels of a (num, channel, spatial) tensor,
+ *  blocked along the contiguous spatial axis: the max, the exp and sum and
+ *  the normalize run channel by channel over a block of positions, so each
+ *  pass reads whole rows instead of striding across the channels
+ */
 template<typename DType>
-inline void SoftmaxGrad(Tensor<cpu, 3, DType> dst,
-                        const Tensor<cpu, 3, DType> &src,
-                        const Tensor<cpu, 2, DType> &label) {
+struct SoftmaxChannelCPU {
+  /*! \brief packet arch, the plain one element packet when DType does not pack */
+  static const packet::PacketArch kArch =
+      expr::PacketCheck<DType, MSHADOW_DEFAULT_PACKET>::kPass ? MSHADOW_DEFAULT_PACKET
+                                                              : packet::kPlain;
+  /*! \brief positions per block, so the block of every channel stays in cache */
+  inline static index_t BlockSize(index_t nchannel) {
+    const index_t kCacheElems = (64 << 10) / sizeof(DType);
+    const index_t block = std::min(static_cast<index_t>(256),
+        std::max(static_cast<index_t>(64), kCacheElems / std::max(nchannel, index_t(1))));
+    return packet::LowerAlign<DType, kArch>(block);
+  }
+  /*!
+   * \brief softmax of positions [n0, n0 + nb) of batch y; Arch is the plain
+   *  packet for the tail or when dst rows are not aligned
+   */
+  template<packet::PacketArch Arch>
+  inline static void Block(Tensor<cpu, 3, DType> dst, const Tensor<cpu, 3, DType> &energy,
+                           index_t y, index_t n0, index_t nb, DType *mmax, DType *sum) {
+    typedef packet::Packet<DType, Arch> Packet;
+    const index_t nchannel = dst.size(1);
+    const DType *e0 = energy[y][0].dptr_ + n0;
+    for (index_t i = 0; i < nb; i += Packet::size) {
+      Packet::LoadUnAligned(e0 + i).Store(mmax + i);
+    }
+    for (index_t x = 1; x < nchannel; ++x) {
+      const DType *ex = energy[y][x].dptr_ + n0;
+      for (index_t i = 0; i < nb; i += Packet::size) {
+        packet::Max(Packet::Load(mmax + i), Packet::LoadUnAligned(ex + i)).Store(mmax + i);
+      }
+    }
+    for (index_t i = 0; i < nb; i += Packet::size) {
+      Packet::Fill(DType(0.0f)).Store(sum + i);
+    }
+    for (index_t x = 0; x < nchannel; ++x) {
+      const DType *ex = energy[y][x].dptr_ + n0;
+      DType *dx = dst[y][x].dptr_ + n0;
+      for (index_t i = 0; i < nb; i += Packet::size) {
+        Packet e = packet::Exp(Packet::LoadUnAligned(ex + i) - Packet::Load(mmax + i));
+        e.Store(dx + i);
+        (Packet::Load(sum + i) + e).Store(sum + i);
+      }
+    }
+    for (index_t x = 0; x < nchannel; ++x) {
+      DType *dx = dst[y][x].dptr_ + n0;
+      for (index_t i = 0; i < nb; i += Packet::size) {
+        (Packet::Load(dx + i) / Packet::Load(sum + i)).Store(dx + i);
+      }
+    }
+  }
+  inline static void Eval(Tensor<cpu, 3, DType> dst, const Tensor<cpu, 3, DType> &energy) {
+    const index_t num = dst.size(0), nspatial = dst.size(2);
+    if (dst.size(1) == 0 || nspatial == 0) return;
+    const index_t block = BlockSize(dst.size(1)), nblock = (nspatial + block - 1) / block;
+    const bool aligned = packet::CheckAlign<kArch>(dst.dptr_) &&
+        packet::CheckAlign<kArch>(dst.stride_ * sizeof(DType));
 #pragma omp parallel for
-  for (openmp_index_t n = 0; n < dst.size(2); ++n) {
-    for (index_t y = 0; y < dst.size(0); ++y) {
-      const int k = static_cast<int>(label[y][n]);
-      for (int x = 0; x < static_cast<int>(dst.size(1)); ++x) {
-        if (x == k) {
-          dst[y][k][n] = src[y][k][n] - 1.0f;
-        } else {
-          dst[y][x][n] = src[y][x][n];
+    for (openmp_index_t t = 0; t < num * nblock; ++t) {
+      MSHADOW_ALIGNED(16) DType mmax[256], sum[256];
+      const index_t y = t / nblock, n0 = t % nblock * block;
+      const index_t nb = std::min(block, nspatial - n0);
+      const index_t nlen = aligned ? packet::LowerAlign<DType, kArch>(nb) : 0;
+      if (nlen != 0) {
+        Block<kArch>(dst, energy, y, n0, nlen, mmax, sum);
+      }
+      if (nlen != nb) {
+        Block<packet::kPlain>(dst, energy, y, n0 + nlen, nb - nlen, mmax, sum);
+      }
+    }
+  }
+  /*!
+   * \brief gradient of the softmax against label[y][n]: dst = src minus the
+   *  one-hot label (smoothed by alpha when smooth), positions whose label is
+   *  ignore_label give 0 when use_ignore; blocked like Eval
+   */
+  inline static void Grad(Tensor<cpu, 3, DType> dst, const Tensor<cpu, 3, DType> &src,
+                          const Tensor<cpu, 2, DType> &label, bool use_ignore,
+                          DType ignore_label, bool smooth, float alpha) {
+    const index_t num = dst.size(0), nchannel = dst.size(1), nspatial = dst.size(2);
+    if (nchannel == 0 || nspatial == 0) return;
+    const DType smooth_grad = smooth ? DType(alpha / (nchannel - 1)) : DType(0.0f);
+    const DType label_alpha = smooth ? DType(alpha) : DType(0.0f);
+    const int ignore = static_cast<int>(ignore_label);
+    const index_t block = BlockSize(nchannel), nblock = (nspatial + block - 1) / block;
+#pragma omp parallel for
+    for (openmp_index_t t = 0; t < num * nblock; ++t) {
+      const index_t y = t / nblock, n0 = t % nblock * block;
+      const index_t n1 = std::min(n0 + block, nspatial);
+      // the label entries, read before the first pass overwrites them when dst is src
+      DType slabel[256];
+      for (index_t n = n0; n < n1; ++n) {
+        const int k = static_cast<int>(label[y][n]);
+        if (k >= 0 && k < static_cast<int>(nchannel)) slabel[n - n0] = src[y][k][n];
+      }
+      for (index_t x = 0; x < nchannel; ++x) {
+        const DType *sx = src[y][x].dptr_;
+        DType *dx = dst[y][x].dptr_;
+        for (index_t n = n0; n < n1; ++n) dx[n] = sx[n] - smooth_grad;
+      }
+      for (index_t n = n0; n < n1; ++n) {
+        const int k = static_cast<int>(label[y][n]);
+        if (use_ignore && k == ignore) {
+          for (index_t x = 0; x < nchannel; ++x) dst[y][x][n] = DType(0.0f);
+        } else if (k >= 0 && k < static_cast<int>(nchannel)) {
+          dst[y][k][n] = slabel[n - n0] - DType(1.0f) + label_alpha;
         }
       }
     }
   }
+};
+
+template<typename DType>
+inline void SoftmaxGrad(Tensor<cpu, 3, DType> dst,
+                        const Tensor<cpu, 3, DType> &src,
+                        const Tensor<cpu, 2, DType> &label) {
+  SoftmaxChannelCPU<DType>::Grad(dst, src, label, false, DType(0.0f), false, 0.0f);
 }
 
 template<typename DType>
@@ -391,20 +1073,7 @@ inline void SmoothSoftmaxGrad(Tensor<cpu, 3, DType> dst,
                         const Tensor<cpu, 3, DType> &src,
                         const Tensor<cpu, 2, DType> &label,
                         const float alpha) {
-  const float smooth_grad = (alpha / (dst.size(1) - 1));
-#pragma omp parallel for
-  for (openmp_index_t n = 0; n < dst.size(2); ++n) {
-    for (index_t y = 0; y < dst.size(0); ++y) {
-      const int k = static_cast<int>(label[y][n]);
-      for (int x = 0; x < static_cast<int>(dst.size(1)); ++x) {
-        if (x == k) {
-          dst[y][k][n] = src[y][k][n] - 1.0f + alpha;
-        } else {
-          dst[y][x][n] = src[y][x][n] - smooth_grad;
-        }
-      }
-    }
-  }
+  SoftmaxChannelCPU<DType>::Grad(dst, src, label, false, DType(0.0f), true, alpha);
 }
 
 template<typename DType>
@@ -412,25 +1081,7 @@ inline void SoftmaxGrad(Tensor<cpu, 3, DType> dst,
                         const Tensor<cpu, 3, DType> &src,
                         const Tensor<cpu, 2, DType> &label,
                         const DType &ignore_label) {
-#pragma omp parallel for
-  for (openmp_index_t n = 0; n < dst.size(2); ++n) {
-    for (index_t y = 0; y < dst.size(0); ++y) {
-      const int k = static_cast<int>(label[y][n]);
-      if (k == static_cast<int>(ignore_label)) {
-        for (int x = 0; x < static_cast<int>(dst.size(1)); ++x) {
-          dst[y][x][n] = DType(0.0f);
-        }
-      } else {
-        for (int x = 0; x < static_cast<int>(dst.size(1)); ++x) {
-          if (x == k) {
-            dst[y][k][n] = src[y][k][n] - 1.0f;
-          } else {
-            dst[y][x][n] = src[y][x][n];
-          }
-        }
-      }
-    }
-  }
+  SoftmaxChannelCPU<DType>::Grad(dst, src, label, true, ignore_label, false, 0.0f);
 }
 
 template<typename DType>
@@ -439,59 +1090,28 @@ inline void SmoothSoftmaxGrad(Tensor<cpu, 3, DType> dst,
                         const Tensor<cpu, 2, DType> &label,
                         const DType &ignore_label,
                         const float alpha) {
-  const float smooth_grad = (alpha / (dst.size(1) - 1));
-#pragma omp parallel for
-  for (openmp_index_t n = 0; n < dst.size(2); ++n) {
-    for (index_t y = 0; y < dst.size(0); ++y) {
-      const int k = static_cast<int>(label[y][n]);
-      if (k == static_cast<int>(ignore_label)) {
-        for (int x = 0; x < static_cast<int>(dst.size(1)); ++x) {
-          dst[y][x][n] = DType(0.0f);
-        }
-      } else {
-        for (int x = 0; x < static_cast<int>(dst.size(1)); ++x) {
-          if (x == k) {
-            dst[y][k][n] = src[y][k][n] - 1.0f + alpha;
-          } else {
-            dst[y][x][n] = src[y][x][n] - smooth_grad;
-          }
-        }
-      }
-    }
-  }
+  SoftmaxChannelCPU<DType>::Grad(dst, src, label, true, ignore_label, true, alpha);
 }
 
 template<typename DType>
 inline void Softmax(Tensor<cpu, 2, DType> dst,
                     const Tensor<cpu, 2, DType> &energy) {
   CHECK_EQ(dst.shape_, energy.shape_) << "Softmax: shape mismatch";
-#pragma omp parallel for
-  for (openmp_index_t y = 0; y < dst.size(0); ++y) {
-    Softmax(dst[y], energy[y]);
-  }
+  SoftmaxCPU<DType>::template Eval<false>(dst, energy);
+}
+
+template<typename DType>
+inline void LogSoftmax(Tensor<cpu, 2, DType> dst,
+                       const Tensor<cpu, 2, DType> &energy) {
+  CHECK_EQ(dst.shape_, energy.shape_) << "LogSoftmax: shape mismatch";
+  SoftmaxCPU<DType>::template Eval<true>(dst, energy);
 }
 
 template<typename DType>
 inline void Softmax(Tensor<cpu, 3, DType> dst,
                     const Tensor<cpu, 3, DType> &energy) {
   CHECK_EQ(dst.shape_, energy.shape_) << "Softmax: shape mismatch";
-#pragma omp parallel for
-  for (openmp_index_t y = 0; y < dst.size(0); ++y) {
-    for (index_t n = 0; n < dst.size(2); ++n) {
-      DType mmax = energy[y][0][n];
-      for (index_t x = 1; x < dst.size(1); ++x) {
-        if (mmax < energy[y][x][n]) mmax = energy[y][x][n];
-      }
-      DType sum = DType(0.0f);
-      for (index_t x = 0; x < dst.size(1); ++x) {
-        dst[y][x][n] = std::exp(energy[y][x][n] - mmax);
-        sum += dst[y][x][n];
-      }
-      for (index_t x = 0; x < dst.size(1); ++x) {
-        dst[y][x][n] /= sum;
-      }
-    }
-  }
+  SoftmaxChannelCPU<DType>::Eval(dst, energy);
 }
 
 template<typename IndexType, typename DType>
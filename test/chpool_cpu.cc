@@ -0,0 +1,66 @@
+// chpool<red::sum> and ch_unpool<red::sum> on CPU by the running channel sum
+// against their Plans, which a scalar in front of the expression forces: a
+// tensor source and F<square>(x), strides and pads, the LRN norm with its
+// scale and shift fused, saveto and plusto
+#include "test_cpu.h"
+
+struct square {
+  template<typename DType>
+  MSHADOW_XINLINE static DType Map(DType a) {
+    return a * a;
+  }
+};
+
+template<typename DType>
+void CheckPool(index_t n, index_t c, index_t h, index_t w,
+               index_t nsize, index_t stride, index_t pad, double tol) {
+  const index_t pc = (c - nsize + pad * 2 + 1) / stride;
+  TensorContainer<cpu, 4, DType> data(Shape4(n, c, h, w)), grad(Shape4(n, pc, h, w));
+  TensorContainer<cpu, 4, DType> out(Shape4(n, pc, h, w)), ref(Shape4(n, pc, h, w));
+  Randomize(data.FlatTo2D());
+  Randomize(grad.FlatTo2D());
+  out = chpool<red::sum>(data, nsize, stride, pad);
+  ref = DType(1.0f) * chpool<red::sum>(data, nsize, stride, pad);
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), tol, "chpool<red::sum>");
+  out += chpool<red::sum>(data, nsize, stride, pad);
+  ref *= DType(2.0f);
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), tol, "chpool<red::sum> plusto");
+  out = chpool<red::sum>(F<square>(data), nsize, stride, pad);
+  ref = DType(1.0f) * chpool<red::sum>(F<square>(data), nsize, stride, pad);
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), tol, "chpool<red::sum>(F<square>)");
+  // the LRN norm
+  const DType salpha = DType(0.25f), knorm = DType(2.0f);
+  out = chpool<red::sum>(F<square>(data), nsize, stride, pad) * salpha + knorm;
+  ref = knorm + salpha * chpool<red::sum>(F<square>(data), nsize, stride, pad);
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), tol, "LRN norm");
+  out = chpool<red::sum>(F<square>(data), nsize, stride, pad) * salpha;
+  ref = salpha * chpool<red::sum>(F<square>(data), nsize, stride, pad);
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), tol, "scaled chpool<red::sum>");
+  // the gradient
+  TensorContainer<cpu, 4, DType> pooled(Shape4(n, pc, h, w));
+  TensorContainer<cpu, 4, DType> gout(Shape4(n, c, h, w)), gref(Shape4(n, c, h, w));
+  pooled = chpool<red::sum>(data, nsize, stride, pad);
+  gout = ch_unpool<red::sum>(data, pooled, grad, nsize, stride, pad);
+  gref = DType(1.0f) * ch_unpool<red::sum>(data, pooled, grad, nsize, stride, pad);
+  CheckClose(gout.FlatTo2D(), gref.FlatTo2D(), tol, "ch_unpool<red::sum>");
+}
+
+template<typename DType>
+void RunType(double tol) {
+  // batch, channel, height, width, local size, stride, pad
+  const index_t cases[][7] = {{2, 16, 5, 7, 5, 1, 2}, {1, 9, 3, 13, 3, 1, 1}, {2, 32, 4, 4, 9, 1, 4},
+                              {1, 12, 6, 5, 3, 2, 1}, {2, 10, 3, 9, 4, 3, 0}, {1, 7, 2, 17, 7, 1, 3},
+                              {1, 5, 1, 1, 1, 1, 0}};
+  for (const index_t *p : cases) {
+    CheckPool<DType>(p[0], p[1], p[2], p[3], p[4], p[5], p[6], tol);
+  }
+}
+
+int main() {
+  InitTensorEngine<cpu>();
+  RunType<float>(1e-5);
+  RunType<double>(1e-12);
+  ShutdownTensorEngine<cpu>();
+  printf("Pass\n");
+  return 0;
+}
@@ -0,0 +1,76 @@
+// pack_col2patch on CPU against a direct scatter of the column matrix:
+// the scatter engine of tensor = pack_col2patch(...), the gather Plan used
+// when it is nested in an expression, in NCHW and NHWC, with strides and
+// dilations together
+#include "test_cpu.h"
+
+// img (NCHW) = sum of the patches of col, one loop per index
+void NaivePack(Tensor<cpu, 4, float> img, const Tensor<cpu, 2, float> &col,
+               index_t k, index_t s, index_t d) {
+  const index_t nbatch = img.size(0), nchannel = img.size(1);
+  const index_t h = img.size(2), w = img.size(3);
+  const index_t oh = (h - d * (k - 1) - 1) / s + 1, ow = (w - d * (k - 1) - 1) / s + 1;
+  img = 0.0f;
+  for (index_t n = 0; n < nbatch; ++n) {
+    for (index_t c = 0; c < nchannel; ++c) {
+      for (index_t ky = 0; ky < k; ++ky) {
+        for (index_t kx = 0; kx < k; ++kx) {
+          for (index_t oy = 0; oy < oh; ++oy) {
+            for (index_t ox = 0; ox < ow; ++ox) {
+              img[n][c][oy * s + ky * d][ox * s + kx * d] +=
+                  col[(c * k + ky) * k + kx][(n * oh + oy) * ow + ox];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+void CheckPack(index_t nbatch, index_t nchannel, index_t h, index_t w,
+               index_t k, index_t s, index_t d) {
+  const index_t oh = (h - d * (k - 1) - 1) / s + 1, ow = (w - d * (k - 1) - 1) / s + 1;
+  const Shape<4> ishape = Shape4(nbatch, nchannel, h, w);
+  TensorContainer<cpu, 2, float> col(Shape2(nchannel * k * k, nbatch * oh * ow));
+  TensorContainer<cpu, 4, float> ref(ishape), out(ishape);
+  Randomize(col.FlatTo2D());
+  NaivePack(ref, col, k, s, d);
+  // scatter engine
+  out = pack_col2patch(col, ishape, k, k, s, s, d, d);
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), 1e-5, "pack_col2patch scatter");
+  out += pack_col2patch(col, ishape, k, k, s, s, d, d);
+  TensorContainer<cpu, 4, float> ref2(ishape);
+  ref2 = ref * 2.0f;
+  CheckClose(out.FlatTo2D(), ref2.FlatTo2D(), 1e-5, "pack_col2patch scatter plusto");
+  // gather Plan, nested in an expression
+  out = 2.0f * pack_col2patch(col, ishape, k, k, s, s, d, d);
+  CheckClose(out.FlatTo2D(), ref2.FlatTo2D(), 1e-5, "pack_col2patch plan");
+  // NHWC, whose column matrix rows are ordered (ky, kx, c)
+  TensorContainer<cpu, 4, float> img_nhwc(Shape4(nbatch, h, w, nchannel));
+  TensorContainer<cpu, 4, float> out_nhwc(Shape4(nbatch, h, w, nchannel));
+  TensorContainer<cpu, 2, float> col_nhwc(Shape2(k * k * nchannel, nbatch * oh * ow));
+  for (index_t ky = 0; ky < k; ++ky) {
+    for (index_t kx = 0; kx < k; ++kx) {
+      for (index_t c = 0; c < nchannel; ++c) {
+        Copy(col_nhwc[(ky * k + kx) * nchannel + c], col[(c * k + ky) * k + kx]);
+      }
+    }
+  }
+  img_nhwc = transpose(ref, Shape4(0, 2, 3, 1));
+  out_nhwc = pack_col2patch<kNHWC>(col_nhwc, img_nhwc.shape_, k, k, s, s, d, d);
+  CheckClose(out_nhwc.FlatTo2D(), img_nhwc.FlatTo2D(), 1e-5, "pack_col2patch NHWC");
+}
+
+int main() {
+  InitTensorEngine<cpu>();
+  // batch, channel, height, width, kernel, stride, dilation
+  const index_t cases[][7] = {{2, 3, 8, 8, 3, 1, 1}, {2, 3, 9, 11, 3, 2, 1}, {1, 2, 12, 10, 3, 1, 2},
+                              {2, 2, 13, 14, 3, 2, 2}, {1, 4, 17, 15, 3, 3, 2}, {2, 1, 16, 16, 2, 2, 3},
+                              {1, 2, 11, 9, 4, 3, 2}, {1, 1, 5, 5, 5, 1, 1}};
+  for (const index_t *c : cases) {
+    CheckPack(c[0], c[1], c[2], c[3], c[4], c[5], c[6]);
+  }
+  ShutdownTensorEngine<cpu>();
+  printf("Pass\n");
+  return 0;
+}
@@ -0,0 +1,62 @@
+// convolution on CPU as dot(weight, unpack_patch2col(img, ...)) without the
+// column matrix, and by Winograd F(2x2, 3x3) and F(4x4, 3x3) with filters
+// transformed in advance, against the GEMM of the unpacked column matrix;
+// the fused padding of unpack_patch2col, by its engine and its Plan, against
+// unpack_patch2col of the padded image
+#include "test_cpu.h"
+
+template<typename DType>
+void CheckConv(index_t n, index_t c, index_t h, index_t w, index_t o,
+               index_t k, index_t s, index_t d, index_t p, double tol) {
+  const index_t oh = (h + 2 * p - d * (k - 1) - 1) / s + 1;
+  const index_t ow = (w + 2 * p - d * (k - 1) - 1) / s + 1;
+  TensorContainer<cpu, 4, DType> img(Shape4(n, c, h, w));
+  TensorContainer<cpu, 2, DType> weight(Shape2(o, c * k * k));
+  TensorContainer<cpu, 2, DType> col(Shape2(c * k * k, n * oh * ow));
+  TensorContainer<cpu, 2, DType> ref(Shape2(o, n * oh * ow)), out(Shape2(o, n * oh * ow));
+  Randomize(img.FlatTo2D());
+  Randomize(weight.FlatTo2D());
+  // the column matrix of the explicitly padded image
+  TensorContainer<cpu, 4, DType> padded(Shape4(n, c, h + 2 * p, w + 2 * p));
+  TensorContainer<cpu, 2, DType> fused(col.shape_);
+  padded = pad(img, p);
+  col = unpack_patch2col(padded, k, k, s, s, d, d);
+  fused = unpack_patch2col(img, k, k, s, s, d, d, p, p);
+  CheckClose(fused, col.FlatTo2D(), 0.0, "unpack_patch2col fused pad");
+  fused = DType(1.0f) * unpack_patch2col(img, k, k, s, s, d, d, p, p);
+  CheckClose(fused, col.FlatTo2D(), 0.0, "unpack_patch2col fused pad plan");
+  ref = dot(weight, col);
+  out = dot(weight, unpack_patch2col(img, k, k, s, s, d, d, p, p));
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), tol, "dot(weight, unpack_patch2col)");
+  out += dot(weight, unpack_patch2col(img, k, k, s, s, d, d, p, p));
+  ref *= DType(2.0f);
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), tol, "dot(weight, unpack_patch2col) plusto");
+  if (k == 3 && s == 1 && d == 1) {
+    ref /= DType(2.0f);
+    for (int tile = 2; tile <= 4; tile += 2) {
+      WinogradFilter<DType> filter(weight, tile);
+      out = dot(filter, unpack_patch2col(img, k, k, s, s, d, d, p, p));
+      CheckClose(out.FlatTo2D(), ref.FlatTo2D(), tol, "winograd");
+    }
+  }
+}
+
+template<typename DType>
+void RunType(double tol) {
+  // batch, in channel, height, width, out channel, kernel, stride, dilation, pad
+  const index_t layers[][9] = {{2, 8, 11, 11, 9, 3, 1, 1, 1}, {1, 3, 16, 16, 16, 3, 1, 1, 0},
+                               {2, 16, 7, 9, 8, 3, 1, 1, 1}, {3, 5, 13, 10, 4, 3, 2, 1, 1},
+                               {2, 4, 12, 12, 6, 3, 1, 2, 2}, {1, 3, 20, 20, 8, 5, 2, 1, 2}};
+  for (const index_t *l : layers) {
+    CheckConv<DType>(l[0], l[1], l[2], l[3], l[4], l[5], l[6], l[7], l[8], tol);
+  }
+}
+
+int main() {
+  InitTensorEngine<cpu>();
+  RunType<float>(1e-4);
+  RunType<double>(1e-10);
+  ShutdownTensorEngine<cpu>();
+  printf("Pass\n");
+  return 0;
+}
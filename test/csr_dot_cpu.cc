@@ -0,0 +1,115 @@
+// dot() of CSRTensor<cpu> against the same product of the dense matrix:
+// dot(csr, dense), dot(csr.T(), dense) and dot(dense, csr.T()), with
+// matrices and vectors, saveto/plusto/minusto, on one and several threads
+#include <vector>
+#include "test_cpu.h"
+
+// a random sparse matrix with about density * ncol entries per row and
+// some empty rows, as CSR arrays and as the dense matrix
+struct SparseMatrix {
+  std::vector<float> data;
+  std::vector<index_t> indices, indptr;
+  TensorContainer<cpu, 2, float> dense;
+  SparseMatrix(index_t nrow, index_t ncol, float density) : dense(Shape2(nrow, ncol)) {
+    dense = 0.0f;
+    indptr.push_back(0);
+    for (index_t i = 0; i < nrow; ++i) {
+      for (index_t j = 0; j < ncol && i % 7 != 3; ++j) {
+        if (rand() < density * RAND_MAX) {
+          const float v = 2.0f * rand() / RAND_MAX - 1.0f;
+          data.push_back(v);
+          indices.push_back(j);
+          dense[i][j] = v;
+        }
+      }
+      indptr.push_back(static_cast<index_t>(data.size()));
+    }
+    // never empty, so data() is valid
+    data.push_back(0.0f);
+    indices.push_back(0);
+  }
+  CSRTensor<cpu, float> csr(void) {
+    return CSRTensor<cpu, float>(&data[0], &indices[0], &indptr[0], dense.shape_);
+  }
+};
+
+// a vector as a one column matrix, mshadow has no dense matrix-vector dot
+Tensor<cpu, 2, float> Col(const Tensor<cpu, 1, float> &v) {
+  return Tensor<cpu, 2, float>(v.dptr_, Shape2(v.size(0), 1), 1, NULL);
+}
+
+// out = dot(csr[.T], rhs) three ways, against the dense product
+void CheckLeft(SparseMatrix *s, index_t n) {
+  const index_t nrow = s->dense.size(0), ncol = s->dense.size(1);
+  CSRTensor<cpu, float> csr = s->csr();
+  TensorContainer<cpu, 2, float> rhs(Shape2(ncol, n)), out(Shape2(nrow, n)), ref(Shape2(nrow, n));
+  TensorContainer<cpu, 2, float> rhs_t(Shape2(nrow, n)), out_t(Shape2(ncol, n)), ref_t(Shape2(ncol, n));
+  Randomize(rhs.FlatTo2D());
+  Randomize(rhs_t.FlatTo2D());
+  out = dot(csr, rhs);
+  ref = dot(s->dense, rhs);
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), 1e-5, "dot(csr, dense)");
+  out += dot(csr, rhs) * 2.0f;
+  ref += dot(s->dense, rhs) * 2.0f;
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), 1e-5, "dot(csr, dense) plusto");
+  out_t = dot(csr.T(), rhs_t);
+  ref_t = dot(s->dense.T(), rhs_t);
+  CheckClose(out_t.FlatTo2D(), ref_t.FlatTo2D(), 1e-5, "dot(csr.T(), dense)");
+  out_t -= dot(csr.T(), rhs_t) * 0.5f;
+  ref_t -= dot(s->dense.T(), rhs_t) * 0.5f;
+  CheckClose(out_t.FlatTo2D(), ref_t.FlatTo2D(), 1e-5, "dot(csr.T(), dense) minusto");
+  // matrix-vector products
+  TensorContainer<cpu, 1, float> x(Shape1(ncol)), y(Shape1(nrow)), yref(Shape1(nrow));
+  TensorContainer<cpu, 1, float> xt(Shape1(ncol)), xref(Shape1(ncol));
+  Randomize(x.FlatTo2D());
+  Randomize(y.FlatTo2D());
+  Col(yref) = dot(s->dense, Col(x));
+  TensorContainer<cpu, 1, float> yout(Shape1(nrow));
+  yout = dot(csr, x);
+  CheckClose(yout.FlatTo2D(), yref.FlatTo2D(), 1e-5, "dot(csr, vector)");
+  xt = dot(csr.T(), y);
+  Col(xref) = dot(s->dense.T(), Col(y));
+  CheckClose(xt.FlatTo2D(), xref.FlatTo2D(), 1e-5, "dot(csr.T(), vector)");
+  xt += dot(csr.T(), y);
+  Col(xref) += dot(s->dense.T(), Col(y));
+  CheckClose(xt.FlatTo2D(), xref.FlatTo2D(), 1e-5, "dot(csr.T(), vector) plusto");
+}
+
+// out = dot(lhs, csr.T())
+void CheckRight(SparseMatrix *s, index_t m) {
+  const index_t nrow = s->dense.size(0), ncol = s->dense.size(1);
+  CSRTensor<cpu, float> csr = s->csr();
+  TensorContainer<cpu, 2, float> lhs(Shape2(m, ncol)), out(Shape2(m, nrow)), ref(Shape2(m, nrow));
+  Randomize(lhs.FlatTo2D());
+  out = dot(lhs, csr.T());
+  ref = dot(lhs, s->dense.T());
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), 1e-5, "dot(dense, csr.T())");
+  TensorContainer<cpu, 1, float> x(Shape1(ncol)), y(Shape1(nrow)), yref(Shape1(nrow));
+  Randomize(x.FlatTo2D());
+  y = dot(x, csr.T());
+  yref = dot(x, s->dense.T());
+  CheckClose(y.FlatTo2D(), yref.FlatTo2D(), 1e-5, "dot(vector, csr.T())");
+}
+
+int main() {
+  InitTensorEngine<cpu>();
+  const int nthreads[] = {1, 4};
+  for (int nthread : nthreads) {
+#ifdef _OPENMP
+    omp_set_num_threads(nthread);
+#endif
+    SparseMatrix a(50, 37, 0.2f), b(300, 20, 0.05f), c(3, 500, 0.5f);
+    const index_t ns[] = {1, 5, 16, 100};
+    for (index_t n : ns) {
+      CheckLeft(&a, n);
+      CheckLeft(&b, n);
+      CheckLeft(&c, n);
+      CheckRight(&a, n);
+      CheckRight(&b, n);
+      CheckRight(&c, n);
+    }
+  }
+  ShutdownTensorEngine<cpu>();
+  printf("Pass\n");
+  return 0;
+}
@@ -0,0 +1,171 @@
+// dot() on CPU against a naive loop, through every backend of GEMMDispatch:
+// all transposes, saveto and plusto, the small kernels with compile time
+// extents and the runtime extent one, the packed GEMM and BLAS, each chosen
+// by a GEMMTuner entry of its transposes and shape class; the packed GEMM of
+// half_t and bf16_t against a float reference, and the bf16_t conversions
+#include <cstring>
+// half_t converts in software unless the target has F16C
+#ifndef __F16C__
+#define MSHADOW_USE_F16C 0
+#endif
+#include "test_cpu.h"
+
+// ref (SV)= scale * dot(lhs[.T], rhs[.T])
+template<typename DType>
+void NaiveDot(Tensor<cpu, 2, DType> ref, const Tensor<cpu, 2, DType> &lhs,
+              const Tensor<cpu, 2, DType> &rhs, bool lt, bool rt, double scale, bool plus) {
+  const index_t k = lt ? lhs.size(0) : lhs.size(1);
+  for (index_t i = 0; i < ref.size(0); ++i) {
+    for (index_t j = 0; j < ref.size(1); ++j) {
+      double sum = 0.0;
+      for (index_t p = 0; p < k; ++p) {
+        sum += static_cast<double>(lt ? lhs[p][i] : lhs[i][p]) *
+               static_cast<double>(rt ? rhs[j][p] : rhs[p][j]);
+      }
+      ref[i][j] = DType((plus ? static_cast<double>(ref[i][j]) : 0.0) + scale * sum);
+    }
+  }
+}
+
+template<bool lt, bool rt, typename DType>
+void CheckShape(GEMMBackend backend, index_t m, index_t n, index_t k, double tol) {
+  TensorContainer<cpu, 2, DType> lhs(lt ? Shape2(k, m) : Shape2(m, k));
+  TensorContainer<cpu, 2, DType> rhs(rt ? Shape2(n, k) : Shape2(k, n));
+  TensorContainer<cpu, 2, DType> dst(Shape2(m, n)), ref(Shape2(m, n));
+  Randomize(lhs.FlatTo2D());
+  Randomize(rhs.FlatTo2D());
+  GEMMBlocking blk;
+  assert(GEMMDispatch<cpu>::Choose<DType>(lt, rt, m, n, k, &blk) == backend);
+  Tensor<cpu, 2, DType> d = dst;
+  // dst = dot
+  DotEngine<sv::saveto, cpu, 2, 2, 2, lt, rt, DType>::Eval(&d, lhs, rhs, DType(1.0f));
+  NaiveDot<DType>(ref, lhs, rhs, lt, rt, 1.0, false);
+  CheckClose(d, ref.FlatTo2D(), tol, "dot saveto");
+  // dst += 2 * dot
+  Randomize(d);
+  Copy(ref, dst);
+  DotEngine<sv::plusto, cpu, 2, 2, 2, lt, rt, DType>::Eval(&d, lhs, rhs, DType(2.0f));
+  NaiveDot<DType>(ref, lhs, rhs, lt, rt, 2.0, true);
+  CheckClose(d, ref.FlatTo2D(), tol, "dot plusto");
+}
+
+// backend[2 * lt + rt] is the backend expected for the transposes lt, rt
+template<typename DType>
+void CheckAllTransposes(const GEMMBackend backend[4], index_t m, index_t n, index_t k,
+                        double tol) {
+  CheckShape<false, false, DType>(backend[0], m, n, k, tol);
+  CheckShape<false, true, DType>(backend[1], m, n, k, tol);
+  CheckShape<true, false, DType>(backend[2], m, n, k, tol);
+  CheckShape<true, true, DType>(backend[3], m, n, k, tol);
+}
+
+template<typename DType>
+void RunType(double tol) {
+  const index_t shapes[][3] = {{2, 2, 2}, {3, 3, 3}, {4, 4, 4}, {8, 8, 8}, {16, 64, 16},
+                               {16, 64, 64}, {5, 7, 3}, {1, 9, 17}, {13, 1, 6}, {33, 70, 40}};
+  GEMMTuner *tuner = GEMMTuner::Get();
+  for (const index_t *s : shapes) {
+    const index_t m = s[0], n = s[1], k = s[2];
+    // without a tuning entry dot() goes to BLAS unless MSHADOW_USE_SMALL_GEMM
+    tuner->Clear();
+    const bool small = MSHADOW_USE_SMALL_GEMM &&
+        (m * n * k <= MSHADOW_SMALL_GEMM_MAX_MNK ||
+         SmallDotDispatch<cpu, true>::HasFixed(m, n, k));
+    const GEMMBackend fallback = small ? kGEMMSmall : kGEMMBLAS;
+    GEMMBackend expect[4] = {fallback, fallback, fallback, fallback};
+    CheckAllTransposes<DType>(expect, m, n, k, tol);
+    // a tuning entry forces the backend of its transposes only
+    for (int t = 0; t < 4; ++t) {
+      tuner->Clear();
+      tuner->Set(DataType<DType>::kFlag, (t & 2) != 0, (t & 1) != 0, m, n, k,
+                 GEMMTuneEntry(kGEMMSmall));
+      for (int u = 0; u < 4; ++u) expect[u] = u == t ? kGEMMSmall : fallback;
+      CheckAllTransposes<DType>(expect, m, n, k, tol);
+    }
+    if (DataType<DType>::kFlag != kFloat64) {
+      for (int t = 0; t < 4; ++t) {
+        tuner->Set(DataType<DType>::kFlag, (t & 2) != 0, (t & 1) != 0, m, n, k,
+                   GEMMTuneEntry(kGEMMPacked, GEMMBlocking(8, 16, 32)));
+        expect[t] = kGEMMPacked;
+      }
+      CheckAllTransposes<DType>(expect, m, n, k, tol);
+    }
+  }
+  tuner->Clear();
+}
+
+// dot() of half_t or bf16_t, which accumulates in float, for one transpose
+template<bool lt, bool rt, typename DType>
+void CheckLowPrecision(index_t m, index_t n, index_t k, double tol) {
+  TensorContainer<cpu, 2, DType> lhs(lt ? Shape2(k, m) : Shape2(m, k));
+  TensorContainer<cpu, 2, DType> rhs(rt ? Shape2(n, k) : Shape2(k, n));
+  TensorContainer<cpu, 2, DType> dst(Shape2(m, n)), ref(Shape2(m, n));
+  Randomize(lhs.FlatTo2D());
+  Randomize(rhs.FlatTo2D());
+  Tensor<cpu, 2, DType> d = dst;
+  DotEngine<sv::saveto, cpu, 2, 2, 2, lt, rt, DType>::Eval(&d, lhs, rhs, DType(1.0f));
+  NaiveDot<DType>(ref, lhs, rhs, lt, rt, 1.0, false);
+  CheckClose(d, ref.FlatTo2D(), tol, "low precision dot saveto");
+  Randomize(d);
+  Copy(ref, dst);
+  DotEngine<sv::plusto, cpu, 2, 2, 2, lt, rt, DType>::Eval(&d, lhs, rhs, DType(2.0f));
+  NaiveDot<DType>(ref, lhs, rhs, lt, rt, 2.0, true);
+  CheckClose(d, ref.FlatTo2D(), tol, "low precision dot plusto");
+}
+
+template<typename DType>
+void RunLowPrecision(double tol) {
+  // small, and larger than one block of the packed GEMM
+  const index_t shapes[][3] = {{1, 1, 1}, {5, 7, 3}, {16, 64, 16}, {33, 70, 40},
+                               {130, 70, 300}, {7, 2100, 9}};
+  for (const index_t *s : shapes) {
+    CheckLowPrecision<false, false, DType>(s[0], s[1], s[2], tol);
+    CheckLowPrecision<false, true, DType>(s[0], s[1], s[2], tol);
+    CheckLowPrecision<true, false, DType>(s[0], s[1], s[2], tol);
+    CheckLowPrecision<true, true, DType>(s[0], s[1], s[2], tol);
+  }
+}
+
+// float to bf16_t rounds to nearest even, keeps NaN a NaN and Inf an Inf
+void CheckBfloat() {
+  typedef bfloat::bf16_t bf16_t;
+  // float bits, and the bf16_t bits they round to
+  const uint32_t cases[][2] = {
+    {0x3F800000u, 0x3F80u}, {0x3F808000u, 0x3F80u}, {0x3F818000u, 0x3F82u},
+    {0x3F808001u, 0x3F81u}, {0x3F80C000u, 0x3F81u}, {0xBF808000u, 0xBF80u},
+    {0xBF818000u, 0xBF82u}, {0x80000000u, 0x8000u}, {0x00000001u, 0x0000u},
+    {0x7F7F0000u, 0x7F7Fu}, {0x7F7FFFFFu, 0x7F80u}, {0x7F800000u, 0x7F80u},
+    {0xFF800000u, 0xFF80u}};
+  for (const uint32_t *c : cases) {
+    float f;
+    std::memcpy(&f, &c[0], sizeof(f));
+    assert(bf16_t(f).bf16_ == c[1]);
+  }
+  // NaN, quiet or signaling, stays a NaN, even with only low mantissa bits set
+  const uint32_t nans[] = {0x7FC00000u, 0x7F800001u, 0xFF800001u, 0x7FFFFFFFu};
+  for (uint32_t bits : nans) {
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    const float back = static_cast<float>(bf16_t(f));
+    assert(back != back);
+  }
+  // every bf16_t value other than NaN goes through float unchanged
+  for (uint32_t bits = 0; bits < 0x10000u; ++bits) {
+    const bf16_t v = bf16_t::Binary(static_cast<uint16_t>(bits));
+    const float f = static_cast<float>(v);
+    if (f != f) continue;
+    assert(bf16_t(f).bf16_ == bits);
+  }
+}
+
+int main() {
+  InitTensorEngine<cpu>();
+  RunType<float>(1e-5);
+  RunType<double>(1e-12);
+  RunLowPrecision<half::half_t>(2e-3);
+  RunLowPrecision<bfloat::bf16_t>(1e-2);
+  CheckBfloat();
+  ShutdownTensorEngine<cpu>();
+  printf("Pass\n");
+  return 0;
+}
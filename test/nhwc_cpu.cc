@@ -0,0 +1,136 @@
+// the kNHWC Plans of pool, unpool, pad, crop, unpack_patch2col and
+// pack_col2patch on CPU against the kNCHW result of the same images,
+// transposed to (batch, height, width, channel)
+#include "test_cpu.h"
+
+// (batch, channel, height, width) to (batch, height, width, channel)
+template<typename DType>
+void ToNHWC(TensorContainer<cpu, 4, DType> *dst, const Tensor<cpu, 4, DType> &src) {
+  dst->Resize(Shape4(src.size(0), src.size(2), src.size(3), src.size(1)));
+  *dst = transpose(src, Shape4(0, 2, 3, 1));
+}
+
+template<typename Reducer>
+void CheckPool(const Tensor<cpu, 4, float> &img, const Tensor<cpu, 4, float> &img_t,
+               index_t ky, index_t kx, index_t sy, index_t sx, const char *what) {
+  TensorContainer<cpu, 4, float> out, out_t, ref_t;
+  out.Resize(pool<Reducer>(img, ky, kx, sy, sx).shape_);
+  out = pool<Reducer>(img, ky, kx, sy, sx);
+  ToNHWC(&ref_t, out);
+  out_t.Resize(ref_t.shape_);
+  out_t = pool<Reducer, kNHWC>(img_t, ky, kx, sy, sx);
+  CheckClose(out_t.FlatTo2D(), ref_t.FlatTo2D(), 1e-5, what);
+  // output shape given explicitly, smaller than the default one
+  const Shape<2> pshape = Shape2(std::max(out.size(2) - 1, index_t(1)), out.size(3));
+  out.Resize(Shape4(img.size(0), img.size(1), pshape[0], pshape[1]));
+  out = pool<Reducer>(img, pshape, ky, kx, sy, sx);
+  ToNHWC(&ref_t, out);
+  out_t.Resize(ref_t.shape_);
+  out_t = pool<Reducer, kNHWC>(img_t, pshape, ky, kx, sy, sx);
+  CheckClose(out_t.FlatTo2D(), ref_t.FlatTo2D(), 1e-5, what);
+}
+
+void CheckUnpool(const Tensor<cpu, 4, float> &img, const Tensor<cpu, 4, float> &img_t,
+                 index_t ky, index_t kx, index_t sy, index_t sx) {
+  TensorContainer<cpu, 4, float> pooled, grad, out(img.shape_);
+  TensorContainer<cpu, 4, float> pooled_t, grad_t, out_t(img_t.shape_), ref_t;
+  pooled.Resize(pool<red::maximum>(img, ky, kx, sy, sx).shape_);
+  grad.Resize(pooled.shape_);
+  pooled = pool<red::maximum>(img, ky, kx, sy, sx);
+  Randomize(grad.FlatTo2D());
+  ToNHWC(&pooled_t, pooled);
+  ToNHWC(&grad_t, grad);
+  out = unpool<red::maximum>(img, pooled, grad, ky, kx, sy, sx);
+  out_t = unpool<red::maximum, kNHWC>(img_t, pooled_t, grad_t, ky, kx, sy, sx);
+  ToNHWC(&ref_t, out);
+  CheckClose(out_t.FlatTo2D(), ref_t.FlatTo2D(), 1e-5, "unpool maximum");
+  pooled = pool<red::sum>(img, ky, kx, sy, sx);
+  ToNHWC(&pooled_t, pooled);
+  out = unpool<red::sum>(img, pooled, grad, ky, kx, sy, sx);
+  out_t = unpool<red::sum, kNHWC>(img_t, pooled_t, grad_t, ky, kx, sy, sx);
+  ToNHWC(&ref_t, out);
+  CheckClose(out_t.FlatTo2D(), ref_t.FlatTo2D(), 1e-5, "unpool sum");
+}
+
+void CheckPadCrop(const Tensor<cpu, 4, float> &img, const Tensor<cpu, 4, float> &img_t,
+                  index_t py, index_t px) {
+  const index_t h = img.size(2), w = img.size(3);
+  TensorContainer<cpu, 4, float> out(Shape4(img.size(0), img.size(1), h + 2 * py, w + 2 * px));
+  TensorContainer<cpu, 4, float> out_t(Shape4(img.size(0), h + 2 * py, w + 2 * px, img.size(1)));
+  TensorContainer<cpu, 4, float> ref_t;
+  out = pad(img, py, px);
+  out_t = pad<kNHWC>(img_t, py, px);
+  ToNHWC(&ref_t, out);
+  CheckClose(out_t.FlatTo2D(), ref_t.FlatTo2D(), 0.0, "pad");
+  if (py == px) {
+    out_t = pad<kNHWC>(img_t, py);
+    CheckClose(out_t.FlatTo2D(), ref_t.FlatTo2D(), 0.0, "pad");
+  }
+  // from the center, then from a corner away from the origin
+  const Shape<2> oshape = Shape2(h - py, w - px);
+  out.Resize(Shape4(img.size(0), img.size(1), oshape[0], oshape[1]));
+  out_t.Resize(Shape4(img.size(0), oshape[0], oshape[1], img.size(1)));
+  out = crop(img, oshape);
+  out_t = crop<kNHWC>(img_t, oshape);
+  ToNHWC(&ref_t, out);
+  CheckClose(out_t.FlatTo2D(), ref_t.FlatTo2D(), 0.0, "crop");
+  out = crop(img, oshape, py, px);
+  out_t = crop<kNHWC>(img_t, oshape, py, px);
+  ToNHWC(&ref_t, out);
+  CheckClose(out_t.FlatTo2D(), ref_t.FlatTo2D(), 0.0, "crop");
+}
+
+// kNHWC row (ky * k + kx) * channel + c is kNCHW row (c * k + ky) * k + kx
+void CheckPatch(const Tensor<cpu, 4, float> &img, const Tensor<cpu, 4, float> &img_t,
+                index_t k, index_t s, index_t d, index_t p) {
+  const index_t c = img.size(1), h = img.size(2), w = img.size(3);
+  const index_t oh = (h + 2 * p - d * (k - 1) - 1) / s + 1;
+  const index_t ow = (w + 2 * p - d * (k - 1) - 1) / s + 1;
+  const Shape<2> cshape = Shape2(c * k * k, img.size(0) * oh * ow);
+  TensorContainer<cpu, 2, float> col(cshape), col_t(cshape), ref_t(cshape);
+  col = unpack_patch2col(img, k, k, s, s, d, d, p, p);
+  col_t = unpack_patch2col<kNHWC>(img_t, k, k, s, s, d, d, p, p);
+  for (index_t ch = 0; ch < c; ++ch) {
+    for (index_t i = 0; i < k * k; ++i) Copy(ref_t[i * c + ch], col[ch * k * k + i]);
+  }
+  CheckClose(col_t, ref_t.FlatTo2D(), 0.0, "unpack_patch2col");
+  // pack_col2patch of the same matrix, rows in each order, without padding
+  if (p != 0) return;
+  TensorContainer<cpu, 4, float> out(img.shape_), out_t(img_t.shape_), out_ref;
+  Randomize(col.FlatTo2D());
+  for (index_t ch = 0; ch < c; ++ch) {
+    for (index_t i = 0; i < k * k; ++i) Copy(col_t[i * c + ch], col[ch * k * k + i]);
+  }
+  out = pack_col2patch(col, img.shape_, k, k, s, s, d, d);
+  out_t = pack_col2patch<kNHWC>(col_t, img_t.shape_, k, k, s, s, d, d);
+  ToNHWC(&out_ref, out);
+  CheckClose(out_t.FlatTo2D(), out_ref.FlatTo2D(), 1e-5, "pack_col2patch");
+}
+
+int main() {
+  InitTensorEngine<cpu>();
+  // batch, channel, height, width
+  const index_t shapes[][4] = {{1, 1, 5, 5}, {2, 3, 12, 12}, {2, 5, 13, 11}, {1, 16, 9, 20}};
+  for (const index_t *s : shapes) {
+    TensorContainer<cpu, 4, float> img(Shape4(s[0], s[1], s[2], s[3])), img_t;
+    Randomize(img.FlatTo2D(), 10.0f);
+    ToNHWC(&img_t, img);
+    // ksize_y, ksize_x, kstride_y, kstride_x
+    const index_t windows[][4] = {{3, 3, 1, 1}, {2, 2, 2, 2}, {5, 3, 2, 1}, {4, 4, 3, 3}};
+    for (const index_t *k : windows) {
+      CheckPool<red::maximum>(img, img_t, k[0], k[1], k[2], k[3], "pool maximum");
+      CheckPool<red::minimum>(img, img_t, k[0], k[1], k[2], k[3], "pool minimum");
+      CheckPool<red::sum>(img, img_t, k[0], k[1], k[2], k[3], "pool sum");
+      CheckUnpool(img, img_t, k[0], k[1], k[2], k[3]);
+    }
+    CheckPadCrop(img, img_t, 1, 1);
+    CheckPadCrop(img, img_t, 2, 1);
+    // ksize, stride, dilate, pad
+    const index_t patches[][4] = {{3, 1, 1, 0}, {3, 1, 1, 1}, {3, 2, 2, 2}, {2, 2, 1, 0},
+                                  {1, 1, 1, 0}, {5, 1, 1, 2}};
+    for (const index_t *p : patches) CheckPatch(img, img_t, p[0], p[1], p[2], p[3]);
+  }
+  ShutdownTensorEngine<cpu>();
+  printf("Pass\n");
+  return 0;
+}
@@ -0,0 +1,138 @@
+// pool3d, unpool3d, unpack_patch2col_3d and pack_col2patch_3d on CPU against
+// loops over (batch, channel, depth, height, width), with strides, dilations
+// and padding; an unpool3d whose pooled shape does not match the kernel is
+// rejected
+#include <sys/wait.h>
+#include <unistd.h>
+#include "test_cpu.h"
+
+struct Window {
+  Shape<3> ksize, kstride, kdilate, kpad, ishape, oshape;
+  Window(Shape<3> ishape, Shape<3> ksize, Shape<3> kstride, Shape<3> kdilate, Shape<3> kpad)
+      : ksize(ksize), kstride(kstride), kdilate(kdilate), kpad(kpad), ishape(ishape) {
+    for (int k = 0; k < 3; ++k) {
+      oshape[k] = (ishape[k] + 2 * kpad[k] - kdilate[k] * (ksize[k] - 1) - 1) / kstride[k] + 1;
+    }
+  }
+  // position of tap t of window p along axis k, false inside the padding
+  bool Tap(int k, index_t p, index_t t, index_t *pos) const {
+    *pos = p * kstride[k] - kpad[k] + t * kdilate[k];
+    return *pos >= 0 && *pos < ishape[k];
+  }
+};
+
+// calls f(window z, y, x, tap z, y, x, voxel z, y, x) for every tap inside the volume
+template<typename F>
+void ForEachTap(const Window &w, F f) {
+  for (index_t pz = 0; pz < w.oshape[0]; ++pz) {
+    for (index_t py = 0; py < w.oshape[1]; ++py) {
+      for (index_t px = 0; px < w.oshape[2]; ++px) {
+        for (index_t tz = 0; tz < w.ksize[0]; ++tz) {
+          for (index_t ty = 0; ty < w.ksize[1]; ++ty) {
+            for (index_t tx = 0; tx < w.ksize[2]; ++tx) {
+              index_t z, y, x;
+              if (w.Tap(0, pz, tz, &z) && w.Tap(1, py, ty, &y) && w.Tap(2, px, tx, &x)) {
+                f(pz, py, px, tz, ty, tx, z, y, x);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template<typename Reducer>
+void CheckPool(const Tensor<cpu, 5, float> &img, const Window &w, const char *what) {
+  const Shape<5> pshape = Shape5(img.size(0), img.size(1), w.oshape[0], w.oshape[1], w.oshape[2]);
+  TensorContainer<cpu, 5, float> out(pshape), ref(pshape), grad(pshape);
+  TensorContainer<cpu, 5, float> gout(img.shape_), gref(img.shape_);
+  out = pool3d<Reducer>(img, w.ksize, w.kstride, w.kdilate, w.kpad);
+  Randomize(grad.FlatTo2D());
+  float init; Reducer::SetInitValue(init);
+  ref = init;
+  gref = 0.0f;
+  for (index_t n = 0; n < img.size(0); ++n) {
+    for (index_t c = 0; c < img.size(1); ++c) {
+      Tensor<cpu, 3, float> r = ref[n][c], g = grad[n][c], src = img[n][c], gr = gref[n][c];
+      ForEachTap(w, [&](index_t pz, index_t py, index_t px, index_t, index_t, index_t,
+                        index_t z, index_t y, index_t x) {
+        Reducer::Reduce(r[pz][py][px], src[z][y][x]);
+      });
+      // every tap whose value is the pooled one gets the gradient of the window
+      ForEachTap(w, [&](index_t pz, index_t py, index_t px, index_t, index_t, index_t,
+                        index_t z, index_t y, index_t x) {
+        gr[z][y][x] += Reducer::PartialGrad(src[z][y][x], r[pz][py][px]) * g[pz][py][px];
+      });
+    }
+  }
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), 1e-5, what);
+  gout = unpool3d<Reducer>(img, out, grad, w.ksize, w.kstride, w.kdilate, w.kpad);
+  CheckClose(gout.FlatTo2D(), gref.FlatTo2D(), 1e-5, what);
+}
+
+void CheckPatch(const Tensor<cpu, 5, float> &img, const Window &w) {
+  const index_t nchannel = img.size(1), ksize = w.ksize.Size(), osize = w.oshape.Size();
+  const Shape<2> cshape = Shape2(nchannel * ksize, img.size(0) * osize);
+  TensorContainer<cpu, 2, float> col(cshape), cref(cshape);
+  TensorContainer<cpu, 5, float> out(img.shape_), ref(img.shape_);
+  col = unpack_patch2col_3d(img, w.ksize, w.kstride, w.kdilate, w.kpad);
+  // row (channel, tap z, tap y, tap x), column (batch, window z, y, x);
+  // pack_col2patch_3d adds each column entry back to its voxel
+  cref = 0.0f;
+  ref = 0.0f;
+  for (index_t n = 0; n < img.size(0); ++n) {
+    for (index_t c = 0; c < nchannel; ++c) {
+      Tensor<cpu, 3, float> src = img[n][c], dst = ref[n][c];
+      ForEachTap(w, [&](index_t pz, index_t py, index_t px, index_t tz, index_t ty, index_t tx,
+                        index_t z, index_t y, index_t x) {
+        const index_t row = ((c * w.ksize[0] + tz) * w.ksize[1] + ty) * w.ksize[2] + tx;
+        const index_t column = ((n * w.oshape[0] + pz) * w.oshape[1] + py) * w.oshape[2] + px;
+        cref[row][column] = src[z][y][x];
+        dst[z][y][x] += col[row][column];
+      });
+    }
+  }
+  CheckClose(col, cref.FlatTo2D(), 0.0, "unpack_patch2col_3d");
+  out = pack_col2patch_3d(col, img.shape_, w.ksize, w.kstride, w.kdilate, w.kpad);
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), 1e-5, "pack_col2patch_3d");
+}
+
+int main() {
+  InitTensorEngine<cpu>();
+  // volume, kernel, stride, dilation, padding
+  const index_t cases[][5][3] = {
+    {{4, 4, 4}, {2, 2, 2}, {2, 2, 2}, {1, 1, 1}, {0, 0, 0}},
+    {{5, 6, 7}, {3, 3, 3}, {1, 1, 1}, {1, 1, 1}, {1, 1, 1}},
+    {{7, 9, 8}, {3, 2, 3}, {2, 1, 3}, {2, 3, 1}, {1, 0, 2}},
+    {{3, 10, 11}, {1, 3, 2}, {1, 2, 2}, {1, 2, 4}, {0, 2, 1}},
+    {{6, 5, 9}, {2, 5, 3}, {3, 1, 2}, {1, 1, 2}, {1, 2, 2}}};
+  for (const auto &s : cases) {
+    const Window w(Shape3(s[0][0], s[0][1], s[0][2]), Shape3(s[1][0], s[1][1], s[1][2]),
+                   Shape3(s[2][0], s[2][1], s[2][2]), Shape3(s[3][0], s[3][1], s[3][2]),
+                   Shape3(s[4][0], s[4][1], s[4][2]));
+    TensorContainer<cpu, 5, float> img(Shape5(2, 3, s[0][0], s[0][1], s[0][2]));
+    Randomize(img.FlatTo2D(), 10.0f);
+    CheckPool<red::maximum>(img, w, "pool3d maximum");
+    CheckPool<red::sum>(img, w, "pool3d sum");
+    CheckPatch(img, w);
+  }
+  // a pooled volume one row short of the kernel and stride, the failed check
+  // aborts the child process
+  TensorContainer<cpu, 5, float> img(Shape5(1, 2, 4, 4, 4)), pooled(Shape5(1, 2, 2, 1, 2));
+  Randomize(img.FlatTo2D());
+  Randomize(pooled.FlatTo2D());
+  const pid_t pid = fork();
+  if (pid == 0) {
+    if (freopen("/dev/null", "w", stderr) == NULL) _exit(2);
+    TensorContainer<cpu, 5, float> grad(img.shape_);
+    grad = unpool3d<red::maximum>(img, pooled, pooled, Shape3(2, 2, 2), Shape3(2, 2, 2));
+    _exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  assert(WIFSIGNALED(status));
+  ShutdownTensorEngine<cpu>();
+  printf("Pass\n");
+  return 0;
+}
@@ -0,0 +1,121 @@
+// pool<red::maximum/minimum/sum> on CPU: the sliding window engine of
+// tensor = pool(...) against the Plan used when pool is nested in an
+// expression, for windows large and small against the stride and outputs
+// whose last window is cut by the border; MaxPoolWithIndex and
+// UnpoolWithIndex against pool<red::maximum>, unpool<red::maximum> and the
+// first maximum of each window, with ties and zero padding
+#include "test_cpu.h"
+
+template<typename Reducer, typename DType>
+void CheckPool(const Tensor<cpu, 4, DType> &img, index_t ky, index_t kx,
+               index_t sy, index_t sx, double tol, const char *what) {
+  TensorContainer<cpu, 4, DType> out, ref;
+  ref.Resize(pool<Reducer>(img, ky, kx, sy, sx).shape_);
+  out.Resize(ref.shape_);
+  ref = DType(1.0f) * pool<Reducer>(img, ky, kx, sy, sx);
+  out = pool<Reducer>(img, ky, kx, sy, sx);
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), tol, what);
+  out += pool<Reducer>(img, ky, kx, sy, sx);
+  ref *= DType(2.0f);
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), tol, what);
+  // output shape given explicitly, smaller than the default one
+  Shape<2> pshape = Shape2(std::max(ref.size(2) - 1, index_t(1)), ref.size(3));
+  TensorContainer<cpu, 4, DType> out2(Shape4(img.size(0), img.size(1), pshape[0], pshape[1]));
+  TensorContainer<cpu, 4, DType> ref2(out2.shape_);
+  ref2 = DType(1.0f) * pool<Reducer>(img, pshape, ky, kx, sy, sx);
+  out2 = pool<Reducer>(img, pshape, ky, kx, sy, sx);
+  CheckClose(out2.FlatTo2D(), ref2.FlatTo2D(), tol, what);
+}
+
+// MaxPoolWithIndex and UnpoolWithIndex with an output of pheight x pwidth;
+// ties only when the image has them, then unpool<red::maximum> is not a reference
+template<typename DType>
+void CheckPoolIndex(const Tensor<cpu, 4, DType> &img, index_t pheight, index_t pwidth,
+                    index_t ky, index_t kx, index_t sy, index_t sx, bool ties) {
+  const index_t height = img.size(2), width = img.size(3);
+  const Shape<4> pshape = Shape4(img.size(0), img.size(1), pheight, pwidth);
+  TensorContainer<cpu, 4, DType> pooled(pshape), ref(pshape), grad(pshape);
+  TensorContainer<cpu, 4, int> index(pshape);
+  MaxPoolWithIndex(pooled, index, img, ky, kx, sy, sx);
+  ref = DType(1.0f) * pool<red::maximum>(img, Shape2(pheight, pwidth), ky, kx, sy, sx);
+  CheckClose(pooled.FlatTo2D(), ref.FlatTo2D(), 0.0, "MaxPoolWithIndex");
+  // the index is the first maximum of its window, in row major order
+  TensorContainer<cpu, 4, DType> gref(img.shape_), gout(img.shape_);
+  Randomize(grad.FlatTo2D());
+  gref = DType(0.0f);
+  for (index_t n = 0; n < img.size(0); ++n) {
+    for (index_t c = 0; c < img.size(1); ++c) {
+      for (index_t py = 0; py < pheight; ++py) {
+        for (index_t px = 0; px < pwidth; ++px) {
+          index_t first = py * sy * width + px * sx;
+          for (index_t y = py * sy; y < std::min(py * sy + ky, height); ++y) {
+            for (index_t x = px * sx; x < std::min(px * sx + kx, width); ++x) {
+              if (img[n][c][y][x] > img[n][c][first / width][first % width]) first = y * width + x;
+            }
+          }
+          assert(index[n][c][py][px] == static_cast<int>(first));
+          gref[n][c][first / width][first % width] += grad[n][c][py][px];
+        }
+      }
+    }
+  }
+  UnpoolWithIndex<sv::saveto>(gout, index, grad);
+  CheckClose(gout.FlatTo2D(), gref.FlatTo2D(), 1e-5, "UnpoolWithIndex");
+  UnpoolWithIndex<sv::plusto>(gout, index, grad);
+  gref *= DType(2.0f);
+  CheckClose(gout.FlatTo2D(), gref.FlatTo2D(), 1e-5, "UnpoolWithIndex plusto");
+  if (!ties) {
+    gref = unpool<red::maximum>(img, pooled, grad, ky, kx, sy, sx);
+    UnpoolWithIndex<sv::saveto>(gout, index, grad);
+    CheckClose(gout.FlatTo2D(), gref.FlatTo2D(), 1e-5, "UnpoolWithIndex vs unpool");
+  }
+}
+
+template<typename DType>
+void RunPoolIndex(const index_t c[6]) {
+  const index_t height = c[0], width = c[1], ky = c[2], kx = c[3], sy = c[4], sx = c[5];
+  TensorContainer<cpu, 4, DType> img(Shape4(2, 3, height, width));
+  Randomize(img.FlatTo2D(), 10.0f);
+  // the default output, and one more window cut by the border when it fits
+  const index_t ph = (height - ky) / sy + 1, pw = (width - kx) / sx + 1;
+  CheckPoolIndex<DType>(img, ph, pw, ky, kx, sy, sx, false);
+  if (ph * sy < height && pw * sx < width) {
+    CheckPoolIndex<DType>(img, ph + 1, pw + 1, ky, kx, sy, sx, false);
+  }
+  // few distinct values, so most windows tie
+  for (index_t i = 0; i < img.shape_.Size(); ++i) {
+    img.dptr_[i / width * img.stride_ + i % width] = DType(static_cast<float>(rand() % 3));
+  }
+  CheckPoolIndex<DType>(img, ph, pw, ky, kx, sy, sx, true);
+  // zero padding of one pixel, ties with the padding when a window is negative
+  Randomize(img.FlatTo2D(), 10.0f);
+  TensorContainer<cpu, 4, DType> padded(Shape4(2, 3, height + 2, width + 2));
+  padded = pad(img, 1);
+  CheckPoolIndex<DType>(padded, (height + 2 - ky) / sy + 1, (width + 2 - kx) / sx + 1,
+                        ky, kx, sy, sx, true);
+}
+
+template<typename DType>
+void RunType(double tol) {
+  // height, width, ksize_y, ksize_x, kstride_y, kstride_x
+  const index_t cases[][6] = {{12, 12, 3, 3, 1, 1}, {13, 11, 7, 7, 1, 1}, {20, 17, 8, 8, 4, 4},
+                              {9, 14, 5, 3, 2, 1}, {16, 16, 2, 2, 2, 2}, {10, 10, 10, 10, 1, 1},
+                              {7, 23, 1, 9, 1, 2}, {15, 9, 6, 4, 3, 1}};
+  for (const index_t *c : cases) {
+    TensorContainer<cpu, 4, DType> img(Shape4(2, 3, c[0], c[1]));
+    Randomize(img.FlatTo2D(), 10.0f);
+    CheckPool<red::maximum, DType>(img, c[2], c[3], c[4], c[5], tol, "pool max");
+    CheckPool<red::minimum, DType>(img, c[2], c[3], c[4], c[5], tol, "pool min");
+    CheckPool<red::sum, DType>(img, c[2], c[3], c[4], c[5], tol, "pool sum");
+    RunPoolIndex<DType>(c);
+  }
+}
+
+int main() {
+  InitTensorEngine<cpu>();
+  RunType<float>(1e-5);
+  RunType<double>(1e-12);
+  ShutdownTensorEngine<cpu>();
+  printf("Pass\n");
+  return 0;
+}
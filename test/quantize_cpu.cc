@@ -0,0 +1,179 @@
+// quantized_dot, quantize, requantize and dequantize on CPU against integer
+// loops: every transpose, int8 and uint8 operands, saveto and plusto, per
+// tensor and per channel along each axis, rounding halves and saturation
+#include <vector>
+#include "test_cpu.h"
+
+// round half away from zero, add zero_point and saturate, in exact arithmetic
+template<typename DType>
+DType NaiveSaturate(double a, int32_t zero_point) {
+  const double q = std::round(a) + zero_point;
+  const double lo = red::limits::MinValue<DType>(), hi = red::limits::MaxValue<DType>();
+  return static_cast<DType>(q < lo ? lo : (q > hi ? hi : q));
+}
+
+template<typename DType>
+void FillInt(Tensor<cpu, 2, DType> t) {
+  for (index_t i = 0; i < t.size(0); ++i) {
+    for (index_t j = 0; j < t.size(1); ++j) {
+      // the extremes most of the time, so the int32 sums get large
+      const int r = rand() % 4;
+      t[i][j] = static_cast<DType>(r == 0 ? red::limits::MinValue<DType>() :
+                                   r == 1 ? red::limits::MaxValue<DType>() :
+                                   rand() % 256 + red::limits::MinValue<DType>());
+    }
+  }
+}
+
+template<bool lt, bool rt, typename LDType, typename RDType>
+void CheckDot(index_t m, index_t n, index_t k) {
+  TensorContainer<cpu, 2, LDType> lhs(lt ? Shape2(k, m) : Shape2(m, k));
+  TensorContainer<cpu, 2, RDType> rhs(rt ? Shape2(n, k) : Shape2(k, n));
+  TensorContainer<cpu, 2, int32_t> out(Shape2(m, n)), ref(Shape2(m, n));
+  FillInt(lhs.FlatTo2D());
+  FillInt(rhs.FlatTo2D());
+  for (index_t i = 0; i < m; ++i) {
+    for (index_t j = 0; j < n; ++j) {
+      int32_t sum = 0;
+      for (index_t p = 0; p < k; ++p) {
+        sum += static_cast<int32_t>(lt ? lhs[p][i] : lhs[i][p]) *
+               static_cast<int32_t>(rt ? rhs[j][p] : rhs[p][j]);
+      }
+      ref[i][j] = sum;
+    }
+  }
+  if (lt && rt) {
+    out = quantized_dot(lhs.T(), rhs.T());
+  } else if (lt) {
+    out = quantized_dot(lhs.T(), rhs);
+  } else if (rt) {
+    out = quantized_dot(lhs, rhs.T());
+  } else {
+    out = quantized_dot(lhs, rhs);
+  }
+  for (index_t i = 0; i < m; ++i) {
+    for (index_t j = 0; j < n; ++j) assert(out[i][j] == ref[i][j]);
+  }
+  if (!lt && !rt) {
+    out += quantized_dot(lhs, rhs);
+    for (index_t i = 0; i < m; ++i) {
+      for (index_t j = 0; j < n; ++j) assert(out[i][j] == 2 * ref[i][j]);
+    }
+  }
+}
+
+template<typename LDType, typename RDType>
+void CheckDotTypes() {
+  const index_t shapes[][3] = {{1, 1, 1}, {3, 5, 7}, {16, 64, 32}, {17, 65, 33},
+                               {40, 9, 300}, {2, 130, 1000}};
+  for (const index_t *s : shapes) {
+    CheckDot<false, false, LDType, RDType>(s[0], s[1], s[2]);
+    CheckDot<false, true, LDType, RDType>(s[0], s[1], s[2]);
+    CheckDot<true, false, LDType, RDType>(s[0], s[1], s[2]);
+    CheckDot<true, true, LDType, RDType>(s[0], s[1], s[2]);
+  }
+}
+
+// quantize, requantize and dequantize of a 3-D tensor, per tensor and with
+// a scale per channel of each axis
+void CheckAffine(index_t d0, index_t d1, index_t d2) {
+  const Shape<3> shape = Shape3(d0, d1, d2);
+  TensorContainer<cpu, 3, float> src(shape), deq(shape);
+  TensorContainer<cpu, 3, int8_t> q(shape);
+  TensorContainer<cpu, 3, uint8_t> uq(shape);
+  TensorContainer<cpu, 3, int32_t> acc(shape);
+  Randomize(src.FlatTo2D(), 20.0f);
+  for (index_t i = 0; i < d0; ++i) {
+    for (index_t j = 0; j < d1; ++j) {
+      for (index_t l = 0; l < d2; ++l) acc[i][j][l] = rand() % 200001 - 100000;
+    }
+  }
+  // per tensor
+  q = quantize<int8_t>(src, 0.1f, 3);
+  uq = quantize<uint8_t>(src, 0.25f, 128);
+  deq = dequantize<float>(q, 0.1f, 3);
+  for (index_t i = 0; i < d0; ++i) {
+    for (index_t j = 0; j < d1; ++j) {
+      for (index_t l = 0; l < d2; ++l) {
+        assert(q[i][j][l] == NaiveSaturate<int8_t>(src[i][j][l] / 0.1f, 3));
+        assert(uq[i][j][l] == NaiveSaturate<uint8_t>(src[i][j][l] / 0.25f, 128));
+        assert(deq[i][j][l] == (static_cast<float>(q[i][j][l]) - 3.0f) * 0.1f);
+      }
+    }
+  }
+  q = requantize<int8_t>(acc, 0.002f, -5);
+  for (index_t i = 0; i < d0; ++i) {
+    for (index_t j = 0; j < d1; ++j) {
+      for (index_t l = 0; l < d2; ++l) {
+        assert(q[i][j][l] == NaiveSaturate<int8_t>(static_cast<float>(acc[i][j][l]) * 0.002f,
+                                                   -5));
+      }
+    }
+  }
+  // per channel along each axis
+  for (int axis = 0; axis < 3; ++axis) {
+    const index_t nchannel = shape[axis];
+    TensorContainer<cpu, 1, float> scales(Shape1(nchannel));
+    TensorContainer<cpu, 1, int32_t> zero_points(Shape1(nchannel));
+    for (index_t c = 0; c < nchannel; ++c) {
+      scales[c] = 0.05f * (c + 1);
+      zero_points[c] = static_cast<int32_t>(c % 5) - 2;
+    }
+    q = quantize<int8_t>(src, scales, zero_points, axis);
+    deq = dequantize<float>(q, scales, zero_points, axis);
+    uq = requantize<uint8_t>(acc, scales, zero_points, axis);
+    for (index_t i = 0; i < d0; ++i) {
+      for (index_t j = 0; j < d1; ++j) {
+        for (index_t l = 0; l < d2; ++l) {
+          const index_t c = axis == 0 ? i : (axis == 1 ? j : l);
+          assert(q[i][j][l] ==
+                 NaiveSaturate<int8_t>(src[i][j][l] / scales[c], zero_points[c]));
+          assert(deq[i][j][l] == (static_cast<float>(q[i][j][l]) -
+                                  static_cast<float>(zero_points[c])) * scales[c]);
+          assert(uq[i][j][l] == NaiveSaturate<uint8_t>(
+              static_cast<float>(acc[i][j][l]) * scales[c], zero_points[c]));
+        }
+      }
+    }
+  }
+}
+
+// values next to a rounding half, and beyond the range of the result
+void CheckEdges() {
+  const float values[] = {0.49999997f, -0.49999997f, 0.5f, -0.5f, 1.5f, 2.5f, -2.5f,
+                          126.5f, 127.49999f, 127.5f, -128.5f, -129.0f, 1e20f, -1e20f};
+  const index_t n = sizeof(values) / sizeof(values[0]);
+  TensorContainer<cpu, 1, float> src(Shape1(n));
+  TensorContainer<cpu, 1, int8_t> q(Shape1(n));
+  TensorContainer<cpu, 1, uint8_t> uq(Shape1(n));
+  for (index_t i = 0; i < n; ++i) src[i] = values[i];
+  q = quantize<int8_t>(src, 1.0f);
+  uq = quantize<uint8_t>(src, 1.0f, 10);
+  const int expect[] = {0, 0, 1, -1, 2, 3, -3, 127, 127, 127, -128, -128, 127, -128};
+  for (index_t i = 0; i < n; ++i) {
+    assert(q[i] == expect[i]);
+    assert(uq[i] == NaiveSaturate<uint8_t>(values[i], 10));
+  }
+  // int32 to int32 keeps the odd values above 2^23, and saturates
+  const int32_t ivalues[] = {8388609, -8388609, 8388611, 2147483647, -2147483647 - 1};
+  TensorContainer<cpu, 1, int32_t> isrc(Shape1(5)), iq(Shape1(5));
+  for (index_t i = 0; i < 5; ++i) isrc[i] = ivalues[i];
+  iq = requantize<int32_t>(isrc, 1.0f);
+  assert(iq[0] == 8388609 && iq[1] == -8388609 && iq[2] == 8388611);
+  assert(iq[3] == 2147483647 && iq[4] == -2147483647 - 1);
+  iq = requantize<int32_t>(isrc, 1.0f, 10);
+  assert(iq[0] == 8388619 && iq[3] == 2147483647);
+}
+
+int main() {
+  InitTensorEngine<cpu>();
+  CheckDotTypes<int8_t, int8_t>();
+  CheckDotTypes<uint8_t, int8_t>();
+  CheckDotTypes<uint8_t, uint8_t>();
+  CheckAffine(3, 4, 5);
+  CheckAffine(7, 1, 33);
+  CheckEdges();
+  ShutdownTensorEngine<cpu>();
+  printf("Pass\n");
+  return 0;
+}
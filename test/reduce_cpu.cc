@@ -0,0 +1,309 @@
+// keep-dim reductions on CPU against naive loops: sum_rows,
+// sumall_except_dim and reduce_except_dim keeping the lowest or a higher
+// dimension, tensors and expressions, unaligned views, scale, saveto and
+// plusto; reduce_with_axis and reduce_keepdim over every axis, with and
+// without the argmax/argmin mask, against their Plans; the two-statistic
+// ReduceStatsExceptDim and ReduceStatsWithAxis; sumall, maxall, minall,
+// norm2 and dot_all of whole expressions, norm2 of entries whose squares
+// overflow or underflow float; on one and several threads
+#include <limits>
+#include "test_cpu.h"
+
+// ref[j] = scale * reduce over i of mat[i][j], in double for sum
+template<typename Reducer>
+void NaiveKeepLowest(Tensor<cpu, 1, float> ref, const Tensor<cpu, 2, float> &mat, double scale) {
+  for (index_t j = 0; j < mat.size(1); ++j) {
+    double res = static_cast<double>(mat[0][j]);
+    for (index_t i = 1; i < mat.size(0); ++i) {
+      const double v = static_cast<double>(mat[i][j]);
+      Reducer::Reduce(res, v);
+    }
+    ref[j] = static_cast<float>(res * scale);
+  }
+}
+
+void CheckKeepLowest(index_t nrow, index_t ncol) {
+  TensorContainer<cpu, 2, float> mat(Shape2(nrow, ncol + 1)), sq(Shape2(nrow, ncol));
+  TensorContainer<cpu, 1, float> out(Shape1(ncol)), ref(Shape1(ncol)), prev(Shape1(ncol));
+  Randomize(mat.FlatTo2D());
+  Tensor<cpu, 2, float> m = mat.Slice(0, nrow);
+  m.shape_[1] = ncol;
+  out = sum_rows(m);
+  NaiveKeepLowest<red::sum>(ref, m, 1.0);
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), 1e-4, "sum_rows");
+  // columns 1.. of mat are not packet aligned
+  Tensor<cpu, 2, float> view(mat.dptr_ + 1, Shape2(nrow, ncol), mat.stride_, NULL);
+  out = sum_rows(view) * 0.5f;
+  NaiveKeepLowest<red::sum>(ref, view, 0.5);
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), 1e-4, "sum_rows unaligned");
+  Randomize(out.FlatTo2D());
+  Copy(prev, out);
+  out += sum_rows(view * view);
+  sq = view * view;
+  NaiveKeepLowest<red::sum>(ref, sq, 1.0);
+  ref += prev;
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), 1e-4, "sum_rows plusto");
+  out = reduce_except_dim<1, red::maximum>(m);
+  NaiveKeepLowest<red::maximum>(ref, m, 1.0);
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), 0.0, "reduce_except_dim<1, red::maximum>");
+  out = reduce_except_dim<1, red::minimum>(view);
+  NaiveKeepLowest<red::minimum>(ref, view, 1.0);
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), 0.0, "reduce_except_dim<1, red::minimum>");
+}
+
+// ref[c] = scale * reduce of t viewed as (num, channel, rest, width) over all but c
+template<typename Reducer>
+void NaiveKeepHighDim(Tensor<cpu, 1, float> ref, const Tensor<cpu, 4, float> &t, double scale) {
+  for (index_t c = 0; c < t.size(1); ++c) {
+    double res;
+    Reducer::SetInitValue(res);
+    for (index_t n = 0; n < t.size(0); ++n) {
+      for (index_t y = 0; y < t.size(2); ++y) {
+        for (index_t x = 0; x < t.size(3); ++x) {
+          const double v = static_cast<double>(t[n][c][y][x]);
+          Reducer::Reduce(res, v);
+        }
+      }
+    }
+    ref[c] = static_cast<float>(res * scale);
+  }
+}
+
+void CheckKeepHighDim(index_t n, index_t c, index_t h, index_t w) {
+  TensorContainer<cpu, 4, float> img(Shape4(n, c, h, w)), sq(Shape4(n, c, h, w));
+  TensorContainer<cpu, 1, float> out(Shape1(c)), ref(Shape1(c)), prev(Shape1(c));
+  Randomize(img.FlatTo2D());
+  out = sumall_except_dim<1>(img);
+  NaiveKeepHighDim<red::sum>(ref, img, 1.0);
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), 1e-4, "sumall_except_dim<1>");
+  Randomize(out.FlatTo2D());
+  Copy(prev, out);
+  out += sumall_except_dim<1>(img * img) * 0.25f;
+  sq = img * img;
+  NaiveKeepHighDim<red::sum>(ref, sq, 0.25);
+  ref += prev;
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), 1e-4, "sumall_except_dim<1> plusto");
+  out = reduce_except_dim<1, red::maximum>(img);
+  NaiveKeepHighDim<red::maximum>(ref, img, 1.0);
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), 0.0, "reduce_except_dim<1, red::maximum>");
+  // keep dimension 2 of a 4-D tensor, the channels of (n * c, h, 1, w)
+  TensorContainer<cpu, 1, float> out2(Shape1(h)), ref2(Shape1(h));
+  Tensor<cpu, 4, float> view(img.dptr_, Shape4(n * c, h, 1, w), img.stride_, NULL);
+  out2 = sumall_except_dim<2>(img);
+  NaiveKeepHighDim<red::sum>(ref2, view, 1.0);
+  CheckClose(out2.FlatTo2D(), ref2.FlatTo2D(), 1e-4, "sumall_except_dim<2>");
+}
+
+// dst = reduce_with_axis over each axis of a 3-D source, engine vs Plan
+template<typename Reducer, bool mask>
+void CheckAxisReducer(const Tensor<cpu, 3, float> &src, const char *what) {
+  for (int axis = 0; axis < 3; ++axis) {
+    Shape<2> dshape;
+    for (int i = 0, j = 0; i < 3; ++i) {
+      if (i != axis) dshape[j++] = src.size(i);
+    }
+    TensorContainer<cpu, 2, float> out(dshape), ref(dshape);
+    out = reduce_with_axis<Reducer, mask>(src, axis);
+    ref = 1.0f * reduce_with_axis<Reducer, mask>(src, axis);
+    CheckClose(out, ref.FlatTo2D(), 1e-5, what);
+    Shape<3> kshape = src.shape_;
+    kshape[axis] = 1;
+    TensorContainer<cpu, 3, float> kout(kshape), kref(kshape);
+    kout = reduce_keepdim<Reducer, mask>(src, axis);
+    kref = 1.0f * reduce_keepdim<Reducer, mask>(src, axis);
+    CheckClose(kout.FlatTo2D(), kref.FlatTo2D(), 1e-5, what);
+    kout += reduce_keepdim<Reducer, mask>(src, axis);
+    kref *= 2.0f;
+    CheckClose(kout.FlatTo2D(), kref.FlatTo2D(), 1e-5, what);
+  }
+}
+
+void CheckAxis(index_t a, index_t b, index_t c) {
+  TensorContainer<cpu, 3, float> src(Shape3(a, b, c));
+  Randomize(src.FlatTo2D());
+  CheckAxisReducer<red::sum, false>(src, "reduce_with_axis<red::sum>");
+  CheckAxisReducer<red::maximum, false>(src, "reduce_with_axis<red::maximum>");
+  CheckAxisReducer<red::maximum, true>(src, "argmax by reduce_with_axis");
+  CheckAxisReducer<red::minimum, true>(src, "argmin by reduce_with_axis");
+  // ties, where the first index must win
+  src *= 2.0f;
+  Tensor<cpu, 2, float> flat = src.FlatTo2D();
+  for (index_t i = 0; i < flat.size(0); ++i) {
+    for (index_t j = 0; j < flat.size(1); ++j) flat[i][j] = std::floor(flat[i][j]);
+  }
+  CheckAxisReducer<red::maximum, true>(src, "argmax by reduce_with_axis, ties");
+  CheckAxisReducer<red::minimum, true>(src, "argmin by reduce_with_axis, ties");
+  // an unaligned source takes the scalar rows
+  if (c == 1) return;
+  Tensor<cpu, 3, float> view(src.dptr_ + 1, Shape3(a, b, c - 1), src.stride_, NULL);
+  CheckAxisReducer<red::sum, false>(view, "reduce_with_axis<red::sum> unaligned");
+  CheckAxisReducer<red::maximum, true>(view, "argmax by reduce_with_axis unaligned");
+}
+
+// element k along axis of a 3-D tensor, i and j index the other two axes
+inline float At(const Tensor<cpu, 3, float> &t, int axis, index_t i, index_t j, index_t k) {
+  return axis == 0 ? t[k][i][j] : axis == 1 ? t[i][k][j] : t[i][j][k];
+}
+
+void CheckStatsWithAxis(const Tensor<cpu, 3, float> &src) {
+  for (int axis = 0; axis < 3; ++axis) {
+    Shape<2> dshape;
+    for (int i = 0, j = 0; i < 3; ++i) {
+      if (i != axis) dshape[j++] = src.size(i);
+    }
+    const index_t size = src.size(axis);
+    TensorContainer<cpu, 2, float> out0(dshape), out1(dshape), ref0(dshape), ref1(dshape);
+    ReduceStatsWithAxis<red::mean_var>(out0, out1, src, axis);
+    for (index_t i = 0; i < dshape[0]; ++i) {
+      for (index_t j = 0; j < dshape[1]; ++j) {
+        double sum = 0.0, sumsq = 0.0;
+        for (index_t k = 0; k < size; ++k) sum += At(src, axis, i, j, k);
+        const double mean = sum / size;
+        for (index_t k = 0; k < size; ++k) {
+          const double d = At(src, axis, i, j, k) - mean;
+          sumsq += d * d;
+        }
+        ref0[i][j] = static_cast<float>(mean);
+        ref1[i][j] = static_cast<float>(sumsq / size);
+      }
+    }
+    CheckClose(out0.FlatTo2D(), ref0.FlatTo2D(), 1e-4, "ReduceStatsWithAxis mean");
+    CheckClose(out1.FlatTo2D(), ref1.FlatTo2D(), 1e-4, "ReduceStatsWithAxis var");
+    ReduceStatsWithAxis<red::max_argmax>(out0, out1, src, axis);
+    ref0 = reduce_with_axis<red::maximum, false>(src, axis);
+    ref1 = reduce_with_axis<red::maximum, true>(src, axis);
+    CheckClose(out0.FlatTo2D(), ref0.FlatTo2D(), 0.0, "ReduceStatsWithAxis max");
+    CheckClose(out1.FlatTo2D(), ref1.FlatTo2D(), 0.0, "ReduceStatsWithAxis argmax");
+  }
+}
+
+void CheckStatsExceptDim(index_t n, index_t c, index_t h, index_t w) {
+  TensorContainer<cpu, 4, float> img(Shape4(n, c, h, w));
+  Randomize(img.FlatTo2D());
+  TensorContainer<cpu, 1, float> out0(Shape1(c)), out1(Shape1(c)), ref0(Shape1(c)), ref1(Shape1(c));
+  ReduceStatsExceptDim<red::mean_var, 1>(out0, out1, img);
+  ReduceStatsExceptDim<red::max_argmax, 1>(ref0, ref1, img);
+  for (index_t ch = 0; ch < c; ++ch) {
+    double sum = 0.0, sumsq = 0.0;
+    float vmax = img[0][ch][0][0];
+    index_t imax = 0;
+    for (index_t b = 0; b < n; ++b) {
+      for (index_t y = 0; y < h; ++y) {
+        for (index_t x = 0; x < w; ++x) {
+          const float v = img[b][ch][y][x];
+          sum += v;
+          sumsq += static_cast<double>(v) * v;
+          if (v > vmax) {
+            vmax = v; imax = (b * h + y) * w + x;
+          }
+        }
+      }
+    }
+    const double cnt = static_cast<double>(n * h * w), mean = sum / cnt;
+    assert(std::fabs(out0[ch] - mean) <= 1e-4);
+    assert(std::fabs(out1[ch] - (sumsq / cnt - mean * mean)) <= 1e-4);
+    assert(ref0[ch] == vmax && ref1[ch] == static_cast<float>(imax));
+  }
+  // keep the lowest dimension, the columns of the flat matrix
+  Tensor<cpu, 2, float> mat = img.FlatTo2D();
+  TensorContainer<cpu, 1, float> lo(Shape1(w)), hi(Shape1(w));
+  ReduceStatsExceptDim<red::min_max, 3>(lo, hi, img);
+  for (index_t x = 0; x < w; ++x) {
+    float vmin = mat[0][x], vmax = mat[0][x];
+    for (index_t r = 1; r < mat.size(0); ++r) {
+      vmin = std::min(vmin, mat[r][x]);
+      vmax = std::max(vmax, mat[r][x]);
+    }
+    assert(lo[x] == vmin && hi[x] == vmax);
+  }
+}
+
+// the whole-expression reductions of a nrow x ncol view at column offset off
+void CheckAll(index_t nrow, index_t ncol, index_t off) {
+  TensorContainer<cpu, 2, float> a(Shape2(nrow, ncol + off)), b(Shape2(nrow, ncol + off));
+  Randomize(a.FlatTo2D());
+  Randomize(b.FlatTo2D());
+  Tensor<cpu, 2, float> x(a.dptr_ + off, Shape2(nrow, ncol), a.stride_, NULL);
+  Tensor<cpu, 2, float> y(b.dptr_ + off, Shape2(nrow, ncol), b.stride_, NULL);
+  double sum = 0.0, sumabs = 0.0, sumsq = 0.0, dot = 0.0, sumexp = 0.0;
+  float vmax = x[0][0], vmin = x[0][0];
+  for (index_t i = 0; i < nrow; ++i) {
+    for (index_t j = 0; j < ncol; ++j) {
+      const double v = x[i][j];
+      sum += v; sumabs += std::fabs(v); sumsq += v * v; dot += v * y[i][j];
+      sumexp += 2.0 * v + 1.0;
+      vmax = std::max(vmax, x[i][j]);
+      vmin = std::min(vmin, x[i][j]);
+    }
+  }
+  const double tol = 1e-5 * std::max(1.0, sumabs);
+  assert(std::fabs(sumall(x) - sum) <= tol);
+  assert(std::fabs(sumall(x * 2.0f + 1.0f) - sumexp) <= 3.0 * tol + 1e-5 * nrow * ncol);
+  assert(maxall(x) == vmax && minall(x) == vmin);
+  assert(std::fabs(norm2(x) - std::sqrt(sumsq)) <= 1e-4 * std::sqrt(sumsq));
+  assert(std::fabs(dot_all(x, y) - dot) <= tol);
+}
+
+// norm2 of entries around scale, whose squares are out of the range of float
+// when scale is 1e20 or 1e-25, an all zero tensor and an infinite entry
+void CheckNorm2Range(index_t nrow, index_t ncol, float scale) {
+  TensorContainer<cpu, 2, float> x(Shape2(nrow, ncol));
+  Randomize(x.FlatTo2D(), scale);
+  double sumsq = 0.0;
+  for (index_t i = 0; i < nrow; ++i) {
+    for (index_t j = 0; j < ncol; ++j) sumsq += static_cast<double>(x[i][j]) * x[i][j];
+  }
+  assert(std::fabs(norm2(x) - std::sqrt(sumsq)) <= 1e-5 * std::sqrt(sumsq));
+  assert(std::fabs(norm2(x * 2.0f) - 2.0 * std::sqrt(sumsq)) <= 2e-5 * std::sqrt(sumsq));
+  x = 0.0f;
+  assert(norm2(x) == 0.0f);
+  x[nrow / 2][ncol / 2] = -std::numeric_limits<float>::infinity();
+  assert(std::isinf(norm2(x)));
+}
+
+int main() {
+  InitTensorEngine<cpu>();
+  const int nthreads[] = {1, 4};
+  for (int nthread : nthreads) {
+#ifdef _OPENMP
+    omp_set_num_threads(nthread);
+#endif
+    // rows, columns
+    const index_t shapes[][2] = {{1, 5}, {17, 3}, {100, 1000}, {1000, 7}, {33, 600}, {64, 257}};
+    for (const index_t *s : shapes) {
+      CheckKeepLowest(s[0], s[1]);
+    }
+    // batch, channel, height, width
+    const index_t images[][4] = {{2, 3, 5, 7}, {1, 1, 40, 33}, {8, 64, 3, 3}, {4, 2, 16, 17},
+                                 {1, 300, 1, 1}, {3, 5, 1, 129}};
+    for (const index_t *s : images) {
+      CheckKeepHighDim(s[0], s[1], s[2], s[3]);
+    }
+    const index_t volumes[][3] = {{3, 4, 5}, {1, 7, 33}, {64, 2, 130}, {9, 300, 2}, {2, 1, 17},
+                                  {4, 6, 1}};
+    for (const index_t *s : volumes) {
+      CheckAxis(s[0], s[1], s[2]);
+      TensorContainer<cpu, 3, float> src(Shape3(s[0], s[1], s[2]));
+      Randomize(src.FlatTo2D());
+      CheckStatsWithAxis(src);
+    }
+    for (const index_t *s : images) {
+      CheckStatsExceptDim(s[0], s[1], s[2], s[3]);
+    }
+    CheckStatsExceptDim(2, 3, 40, 700);
+    // rows, columns, column offset
+    const index_t mats[][3] = {{1, 1, 0}, {1, 3, 1}, {7, 5, 0}, {100, 1000, 0}, {100, 1000, 1},
+                               {3000, 3, 2}, {2, 70001, 3}};
+    for (const index_t *s : mats) {
+      CheckAll(s[0], s[1], s[2]);
+    }
+    const float scales[] = {1.0f, 1e20f, 1e-25f};
+    for (float scale : scales) {
+      CheckNorm2Range(3, 7, scale);
+      CheckNorm2Range(100, 1000, scale);
+    }
+  }
+  ShutdownTensorEngine<cpu>();
+  printf("Pass\n");
+  return 0;
+}
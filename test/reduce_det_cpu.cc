@@ -0,0 +1,62 @@
+// MSHADOW_DETERMINISTIC_REDUCE on CPU: sum_rows, sumall_except_dim and
+// ReduceStatsExceptDim give the same bits for any number of threads, and
+// the compensated sums of mode 2 stay close to the exact sums
+#ifndef MSHADOW_DETERMINISTIC_REDUCE
+#define MSHADOW_DETERMINISTIC_REDUCE 2
+#endif
+#include <cstring>
+#include <vector>
+#include "test_cpu.h"
+
+// the reductions of one thread count, concatenated
+std::vector<float> Reduce(const Tensor<cpu, 4, float> &img, int nthread) {
+#ifdef _OPENMP
+  omp_set_num_threads(nthread);
+#endif
+  const index_t c = img.size(1), w = img.size(3);
+  TensorContainer<cpu, 1, float> rows(Shape1(w)), chan(Shape1(c));
+  TensorContainer<cpu, 1, float> mean(Shape1(c)), var(Shape1(c));
+  rows = sum_rows(img.FlatTo2D());
+  chan = sumall_except_dim<1>(img);
+  ReduceStatsExceptDim<red::mean_var, 1>(mean, var, img);
+  std::vector<float> res;
+  res.insert(res.end(), rows.dptr_, rows.dptr_ + w);
+  res.insert(res.end(), chan.dptr_, chan.dptr_ + c);
+  res.insert(res.end(), mean.dptr_, mean.dptr_ + c);
+  res.insert(res.end(), var.dptr_, var.dptr_ + c);
+  return res;
+}
+
+void CheckDeterministic(index_t n, index_t c, index_t h, index_t w) {
+  TensorContainer<cpu, 4, float> img(Shape4(n, c, h, w));
+  // a large offset, so that the rounding of a plain sum shows
+  Randomize(img.FlatTo2D());
+  img += 100.0f;
+  const std::vector<float> ref = Reduce(img, 1);
+  const int nthreads[] = {2, 3, 5, 8};
+  for (int nthread : nthreads) {
+    const std::vector<float> res = Reduce(img, nthread);
+    assert(res.size() == ref.size());
+    assert(std::memcmp(&res[0], &ref[0], ref.size() * sizeof(float)) == 0);
+  }
+  // the column sums against double sums
+  Tensor<cpu, 2, float> mat = img.FlatTo2D();
+  for (index_t x = 0; x < w; ++x) {
+    double sum = 0.0;
+    for (index_t r = 0; r < mat.size(0); ++r) sum += mat[r][x];
+    const double tol = MSHADOW_DETERMINISTIC_REDUCE == 2 ? 1e-6 : 1e-4;
+    assert(std::fabs(ref[x] - sum) <= tol * std::fabs(sum));
+  }
+}
+
+int main() {
+  InitTensorEngine<cpu>();
+  // batch, channel, height, width
+  const index_t images[][4] = {{4, 3, 100, 9}, {1, 2, 2000, 17}, {20, 5, 31, 33}, {3, 1, 1, 1}};
+  for (const index_t *s : images) {
+    CheckDeterministic(s[0], s[1], s[2], s[3]);
+  }
+  ShutdownTensorEngine<cpu>();
+  printf("Pass\n");
+  return 0;
+}
@@ -0,0 +1,134 @@
+// segment_reduce, segment_mean and segment_broadcast on CPU against a loop
+// over every segment: empty, short grouped and long split segments, offsets
+// not covering the whole first axis, aligned and unaligned sources, saveto
+// and plusto, on one and several threads; a vector, which the expressions
+// reject, reshaped to one column
+#include <vector>
+#include "test_cpu.h"
+
+// ref[s] = reduction of src[off[s] .. off[s + 1]), divided by the length if mean
+template<typename Reducer>
+void NaiveReduce(Tensor<cpu, 3, float> ref, const Tensor<cpu, 3, float> &src,
+                 const std::vector<int> &off, bool mean) {
+  for (index_t s = 0; s + 1 < static_cast<index_t>(off.size()); ++s) {
+    for (index_t i = 0; i < src.size(1); ++i) {
+      for (index_t j = 0; j < src.size(2); ++j) {
+        float res; Reducer::SetInitValue(res);
+        for (int k = off[s]; k < off[s + 1]; ++k) Reducer::Reduce(res, src[k][i][j]);
+        if (mean && off[s + 1] > off[s]) res /= static_cast<float>(off[s + 1] - off[s]);
+        ref[s][i][j] = res;
+      }
+    }
+  }
+}
+
+// ref[k] = val[s] for off[s] <= k < off[s + 1], 0 outside the segments
+void NaiveBroadcast(Tensor<cpu, 3, float> ref, const Tensor<cpu, 3, float> &val,
+                    const std::vector<int> &off, bool mean) {
+  ref = 0.0f;
+  for (index_t s = 0; s + 1 < static_cast<index_t>(off.size()); ++s) {
+    for (int k = off[s]; k < off[s + 1]; ++k) {
+      for (index_t i = 0; i < val.size(1); ++i) {
+        for (index_t j = 0; j < val.size(2); ++j) {
+          ref[k][i][j] = mean ? val[s][i][j] / static_cast<float>(off[s + 1] - off[s]) :
+                                val[s][i][j];
+        }
+      }
+    }
+  }
+}
+
+void CheckSegments(const std::vector<int> &off, index_t size, index_t inner, index_t last) {
+  const index_t nseg = off.size() - 1;
+  TensorContainer<cpu, 1, int> offsets(Shape1(off.size()));
+  for (index_t s = 0; s <= nseg; ++s) offsets[s] = off[s];
+  // one spare column so that src + 1 is an unaligned view of the same shape
+  TensorContainer<cpu, 3, float> buf(Shape3(size, inner, last + 1));
+  Randomize(buf.FlatTo2D());
+  Tensor<cpu, 3, float> aligned(buf.dptr_, Shape3(size, inner, last), buf.stride_, NULL);
+  Tensor<cpu, 3, float> unaligned(buf.dptr_ + 1, Shape3(size, inner, last), buf.stride_, NULL);
+  TensorContainer<cpu, 3, float> out(Shape3(nseg, inner, last)), ref(Shape3(nseg, inner, last));
+  TensorContainer<cpu, 3, float> ref2(Shape3(nseg, inner, last));
+  for (int u = 0; u < 2; ++u) {
+    Tensor<cpu, 3, float> src = u == 0 ? aligned : unaligned;
+    out = segment_reduce<red::sum>(src, offsets);
+    NaiveReduce<red::sum>(ref, src, off, false);
+    CheckClose(out.FlatTo2D(), ref.FlatTo2D(), 1e-4, "segment_reduce sum");
+    out += segment_reduce<red::sum>(src, offsets);
+    ref2 = ref * 2.0f;
+    CheckClose(out.FlatTo2D(), ref2.FlatTo2D(), 1e-4, "segment_reduce sum plusto");
+    out = segment_reduce<red::maximum>(src, offsets);
+    NaiveReduce<red::maximum>(ref, src, off, false);
+    CheckClose(out.FlatTo2D(), ref.FlatTo2D(), 0.0, "segment_reduce maximum");
+    out = segment_reduce<red::minimum>(src, offsets);
+    NaiveReduce<red::minimum>(ref, src, off, false);
+    CheckClose(out.FlatTo2D(), ref.FlatTo2D(), 0.0, "segment_reduce minimum");
+    out = segment_mean(src, offsets);
+    NaiveReduce<red::sum>(ref, src, off, true);
+    CheckClose(out.FlatTo2D(), ref.FlatTo2D(), 1e-4, "segment_mean");
+    // the Plan, nested in an expression
+    out = 1.0f * segment_mean(src, offsets);
+    CheckClose(out.FlatTo2D(), ref.FlatTo2D(), 1e-4, "segment_mean plan");
+  }
+  // broadcast back to the positions, the gradient of the reductions
+  TensorContainer<cpu, 3, float> val(Shape3(nseg, inner, last));
+  TensorContainer<cpu, 3, float> grad(Shape3(size, inner, last)), gref(Shape3(size, inner, last));
+  Randomize(val.FlatTo2D());
+  for (int mean = 0; mean < 2; ++mean) {
+    grad = segment_broadcast(val, offsets, size, mean != 0);
+    NaiveBroadcast(gref, val, off, mean != 0);
+    CheckClose(grad.FlatTo2D(), gref.FlatTo2D(), 1e-6, "segment_broadcast");
+    grad += segment_broadcast(val, offsets, size, mean != 0);
+    gref *= 2.0f;
+    CheckClose(grad.FlatTo2D(), gref.FlatTo2D(), 1e-6, "segment_broadcast plusto");
+    grad = 1.0f * segment_broadcast(val, offsets, size, mean != 0);
+    gref /= 2.0f;
+    CheckClose(grad.FlatTo2D(), gref.FlatTo2D(), 1e-6, "segment_broadcast plan");
+  }
+}
+
+// the segments of a vector as a (size, 1) column, a view and a reshape
+void CheckVector() {
+  TensorContainer<cpu, 1, float> v(Shape1(6));
+  TensorContainer<cpu, 1, int> offsets(Shape1(3));
+  for (index_t i = 0; i < 6; ++i) v[i] = static_cast<float>(i);
+  offsets[0] = 0; offsets[1] = 2; offsets[2] = 6;
+  Tensor<cpu, 2, float> col(v.dptr_, Shape2(6, 1), 1, NULL);
+  TensorContainer<cpu, 2, float> out(Shape2(2, 1)), back(Shape2(6, 1));
+  out = segment_reduce<red::sum>(col, offsets);
+  assert(out[0][0] == 1.0f && out[1][0] == 14.0f);
+  out = 1.0f * segment_reduce<red::sum>(reshape(v, Shape2(6, 1)), offsets);
+  assert(out[0][0] == 1.0f && out[1][0] == 14.0f);
+  out = segment_mean(reshape(v, Shape2(6, 1)), offsets);
+  assert(out[0][0] == 0.5f && out[1][0] == 3.5f);
+  back = segment_broadcast(out, offsets, 6);
+  back += 1.0f * segment_broadcast(out, offsets, 6);
+  for (index_t i = 0; i < 6; ++i) assert(back[i][0] == (i < 2 ? 1.0f : 7.0f));
+}
+
+int main() {
+  InitTensorEngine<cpu>();
+  const int nthreads[] = {1, 4};
+  for (int nthread : nthreads) {
+#ifdef _OPENMP
+    omp_set_num_threads(nthread);
+#endif
+    // short segments with empty ones, grouped into tasks
+    CheckSegments({0, 1, 1, 3, 6, 6, 10}, 10, 2, 9);
+    // one long segment split into pieces among short ones
+    std::vector<int> skew = {0, 2};
+    skew.push_back(2 + 5000);
+    for (int s = 0; s < 20; ++s) skew.push_back(skew.back() + s % 3);
+    CheckSegments(skew, skew.back(), 1, 13);
+    CheckSegments({0, 3, 400, 401, 700}, 700, 3, 4);
+    // offsets starting after 0 and ending before the last position
+    CheckSegments({2, 5, 5, 9}, 12, 2, 8);
+    // no segment at all, and one position per segment
+    CheckSegments({0}, 4, 2, 5);
+    CheckSegments({0, 1, 2, 3, 4, 5}, 5, 4, 1);
+    CheckVector();
+  }
+  ShutdownTensorEngine<cpu>();
+  printf("Pass\n");
+  return 0;
+}
@@ -0,0 +1,167 @@
+// Softmax and LogSoftmax on CPU against the same sums in double: narrow and
+// wide rows, rows split across the threads, unaligned rows, log-softmax in
+// place, float, double and half_t, which has no packet; the channel softmax
+// of (num, channel, spatial) tensors and its gradients, in place too
+#include <vector>
+// half_t converts in software unless the target has F16C
+#ifndef __F16C__
+#define MSHADOW_USE_F16C 0
+#endif
+#include "test_cpu.h"
+
+// ref = softmax (or log-softmax) of every row of energy, in double
+template<typename DType>
+void NaiveSoftmax(Tensor<cpu, 2, DType> ref, const Tensor<cpu, 2, DType> &energy, bool log) {
+  for (index_t y = 0; y < ref.size(0); ++y) {
+    double mmax = static_cast<double>(energy[y][0]), sum = 0.0;
+    for (index_t x = 1; x < ref.size(1); ++x) {
+      mmax = std::max(mmax, static_cast<double>(energy[y][x]));
+    }
+    for (index_t x = 0; x < ref.size(1); ++x) {
+      sum += std::exp(static_cast<double>(energy[y][x]) - mmax);
+    }
+    for (index_t x = 0; x < ref.size(1); ++x) {
+      const double v = static_cast<double>(energy[y][x]) - mmax;
+      ref[y][x] = DType(log ? v - std::log(sum) : std::exp(v) / sum);
+    }
+  }
+}
+
+template<typename DType>
+void CheckRows(index_t nrow, index_t n, double tol) {
+  // one spare column so that buf + 1 gives unaligned rows of the same shape
+  TensorContainer<cpu, 2, DType> buf(Shape2(nrow, n + 1)), ref(Shape2(nrow, n));
+  TensorContainer<cpu, 2, DType> out(Shape2(nrow, n + 1));
+  Randomize(buf.FlatTo2D(), 8.0f);
+  for (int u = 0; u < 2; ++u) {
+    Tensor<cpu, 2, DType> energy(buf.dptr_ + u, Shape2(nrow, n), buf.stride_, NULL);
+    Tensor<cpu, 2, DType> dst(out.dptr_ + u, Shape2(nrow, n), out.stride_, NULL);
+    Softmax(dst, energy);
+    NaiveSoftmax(ref.FlatTo2D(), energy, false);
+    CheckClose(dst, ref.FlatTo2D(), tol, "Softmax");
+    LogSoftmax(dst, energy);
+    NaiveSoftmax(ref.FlatTo2D(), energy, true);
+    CheckClose(dst, ref.FlatTo2D(), tol, "LogSoftmax");
+    // log-softmax in place
+    Copy(dst, energy);
+    LogSoftmax(dst, dst);
+    CheckClose(dst, ref.FlatTo2D(), tol, "LogSoftmax in place");
+  }
+  // one dimensional
+  Tensor<cpu, 2, DType> energy(buf.dptr_, Shape2(nrow, n), buf.stride_, NULL);
+  Tensor<cpu, 1, DType> v = out[0].Slice(0, n);
+  Softmax(v, energy[0]);
+  NaiveSoftmax(ref.FlatTo2D(), energy, false);
+  CheckClose(v.FlatTo2D(), ref[0].FlatTo2D(), tol, "Softmax 1-D");
+}
+
+// softmax over the channels, and the gradients with every combination of
+// ignore_label and label smoothing, dst apart and dst = src
+template<typename DType>
+void CheckChannels(index_t num, index_t nchannel, index_t nspatial, double tol) {
+  const Shape<3> shape = Shape3(num, nchannel, nspatial);
+  TensorContainer<cpu, 3, DType> energy(shape), out(shape), ref(shape), grad(shape);
+  Randomize(energy.FlatTo2D(), 8.0f);
+  for (index_t y = 0; y < num; ++y) {
+    for (index_t n = 0; n < nspatial; ++n) {
+      double mmax = static_cast<double>(energy[y][0][n]), sum = 0.0;
+      for (index_t x = 1; x < nchannel; ++x) {
+        mmax = std::max(mmax, static_cast<double>(energy[y][x][n]));
+      }
+      for (index_t x = 0; x < nchannel; ++x) {
+        sum += std::exp(static_cast<double>(energy[y][x][n]) - mmax);
+      }
+      for (index_t x = 0; x < nchannel; ++x) {
+        ref[y][x][n] = DType(std::exp(static_cast<double>(energy[y][x][n]) - mmax) / sum);
+      }
+    }
+  }
+  Softmax(out, energy);
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), tol, "Softmax channel");
+  // unaligned positions
+  Tensor<cpu, 3, DType> eview(energy.dptr_ + 1, Shape3(num, nchannel, nspatial - 1),
+                              energy.stride_, NULL);
+  Tensor<cpu, 3, DType> oview(out.dptr_ + 1, Shape3(num, nchannel, nspatial - 1),
+                              out.stride_, NULL);
+  Tensor<cpu, 3, DType> rview(ref.dptr_ + 1, Shape3(num, nchannel, nspatial - 1),
+                              ref.stride_, NULL);
+  if (nspatial > 1) {
+    Softmax(oview, eview);
+    CheckClose(oview.FlatTo2D(), rview.FlatTo2D(), tol, "Softmax channel unaligned");
+  }
+  Copy(out, energy);
+  Softmax(out, out);
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), tol, "Softmax channel in place");
+  // labels in [0, nchannel), some of them the ignored label 1
+  TensorContainer<cpu, 2, DType> label(Shape2(num, nspatial));
+  for (index_t y = 0; y < num; ++y) {
+    for (index_t n = 0; n < nspatial; ++n) {
+      label[y][n] = DType(static_cast<float>(rand() % nchannel));
+    }
+  }
+  const DType ignore = DType(1.0f);
+  const float alpha = 0.1f;
+  for (int c = 0; c < 4; ++c) {
+    const bool use_ignore = (c & 1) != 0, smooth = (c & 2) != 0;
+    const DType smooth_grad = smooth ? DType(alpha / (nchannel - 1)) : DType(0.0f);
+    for (index_t y = 0; y < num; ++y) {
+      for (index_t x = 0; x < nchannel; ++x) {
+        for (index_t n = 0; n < nspatial; ++n) {
+          const int k = static_cast<int>(label[y][n]);
+          if (use_ignore && k == static_cast<int>(ignore)) {
+            ref[y][x][n] = DType(0.0f);
+          } else if (static_cast<int>(x) == k) {
+            ref[y][x][n] = energy[y][x][n] - DType(1.0f) + (smooth ? DType(alpha) : DType(0.0f));
+          } else {
+            ref[y][x][n] = energy[y][x][n] - smooth_grad;
+          }
+        }
+      }
+    }
+    for (int inplace = 0; inplace < 2; ++inplace) {
+      Tensor<cpu, 3, DType> src = energy;
+      if (inplace) {
+        Copy(grad, energy);
+        src = grad;
+      }
+      if (c == 0) SoftmaxGrad(grad, src, label);
+      if (c == 1) SoftmaxGrad(grad, src, label, ignore);
+      if (c == 2) SmoothSoftmaxGrad(grad, src, label, alpha);
+      if (c == 3) SmoothSoftmaxGrad(grad, src, label, ignore, alpha);
+      CheckClose(grad.FlatTo2D(), ref.FlatTo2D(), 1e-6,
+                 inplace ? "SoftmaxGrad channel in place" : "SoftmaxGrad channel");
+    }
+  }
+}
+
+// half_t sums in half precision, so it only runs rows up to max_width
+template<typename DType>
+void RunType(double tol, index_t max_width) {
+  // rows, width: narrow rows, widths around the packet and the chunk, and
+  // rows wide enough to be split when there are fewer rows than threads
+  const index_t shapes[][2] = {{1, 1}, {3, 5}, {17, 64}, {8, 2047}, {2, 2049},
+                               {1, 8192}, {2, 20000}, {1, 33001}};
+  for (const index_t *s : shapes) {
+    if (s[1] <= max_width) CheckRows<DType>(s[0], s[1], tol);
+  }
+  // num, channel, spatial: blocks of positions and their unaligned tails
+  const index_t channels[][3] = {{1, 2, 1}, {2, 3, 7}, {2, 10, 64}, {3, 21, 300},
+                                 {1, 2, 1000}, {2, 600, 33}};
+  for (const index_t *c : channels) CheckChannels<DType>(c[0], c[1], c[2], tol);
+}
+
+int main() {
+  InitTensorEngine<cpu>();
+  const int nthreads[] = {1, 4};
+  for (int nthread : nthreads) {
+#ifdef _OPENMP
+    omp_set_num_threads(nthread);
+#endif
+    RunType<float>(1e-5, 1 << 20);
+    RunType<double>(1e-12, 1 << 20);
+    RunType<half::half_t>(2e-2, 64);
+  }
+  ShutdownTensorEngine<cpu>();
+  printf("Pass\n");
+  return 0;
+}
@@ -0,0 +1,45 @@
+#ifndef TEST_CPU_H
+#define TEST_CPU_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include "mshadow/tensor.h"
+#include "assert.h"
+
+using namespace mshadow;
+using namespace mshadow::expr;
+
+// fill with values uniform in [-scale, scale)
+template<int dim, typename DType>
+void Randomize(Tensor<cpu, dim, DType> t, float scale = 1.0f) {
+  Tensor<cpu, 2, DType> mat = t.FlatTo2D();
+  for (index_t i = 0; i < mat.size(0); ++i) {
+    for (index_t j = 0; j < mat.size(1); ++j) {
+      mat[i][j] = DType(scale * (2.0f * rand() / RAND_MAX - 1.0f));
+    }
+  }
+}
+
+// |out - ref| <= tol * max(1, |ref|) everywhere, NaN only where ref is NaN
+template<int dim, typename DType>
+bool CheckClose(const Tensor<cpu, dim, DType> &out, const Tensor<cpu, dim, DType> &ref,
+                double tol, const char *what) {
+  assert(out.shape_ == ref.shape_);
+  Tensor<cpu, 2, DType> a = out.FlatTo2D(), b = ref.FlatTo2D();
+  for (index_t i = 0; i < a.size(0); ++i) {
+    for (index_t j = 0; j < a.size(1); ++j) {
+      const double x = static_cast<double>(a[i][j]), y = static_cast<double>(b[i][j]);
+      const bool ok = (x != x) ? (y != y) : std::fabs(x - y) <= tol * std::max(1.0, std::fabs(y));
+      if (!ok) {
+        fprintf(stderr, "%s: mismatch at (%d, %d): %g vs %g\n", what,
+               static_cast<int>(i), static_cast<int>(j), x, y);
+        assert(false);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+#endif
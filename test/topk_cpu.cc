@@ -0,0 +1,134 @@
+// TopK, ArgMax and ArgMin on CPU against a stable sort of every line: each
+// axis of 3-D tensors, the insertion list, the k = 1 scan and the partial
+// sort, ties and NaN, and the rejection of an index tensor of the wrong shape
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#include "test_cpu.h"
+
+// element k along axis of a 3-D tensor, i and j index the other two axes
+template<typename DType>
+inline DType &At(Tensor<cpu, 3, DType> t, int axis, index_t i, index_t j, index_t k) {
+  return axis == 0 ? t[k][i][j] : axis == 1 ? t[i][k][j] : t[i][j][k];
+}
+
+// ranks before: larger (or smaller) first, NaN last, lower position on ties
+struct Rank {
+  const std::vector<float> *line;
+  bool largest;
+  bool operator()(index_t a, index_t b) const {
+    const float x = (*line)[a], y = (*line)[b];
+    if (x != x || y != y) return y != y && x == x;
+    return largest ? x > y : x < y;
+  }
+};
+
+void CheckTopK(Tensor<cpu, 3, float> src, index_t k, bool largest) {
+  for (int axis = 0; axis < 3; ++axis) {
+    if (k > src.size(axis)) continue;
+    Shape<3> oshape = src.shape_;
+    oshape[axis] = k;
+    TensorContainer<cpu, 3, float> values(oshape);
+    TensorContainer<cpu, 3, int> indices(oshape);
+    TopK(values, indices, src, k, axis, largest);
+    Shape<2> lshape;
+    for (int i = 0, j = 0; i < 3; ++i) {
+      if (i != axis) lshape[j++] = src.size(i);
+    }
+    const index_t size = src.size(axis);
+    std::vector<float> line(size);
+    std::vector<index_t> perm(size);
+    for (index_t i = 0; i < lshape[0]; ++i) {
+      for (index_t j = 0; j < lshape[1]; ++j) {
+        for (index_t p = 0; p < size; ++p) {
+          line[p] = At<float>(src, axis, i, j, p);
+          perm[p] = p;
+        }
+        Rank rank = {&line, largest};
+        std::stable_sort(perm.begin(), perm.end(), rank);
+        for (index_t p = 0; p < k; ++p) {
+          const float v = At<float>(values, axis, i, j, p);
+          assert(At<int>(indices, axis, i, j, p) == static_cast<int>(perm[p]));
+          assert(v == line[perm[p]] || (v != v && line[perm[p]] != line[perm[p]]));
+        }
+      }
+    }
+  }
+}
+
+void CheckArg(Tensor<cpu, 3, float> src) {
+  for (int axis = 0; axis < 3; ++axis) {
+    Shape<2> dshape;
+    for (int i = 0, j = 0; i < 3; ++i) {
+      if (i != axis) dshape[j++] = src.size(i);
+    }
+    TensorContainer<cpu, 2, int> imax(dshape), imin(dshape);
+    TensorContainer<cpu, 2, float> ref(dshape);
+    ArgMax(imax, src, axis);
+    ref = reduce_with_axis<red::maximum, true>(src, axis);
+    for (index_t i = 0; i < dshape[0]; ++i) {
+      for (index_t j = 0; j < dshape[1]; ++j) assert(imax[i][j] == static_cast<int>(ref[i][j]));
+    }
+    ArgMin(imin, src, axis);
+    ref = reduce_with_axis<red::minimum, true>(src, axis);
+    for (index_t i = 0; i < dshape[0]; ++i) {
+      for (index_t j = 0; j < dshape[1]; ++j) assert(imin[i][j] == static_cast<int>(ref[i][j]));
+    }
+    Shape<3> kshape = src.shape_;
+    kshape[axis] = 1;
+    TensorContainer<cpu, 3, int> ikeep(kshape);
+    ArgMax(ikeep, src, axis);
+    for (index_t i = 0; i < dshape[0]; ++i) {
+      for (index_t j = 0; j < dshape[1]; ++j) assert(At<int>(ikeep, axis, i, j, 0) == imax[i][j]);
+    }
+  }
+}
+
+void CheckShapes(index_t a, index_t b, index_t c) {
+  TensorContainer<cpu, 3, float> src(Shape3(a, b, c));
+  Randomize(src.FlatTo2D());
+  const index_t ks[] = {1, 2, 5, 32, 33, 100};
+  for (index_t k : ks) {
+    CheckTopK(src, k, true);
+    CheckTopK(src, k, false);
+  }
+  CheckArg(src);
+  // ties and NaN
+  Tensor<cpu, 2, float> flat = src.FlatTo2D();
+  for (index_t i = 0; i < flat.size(0); ++i) {
+    for (index_t j = 0; j < flat.size(1); ++j) {
+      flat[i][j] = (i + j) % 7 == 3 ? NAN : std::floor(flat[i][j] * 3.0f);
+    }
+  }
+  for (index_t k : ks) {
+    CheckTopK(src, k, true);
+    CheckTopK(src, k, false);
+  }
+}
+
+int main() {
+  InitTensorEngine<cpu>();
+  const index_t volumes[][3] = {{3, 4, 5}, {2, 40, 7}, {1, 3, 200}, {50, 2, 3}, {9, 300, 1},
+                                {4, 1, 1}};
+  for (const index_t *s : volumes) {
+    CheckShapes(s[0], s[1], s[2]);
+  }
+  // an index tensor with the right size but the axes swapped is rejected,
+  // the failed check aborts the child process
+  TensorContainer<cpu, 2, float> src(Shape2(6, 4));
+  TensorContainer<cpu, 2, float> values(Shape2(2, 4));
+  TensorContainer<cpu, 2, int> indices(Shape2(4, 2));
+  Randomize(src.FlatTo2D());
+  const pid_t pid = fork();
+  if (pid == 0) {
+    if (freopen("/dev/null", "w", stderr) == NULL) _exit(2);
+    TopK(values, indices, src, 2, 0);
+    _exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  assert(WIFSIGNALED(status));
+  ShutdownTensorEngine<cpu>();
+  printf("Pass\n");
+  return 0;
+}
@@ -0,0 +1,137 @@
+// nearest and bilinear upsampling on CPU by rows against their Plans, which a
+// scalar in front of the expression forces, saveto and plusto; both against
+// loops in double, with the pixel centers aligned and the border clamped, and
+// their gradients against the scatter of those loops; the bilinear gradient
+// is also checked as the adjoint of the forward pass
+#include <vector>
+#include "test_cpu.h"
+
+// output y samples the source at (y + 0.5) / scale - 0.5, clamped to [0, size - 1]
+void NaiveTaps(index_t y, index_t scale, index_t size, index_t *y0, index_t *y1, double *w) {
+  const double sy = std::min(std::max((y + 0.5) / scale - 0.5, 0.0), size - 1.0);
+  *y0 = static_cast<index_t>(std::floor(sy));
+  *y1 = std::min(*y0 + 1, size - 1);
+  *w = sy - *y0;
+}
+
+// ref = upsampling of src, gref = its gradient for the upsampled gradient grad
+template<typename DType>
+void NaiveUpSampling(const Tensor<cpu, 4, DType> &src, const Tensor<cpu, 4, DType> &grad,
+                     index_t scale, bool bilinear,
+                     Tensor<cpu, 4, DType> ref, Tensor<cpu, 4, DType> gref) {
+  const index_t h = src.size(2), w = src.size(3);
+  for (index_t n = 0; n < src.size(0); ++n) {
+    for (index_t c = 0; c < src.size(1); ++c) {
+      std::vector<double> acc(h * w, 0.0);
+      for (index_t y = 0; y < h * scale; ++y) {
+        for (index_t x = 0; x < w * scale; ++x) {
+          index_t y0 = y / scale, y1 = y0, x0 = x / scale, x1 = x0;
+          double wy = 0.0, wx = 0.0;
+          if (bilinear) {
+            NaiveTaps(y, scale, h, &y0, &y1, &wy);
+            NaiveTaps(x, scale, w, &x0, &x1, &wx);
+          }
+          const double k[4] = {(1 - wy) * (1 - wx), (1 - wy) * wx, wy * (1 - wx), wy * wx};
+          const index_t ty[4] = {y0, y0, y1, y1}, tx[4] = {x0, x1, x0, x1};
+          double v = 0.0;
+          for (int t = 0; t < 4; ++t) {
+            v += k[t] * static_cast<double>(src[n][c][ty[t]][tx[t]]);
+            acc[ty[t] * w + tx[t]] += k[t] * static_cast<double>(grad[n][c][y][x]);
+          }
+          ref[n][c][y][x] = DType(v);
+        }
+      }
+      for (index_t y = 0; y < h; ++y) {
+        for (index_t x = 0; x < w; ++x) gref[n][c][y][x] = DType(acc[y * w + x]);
+      }
+    }
+  }
+}
+
+template<typename DType>
+double Inner(const Tensor<cpu, 4, DType> &a, const Tensor<cpu, 4, DType> &b) {
+  Tensor<cpu, 2, DType> x = a.FlatTo2D(), y = b.FlatTo2D();
+  double sum = 0.0;
+  for (index_t i = 0; i < x.size(0); ++i) {
+    for (index_t j = 0; j < x.size(1); ++j) {
+      sum += static_cast<double>(x[i][j]) * static_cast<double>(y[i][j]);
+    }
+  }
+  return sum;
+}
+
+template<typename DType>
+void CheckUpSampling(index_t n, index_t c, index_t h, index_t w, index_t scale, double tol) {
+  const Shape<4> sshape = Shape4(n, c, h, w), oshape = Shape4(n, c, h * scale, w * scale);
+  TensorContainer<cpu, 4, DType> src(sshape), grad(oshape);
+  TensorContainer<cpu, 4, DType> out(oshape), ref(oshape), gout(sshape), gref(sshape);
+  Randomize(src.FlatTo2D());
+  Randomize(grad.FlatTo2D());
+  out = upsampling_nearest(src, scale);
+  ref = DType(1.0f) * upsampling_nearest(src, scale);
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), tol, "upsampling_nearest");
+  out += upsampling_nearest(src, scale);
+  ref *= DType(2.0f);
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), tol, "upsampling_nearest plusto");
+  out = upsampling_bilinear(src, scale);
+  ref = DType(1.0f) * upsampling_bilinear(src, scale);
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), tol, "upsampling_bilinear");
+  out += upsampling_bilinear(src, scale);
+  ref *= DType(2.0f);
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), tol, "upsampling_bilinear plusto");
+  gout = upsampling_bilinear_grad(grad, scale);
+  gref = DType(1.0f) * upsampling_bilinear_grad(grad, scale);
+  CheckClose(gout.FlatTo2D(), gref.FlatTo2D(), tol, "upsampling_bilinear_grad");
+  gout += upsampling_bilinear_grad(grad, scale);
+  gref *= DType(2.0f);
+  CheckClose(gout.FlatTo2D(), gref.FlatTo2D(), tol, "upsampling_bilinear_grad plusto");
+  // against the loops, the gradient of nearest is the sum over each block
+  NaiveUpSampling<DType>(src, grad, scale, false, ref, gref);
+  out = upsampling_nearest(src, scale);
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), tol, "upsampling_nearest naive");
+  gout = upsampling_nearest_grad(grad, scale);
+  CheckClose(gout.FlatTo2D(), gref.FlatTo2D(), tol, "upsampling_nearest_grad naive");
+  gref *= DType(2.0f);
+  gout += upsampling_nearest_grad(grad, scale);
+  CheckClose(gout.FlatTo2D(), gref.FlatTo2D(), tol, "upsampling_nearest_grad plusto");
+  gref /= DType(2.0f);
+  gout = DType(1.0f) * upsampling_nearest_grad(grad, scale);
+  CheckClose(gout.FlatTo2D(), gref.FlatTo2D(), tol, "upsampling_nearest_grad plan");
+  NaiveUpSampling<DType>(src, grad, scale, true, ref, gref);
+  out = upsampling_bilinear(src, scale);
+  CheckClose(out.FlatTo2D(), ref.FlatTo2D(), tol, "upsampling_bilinear naive");
+  gout = upsampling_bilinear_grad(grad, scale);
+  CheckClose(gout.FlatTo2D(), gref.FlatTo2D(), tol, "upsampling_bilinear_grad naive");
+  // the corner pixels of the output are the corner pixels of the source
+  for (index_t i = 0; i < n; ++i) {
+    for (index_t j = 0; j < c; ++j) {
+      assert(out[i][j][0][0] == src[i][j][0][0]);
+      assert(out[i][j][h * scale - 1][w * scale - 1] == src[i][j][h - 1][w - 1]);
+    }
+  }
+  // <upsampling_bilinear(src), grad> == <src, upsampling_bilinear_grad(grad)>
+  out = upsampling_bilinear(src, scale);
+  gout = upsampling_bilinear_grad(grad, scale);
+  const double lhs = Inner<DType>(out, grad), rhs = Inner<DType>(src, gout);
+  assert(std::fabs(lhs - rhs) <= 1e-4 * std::max(1.0, std::fabs(lhs)));
+}
+
+template<typename DType>
+void RunType(double tol) {
+  // batch, channel, height, width, scale
+  const index_t cases[][5] = {{2, 3, 5, 7, 2}, {1, 2, 8, 8, 3}, {1, 1, 1, 1, 2},
+                              {2, 2, 3, 17, 4}, {1, 3, 6, 1, 2}, {1, 1, 4, 9, 1},
+                              {1, 2, 2, 3, 5}, {3, 1, 1, 6, 3}};
+  for (const index_t *p : cases) {
+    CheckUpSampling<DType>(p[0], p[1], p[2], p[3], p[4], tol);
+  }
+}
+
+int main() {
+  InitTensorEngine<cpu>();
+  RunType<float>(1e-5);
+  RunType<double>(1e-5);
+  ShutdownTensorEngine<cpu>();
+  printf("Pass\n");
+  return 0;
+}